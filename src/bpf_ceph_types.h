@@ -12,6 +12,52 @@
 #define MSG_OSD_EC_READ 110
 #define MSG_OSD_EC_READ_REPLY 111
 
+// Recovery, backfill and scrub messages traced with --background
+#define MSG_OSD_REP_SCRUB 93
+#define MSG_OSD_PG_SCAN 94
+#define MSG_OSD_PG_BACKFILL 95
+#define MSG_OSD_PG_BACKFILL_REMOVE 96
+#define MSG_OSD_PG_PUSH 105
+#define MSG_OSD_PG_PULL 106
+#define MSG_OSD_PG_PUSH_REPLY 107
+#define MSG_OSD_REP_SCRUBMAP 117
+#define MSG_OSD_PG_RECOVERY_DELETE 118
+
+// OpRequest::reqid is only set for client ops and repops, so a background
+// op is keyed by its sender and message sequence number instead: owner is
+// the sending OSD with this bit set, tid the header seq.
+#define OSDTRACE_BACKGROUND_OWNER (1ULL << 63)
+
+// Var paths of the OSD::enqueue_op and OSD::dequeue_op probes, relative to
+// the function's varid and in the order of osd_probes in osdtrace.cc.
+// Client and background ops read different ones, so they go by name.
+#define ENQ_VAR_TYPE 0
+#define ENQ_VAR_OWNER 1
+#define ENQ_VAR_TID 2
+#define ENQ_VAR_RECV_STAMP 3
+#define ENQ_VAR_THROTTLE_STAMP 4
+#define ENQ_VAR_RECV_COMPLETE_STAMP 5
+#define ENQ_VAR_DISPATCH_STAMP 6
+#define ENQ_VAR_SEQ 7
+#define ENQ_VAR_SRC 8
+#define ENQ_VAR_FRONT_LEN 9
+
+#define DEQ_VAR_TYPE 0
+#define DEQ_VAR_OWNER 1
+#define DEQ_VAR_TID 2
+#define DEQ_VAR_POOL 3
+#define DEQ_VAR_SEED 4
+#define DEQ_VAR_SEQ 5
+#define DEQ_VAR_SRC 6
+
+static inline int ceph_background_msg(__u16 type) {
+  return type == MSG_OSD_PG_PUSH || type == MSG_OSD_PG_PULL ||
+         type == MSG_OSD_PG_PUSH_REPLY || type == MSG_OSD_PG_SCAN ||
+         type == MSG_OSD_PG_BACKFILL || type == MSG_OSD_PG_BACKFILL_REMOVE ||
+         type == MSG_OSD_PG_RECOVERY_DELETE || type == MSG_OSD_REP_SCRUB ||
+         type == MSG_OSD_REP_SCRUBMAP;
+}
+
 #define MAX_ACTING 16
 
 #define CEPH_OSD_FLAG_READ 0x0010
@@ -82,6 +128,153 @@ struct ctx_k {
   __u64 start_stamp;
 };
 
+// --kv: a batch is the txcs one kv_sync_thread applies with _txc_apply_kv
+// before its next RocksDBStore::submit_transaction_sync.
+struct kv_thread_v {
+  struct ctx_k applying;  // txc inside _txc_apply_kv, for the return probe
+  __u64 batch;            // current batch of this thread
+  __u64 fsync_start;      // BlueFS::fsync entry during the batch sync
+  __u32 synced;           // the current batch was already synced
+};
+
+struct kv_batch_k {
+  __u64 ptid;
+  __u64 batch;
+};
+
+struct kv_batch_v {
+  __u64 sync_start;
+  __u64 sync_end;
+  __u64 fsync_ns;
+};
+
+// --sched: op scheduler classes, told apart by the OpQueueable::run() that
+// executes an item.  An item enqueued before its class was first seen
+// running counts as SCHED_OTHER.
+#define SCHED_OTHER 0
+#define SCHED_CLIENT 1
+#define SCHED_PEERING 2
+#define SCHED_RECOVERY 3
+#define SCHED_SCRUB 4
+#define SCHED_SNAPTRIM 5
+#define SCHED_PG_DELETE 6
+#define SCHED_NUM_CLASSES 7
+
+struct sched_k {
+  __u32 pid;
+  __u32 shard;
+  __u32 cls;
+};
+
+// Cumulative since tracing started, except the maxima, which cover the
+// current sched_epoch only.
+struct sched_v {
+  __s64 depth;  // enqueued and not yet run
+  __u64 max_depth;
+  __u64 enqueued;
+  __u64 dequeued;
+  __u64 wait_sum_ns;
+  __u64 wait_max_ns;
+  __u64 epoch;
+};
+
+// An item between ShardedOpWQ::_enqueue and its run(), keyed by pid and the
+// address of its PGOpQueueable::pgid.
+struct sched_item_k {
+  __u32 pid;
+  __u64 addr;
+};
+
+struct sched_item_v {
+  __u64 enqueue_stamp;
+  __u64 vtable;
+  __u32 shard;
+  __u32 cls;
+};
+
+struct sched_vtable_k {
+  __u32 pid;
+  __u64 vtable;
+};
+
+// --pg-lock: PG::lock() waits and holds, one log2 histogram per
+// (OSD process, PG, kind).  Slot i counts [2^i, 2^(i+1)) us, slot 0 also 0.
+#define PGLOCK_WAIT 0
+#define PGLOCK_HOLD 1
+#define PGLOCK_SLOTS 32
+
+struct pglock_k {
+  __u32 pid;
+  __u32 seed;
+  __u64 pool;
+  __u32 kind;
+  __u32 pad;
+};
+
+struct pglock_hist {
+  __u64 count;
+  __u64 sum_us;
+  __u64 slots[PGLOCK_SLOTS];
+};
+
+// A PG lock a thread is waiting for or holds.  A thread can hold several PG
+// locks at once, so each is kept under (thread, PG): pg is the address of
+// the PG's pg_id.pgid.m_pool, which PG::lock, PG::unlock and dequeue_op all
+// reach.  wait_ns is kept until dequeue_op charges it to the op the lock
+// was taken for.
+struct pglock_thread_k {
+  __u64 ptid;
+  __u64 pg;
+};
+
+struct pglock_thread_v {
+  __u64 pool;
+  __u32 seed;
+  __u32 pad;
+  __u64 wait_start;
+  __u64 acquired;
+  __u64 wait_ns;
+};
+
+// --msgr: async messenger traffic per connection.  A connection is named by
+// the address of its Connection::peer_type, which both the AsyncConnection
+// and the ProtocolV2 probes can reach.
+#define CEPH_ENTITY_TYPE_MON 0x01
+#define CEPH_ENTITY_TYPE_MDS 0x02
+#define CEPH_ENTITY_TYPE_OSD 0x04
+#define CEPH_ENTITY_TYPE_CLIENT 0x08
+#define CEPH_ENTITY_TYPE_MGR 0x10
+
+struct msgr_conn_k {
+  __u32 pid;
+  __u32 pad;
+  __u64 conn;
+};
+
+struct msgr_conn_v {
+  __s32 peer_type;
+  // set by AsyncConnection::_stop(): userspace drops the entry once it has
+  // read the last counters, and a new connection at the same address starts
+  // over
+  __u32 closed;
+  __s64 peer_id;
+  __u64 bytes_in;
+  __u64 bytes_out;
+  __u64 msgs_in;
+  __u64 msgs_out;
+  // sends the socket did not take in full, and the time until the
+  // connection's send queue drained again; stall_start is 0 when it is empty
+  __u64 stalls;
+  __u64 stall_ns;
+  __u64 stall_start;
+};
+
+// The connection and outgoing length of a read_bulk or _try_send in progress
+struct msgr_call_v {
+  __u64 conn;
+  __u64 len;
+};
+
 struct peers_info {
     int peer1;
     int peer2;
@@ -90,6 +283,116 @@ struct peers_info {
     __u64 recv_stamp2;
 };
 
+// --ec: the erasure-coded write pipeline of a primary op.  ECBackend sends
+// the sub-writes of all remote shards at once, right before it writes its
+// own shard, so sent_stamp is common to every shard.  Shards past
+// EC_MAX_SHARDS are not tracked.
+#define EC_MAX_SHARDS 16
+
+struct ec_info {
+  __u64 submit_stamp;        // ECBackend::submit_transaction
+  __u64 encode_start_stamp;  // ECTransaction::generate_transactions
+  __u64 encode_end_stamp;
+  __u64 sent_stamp;
+  __u32 shard_mask;          // shards whose commit was seen
+  __s32 osd[EC_MAX_SHARDS];
+  __u64 commit_stamp[EC_MAX_SHARDS];
+};
+
+// ECBackend's own tid of a write in flight, and the thread encoding one
+struct ec_tid_k {
+  __u32 pid;
+  __u32 pad;
+  __u64 tid;
+};
+
+struct ec_thread_v {
+  __u64 encode_start;
+  __u64 encode_end;
+};
+
+// --offcpu: the time the thread running an op (from dequeue_op until it
+// returns) spent switched out, and the stacks of its longest switch.  A
+// stack id is negative when the stack could not be recorded.
+#define OFFCPU_STACK_DEPTH 32
+
+struct offcpu_info {
+  __u64 total_ns;
+  __u64 runnable_ns;  // preempted while still runnable, i.e. waiting for a CPU
+  __u64 max_ns;
+  __u32 switches;
+  __u8 max_runnable;
+  __u8 pad[3];
+  __s32 max_kstack;
+  __s32 max_ustack;
+};
+
+struct offcpu_thread_v {
+  struct op_k key;
+  __u64 start;  // switched out at, 0 while on a CPU
+  __s32 kstack;
+  __s32 ustack;
+  __u8 runnable;
+  __u8 pad[7];
+};
+
+// --blk: block requests on the OSDs' devices.  A request is named by its
+// device (the kernel's dev_t, MAJOR << 20 | MINOR) and first sector, and
+// belongs to the op whose BlueStore aio the submitting thread was issuing.
+#define BLK_SLOTS 32
+
+struct blk_rq_k {
+  __u32 dev;
+  __u32 pad;
+  __u64 sector;
+};
+
+struct blk_rq_v {
+  struct op_k key;  // owner 0 when no traced aio submitted it
+  __u64 insert_stamp;
+  __u64 issue_stamp;
+};
+
+// log2(us) histograms of the scheduler queue and device service time
+struct blk_hist {
+  __u64 count;
+  __u64 bytes;
+  __u64 queue_sum_us;
+  __u64 device_sum_us;
+  __u64 queue_slots[BLK_SLOTS];
+  __u64 device_slots[BLK_SLOTS];
+};
+
+// The request of a txc's aio that completed last, which ended aio_wait
+struct blk_info {
+  __u32 ios;
+  __u32 pad;
+  __u64 bytes;
+  __u64 complete_stamp;
+  __u64 queue_ns;
+  __u64 device_ns;
+};
+
+// --cpu: the per-thread counters of the thread that dequeued the op, read
+// at the stamps it reaches itself.  cycles holds the task clock (ns) where
+// the hardware counters are unavailable, and instructions stays 0.
+#define CPU_MAX_THREADS 4096
+
+struct cpu_reading {
+  __u64 cycles;
+  __u64 instructions;
+};
+
+struct cpu_info {
+  __u32 tid;
+  __u32 pad;
+  struct cpu_reading dequeue;
+  struct cpu_reading execute_ctx;
+  struct cpu_reading queue_transaction;
+  struct cpu_reading aio_submit;
+  struct cpu_reading reply;
+};
+
 struct delay_info {
     int cnt;
     char delays[5][32];
@@ -201,6 +504,33 @@ struct op_v {
   __u32 detail_ops_captured;
   __u32 detail_ops_total;
   __u32 detail_ops_unavailable;
+  // --kv: the kv_sync_thread's _txc_apply_kv of this txc, and the
+  // submit_transaction_sync (with its BlueFS fsync time) of the batch it
+  // was applied in.  kv_sync_ptid is 0 when the kv probes did not see it.
+  unsigned long long kv_apply_stamp;
+  unsigned long long kv_applied_stamp;
+  unsigned long long kv_sync_start_stamp;
+  unsigned long long kv_sync_end_stamp;
+  __u64 kv_fsync_ns;
+  __u64 kv_sync_ptid;
+  __u64 kv_batch;
+  // --pg-lock: the PG::lock() wait of the thread that dequeued the op
+  __u64 pg_lock_wait_ns;
+};
+
+// The data of --ec, --offcpu, --blk and --cpu.  It lives in a side map keyed
+// by op_k and is appended to the op_v record only when one of those modes is
+// on, so the default event keeps the size of a bare op_v.
+struct op_ext {
+  struct ec_info ec;
+  struct offcpu_info offcpu;
+  struct blk_info blk;
+  struct cpu_info cpu;
+};
+
+struct op_ext_v {
+  struct op_v op;
+  struct op_ext ext;
 };
 
 typedef struct VarLocation {
@@ -0,0 +1,43 @@
+#ifndef BPF_HIST_H
+#define BPF_HIST_H
+
+#ifdef __cplusplus
+#include <linux/stddef.h>
+#include <linux/types.h>
+#include <cmath>
+#endif
+
+// The log2 histogram slot of v, the last slot holding everything above it.
+// Slot i holds [2^i, 2^(i+1)), as the userspace reports print them.
+static __always_inline __u32 hist_slot(__u64 v, __u32 slots)
+{
+  __u32 r = 0;
+  if (v >> 32) { v >>= 32; r += 32; }
+  if (v >> 16) { v >>= 16; r += 16; }
+  if (v >> 8) { v >>= 8; r += 8; }
+  if (v >> 4) { v >>= 4; r += 4; }
+  if (v >> 2) { v >>= 2; r += 2; }
+  if (v >> 1) { r += 1; }
+  return r < slots ? r : slots - 1;
+}
+
+#ifdef __cplusplus
+// Nearest-rank percentile, p in (0, 100], of the `count` values in a
+// hist_slot() histogram, as the upper bound of the slot it falls in.
+template <typename Slot>
+static inline __u64 hist_percentile(const Slot *slots, int nslots,
+                                    __u64 count, double p)
+{
+  if (count == 0) return 0;
+  __u64 rank = (__u64)std::ceil(p / 100.0 * count);
+  if (rank < 1) rank = 1;
+  __u64 seen = 0;
+  for (int i = 0; i < nslots; ++i) {
+    seen += slots[i];
+    if (seen >= rank) return (2ull << i) - 1;
+  }
+  return (2ull << (nslots - 1)) - 1;
+}
+#endif
+
+#endif
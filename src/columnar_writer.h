@@ -0,0 +1,356 @@
+#ifndef COLUMNAR_WRITER_H
+#define COLUMNAR_WRITER_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Self-describing columnar event file ("cephtrace columnar", *.ctc).
+//
+// The text outputs are meant for people; loading them into analytics tools
+// means regex parsing every line.  This writer instead stores the raw event
+// fields column by column, in batches, so a reader can pull out the few
+// columns it needs as flat arrays.  Strings (object names, op lists, labels)
+// go through one file-wide dictionary and are stored as 32-bit ids.  Numeric
+// columns are byte-transposed and deflated, which compresses timestamps and
+// ids far better than the equivalent text.
+//
+// Layout, all integers little-endian:
+//
+//   file    := MAGIC record*
+//   record  := kind:u8 length:u32 payload[length]
+//   'M'     := count:u32 (key:str value:str)*           metadata
+//   'S'     := table:u16 name:str ncols:u16              schema
+//              (type:u8 clock:u8 name:str)*
+//   'D'     := first_id:u32 count:u32 str*               dictionary entries;
+//                                                        first_id 0 restarts it
+//   'B'     := table:u16 rows:u32                        batch, one chunk per
+//              (codec:u8 raw_len:u32 stored_len:u32 data)*  column in order
+//   str     := length:u16 bytes
+//
+// Unknown record kinds must be skipped, so the format can grow.  A file cut
+// short by a crash loses at most the trailing partial record.
+// tools/columnar_reader.py is the reference reader.
+class ColumnarWriter {
+ public:
+  static constexpr char MAGIC[8] = {'C', 'T', 'R', 'C', 'O', 'L', 0, 1};
+
+  enum type_e : uint8_t { U8 = 1, U16, U32, U64, I32, I64, STR };
+
+  // Time base of a timestamp column.  BPF stamps are CLOCK_BOOTTIME
+  // (bpf_ktime_get_boot_ns) or CLOCK_MONOTONIC (bpf_ktime_get_ns); the
+  // "boottime_to_realtime_ns" / "monotonic_to_realtime_ns" metadata entries
+  // give the offsets that convert them to wall-clock time.
+  enum clock_e : uint8_t { NO_CLOCK = 0, REALTIME_NS, BOOTTIME_NS, MONOTONIC_NS };
+
+  enum codec_e : uint8_t { CODEC_RAW = 0, CODEC_ZLIB, CODEC_SHUFFLE_ZLIB };
+
+  struct Column {
+    const char *name;
+    type_e type;
+    clock_e clock;
+  };
+
+  static constexpr size_t BATCH_ROWS = 16384;
+  static constexpr uint64_t FLUSH_INTERVAL_MS = 2000;
+  static constexpr size_t MAX_DICT_ENTRIES = 1 << 20;
+
+  static size_t type_width(type_e t) {
+    switch (t) {
+      case U8: return 1;
+      case U16: return 2;
+      case U32: case I32: case STR: return 4;
+      case U64: case I64: return 8;
+    }
+    return 0;
+  }
+
+  class Table {
+   public:
+    // Append the next column's value for the current row; columns are filled
+    // in the order they were declared.
+    template <typename T>
+    Table &add(T v) {
+      static_assert(std::is_integral<T>::value || std::is_enum<T>::value,
+                    "add() takes an integer");
+      store((uint64_t)(int64_t)v);
+      return *this;
+    }
+
+    Table &add_str(const char *s, size_t n) {
+      store(writer_->intern(s, n));
+      return *this;
+    }
+    Table &add_str(const char *s) { return add_str(s, strlen(s)); }
+    Table &add_str(const std::string &s) { return add_str(s.data(), s.size()); }
+
+    void end_row() {
+      if (col_ != cols_.size())
+        std::cerr << "columnar table " << name_ << ": row has " << col_
+                  << " of " << cols_.size() << " columns" << std::endl;
+      while (col_ < cols_.size()) store(0);
+      col_ = 0;
+      if (++rows_ >= BATCH_ROWS) writer_->flush();
+    }
+
+    const std::string &name() const { return name_; }
+    size_t pending_rows() const { return rows_; }
+
+   private:
+    friend class ColumnarWriter;
+
+    Table(ColumnarWriter *writer, uint16_t id, const std::string &name,
+          const std::vector<Column> &cols)
+        : writer_(writer), id_(id), name_(name), cols_(cols),
+          data_(cols.size()) {}
+
+    void store(uint64_t v) {
+      if (col_ >= cols_.size()) return;
+      std::vector<uint8_t> &d = data_[col_];
+      size_t w = type_width(cols_[col_].type);
+      for (size_t i = 0; i < w; ++i) d.push_back((uint8_t)(v >> (8 * i)));
+      ++col_;
+    }
+
+    ColumnarWriter *writer_;
+    uint16_t id_;
+    std::string name_;
+    std::vector<Column> cols_;
+    std::vector<std::vector<uint8_t>> data_;
+    size_t col_ = 0;
+    size_t rows_ = 0;
+  };
+
+  explicit ColumnarWriter(const std::string &path) : path_(path) {}
+  ~ColumnarWriter() { close(); }
+
+  ColumnarWriter(const ColumnarWriter &) = delete;
+  ColumnarWriter &operator=(const ColumnarWriter &) = delete;
+
+  // Metadata and tables must be declared before open().
+  void set_meta(const std::string &key, const std::string &value) {
+    meta_.emplace_back(key, value);
+  }
+
+  Table *add_table(const std::string &name, const std::vector<Column> &cols) {
+    tables_.emplace_back(new Table(this, tables_.size(), name, cols));
+    return tables_.back().get();
+  }
+
+  // Create the file and write the metadata and schemas.  Returns false with
+  // errno set on failure.
+  bool open() {
+    fd_ = ::open(path_.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd_ < 0) return false;
+    record_.assign(MAGIC, MAGIC + sizeof(MAGIC));
+    write_out(record_);
+
+    set_meta("boottime_to_realtime_ns", std::to_string(clock_offset(CLOCK_BOOTTIME)));
+    set_meta("monotonic_to_realtime_ns", std::to_string(clock_offset(CLOCK_MONOTONIC)));
+    begin_record('M');
+    put32(meta_.size());
+    for (const auto &kv : meta_) {
+      put_str(kv.first.data(), kv.first.size());
+      put_str(kv.second.data(), kv.second.size());
+    }
+    end_record();
+
+    for (const auto &t : tables_) {
+      begin_record('S');
+      put16(t->id_);
+      put_str(t->name_.data(), t->name_.size());
+      put16(t->cols_.size());
+      for (const Column &c : t->cols_) {
+        record_.push_back(c.type);
+        record_.push_back(c.clock);
+        put_str(c.name, strlen(c.name));
+      }
+      end_record();
+    }
+    last_flush_ms_ = now_ms();
+    return true;
+  }
+
+  // Call periodically (e.g. after every ring buffer poll) so a long quiet
+  // period does not leave rows only in memory.
+  void tick() {
+    if (now_ms() - last_flush_ms_ >= FLUSH_INTERVAL_MS) flush();
+  }
+
+  // Write one batch per table with pending rows, preceded by any dictionary
+  // entries they introduced.
+  void flush() {
+    last_flush_ms_ = now_ms();
+    if (fd_ < 0) return;
+    if (dict_written_ < dict_order_.size()) {
+      begin_record('D');
+      put32(dict_written_);
+      put32(dict_order_.size() - dict_written_);
+      for (size_t i = dict_written_; i < dict_order_.size(); ++i)
+        put_str(dict_order_[i]->data(), dict_order_[i]->size());
+      end_record();
+      dict_written_ = dict_order_.size();
+    }
+    for (const auto &t : tables_) {
+      if (t->rows_ == 0) continue;
+      begin_record('B');
+      put16(t->id_);
+      put32(t->rows_);
+      for (size_t c = 0; c < t->cols_.size(); ++c) {
+        put_column(t->data_[c], type_width(t->cols_[c].type));
+        t->data_[c].clear();
+      }
+      end_record();
+      t->rows_ = 0;
+    }
+    // Ids already written stay valid for the batches above; start over so a
+    // capture with endless distinct object names cannot grow without bound.
+    if (dict_order_.size() >= MAX_DICT_ENTRIES) {
+      dict_.clear();
+      dict_order_.clear();
+      dict_written_ = 0;
+    }
+  }
+
+  void close() {
+    if (fd_ < 0) return;
+    flush();
+    ::close(fd_);
+    fd_ = -1;
+  }
+
+  const std::string &path() const { return path_; }
+
+ private:
+  static uint64_t now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000ull + ts.tv_nsec / 1000000;
+  }
+
+  // Nanoseconds to add to a `clk` stamp to get CLOCK_REALTIME.
+  static int64_t clock_offset(clockid_t clk) {
+    struct timespec real, other;
+    clock_gettime(CLOCK_REALTIME, &real);
+    clock_gettime(clk, &other);
+    return (int64_t)(real.tv_sec - other.tv_sec) * 1000000000ll +
+           (real.tv_nsec - other.tv_nsec);
+  }
+
+  uint32_t intern(const char *s, size_t n) {
+    if (n > UINT16_MAX) n = UINT16_MAX;
+    key_.assign(s, n);
+    auto it = dict_.find(key_);
+    if (it != dict_.end()) return it->second;
+    uint32_t id = dict_order_.size();
+    auto ins = dict_.emplace(key_, id);
+    dict_order_.push_back(&ins.first->first);
+    return id;
+  }
+
+  void begin_record(char kind) {
+    record_.clear();
+    record_.push_back(kind);
+    put32(0);
+  }
+
+  void end_record() {
+    uint32_t len = record_.size() - 5;
+    memcpy(record_.data() + 1, &len, sizeof(len));
+    write_out(record_);
+  }
+
+  void put16(uint16_t v) {
+    record_.push_back(v);
+    record_.push_back(v >> 8);
+  }
+
+  void put32(uint32_t v) {
+    for (int i = 0; i < 4; ++i) record_.push_back(v >> (8 * i));
+  }
+
+  void put_str(const char *s, size_t n) {
+    if (n > UINT16_MAX) n = UINT16_MAX;
+    put16(n);
+    record_.insert(record_.end(), s, s + n);
+  }
+
+  // Multi-byte values are transposed first (all low bytes, then the next
+  // byte of every value, ...): the high bytes of stamps and ids barely
+  // change, which deflate turns into long runs.
+  void put_column(const std::vector<uint8_t> &data, size_t width) {
+    const std::vector<uint8_t> *src = &data;
+    uint8_t codec = CODEC_ZLIB;
+    if (width > 1) {
+      size_t rows = data.size() / width;
+      shuffled_.resize(data.size());
+      for (size_t r = 0; r < rows; ++r)
+        for (size_t b = 0; b < width; ++b)
+          shuffled_[b * rows + r] = data[r * width + b];
+      src = &shuffled_;
+      codec = CODEC_SHUFFLE_ZLIB;
+    }
+    uLongf zlen = compressBound(src->size());
+    packed_.resize(zlen);
+    if (compress2(packed_.data(), &zlen, src->data(), src->size(),
+                  Z_BEST_SPEED) != Z_OK || zlen >= data.size()) {
+      record_.push_back(CODEC_RAW);
+      put32(data.size());
+      put32(data.size());
+      record_.insert(record_.end(), data.begin(), data.end());
+      return;
+    }
+    record_.push_back(codec);
+    put32(data.size());
+    put32(zlen);
+    record_.insert(record_.end(), packed_.begin(), packed_.begin() + zlen);
+  }
+
+  void write_out(const std::vector<uint8_t> &buf) {
+    const uint8_t *p = buf.data();
+    size_t len = buf.size();
+    while (len > 0) {
+      ssize_t n = ::write(fd_, p, len);
+      if (n < 0) {
+        if (errno == EINTR) continue;
+        if (!write_failed_)
+          std::cerr << "Failed to write " << path_ << ": " << strerror(errno)
+                    << std::endl;
+        write_failed_ = true;
+        return;
+      }
+      p += n;
+      len -= n;
+    }
+  }
+
+  std::string path_;
+  int fd_ = -1;
+  bool write_failed_ = false;
+  uint64_t last_flush_ms_ = 0;
+  std::vector<std::pair<std::string, std::string>> meta_;
+  std::vector<std::unique_ptr<Table>> tables_;
+
+  std::unordered_map<std::string, uint32_t> dict_;
+  std::vector<const std::string *> dict_order_;
+  size_t dict_written_ = 0;
+  std::string key_;
+
+  std::vector<uint8_t> record_;
+  std::vector<uint8_t> shuffled_;
+  std::vector<uint8_t> packed_;
+};
+
+#endif  // COLUMNAR_WRITER_H
@@ -0,0 +1,310 @@
+#ifndef DWARF_BLOB_H
+#define DWARF_BLOB_H
+
+#include <stdint.h>
+#include <string.h>
+#include <zlib.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Binary companion of the DWARF JSON files: the same data DwarfParser
+// exports (per-module func2pc, type_sizes, member_offsets, func2vf, build-id,
+// plus version and arch), laid out as flat record tables that are used in
+// place from an mmap -- no tokenizing, no DOM, no number parsing.
+//
+//   header    magic "CTDWARF\0", format version, byte-order mark, file size,
+//             CRC-32 of everything after the header, version/arch strings
+//             and the offset and count of each table below
+//   modules   ModuleRec: name, build-id, and a Range into each record table
+//   pcs       PcRec        function -> entry pc
+//   sizes     U32Rec       type -> size
+//   offsets   U32Rec       "Type::a.b" -> member offset
+//   funcs     FuncRec      function -> Range into vars
+//   vars      VarRec       VarLocation + Range into fields
+//   fields    FieldRec     Field
+//   strings   all names, referenced as (offset, length); not NUL-terminated
+//
+// Tables are 8-byte aligned and in host byte order: like the JSON files, a
+// blob describes one architecture's build, and a reader on the other byte
+// order rejects it.  Include after bpf_ceph_types.h (VarField, Field).
+namespace dwarf_blob {
+
+static constexpr char MAGIC[8] = {'C', 'T', 'D', 'W', 'A', 'R', 'F', '\0'};
+static constexpr uint32_t FORMAT_VERSION = 1;
+static constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+struct StrRef {
+  uint32_t off;
+  uint32_t len;
+};
+
+struct Range {
+  uint32_t first;
+  uint32_t count;
+};
+
+struct ModuleRec {
+  StrRef name;
+  StrRef build_id;
+  Range pcs;
+  Range sizes;
+  Range offsets;
+  Range funcs;
+};
+
+struct PcRec {
+  StrRef name;
+  uint64_t pc;
+};
+
+struct U32Rec {
+  StrRef name;
+  uint32_t value;
+  uint32_t pad;
+};
+
+struct FuncRec {
+  StrRef name;
+  Range vars;
+};
+
+struct VarRec {
+  int32_t reg;
+  int32_t offset;
+  uint32_t stack;
+  uint32_t pad;
+  Range fields;
+};
+
+struct FieldRec {
+  int32_t offset;
+  uint32_t pointer;
+};
+
+struct Table {
+  uint32_t off;
+  uint32_t count;  // records; bytes for the string table
+};
+
+struct Header {
+  char magic[8];
+  uint32_t format_version;
+  uint32_t byte_order;
+  uint64_t file_size;
+  uint32_t crc;  // crc32 of bytes [sizeof(Header), file_size)
+  uint32_t reserved;
+  StrRef version;
+  StrRef arch;
+  Table modules, pcs, sizes, offsets, funcs, vars, fields, strings;
+};
+
+static_assert(sizeof(Header) % 8 == 0, "tables after the header stay aligned");
+
+inline bool has_magic(const void *data, size_t size) {
+  return size >= sizeof(MAGIC) && memcmp(data, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+template <typename T>
+struct Span {
+  const T *data;
+  uint32_t count;
+  const T *begin() const { return data; }
+  const T *end() const { return data + count; }
+  uint32_t size() const { return count; }
+};
+
+// Builds a blob module by module: begin_module(), then the add_*() calls
+// for that module, then the next begin_module().
+class Writer {
+ public:
+  void set_version(const std::string &v) { version_ = add_string(v); }
+  void set_arch(const std::string &a) { arch_ = add_string(a); }
+
+  void begin_module(const std::string &name, const std::string &build_id) {
+    ModuleRec m = {};
+    m.name = add_string(name);
+    m.build_id = add_string(build_id);
+    m.pcs.first = pcs_.size();
+    m.sizes.first = sizes_.size();
+    m.offsets.first = offsets_.size();
+    m.funcs.first = funcs_.size();
+    modules_.push_back(m);
+  }
+
+  void add_func_pc(const std::string &func, uint64_t pc) {
+    pcs_.push_back({add_string(func), pc});
+    ++modules_.back().pcs.count;
+  }
+  void add_type_size(const std::string &type, uint32_t size) {
+    sizes_.push_back({add_string(type), size, 0});
+    ++modules_.back().sizes.count;
+  }
+  void add_member_offset(const std::string &key, uint32_t offset) {
+    offsets_.push_back({add_string(key), offset, 0});
+    ++modules_.back().offsets.count;
+  }
+  void add_func_vars(const std::string &func, const std::vector<VarField> &vfs) {
+    FuncRec f = {add_string(func), {(uint32_t)vars_.size(), (uint32_t)vfs.size()}};
+    for (const auto &vf : vfs) {
+      VarRec v = {};
+      v.reg = vf.varloc.reg;
+      v.offset = vf.varloc.offset;
+      v.stack = vf.varloc.stack;
+      v.fields = {(uint32_t)fields_.size(), (uint32_t)vf.fields.size()};
+      for (const auto &field : vf.fields)
+        fields_.push_back({field.offset, field.pointer});
+      vars_.push_back(v);
+    }
+    funcs_.push_back(f);
+    ++modules_.back().funcs.count;
+  }
+
+  std::string finish() const {
+    Header h = {};
+    memcpy(h.magic, MAGIC, sizeof(MAGIC));
+    h.format_version = FORMAT_VERSION;
+    h.byte_order = BYTE_ORDER_MARK;
+    h.version = version_;
+    h.arch = arch_;
+
+    std::string out(sizeof(Header), '\0');
+    h.modules = append(out, modules_);
+    h.pcs = append(out, pcs_);
+    h.sizes = append(out, sizes_);
+    h.offsets = append(out, offsets_);
+    h.funcs = append(out, funcs_);
+    h.vars = append(out, vars_);
+    h.fields = append(out, fields_);
+    h.strings = {(uint32_t)out.size(), (uint32_t)strings_.size()};
+    out += strings_;
+
+    h.file_size = out.size();
+    h.crc = crc32(0, (const Bytef *)out.data() + sizeof(Header),
+                  out.size() - sizeof(Header));
+    memcpy(&out[0], &h, sizeof(h));
+    return out;
+  }
+
+ private:
+  StrRef add_string(const std::string &s) {
+    StrRef r = {(uint32_t)strings_.size(), (uint32_t)s.size()};
+    strings_ += s;
+    return r;
+  }
+
+  template <typename T>
+  static Table append(std::string &out, const std::vector<T> &recs) {
+    out.resize((out.size() + 7) & ~size_t(7), '\0');
+    Table t = {(uint32_t)out.size(), (uint32_t)recs.size()};
+    out.append((const char *)recs.data(), recs.size() * sizeof(T));
+    return t;
+  }
+
+  StrRef version_ = {0, 0}, arch_ = {0, 0};
+  std::vector<ModuleRec> modules_;
+  std::vector<PcRec> pcs_;
+  std::vector<U32Rec> sizes_, offsets_;
+  std::vector<FuncRec> funcs_;
+  std::vector<VarRec> vars_;
+  std::vector<FieldRec> fields_;
+  std::string strings_;
+};
+
+// Validates a blob once in open() -- checksum, bounds and alignment of every
+// table, string and range -- so the accessors can hand out pointers into it
+// unchecked.  The bytes must outlive the reader.
+class Reader {
+ public:
+  bool open(const void *data, size_t size) {
+    base_ = (const uint8_t *)data;
+    size_ = size;
+    if (size < sizeof(Header) || !has_magic(data, size)) return fail("not a DWARF blob");
+    if ((uintptr_t)data % 8 != 0) return fail("misaligned buffer");
+    memcpy(&h_, data, sizeof(h_));
+    if (h_.byte_order != BYTE_ORDER_MARK) return fail("byte order differs from this host");
+    if (h_.format_version != FORMAT_VERSION)
+      return fail("unsupported format version " + std::to_string(h_.format_version));
+    if (h_.file_size != size) return fail("truncated");
+    if (crc32(0, base_ + sizeof(Header), size - sizeof(Header)) != h_.crc)
+      return fail("checksum mismatch");
+
+    if (!table_ok(h_.modules, sizeof(ModuleRec)) || !table_ok(h_.pcs, sizeof(PcRec)) ||
+        !table_ok(h_.sizes, sizeof(U32Rec)) || !table_ok(h_.offsets, sizeof(U32Rec)) ||
+        !table_ok(h_.funcs, sizeof(FuncRec)) || !table_ok(h_.vars, sizeof(VarRec)) ||
+        !table_ok(h_.fields, sizeof(FieldRec)) ||
+        (uint64_t)h_.strings.off + h_.strings.count > size_)
+      return fail("table out of bounds");
+    if (!str_ok(h_.version) || !str_ok(h_.arch)) return fail("string out of bounds");
+
+    for (const ModuleRec &m : modules()) {
+      if (!str_ok(m.name) || !str_ok(m.build_id) || !range_ok(m.pcs, h_.pcs) ||
+          !range_ok(m.sizes, h_.sizes) || !range_ok(m.offsets, h_.offsets) ||
+          !range_ok(m.funcs, h_.funcs))
+        return fail("module record out of bounds");
+    }
+    for (const PcRec &r : table<PcRec>(h_.pcs))
+      if (!str_ok(r.name)) return fail("string out of bounds");
+    for (const U32Rec &r : table<U32Rec>(h_.sizes))
+      if (!str_ok(r.name)) return fail("string out of bounds");
+    for (const U32Rec &r : table<U32Rec>(h_.offsets))
+      if (!str_ok(r.name)) return fail("string out of bounds");
+    for (const FuncRec &r : table<FuncRec>(h_.funcs))
+      if (!str_ok(r.name) || !range_ok(r.vars, h_.vars)) return fail("function record out of bounds");
+    for (const VarRec &r : table<VarRec>(h_.vars))
+      if (!range_ok(r.fields, h_.fields)) return fail("variable record out of bounds");
+    return true;
+  }
+
+  const std::string &error() const { return error_; }
+
+  std::string_view str(StrRef r) const {
+    return std::string_view((const char *)base_ + h_.strings.off + r.off, r.len);
+  }
+  std::string_view version() const { return str(h_.version); }
+  std::string_view arch() const { return str(h_.arch); }
+
+  Span<ModuleRec> modules() const { return table<ModuleRec>(h_.modules); }
+  Span<PcRec> pcs(const ModuleRec &m) const { return sub<PcRec>(h_.pcs, m.pcs); }
+  Span<U32Rec> type_sizes(const ModuleRec &m) const { return sub<U32Rec>(h_.sizes, m.sizes); }
+  Span<U32Rec> member_offsets(const ModuleRec &m) const {
+    return sub<U32Rec>(h_.offsets, m.offsets);
+  }
+  Span<FuncRec> funcs(const ModuleRec &m) const { return sub<FuncRec>(h_.funcs, m.funcs); }
+  Span<VarRec> vars(const FuncRec &f) const { return sub<VarRec>(h_.vars, f.vars); }
+  Span<FieldRec> fields(const VarRec &v) const { return sub<FieldRec>(h_.fields, v.fields); }
+
+ private:
+  bool fail(const std::string &why) {
+    error_ = why;
+    return false;
+  }
+
+  bool table_ok(const Table &t, size_t rec_size) const {
+    return t.off % 8 == 0 && t.off >= sizeof(Header) &&
+           (uint64_t)t.off + (uint64_t)t.count * rec_size <= size_;
+  }
+  bool str_ok(StrRef r) const { return (uint64_t)r.off + r.len <= h_.strings.count; }
+  static bool range_ok(Range r, const Table &t) {
+    return (uint64_t)r.first + r.count <= t.count;
+  }
+
+  template <typename T>
+  Span<T> table(const Table &t) const {
+    return {(const T *)(base_ + t.off), t.count};
+  }
+  template <typename T>
+  Span<T> sub(const Table &t, Range r) const {
+    return {(const T *)(base_ + t.off) + r.first, r.count};
+  }
+
+  const uint8_t *base_ = nullptr;
+  size_t size_ = 0;
+  Header h_ = {};
+  std::string error_;
+};
+
+}  // namespace dwarf_blob
+
+#endif
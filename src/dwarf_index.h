@@ -0,0 +1,367 @@
+#ifndef DWARF_INDEX_H
+#define DWARF_INDEX_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+// Reader for the DWARF name accelerator tables, so DwarfParser can go
+// straight to the compile units that define a probed function or a
+// requested type instead of walking every CU of ceph-osd.
+//
+//   .gdb_index    versions 7 and 8, written by gdb-add-index (RPM debuginfo
+//                 packages) and by gold/lld --gdb-index.  Names are
+//                 qualified ("OSD::dequeue_op").
+//   .debug_names  DWARF 5, one or more name tables concatenated.  Names are
+//                 usually the DW_AT_name only ("dequeue_op").
+//
+// The reader works on the raw section bytes, which must outlive it, and
+// never touches libdw.  Lookups return .debug_info offsets of the CU
+// headers, in index order and without duplicates; entries in type units
+// are skipped.  A lookup that finds nothing means "not in the index" --
+// callers fall back to a full walk rather than treat it as absent.
+class DwarfNameIndex {
+ public:
+  enum kind_e { ANY_KIND, TYPE, FUNCTION };
+
+  // Both return false, leaving the index empty, on an unsupported version
+  // or a malformed section.
+  bool load_gdb_index(const uint8_t *data, size_t size) {
+    clear();
+    if (size < 24) return false;
+    uint32_t version = get32(data, false);
+    if (version != 7 && version != 8) return false;
+    uint32_t cu_list = get32(data + 4, false), tu_list = get32(data + 8, false);
+    uint32_t symtab = get32(data + 16, false), pool = get32(data + 20, false);
+    if (cu_list > tu_list || tu_list > size || symtab > pool || pool > size ||
+        (tu_list - cu_list) % 16 != 0)
+      return false;
+    size_t slots = (pool - symtab) / 8;
+    if (slots & (slots - 1)) return false;  // must be a power of two
+    gdb_ = {data, size, cu_list, (tu_list - cu_list) / 16, symtab, slots, pool};
+    format_ = "gdb_index";
+    return true;
+  }
+
+  // `str` is .debug_str, which the name table's string offsets point into.
+  bool load_debug_names(const uint8_t *data, size_t size, const uint8_t *str,
+                        size_t str_size, bool big_endian = false) {
+    clear();
+    size_t pos = 0;
+    while (pos < size) {
+      NamesUnit u;
+      if (!parse_names_unit(data, size, pos, big_endian, u)) {
+        units_.clear();
+        return false;
+      }
+      u.str = str;
+      u.str_size = str_size;
+      units_.push_back(u);
+    }
+    if (units_.empty()) return false;
+    format_ = "debug_names";
+    return true;
+  }
+
+  bool loaded() const { return format_ != nullptr; }
+  const char *format() const { return format_ ? format_ : "none"; }
+
+  std::vector<uint64_t> lookup(const std::string &name, kind_e kind = ANY_KIND) const {
+    std::vector<uint64_t> cus;
+    if (gdb_.data) {
+      gdb_lookup(name, kind, cus);
+    } else {
+      for (const auto &u : units_) names_lookup(u, name, kind, cus);
+    }
+    return cus;
+  }
+
+  // Hash functions of the two formats, exposed for the unit test.
+  static uint32_t gdb_hash(const std::string &name) {
+    uint32_t r = 0;
+    for (unsigned char c : name) {
+      if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+      r = r * 67 + c - 113;
+    }
+    return r;
+  }
+  static uint32_t djb_hash(const std::string &name) {
+    uint32_t h = 5381;
+    for (unsigned char c : name) {
+      if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+      h = h * 33 + c;
+    }
+    return h;
+  }
+
+ private:
+  struct GdbIndex {
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+    size_t cu_list = 0, cu_count = 0;
+    size_t symtab = 0, slots = 0;
+    size_t pool = 0;
+  };
+
+  struct Abbrev {
+    uint64_t code;
+    uint64_t tag;
+    std::vector<std::pair<uint64_t, uint64_t>> attrs;  // (DW_IDX_*, DW_FORM_*)
+  };
+
+  struct NamesUnit {
+    const uint8_t *data;  // start of the unit
+    size_t size;
+    bool big_endian;
+    int offset_size;
+    uint32_t cu_count, tu_count;
+    uint32_t bucket_count, name_count;
+    size_t cu_list, buckets, hashes, str_offsets, entry_offsets, entry_pool;
+    std::vector<Abbrev> abbrevs;
+    const uint8_t *str;
+    size_t str_size;
+  };
+
+  // DWARF constants used here; the header does not depend on <dwarf.h>.
+  enum : uint64_t {
+    IDX_compile_unit = 1, IDX_type_unit = 2,
+    FORM_data2 = 0x05, FORM_data4 = 0x06, FORM_data8 = 0x07,
+    FORM_data1 = 0x0b, FORM_sdata = 0x0d, FORM_udata = 0x0f,
+    FORM_ref1 = 0x11, FORM_ref2 = 0x12, FORM_ref4 = 0x13, FORM_ref8 = 0x14,
+    FORM_ref_udata = 0x15, FORM_flag_present = 0x19, FORM_ref_sig8 = 0x20,
+    TAG_class_type = 0x02, TAG_enumeration_type = 0x04, TAG_structure_type = 0x13,
+    TAG_typedef = 0x16, TAG_union_type = 0x17, TAG_base_type = 0x24,
+    TAG_subprogram = 0x2e,
+  };
+
+  void clear() {
+    gdb_ = GdbIndex();
+    units_.clear();
+    format_ = nullptr;
+  }
+
+  static uint32_t get32(const uint8_t *p, bool be) {
+    return be ? (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3]
+              : (uint32_t)p[3] << 24 | p[2] << 16 | p[1] << 8 | p[0];
+  }
+  static uint64_t get64(const uint8_t *p, bool be) {
+    uint64_t hi = get32(p + (be ? 0 : 4), be), lo = get32(p + (be ? 4 : 0), be);
+    return hi << 32 | lo;
+  }
+  static uint64_t get_n(const uint8_t *p, int n, bool be) {
+    uint64_t v = 0;
+    for (int i = 0; i < n; ++i) v |= (uint64_t)p[be ? n - 1 - i : i] << (8 * i);
+    return v;
+  }
+  static bool uleb(const uint8_t *data, size_t end, size_t &pos, uint64_t &v) {
+    v = 0;
+    for (int shift = 0; pos < end && shift < 64; shift += 7) {
+      uint8_t b = data[pos++];
+      v |= (uint64_t)(b & 0x7f) << shift;
+      if (!(b & 0x80)) return true;
+    }
+    return false;
+  }
+
+  static bool kind_matches(kind_e want, kind_e have) {
+    return want == ANY_KIND || have == ANY_KIND || want == have;
+  }
+
+  static void add_unique(std::vector<uint64_t> &cus, uint64_t off) {
+    for (uint64_t c : cus)
+      if (c == off) return;
+    cus.push_back(off);
+  }
+
+  void gdb_lookup(const std::string &name, kind_e kind, std::vector<uint64_t> &cus) const {
+    const GdbIndex &g = gdb_;
+    if (g.slots == 0) return;
+    uint32_t hash = gdb_hash(name);
+    size_t mask = g.slots - 1;
+    size_t slot = hash & mask, step = ((hash * 17) & mask) | 1;
+    for (size_t probes = 0; probes < g.slots; ++probes, slot = (slot + step) & mask) {
+      const uint8_t *s = g.data + g.symtab + slot * 8;
+      uint32_t name_off = get32(s, false), vec_off = get32(s + 4, false);
+      if (name_off == 0 && vec_off == 0) return;
+      if (g.pool + name_off >= g.size) return;
+      const char *str = (const char *)g.data + g.pool + name_off;
+      size_t max = g.size - g.pool - name_off;
+      if (strnlen(str, max) != name.size() || memcmp(str, name.data(), name.size()) != 0)
+        continue;
+      if (g.pool + vec_off + 4 > g.size) return;
+      const uint8_t *vec = g.data + g.pool + vec_off;
+      uint32_t n = get32(vec, false);
+      if (g.pool + vec_off + 4 + (uint64_t)n * 4 > g.size) return;
+      for (uint32_t i = 0; i < n; ++i) {
+        uint32_t e = get32(vec + 4 + i * 4, false);
+        uint32_t cu = e & 0xffffff;
+        uint32_t k = (e >> 28) & 7;
+        kind_e have = k == 1 ? TYPE : k == 3 ? FUNCTION : ANY_KIND;
+        if (k == 2 || k == 4) continue;  // variables, enumerators
+        if (cu >= g.cu_count || !kind_matches(kind, have)) continue;
+        add_unique(cus, get64(g.data + g.cu_list + cu * 16, false));
+      }
+      return;
+    }
+  }
+
+  static bool parse_names_unit(const uint8_t *data, size_t size, size_t &pos,
+                               bool be, NamesUnit &u) {
+    size_t start = pos;
+    if (size - pos < 4) return false;
+    uint64_t length = get32(data + pos, be);
+    size_t hdr = 4;
+    u.offset_size = 4;
+    if (length == 0xffffffff) {
+      if (size - pos < 12) return false;
+      length = get64(data + pos + 4, be);
+      hdr = 12;
+      u.offset_size = 8;
+    }
+    if (length > size - pos - hdr || length < 36) return false;
+    const uint8_t *p = data + pos + hdr;
+    size_t unit_end = hdr + length;
+    if (get_n(p, 2, be) != 5) return false;
+    u.data = data + start;
+    u.size = unit_end;
+    u.big_endian = be;
+    u.cu_count = get32(p + 4, be);
+    u.tu_count = get32(p + 8, be);
+    uint32_t foreign = get32(p + 12, be);
+    u.bucket_count = get32(p + 16, be);
+    u.name_count = get32(p + 20, be);
+    uint32_t abbrev_size = get32(p + 24, be);
+    uint32_t aug_size = get32(p + 28, be);
+    uint64_t off = hdr + 32 + (uint64_t)aug_size;
+    int os = u.offset_size;
+    u.cu_list = off;
+    off += (uint64_t)u.cu_count * os + (uint64_t)u.tu_count * os + (uint64_t)foreign * 8;
+    u.buckets = off;
+    off += (uint64_t)u.bucket_count * 4;
+    u.hashes = off;
+    if (u.bucket_count) off += (uint64_t)u.name_count * 4;
+    u.str_offsets = off;
+    off += (uint64_t)u.name_count * os;
+    u.entry_offsets = off;
+    off += (uint64_t)u.name_count * os;
+    uint64_t abbrev_start = off;
+    off += abbrev_size;
+    u.entry_pool = off;
+    if (off > unit_end) return false;
+
+    size_t a = abbrev_start, aend = abbrev_start + abbrev_size;
+    while (true) {
+      Abbrev ab;
+      if (!uleb(u.data, aend, a, ab.code)) return false;
+      if (ab.code == 0) break;
+      if (!uleb(u.data, aend, a, ab.tag)) return false;
+      while (true) {
+        uint64_t idx, form;
+        if (!uleb(u.data, aend, a, idx) || !uleb(u.data, aend, a, form)) return false;
+        if (idx == 0 && form == 0) break;
+        ab.attrs.push_back({idx, form});
+      }
+      u.abbrevs.push_back(ab);
+    }
+    pos = start + unit_end;
+    return true;
+  }
+
+  // Value of one entry attribute; false on an unsupported form.
+  static bool read_form(const NamesUnit &u, uint64_t form, size_t &pos, uint64_t &v) {
+    int n;
+    switch (form) {
+      case FORM_flag_present: v = 1; return true;
+      case FORM_data1: case FORM_ref1: n = 1; break;
+      case FORM_data2: case FORM_ref2: n = 2; break;
+      case FORM_data4: case FORM_ref4: n = 4; break;
+      case FORM_data8: case FORM_ref8: case FORM_ref_sig8: n = 8; break;
+      case FORM_udata: case FORM_ref_udata: case FORM_sdata:
+        return uleb(u.data, u.size, pos, v);
+      default:
+        return false;
+    }
+    if (u.size - pos < (size_t)n) return false;
+    v = get_n(u.data + pos, n, u.big_endian);
+    pos += n;
+    return true;
+  }
+
+  static kind_e tag_kind(uint64_t tag) {
+    switch (tag) {
+      case TAG_subprogram:
+        return FUNCTION;
+      case TAG_class_type:
+      case TAG_enumeration_type:
+      case TAG_structure_type:
+      case TAG_typedef:
+      case TAG_union_type:
+      case TAG_base_type:
+        return TYPE;
+    }
+    return ANY_KIND;
+  }
+
+  static void names_entries(const NamesUnit &u, size_t pos, kind_e kind,
+                            std::vector<uint64_t> &cus) {
+    while (pos < u.size) {
+      uint64_t code;
+      if (!uleb(u.data, u.size, pos, code) || code == 0) return;
+      const Abbrev *ab = nullptr;
+      for (const auto &cand : u.abbrevs)
+        if (cand.code == code) ab = &cand;
+      if (!ab) return;
+      uint64_t cu = u.cu_count == 1 ? 0 : UINT64_MAX;
+      bool in_tu = false;
+      for (const auto &attr : ab->attrs) {
+        uint64_t v;
+        if (!read_form(u, attr.second, pos, v)) return;
+        if (attr.first == IDX_compile_unit) cu = v;
+        if (attr.first == IDX_type_unit) in_tu = true;
+      }
+      kind_e have = tag_kind(ab->tag);
+      if (in_tu || cu >= u.cu_count || have == ANY_KIND || !kind_matches(kind, have))
+        continue;
+      add_unique(cus, get_n(u.data + u.cu_list + cu * u.offset_size, u.offset_size,
+                            u.big_endian));
+    }
+  }
+
+  static void names_lookup(const NamesUnit &u, const std::string &name, kind_e kind,
+                           std::vector<uint64_t> &cus) {
+    int os = u.offset_size;
+    auto match = [&](uint32_t i) {  // i is 0-based
+      uint64_t so = get_n(u.data + u.str_offsets + (size_t)i * os, os, u.big_endian);
+      if (so >= u.str_size) return false;
+      const char *s = (const char *)u.str + so;
+      return strnlen(s, u.str_size - so) == name.size() &&
+             memcmp(s, name.data(), name.size()) == 0;
+    };
+    auto entries = [&](uint32_t i) {
+      uint64_t eo = get_n(u.data + u.entry_offsets + (size_t)i * os, os, u.big_endian);
+      if (u.entry_pool + eo < u.size) names_entries(u, u.entry_pool + eo, kind, cus);
+    };
+    if (u.bucket_count == 0) {
+      for (uint32_t i = 0; i < u.name_count; ++i)
+        if (match(i)) entries(i);
+      return;
+    }
+    uint32_t hash = djb_hash(name);
+    uint32_t b = hash % u.bucket_count;
+    uint32_t i = get32(u.data + u.buckets + (size_t)b * 4, u.big_endian);
+    if (i == 0) return;
+    for (--i; i < u.name_count; ++i) {
+      uint32_t h = get32(u.data + u.hashes + (size_t)i * 4, u.big_endian);
+      if (h % u.bucket_count != b) return;
+      if (h == hash && match(i)) entries(i);
+    }
+  }
+
+  GdbIndex gdb_;
+  std::vector<NamesUnit> units_;
+  const char *format_ = nullptr;
+};
+
+#endif  // DWARF_INDEX_H
@@ -25,6 +25,9 @@ extern "C" {
 #include <elfutils/libdw.h>
 #include <elfutils/libdwfl.h>
 #include <fcntl.h>
+#include <gelf.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <stdlib.h>
 }
@@ -36,6 +39,25 @@ extern "C" {
 
 using namespace std;
 
+// Adds the lifetime of a scope to one of DwarfParser::stats' phases.
+class PhaseTimer {
+ public:
+  explicit PhaseTimer(DwarfParser::PhaseStat &stat) : stat_(stat), start_(now()) {}
+  ~PhaseTimer() {
+    stat_.ns += now() - start_;
+    ++stat_.calls;
+  }
+
+ private:
+  static uint64_t now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+  }
+  DwarfParser::PhaseStat &stat_;
+  uint64_t start_;
+};
+
 bool DwarfParser::die_has_loclist(Dwarf_Die *begin_die) {
   Dwarf_Die die;
   Dwarf_Attribute loc;
@@ -88,13 +110,9 @@ Dwarf_Die *DwarfParser::resolve_typedecl(Dwarf_Die *type) {
 
   string type_name = cache_type_prefix(type) + string(name);
 
-  for (auto &p : global_type_cache) {
-    auto &cus = p.second;
-    for (auto i = cus.begin(); i != cus.end(); ++i) {
-      auto &v = (*i).second;
-      if (v.find(type_name) != v.end()) return &(v[type_name]);
-    }
-  }
+  do {
+    if (Dwarf_Die *die = global_type_cache.find_any(type_name)) return die;
+  } while (index_types(cur_mod, name));
 
   cerr << "Couldn't resolve type " << type_name << endl; 
 
@@ -105,16 +123,11 @@ Dwarf_Die *DwarfParser::resolve_type_name(const std::string& name) {
   const std::string candidates[] = {
       name, "struct " + name, "union " + name, "enum " + name};
 
-  for (auto &module : global_type_cache) {
-    for (auto &cu : module.second) {
-      for (const auto& candidate : candidates) {
-        auto found = cu.second.find(candidate);
-        if (found != cu.second.end()) {
-          return &found->second;
-        }
-      }
+  do {
+    for (const auto& candidate : candidates) {
+      if (Dwarf_Die *die = global_type_cache.find_any(candidate)) return die;
     }
-  }
+  } while (index_types(cur_mod, name));
 
   cerr << "Couldn't resolve type " << name << endl;
   return NULL;
@@ -153,21 +166,11 @@ static void strip_type_wrappers(DwarfParser *dp, Dwarf_Die *die) {
 
 bool DwarfParser::find_cached_type(Dwfl_Module *module, const std::string& name,
                                    Dwarf_Die &out) {
-  auto module_it = global_type_cache.find(module);
-  if (module_it == global_type_cache.end())
-    return false;
-
   const std::string candidates[] = {
       name, "struct " + name, "union " + name, "enum " + name};
   Dwarf_Die *type = nullptr;
-  for (auto& cu : module_it->second) {
-    for (const auto& candidate : candidates) {
-      auto found = cu.second.find(candidate);
-      if (found != cu.second.end()) {
-        type = &found->second;
-        break;
-      }
-    }
+  for (const auto& candidate : candidates) {
+    type = global_type_cache.find(module, candidate);
     if (type != nullptr)
       break;
   }
@@ -355,7 +358,8 @@ const char *DwarfParser::cache_type_prefix(Dwarf_Die *type) {
   return "";
 }
 
-int DwarfParser::iterate_types_in_cu(mod_cu_type_cache_t & mcu, Dwarf_Die *cu_die) {
+int DwarfParser::iterate_types_in_cu(Dwfl_Module *mod, Dwarf_Die *cu_die) {
+  PhaseTimer timer(stats.iterate_types_in_cu);
   assert(cu_die);
   assert(dwarf_tag(cu_die) == DW_TAG_compile_unit ||
          dwarf_tag(cu_die) == DW_TAG_type_unit ||
@@ -363,12 +367,12 @@ int DwarfParser::iterate_types_in_cu(mod_cu_type_cache_t & mcu, Dwarf_Die *cu_di
 
   if (dwarf_tag(cu_die) == DW_TAG_partial_unit) return DWARF_CB_OK;
 
-  cu_type_cache_t &v = mcu[cu_die->addr];
   // TODO inner types process
   // bool has_inner_types = dwarf_srclang(cu_die) == DW_LANG_C_plus_plus;
 
   int rc = DWARF_CB_OK;
   Dwarf_Die die;
+  string type_name;
 
   if (dwarf_child(cu_die, &die) != 0) return rc;
 
@@ -386,8 +390,8 @@ int DwarfParser::iterate_types_in_cu(mod_cu_type_cache_t & mcu, Dwarf_Die *cu_di
         if (!name || dwarf_hasattr(&die, DW_AT_declaration)
             /*TODO || has_only_decl_members(die)*/)
           continue;
-        string type_name = cache_type_prefix(&die) + string(name);
-        if (v.find(type_name) == v.end()) v[type_name] = die;
+        type_name.assign(cache_type_prefix(&die)).append(name);
+        global_type_cache.insert(mod, type_name, die);
 
       }
 
@@ -410,7 +414,6 @@ void DwarfParser::traverse_module(Dwfl_Module *mod, Dwarf *dw, bool want_type) {
   size_t cuhl;
   Dwarf_Off noff;
 
-  mod_cu_type_cache_t &mcu = global_type_cache[mod];
   while (dwarf_nextcu(dw, off, &noff, &cuhl, NULL, NULL, NULL) == 0) {
     Dwarf_Die die_mem;
     Dwarf_Die *die;
@@ -419,7 +422,7 @@ void DwarfParser::traverse_module(Dwfl_Module *mod, Dwarf *dw, bool want_type) {
     //cout << "preprocess_module cu name " << cu_name << endl;
     /* Skip partial units. */
     if (dwarf_tag(die) == DW_TAG_compile_unit) {
-      iterate_types_in_cu(mcu, die);
+      iterate_types_in_cu(mod, die);
     }
     off = noff;
   }
@@ -435,12 +438,94 @@ void DwarfParser::traverse_module(Dwfl_Module *mod, Dwarf *dw, bool want_type) {
       Dwarf_Die die_mem;
       Dwarf_Die *die;
       die = dwarf_offdie_types(dw, off + cuhl, &die_mem);
-      if (dwarf_tag(die) == DW_TAG_type_unit) iterate_types_in_cu(mcu, die);
+      if (dwarf_tag(die) == DW_TAG_type_unit) iterate_types_in_cu(mod, die);
       off = noff;
     }
   }
 }
 
+// The CU DIE of the unit whose header is at `off` in .debug_info -- the
+// offsets the name index returns.
+static bool cu_die_at(Dwarf *dw, Dwarf_Off off, Dwarf_Die *cu_die) {
+  Dwarf_Off next_off;
+  size_t header_size;
+  if (dwarf_nextcu(dw, off, &next_off, &header_size, NULL, NULL, NULL) != 0)
+    return false;
+  return dwarf_offdie(dw, off + header_size, cu_die) != NULL;
+}
+
+bool DwarfParser::load_name_index(Dwfl_Module *mod, Dwarf *dw) {
+  ModuleIndex &mi = mod_index[mod];
+  mi.dwarf = dw;
+  if (!use_name_index) return false;
+
+  Elf *elf = dwarf_getelf(dw);
+  size_t shstrndx;
+  GElf_Ehdr ehdr;
+  if (elf == NULL || elf_getshdrstrndx(elf, &shstrndx) != 0 ||
+      gelf_getehdr(elf, &ehdr) == NULL)
+    return false;
+
+  Elf_Data *gdb_index = NULL, *debug_names = NULL, *debug_str = NULL;
+  Elf_Scn *scn = NULL;
+  while ((scn = elf_nextscn(elf, scn)) != NULL) {
+    GElf_Shdr shdr;
+    if (gelf_getshdr(scn, &shdr) == NULL || shdr.sh_type == SHT_NOBITS) continue;
+    const char *name = elf_strptr(elf, shstrndx, shdr.sh_name);
+    if (name == NULL) continue;
+    Elf_Data **data = strcmp(name, ".gdb_index") == 0     ? &gdb_index
+                      : strcmp(name, ".debug_names") == 0 ? &debug_names
+                      : strcmp(name, ".debug_str") == 0   ? &debug_str
+                                                          : NULL;
+    if (data == NULL) continue;
+    // libdw has already decompressed the sections it reads itself.
+    if ((shdr.sh_flags & SHF_COMPRESSED) && elf_compress(scn, 0, 0) < 0) continue;
+    *data = elf_getdata(scn, NULL);
+  }
+
+  if (gdb_index != NULL) {
+    mi.names.load_gdb_index((const uint8_t *)gdb_index->d_buf, gdb_index->d_size);
+  }
+  if (!mi.names.loaded() && debug_names != NULL && debug_str != NULL) {
+    mi.names.load_debug_names((const uint8_t *)debug_names->d_buf, debug_names->d_size,
+                              (const uint8_t *)debug_str->d_buf, debug_str->d_size,
+                              ehdr.e_ident[EI_DATA] == ELFDATA2MSB);
+  }
+  if (mi.names.loaded()) {
+    clog << "Using the ." << mi.names.format() << " name index of "
+         << cur_mod_name << endl;
+  }
+  return mi.names.loaded();
+}
+
+bool DwarfParser::index_types(Dwfl_Module *mod, const std::string& name) {
+  auto it = mod_index.find(mod);
+  if (it == mod_index.end() || it->second.all_types) return false;
+  ModuleIndex &mi = it->second;
+
+  vector<Dwarf_Off> cus;
+  if (mi.names.loaded()) cus = mi.names.lookup(name, DwarfNameIndex::TYPE);
+
+  // Every CU including a header defines its types, so the first CU that
+  // yields the name is enough.
+  const std::string candidates[] = {
+      name, "struct " + name, "union " + name, "enum " + name};
+  for (Dwarf_Off off : cus) {
+    Dwarf_Die cu_die;
+    if (!mi.typed_cus.insert(off).second || !cu_die_at(mi.dwarf, off, &cu_die))
+      continue;
+    iterate_types_in_cu(mod, &cu_die);
+    for (const auto& candidate : candidates) {
+      if (global_type_cache.find(mod, candidate)) return true;
+    }
+  }
+
+  // Not indexed, or the listed CUs only declare it: walk them all.
+  traverse_module(mod, mi.dwarf, true);
+  mi.all_types = true;
+  return true;
+}
+
 bool DwarfParser::find_param(Dwarf_Die *func, string symbol,
                              Dwarf_Die &vardie) {
   // dwarf_getscopevar: returns a non-negative scope index on success, -1 on
@@ -784,6 +869,7 @@ bool DwarfParser::find_class_member(Dwarf_Die *vardie, Dwarf_Die *typedie,
 bool DwarfParser::translate_fields(Dwarf_Die *vardie, Dwarf_Die *typedie,
                                    Dwarf_Addr pc, vector<string> fields,
                                    vector<Field> &res) {
+  PhaseTimer timer(stats.translate_fields);
   int i = 1;
   Field field = {0, false};
   res.clear();
@@ -933,6 +1019,8 @@ static int handle_function(Dwarf_Die *die, void *data) {
   DwarfParser *dp = (DwarfParser *)data;
   const char *funcname = dwarf_diename(die);
   if (!dp->filter_func(funcname)) return 0;
+  // timed past the filter: most function DIEs are dropped right here
+  PhaseTimer timer(dp->stats.handle_function);
   Dwarf_Die func_abstract = *die;
   // in case of compiler's lto optimization, need to find the abstract function die 
   // in the source code module
@@ -1001,8 +1089,14 @@ static int handle_function(Dwarf_Die *die, void *data) {
     string varname = arr[i][0];
     Dwarf_Die vardie, typedie;
     VarLocation varloc;
+    // A var path this Ceph version does not have leaves its entry without
+    // fields, so the probe reading it bails out instead of the whole parse.
     bool ok = dp->translate_param_location(die, varname, pc, vardie, varloc);
-    assert(ok);
+    if (!ok) {
+      cerr << "Warning: no parameter " << varname << " in " << fullname
+           << ", skipping it" << endl;
+      continue;
+    }
     //printf("var %s location : register %d, offset %d, stack %d\n",
      //varname.c_str(), varloc.reg, varloc.offset, varloc.stack);
     vf[i].varloc = varloc;
@@ -1010,7 +1104,11 @@ static int handle_function(Dwarf_Die *die, void *data) {
     // translate fileds
     dp->dwarf_die_type(&vardie, &typedie);
     ok = dp->translate_fields(&vardie, &typedie, pc, arr[i], vf[i].fields);
-    assert(ok);
+    if (!ok) {
+      cerr << "Warning: couldn't resolve " << arr[i].back() << " of "
+           << varname << " in " << fullname << ", skipping it" << endl;
+      vf[i].fields.clear();
+    }
     for (int j = 1; j < (int)vf[i].fields.size(); ++j) {
        //printf("Field %s is at offset %d, defref %d\n", arr[i][j].c_str(),
        //vf[i].fields[j].offset, vf[i].fields[j].pointer);
@@ -1170,6 +1268,7 @@ static int preprocess_module(Dwfl_Module *dwflmod, void **userdata,
 
   DwarfParser *dp = (DwarfParser *)arg;
   assert(dwflmod != NULL && dp != NULL);
+  PhaseTimer timer(dp->stats.preprocess_module);
 
   dp->cur_mod = dwflmod;
   const char* mod_path = dwfl_module_info(dwflmod, NULL, NULL, NULL, NULL, NULL, NULL, NULL);
@@ -1184,7 +1283,19 @@ static int preprocess_module(Dwfl_Module *dwflmod, void **userdata,
   }
 
 
-  dp->traverse_module(dwflmod, dwarf, true); 
+  if (dp->load_name_index(dwflmod, dwarf)) {
+    std::set<std::string> wanted(dp->requested_type_sizes);
+    for (const auto& request : dp->requested_member_offsets)
+      wanted.insert(request.first);
+    for (const auto& type_name : wanted) {
+      Dwarf_Die die;
+      if (!dp->find_cached_type(dwflmod, type_name, die))
+        dp->index_types(dwflmod, type_name);
+    }
+  } else {
+    dp->traverse_module(dwflmod, dwarf, true);
+    dp->mod_index[dwflmod].all_types = true;
+  }
   for (const auto& type_name : dp->requested_type_sizes) {
     int size = dp->resolve_type_size(dwflmod, type_name);
     if (size > 0)
@@ -1212,6 +1323,7 @@ static int handle_module(Dwfl_Module *dwflmod, void **userdata,
 
   DwarfParser *dp = (DwarfParser *)arg;
   assert(dwflmod != NULL && dp != NULL);
+  PhaseTimer timer(dp->stats.handle_module);
 
   dp->cur_mod = dwflmod;
   const char* mod_path = dwfl_module_info(dwflmod, NULL, NULL, NULL, NULL, NULL, NULL, NULL);
@@ -1226,25 +1338,53 @@ static int handle_module(Dwfl_Module *dwflmod, void **userdata,
 
   int start_time = clock();
 
+  // With a name index, visit just the CUs defining a probed function, among
+  // the probe units like the full walk.  A probe the index does not list in
+  // any of them (e.g. only emitted inline) still gets the per-unit walk
+  // below, minus the CUs already seen.
+  std::set<Dwarf_Off> walked;
+  bool walk_units = true;
+  auto mi = dp->mod_index.find(dwflmod);
+  if (mi != dp->mod_index.end() && mi->second.names.loaded()) {
+    const DwarfNameIndex &names = mi->second.names;
+    walk_units = false;
+    for (const auto& probe : dp->probes) {
+      size_t found = probe.first.find_last_of(":");
+      vector<Dwarf_Off> cus = names.lookup(probe.first, DwarfNameIndex::FUNCTION);
+      if (found != string::npos) {
+        for (Dwarf_Off off :
+             names.lookup(probe.first.substr(found + 1), DwarfNameIndex::FUNCTION))
+          cus.push_back(off);
+      }
+      bool listed = false;
+      for (Dwarf_Off off : cus) {
+        Dwarf_Die cu_die;
+        if (!cu_die_at(dwarf, off, &cu_die)) continue;
+        string cu_name = dwarf_diename(&cu_die) ?: "<unknown>";
+        if (!dp->filter_cu(cu_name) && cu_name != "<artificial>") continue;
+        listed = true;
+        if (walked.insert(off).second)
+          dp->walk_cu_functions(dwflmod, &cu_die);
+      }
+      if (!listed) walk_units = true;
+    }
+  }
+
   Dwarf_Off offset = 0;
   Dwarf_Off next_offset;
   size_t header_size;
   Dwarf_Die cu_die;
 
-  while (dwarf_nextcu(dwarf, offset, &next_offset, &header_size, nullptr,
+  while (walk_units &&
+         dwarf_nextcu(dwarf, offset, &next_offset, &header_size, nullptr,
                       nullptr, nullptr) == 0) {
-    if (dwarf_offdie(dwarf, offset + header_size, &cu_die) != nullptr) {
-      dp->cfi_debug = dwfl_module_dwarf_cfi(dwflmod, &dp->cfi_debug_bias);
-      dp->cfi_eh = dwfl_module_eh_cfi(dwflmod, &dp->cfi_eh_bias);
-      assert(dp->cfi_debug == NULL || dp->cfi_debug_bias == 0);
-
+    if (!walked.count(offset) &&
+        dwarf_offdie(dwarf, offset + header_size, &cu_die) != nullptr) {
       string cu_name = dwarf_diename(&cu_die) ?: "<unknown>";
       //cout << "handle_module cu name " << cu_name << endl;
       if (dp->filter_cu(cu_name) || cu_name == "<artificial>") {
         //cout << "cu name " << cu_name << endl;
-        dp->cur_cu = &cu_die;
-        dwarf_getfuncs(&cu_die, (int (*)(Dwarf_Die *, void *))handle_function,
-                       dp, 0);
+        dp->walk_cu_functions(dwflmod, &cu_die);
       }
     }
     offset = next_offset;
@@ -1257,6 +1397,15 @@ static int handle_module(Dwfl_Module *dwflmod, void **userdata,
   return 0;
 }
 
+void DwarfParser::walk_cu_functions(Dwfl_Module *mod, Dwarf_Die *cu_die) {
+  cfi_debug = dwfl_module_dwarf_cfi(mod, &cfi_debug_bias);
+  cfi_eh = dwfl_module_eh_cfi(mod, &cfi_eh_bias);
+  assert(cfi_debug == NULL || cfi_debug_bias == 0);
+
+  cur_cu = cu_die;
+  dwarf_getfuncs(cu_die, (int (*)(Dwarf_Die *, void *))handle_function, this, 0);
+}
+
 int DwarfParser::parse() {
   if(getenv("DEBUGINFOD_URLS") == NULL) {
     //If the DEBUGINFOD_URLS is not set, set it to https://debuginfod.ubuntu.com as default
@@ -1273,6 +1422,7 @@ int DwarfParser::parse() {
 }
 
 void DwarfParser::add_module(string path) {
+  PhaseTimer timer(stats.add_module);
   const char *fname = path.c_str();
   int fd = open(fname, O_RDONLY);
   if (fd == -1) {
@@ -1298,22 +1448,7 @@ DwarfParser::DwarfParser(probes_t ps, vector<string> pus)
 
 DwarfParser::~DwarfParser() {}
 
-void DwarfParser::export_to_json(const std::string& filename, const std::string& version) {
-    json j;
-
-    // Add version information first if provided (will appear at the top)
-    if (!version.empty()) {
-        j["version"] = version;
-    }
-
-    // Record the host architecture so the consumer can refuse the JSON on a
-    // mismatched target (build-id keying is per-arch by construction, but
-    // tooling that looks at the file as data still benefits from the field).
-    std::string arch = get_host_arch();
-    if (!arch.empty()) {
-        j["arch"] = arch;
-    }
-
+std::set<std::string> DwarfParser::exported_modules() const {
     std::set<std::string> modules;
     for (const auto& [module, unused] : mod_func2pc) {
         (void)unused;
@@ -1331,8 +1466,27 @@ void DwarfParser::export_to_json(const std::string& filename, const std::string&
         (void)unused;
         modules.insert(module);
     }
+    return modules;
+}
+
+void DwarfParser::export_to_json(const std::string& filename, const std::string& version) {
+    PhaseTimer timer(stats.export_to_json);
+    json j;
+
+    // Add version information first if provided (will appear at the top)
+    if (!version.empty()) {
+        j["version"] = version;
+    }
 
-    for (const auto& module : modules) {
+    // Record the host architecture so the consumer can refuse the JSON on a
+    // mismatched target (build-id keying is per-arch by construction, but
+    // tooling that looks at the file as data still benefits from the field).
+    std::string arch = get_host_arch();
+    if (!arch.empty()) {
+        j["arch"] = arch;
+    }
+
+    for (const auto& module : exported_modules()) {
         json module_obj;
 
         // Read the on-disk ELF build-id for this module.  mod_path is
@@ -1422,7 +1576,33 @@ void DwarfParser::export_to_json(const std::string& filename, const std::string&
     out.close();
 }
 
-bool DwarfParser::import_from_json(const std::string& filename, const std::string& expected_version) {
+// Check the build-ids a DWARF data file was exported with against the
+// target's (basename, build-id) pairs.  A module the file lacks, or exported
+// without a build-id (older files), is not checked; nor is one whose target
+// build-id could not be read.
+static bool build_ids_match(
+    const std::map<std::string, std::string>& file_build_ids,
+    const std::vector<std::pair<std::string, std::string>>& expected_build_ids,
+    const std::string& filename) {
+    for (const auto& [module, build_id] : expected_build_ids) {
+        auto it = file_build_ids.find(module);
+        if (build_id.empty() || it == file_build_ids.end() || it->second.empty() ||
+            it->second == build_id) {
+            continue;
+        }
+        std::cerr << "Build-id mismatch for " << module << "! " << filename
+                  << " was exported from build-id " << it->second
+                  << ", the target's is " << build_id << std::endl;
+        std::cerr << "The DWARF data was generated from a different build of the binary." << std::endl;
+        std::cerr << "Please regenerate the file from this binary with -j." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool DwarfParser::import_from_json(
+    const std::string& filename, const std::string& expected_version,
+    const std::vector<std::pair<std::string, std::string>>& expected_build_ids) {
     try {
         // Read JSON file
         std::ifstream input(filename);
@@ -1430,7 +1610,17 @@ bool DwarfParser::import_from_json(const std::string& filename, const std::strin
             std::cerr << "Failed to open input file: " << filename << std::endl;
             return false;
         }
-        
+
+        // -i takes either format; the binary one starts with its magic.
+        char magic[sizeof(dwarf_blob::MAGIC)];
+        if (input.read(magic, sizeof(magic)) &&
+            dwarf_blob::has_magic(magic, sizeof(magic))) {
+            input.close();
+            return import_from_binary(filename, expected_version, expected_build_ids);
+        }
+        input.clear();
+        input.seekg(0);
+
         json j;
         input >> j;
         input.close();
@@ -1454,6 +1644,17 @@ bool DwarfParser::import_from_json(const std::string& filename, const std::strin
             }
         }
 
+        std::map<std::string, std::string> file_build_ids;
+        for (const auto& [module, module_data] : j.items()) {
+            if (module_data.is_object() && module_data.contains("build_id")) {
+                file_build_ids[get_basename(module)] =
+                    module_data["build_id"].get<std::string>();
+            }
+        }
+        if (!build_ids_match(file_build_ids, expected_build_ids, filename)) {
+            return false;
+        }
+
         // Clear existing data
         mod_func2pc.clear();
         mod_func2vf.clear();
@@ -1541,6 +1742,146 @@ bool DwarfParser::import_from_json(const std::string& filename, const std::strin
     }
 }
 
+void DwarfParser::export_to_binary(const std::string& filename, const std::string& version) {
+    dwarf_blob::Writer w;
+    w.set_version(version);
+    w.set_arch(get_host_arch());
+
+    for (const auto& module : exported_modules()) {
+        std::string bid;
+        auto path_it = mod_path.find(module);
+        if (path_it != mod_path.end()) {
+            bid = get_elf_build_id(path_it->second);
+        }
+        w.begin_module(module, bid);
+
+        auto pc_it = mod_func2pc.find(module);
+        if (pc_it != mod_func2pc.end()) {
+            for (const auto& [func, pc] : pc_it->second) {
+                w.add_func_pc(func, pc);
+            }
+        }
+        auto sizes_it = mod_type_sizes.find(module);
+        if (sizes_it != mod_type_sizes.end()) {
+            for (const auto& [type_name, size] : sizes_it->second) {
+                w.add_type_size(type_name, size);
+            }
+        }
+        auto offsets_it = mod_member_offsets.find(module);
+        if (offsets_it != mod_member_offsets.end()) {
+            for (const auto& [key, offset] : offsets_it->second) {
+                w.add_member_offset(key, offset);
+            }
+        }
+        auto vf_it = mod_func2vf.find(module);
+        if (vf_it != mod_func2vf.end()) {
+            for (const auto& [func, var_fields] : vf_it->second) {
+                w.add_func_vars(func, var_fields);
+            }
+        }
+    }
+
+    std::string blob = w.finish();
+    std::ofstream out(filename, std::ios::binary);
+    if (!out.is_open()) {
+        std::cerr << "Failed to open output file: " << filename << std::endl;
+        return;
+    }
+    out.write(blob.data(), blob.size());
+    out.close();
+}
+
+bool DwarfParser::import_from_binary(
+    const std::string& filename, const std::string& expected_version,
+    const std::vector<std::pair<std::string, std::string>>& expected_build_ids) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Failed to open input file: " << filename << std::endl;
+        return false;
+    }
+    struct stat st;
+    void* map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED) {
+        std::cerr << "Failed to map input file: " << filename << std::endl;
+        return false;
+    }
+
+    dwarf_blob::Reader r;
+    bool ok = r.open(map, st.st_size);
+    if (!ok) {
+        std::cerr << "Invalid DWARF data file " << filename << ": " << r.error() << std::endl;
+    } else if (!expected_version.empty()) {
+        // Same checks and messages as the JSON path.
+        std::string file_version(r.version());
+        if (file_version.empty()) {
+            std::cerr << "Error: DWARF data file does not contain version information." << std::endl;
+            std::cerr << "Expected version: " << expected_version << std::endl;
+            ok = false;
+        } else if (file_version != expected_version) {
+            std::cerr << "Version mismatch! DWARF data file version: " << file_version
+                      << ", Expected version: " << expected_version << std::endl;
+            std::cerr << "The DWARF data file was generated for a different version of the library." << std::endl;
+            std::cerr << "Please regenerate the file or use the correct library version." << std::endl;
+            ok = false;
+        } else {
+            std::cout << "Version check passed: " << file_version << std::endl;
+        }
+    }
+    if (ok) {
+        std::map<std::string, std::string> file_build_ids;
+        for (const auto& m : r.modules()) {
+            file_build_ids[get_basename(std::string(r.str(m.name)))] =
+                std::string(r.str(m.build_id));
+        }
+        ok = build_ids_match(file_build_ids, expected_build_ids, filename);
+    }
+
+    if (ok) {
+        mod_func2pc.clear();
+        mod_func2vf.clear();
+        mod_type_sizes.clear();
+        mod_member_offsets.clear();
+
+        for (const auto& m : r.modules()) {
+            std::string key = get_basename(std::string(r.str(m.name)));
+            auto& func2pc = mod_func2pc[key];
+            for (const auto& pc : r.pcs(m)) {
+                func2pc.emplace(r.str(pc.name), pc.pc);
+            }
+            for (const auto& size : r.type_sizes(m)) {
+                mod_type_sizes[key].emplace(r.str(size.name), size.value);
+            }
+            for (const auto& offset : r.member_offsets(m)) {
+                mod_member_offsets[key].emplace(r.str(offset.name), offset.value);
+            }
+            auto& func2vf = mod_func2vf[key];
+            for (const auto& func : r.funcs(m)) {
+                std::vector<VarField> var_fields;
+                var_fields.reserve(func.vars.count);
+                for (const auto& var : r.vars(func)) {
+                    VarField var_field;
+                    var_field.varloc.reg = var.reg;
+                    var_field.varloc.offset = var.offset;
+                    var_field.varloc.stack = var.stack != 0;
+                    var_field.fields.reserve(var.fields.count);
+                    for (const auto& field : r.fields(var)) {
+                        var_field.fields.push_back({field.offset, field.pointer != 0});
+                    }
+                    var_fields.push_back(std::move(var_field));
+                }
+                func2vf.emplace(r.str(func.name), std::move(var_fields));
+            }
+        }
+    }
+
+    munmap(map, st.st_size);
+    return ok;
+}
+
 // Find the embedded entry whose per-module build-ids match the caller's set,
 // or nullptr if none.  Shared by import_from_embedded() (which then loads the
 // data) and is_embedded_traceable() (which only reports the verdict).
@@ -8,6 +8,9 @@
 #include <elfutils/known-dwarf.h>
 #include <set>
 #include <vector>
+#include "dwarf_blob.h"
+#include "dwarf_index.h"
+#include "type_cache.h"
 #include "nlohmann/json.hpp"  // nlohmann/json library
 
 using json = nlohmann::ordered_json;
@@ -26,10 +29,9 @@ class DwarfParser {
   friend int preprocess_module(Dwfl_Module *, void **, const char *, Dwarf_Addr,
                            void *);
 
-  typedef std::unordered_map<std::string, Dwarf_Die> cu_type_cache_t;
-  typedef std::unordered_map<void *, cu_type_cache_t> mod_cu_type_cache_t;
-  typedef std::unordered_map<void *, mod_cu_type_cache_t> global_mod_cu_type_cache_t; 
-  
+  // Named type DIEs per module, keyed by cache_type_prefix() + DW_AT_name
+  // ("struct X", "union X", "enum X", or the bare name); see type_cache.h.
+  typedef TypeCache<Dwarf_Die> type_cache_t;
 
   typedef std::map<std::string, std::vector<VarField>> func2vf_t;
   typedef std::map<std::string, Dwarf_Addr> func2pc_t;
@@ -53,10 +55,36 @@ class DwarfParser {
   // export_to_json() read each module's ELF build-id without the caller
   // needing to re-derive the path.
   std::map<std::string, std::string> mod_path;
-  global_mod_cu_type_cache_t global_type_cache;
+  type_cache_t global_type_cache;
   std::vector<std::string> probe_units;
   probes_t probes;
 
+  // Wall time and call count of each parse phase, accumulated over the
+  // parser's lifetime.  Phases nest: iterate_types_in_cu runs inside
+  // preprocess_module, handle_function inside handle_module and
+  // translate_fields inside handle_function.  Read by
+  // tests/bench_dwarf_parser.cc; the tools themselves ignore it.
+  struct PhaseStat {
+    uint64_t ns = 0;
+    uint64_t calls = 0;
+  };
+  struct ParseStats {
+    PhaseStat add_module;
+    PhaseStat preprocess_module;
+    PhaseStat iterate_types_in_cu;
+    PhaseStat handle_module;
+    PhaseStat handle_function;
+    PhaseStat translate_fields;
+    PhaseStat export_to_json;
+  };
+  ParseStats stats;
+
+  // Use a module's .gdb_index / .debug_names, when it has one, to visit
+  // only the CUs defining the probed functions and the types actually
+  // needed (see dwarf_index.h).  Modules without one, and names an index
+  // does not list, fall back to walking every CU.
+  bool use_name_index = true;
+
  private:
   std::vector<Dwfl *> dwfls;
   Dwfl_Module *cur_mod;
@@ -96,7 +124,7 @@ class DwarfParser {
   static std::string member_offset_key(const std::string&,
                                        const std::vector<std::string>&);
   const char *cache_type_prefix(Dwarf_Die *);
-  int iterate_types_in_cu(mod_cu_type_cache_t &, Dwarf_Die *);
+  int iterate_types_in_cu(Dwfl_Module *, Dwarf_Die *);
   void traverse_module(Dwfl_Module *, Dwarf *, bool);
   bool find_param(Dwarf_Die *, std::string, Dwarf_Die &);
   Dwarf_Attribute *find_func_frame_base(Dwarf_Die *, Dwarf_Attribute *);
@@ -137,9 +165,38 @@ class DwarfParser {
    * Imports the module function data (func2pc and func2vf) from a JSON file
    * @param filename The path to the input JSON file
    * @param expected_version Optional expected version string to compare with JSON version
+   * @param expected_build_ids Optional (basename, hex build-id) pairs of the
+   *                           target; the import fails if the file was
+   *                           exported from another build of one of them
+   * @return bool Returns true if import was successful, false otherwise
+   */
+  bool import_from_json(
+      const std::string& filename, const std::string& expected_version = "",
+      const std::vector<std::pair<std::string, std::string>>& expected_build_ids = {});
+  /**
+   * Exports the same data as export_to_json in the binary format of
+   * dwarf_blob.h, which import_from_json also accepts.  Tools write it
+   * for -j paths ending in ".bin" (see is_binary_export).
+   * @param filename The path to the output file
+   * @param version Optional version string, checked on import as for JSON
+   */
+  void export_to_binary(const std::string& filename, const std::string& version = "");
+  /**
+   * Imports a file written by export_to_binary.  The file is mmap'ed,
+   * its checksum and bounds are verified, and its records are copied into
+   * mod_func2pc/mod_func2vf like the JSON import's, so the tools look them
+   * up the same way whichever format was given.
+   * import_from_json forwards here when the file starts with the binary magic.
+   * The version and build-ids are checked as for JSON.
    * @return bool Returns true if import was successful, false otherwise
    */
-  bool import_from_json(const std::string& filename, const std::string& expected_version = "");
+  bool import_from_binary(
+      const std::string& filename, const std::string& expected_version = "",
+      const std::vector<std::pair<std::string, std::string>>& expected_build_ids = {});
+  // True for -j output paths that should get the binary format.
+  static bool is_binary_export(const std::string& filename) {
+    return filename.size() > 4 && filename.compare(filename.size() - 4, 4, ".bin") == 0;
+  }
   /**
    * Imports module function data from compiled-in embedded DWARF data,
    * matching the target binary by ELF GNU build-id.
@@ -210,6 +267,21 @@ class DwarfParser {
   bool find_cached_type(Dwfl_Module *, const std::string&, Dwarf_Die &);
   int resolve_member_offset(Dwfl_Module *, const std::string&,
                             const std::vector<std::string>&);
+  // Every module with data to export, for export_to_json/export_to_binary.
+  std::set<std::string> exported_modules() const;
+
+  struct ModuleIndex {
+    Dwarf *dwarf = nullptr;
+    DwarfNameIndex names;
+    std::set<Dwarf_Off> typed_cus;  // CUs already in global_type_cache
+    bool all_types = false;         // every CU is in global_type_cache
+  };
+  std::map<Dwfl_Module *, ModuleIndex> mod_index;
+  bool load_name_index(Dwfl_Module *, Dwarf *);
+  // Cache the types of the CUs the index lists for a type name, or of the
+  // whole module when the index cannot answer.  True if the cache grew.
+  bool index_types(Dwfl_Module *, const std::string&);
+  void walk_cu_functions(Dwfl_Module *, Dwarf_Die *);
 };
 
 #endif
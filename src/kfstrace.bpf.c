@@ -2,6 +2,7 @@
 #include <bpf/bpf_helpers.h>
 #include <bpf/bpf_tracing.h>
 #include <bpf/bpf_core_read.h>
+#include "bpf_hist.h"
 
 char LICENSE[] SEC("license") = "Dual BSD/GPL";
 
@@ -16,6 +17,23 @@ char LICENSE[] SEC("license") = "Dual BSD/GPL";
 #define CEPH_MDS_PATH_MAX 64
 #define TASK_COMM_LEN 16
 
+// Aggregate mode (--aggregate): completed requests update agg_hists instead
+// of being sent to user space through rb / mds_rb.
+#define AGG_MAX_ENTRIES 4096
+#define AGG_SLOTS 32
+
+const volatile bool aggregate = false;
+
+// File attribution mode (--files): CephFS reads, writes and opens send the
+// dentry chain of the file to dentry_rb, once per inode, so user space can
+// name the inode encoded in each data object name ("<ino>.<objno>").
+#define DENTRY_NAME_MAX 128
+#define DENTRY_MAX_DEPTH 16
+#define SEEN_INODES_MAX 65536
+#define CEPH_SUPER_MAGIC 0x00c36400
+
+const volatile bool files = false;
+
 // Use the cls_op from bpf_ceph_types.h (method_name[32])
 struct cls_op {
     char cls_name[8];
@@ -191,6 +209,210 @@ struct {
     __uint(max_entries, 256 * 1024);
 } mds_rb SEC(".maps");
 
+// Aggregation key: one histogram per target, op and direction
+enum agg_kind {
+    AGG_OSD = 0,        // OSD request, latency to osd_dispatch of the reply
+    AGG_MDS_SAFE,       // MDS request, latency to the safe reply
+    AGG_MDS_UNSAFE,     // MDS request, latency to the unsafe reply
+};
+
+struct agg_key {
+    __u32 kind;       // enum agg_kind
+    __u32 target;     // primary OSD or MDS rank
+    __u32 op;         // first OSD op (CEPH_OSD_OP_*) or MDS op (CEPH_MDS_OP_*)
+    __u32 is_write;
+};
+
+// Latencies in microseconds; slot i counts [2^i, 2^(i+1)), slot 0 also 0
+struct agg_hist {
+    __u64 count;
+    __u64 sum_us;
+    __u64 max_us;
+    __u64 slots[AGG_SLOTS];
+};
+
+// Per-CPU, so the kprobes update their own copy without atomics; user space
+// sums the CPUs when it prints.  Entries are allocated on first use.
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_HASH);
+    __uint(max_entries, AGG_MAX_ENTRIES);
+    __uint(map_flags, BPF_F_NO_PREALLOC);
+    __type(key, struct agg_key);
+    __type(value, struct agg_hist);
+} agg_hists SEC(".maps");
+
+// A subprogram rather than inline: its zeroed histogram would otherwise add
+// to the stack of the (already large) probe bodies at every call site.
+static __noinline void agg_record(struct agg_key *key, __u64 lat_us)
+{
+    struct agg_hist *h = bpf_map_lookup_elem(&agg_hists, key);
+    if (!h) {
+        struct agg_hist zero = {};
+        bpf_map_update_elem(&agg_hists, key, &zero, BPF_NOEXIST);
+        h = bpf_map_lookup_elem(&agg_hists, key);
+        if (!h)
+            return; // Map full
+    }
+    h->slots[hist_slot(lat_us, AGG_SLOTS)]++;
+    h->count++;
+    h->sum_us += lat_us;
+    if (lat_us > h->max_us)
+        h->max_us = lat_us;
+}
+
+// One path component: the inode, its parent directory and its name
+struct dentry_event {
+    __u64 ino;                    // Ceph inode number
+    __u64 parent_ino;             // Equal to ino at the root of the mount
+    char name[DENTRY_NAME_MAX];   // Dentry name (truncated if needed)
+} __attribute__((packed));
+
+// Inodes already sent to user space.  LRU, so an evicted inode is simply
+// sent again the next time it is read or written.
+struct {
+    __uint(type, BPF_MAP_TYPE_LRU_HASH);
+    __uint(max_entries, SEEN_INODES_MAX);
+    __type(key, __u64);
+    __type(value, __u8);
+} seen_inodes SEC(".maps");
+
+struct {
+    __uint(type, BPF_MAP_TYPE_RINGBUF);
+    __uint(max_entries, 256 * 1024);
+} dentry_rb SEC(".maps");
+
+// The Ceph inode number of a dentry, 0 for a negative dentry.  On 64-bit
+// kernels i_ino is the Ceph inode number used in the data object names.
+static __always_inline __u64 dentry_ino(struct dentry *dentry)
+{
+    struct inode *inode = NULL;
+    __u64 ino = 0;
+
+    if (bpf_core_read(&inode, sizeof(inode), &dentry->d_inode) != 0 || !inode ||
+        bpf_core_read(&ino, sizeof(ino), &inode->i_ino) != 0)
+        return 0;
+    return ino;
+}
+
+// Send `ino` as the child `parent_ino` calls by the name of `named`; false
+// if the ring buffer is full.
+static __always_inline bool submit_dentry(__u64 ino, __u64 parent_ino, struct dentry *named)
+{
+    const unsigned char *name = NULL;
+
+    struct dentry_event *event = bpf_ringbuf_reserve(&dentry_rb, sizeof(*event), 0);
+    if (!event)
+        return false;
+    event->ino = ino;
+    event->parent_ino = parent_ino;
+    event->name[0] = '\0';
+    if (bpf_core_read(&name, sizeof(name), &named->d_name.name) == 0 && name)
+        bpf_core_read_str(event->name, sizeof(event->name), name);
+    bpf_ringbuf_submit(event, 0);
+    return true;
+}
+
+// Send the dentries from `dentry` up to the root, stopping at the first
+// inode user space already knows.
+static __noinline void send_dentry_chain(struct dentry *dentry)
+{
+    for (int depth = 0; depth < DENTRY_MAX_DEPTH && dentry; depth++) {
+        struct dentry *parent = NULL;
+        __u64 ino, parent_ino = 0;
+        __u8 one = 1;
+
+        ino = dentry_ino(dentry);
+        if (!ino)
+            return;
+        if (bpf_map_update_elem(&seen_inodes, &ino, &one, BPF_NOEXIST) != 0)
+            return; // Already sent, and so were its ancestors
+
+        bpf_core_read(&parent, sizeof(parent), &dentry->d_parent);
+        if (parent && parent != dentry)
+            parent_ino = dentry_ino(parent);
+        if (!parent_ino)
+            parent_ino = ino;
+
+        if (!submit_dentry(ino, parent_ino, dentry)) {
+            bpf_map_delete_elem(&seen_inodes, &ino); // Retry on the next access
+            return;
+        }
+
+        if (parent_ino == ino)
+            return;
+        dentry = parent;
+    }
+}
+
+static __always_inline void send_file_dentries(struct file *file)
+{
+    struct dentry *dentry = NULL;
+    if (files && file && bpf_core_read(&dentry, sizeof(dentry), &file->f_path.dentry) == 0)
+        send_dentry_chain(dentry);
+}
+
+SEC("kprobe/ceph_read_iter")
+int trace_read_iter(struct pt_regs *ctx)
+{
+    struct kiocb *iocb = (struct kiocb *)PT_REGS_PARM1(ctx);
+    struct file *file = NULL;
+    if (bpf_core_read(&file, sizeof(file), &iocb->ki_filp) == 0)
+        send_file_dentries(file);
+    return 0;
+}
+
+SEC("kprobe/ceph_write_iter")
+int trace_write_iter(struct pt_regs *ctx)
+{
+    struct kiocb *iocb = (struct kiocb *)PT_REGS_PARM1(ctx);
+    struct file *file = NULL;
+    if (bpf_core_read(&file, sizeof(file), &iocb->ki_filp) == 0)
+        send_file_dentries(file);
+    return 0;
+}
+
+// Opens cover files that are then only accessed through mmap, whose
+// writeback does not pass through ceph_write_iter
+SEC("kprobe/ceph_open")
+int trace_ceph_open(struct pt_regs *ctx)
+{
+    send_file_dentries((struct file *)PT_REGS_PARM2(ctx));
+    return 0;
+}
+
+// A rename moves `dentry` to the name and parent of `target`.  An inode user
+// space already knows gets its new name and parent right away, so a renamed
+// file or directory is reported under its new path; one never sent is named
+// on its next access anyway.  Renames by other clients reach the kernel
+// client as the same d_move when it next looks the dentry up.
+SEC("kprobe/d_move")
+int trace_d_move(struct pt_regs *ctx)
+{
+    struct dentry *dentry = (struct dentry *)PT_REGS_PARM1(ctx);
+    struct dentry *target = (struct dentry *)PT_REGS_PARM2(ctx);
+    struct dentry *parent = NULL;
+    struct super_block *sb = NULL;
+    unsigned long magic = 0;
+    __u64 ino, parent_ino = 0;
+
+    if (bpf_core_read(&sb, sizeof(sb), &dentry->d_sb) != 0 || !sb ||
+        bpf_core_read(&magic, sizeof(magic), &sb->s_magic) != 0 ||
+        magic != CEPH_SUPER_MAGIC)
+        return 0;
+    ino = dentry_ino(dentry);
+    if (!ino || !bpf_map_lookup_elem(&seen_inodes, &ino))
+        return 0;
+
+    if (bpf_core_read(&parent, sizeof(parent), &target->d_parent) == 0 && parent)
+        parent_ino = dentry_ino(parent);
+    if (!parent_ino || !submit_dentry(ino, parent_ino, target)) {
+        bpf_map_delete_elem(&seen_inodes, &ino); // Resend on the next access
+        return 0;
+    }
+    send_dentry_chain(parent);
+    return 0;
+}
+
 // Helper function to initialize kernel trace event in map (avoids stack overflow)
 static __always_inline void initialize_kernel_trace_event(struct request_key *key) {
     struct kernel_trace_event zero_event = {};
@@ -274,6 +496,17 @@ int trace_send_request(struct pt_regs *ctx)
     info->pid = bpf_get_current_pid_tgid() >> 32;
     bpf_get_current_comm(&info->comm, sizeof(info->comm));
     info->attempts = 1;  // First attempt
+
+    // Aggregate mode only needs the direction and the first op
+    if (aggregate) {
+        __u32 agg_flags;
+        __u16 first_op;
+        if (bpf_core_read(&agg_flags, sizeof(agg_flags), &req->r_t.flags) == 0)
+            info->is_write = (agg_flags & CEPH_OSD_FLAG_WRITE) ? 1 : 0;
+        if (bpf_core_read(&first_op, sizeof(first_op), &req->r_ops[0].op) == 0)
+            info->ops[0] = first_op;
+        return 0;
+    }
     
     // Read acting set from req->r_t.acting
     struct ceph_osd_request_target *target = &req->r_t;
@@ -425,6 +658,16 @@ int trace_osd_dispatch(struct pt_regs *ctx)
     bpf_printk("trace_osd_dispatch: found pending request\n");
     
     end_time = bpf_ktime_get_ns();
+
+    if (aggregate) {
+        struct agg_key akey = {};
+        akey.kind = AGG_OSD;
+        akey.target = info->primary_osd;
+        akey.op = info->ops[0];
+        akey.is_write = info->is_write;
+        agg_record(&akey, (end_time - info->start_time) / 1000);
+        goto cleanup;
+    }
     
     // Reserve space in ring buffer
     event = bpf_ringbuf_reserve(&rb, sizeof(struct kernel_trace_event), 0);
@@ -543,6 +786,10 @@ int trace_prepare_send_request(struct pt_regs *ctx)
     event->got_safe_reply = 0;
     event->is_write_op = is_mds_write_op(op);
 
+    // Aggregate mode keys on the op code; the name and path are not needed
+    if (aggregate)
+        return 0;
+
     // Get operation name
     get_mds_op_name(op, event->op_name, CEPH_MDS_OP_NAME_MAX);
 
@@ -679,6 +926,21 @@ int trace_mds_dispatch(struct pt_regs *ctx)
         // For write operations that got unsafe reply first, this completes the two-phase pattern
         // For read operations, this is the only reply
 
+        if (aggregate) {
+            struct agg_key akey = {};
+            akey.kind = AGG_MDS_SAFE;
+            akey.target = event->mds_rank;
+            akey.op = event->op;
+            akey.is_write = event->is_write_op;
+            agg_record(&akey, event->safe_latency_us);
+            if (event->got_unsafe_reply) {
+                akey.kind = AGG_MDS_UNSAFE;
+                agg_record(&akey, event->unsafe_latency_us);
+            }
+            bpf_map_delete_elem(&pending_mds_requests, &key);
+            return 0;
+        }
+
         // Reserve space in ring buffer and emit the completed event
         output_event = bpf_ringbuf_reserve(&mds_rb, sizeof(struct mds_trace_event), 0);
         if (output_event) {
@@ -1,29 +1,39 @@
 // Kernel-level Ceph client tracing
 // Traces requests from Ceph kernel clients to OSDs using kprobes
 
+#include <bpf/bpf.h>
 #include <bpf/libbpf.h>
 #include <errno.h>
 #include <getopt.h>
 #include <stdio.h>
+#include <sys/epoll.h>
 #include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
 #include <time.h>
 #include <signal.h>
 #include <unistd.h>
 #include <string.h>
 #include <linux/types.h>
 
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <ctime>
 #include <iostream>
+#include <list>
 #include <map>
 #include <string>
 #include <sstream>
+#include <tuple>
+#include <unordered_map>
 #include <vector>
 
 #include "kfstrace.skel.h"
 #include "bpf_ceph_types.h"
+#include "bpf_hist.h"
 #include "version_utils.h"
+#include "columnar_writer.h"
 
 #define CEPH_PG_MAX_SIZE 8
 #define CEPH_OID_INLINE_LEN 24
@@ -34,6 +44,16 @@
 #define CEPH_MDS_PATH_MAX 64
 #define TASK_COMM_LEN 16
 
+// Aggregate mode (must match eBPF definitions)
+#define AGG_SLOTS 32
+
+// File attribution mode (must match eBPF definitions)
+#define DENTRY_NAME_MAX 128
+#define SEEN_INODES_MAX 65536
+
+// Rows printed per --files table
+#define FILES_TOP 20
+
 
 struct kernel_trace_event {
     __u64 tid;
@@ -82,10 +102,71 @@ struct mds_trace_event {
     char path[CEPH_MDS_PATH_MAX]; // Request path (truncated if needed)
 } __attribute__((packed));
 
+enum agg_kind { AGG_OSD = 0, AGG_MDS_SAFE, AGG_MDS_UNSAFE };
+
+struct agg_key {
+    __u32 kind;
+    __u32 target;
+    __u32 op;
+    __u32 is_write;
+
+    bool operator<(const agg_key &o) const {
+        return std::tie(kind, target, op, is_write) <
+               std::tie(o.kind, o.target, o.op, o.is_write);
+    }
+};
+
+struct agg_hist {
+    __u64 count;
+    __u64 sum_us;
+    __u64 max_us;
+    __u64 slots[AGG_SLOTS];
+};
+
+typedef std::map<agg_key, agg_hist> agg_snapshot_t;
+
+// Path component event (must match eBPF definition)
+struct dentry_event {
+    __u64 ino;
+    __u64 parent_ino;
+    char name[DENTRY_NAME_MAX];
+} __attribute__((packed));
+
+// OSD requests to the data objects of one inode, or of one directory subtree
+struct file_stats {
+    __u64 count;
+    __u64 bytes;
+    __u64 sum_us;
+    __u64 max_us;
+};
+
+typedef std::map<__u64, file_stats> file_stats_t;
+
 long long latency_threshold = 0;
 
 static volatile bool exiting = false;
 
+// --columnar output; a table is only set when its ring buffer is in use
+static ColumnarWriter *columnar = NULL;
+static ColumnarWriter::Table *columnar_osd = NULL;
+static ColumnarWriter::Table *columnar_mds = NULL;
+
+// --files state: inode -> (parent inode, name) from dentry_rb, and the OSD
+// requests per inode for the current interval and since start.  The names
+// are bounded like the BPF seen_inodes map, least recently used out first.
+struct inode_name {
+    __u64 parent_ino;
+    std::string name;
+    std::list<__u64>::iterator lru;
+};
+
+static bool files_mode = false;
+static std::unordered_map<__u64, inode_name> inode_names;
+static std::list<__u64> inode_lru;  // Most recently used first
+static int seen_inodes_fd = -1;
+static file_stats_t interval_files, total_files;
+static __u64 interval_other = 0, total_other = 0;
+
 static void sig_handler(int sig)
 {
     (void)sig;
@@ -159,6 +240,99 @@ static std::string format_ops(const kernel_trace_event* event)
     return ops_list.str();
 }
 
+// CephFS data objects are named "<ino>.<object number>", both in hex, the
+// object number zero-padded to 8 digits
+static bool file_object_ino(const char *name, __u64 *ino)
+{
+    const char *dot = strchr(name, '.');
+    if (!dot || dot == name || dot - name > 16 || strlen(dot + 1) != 8 ||
+        strspn(name, "0123456789abcdef") != (size_t)(dot - name) ||
+        strspn(dot + 1, "0123456789abcdef") != 8)
+        return false;
+    *ino = strtoull(name, NULL, 16);
+    return true;
+}
+
+static void add_file_stats(file_stats &st, __u64 bytes, __u64 latency_us)
+{
+    st.count++;
+    st.bytes += bytes;
+    st.sum_us += latency_us;
+    if (latency_us > st.max_us)
+        st.max_us = latency_us;
+}
+
+// --files: charge an OSD request to the inode its object belongs to
+static void account_file_request(const struct kernel_trace_event *event)
+{
+    char object_name[CEPH_OID_INLINE_LEN + 1] = "";
+    __u64 ino;
+
+    if (event->object_name_len > 0 && event->object_name_len < CEPH_OID_INLINE_LEN) {
+        memcpy(object_name, event->object_name, event->object_name_len);
+        object_name[event->object_name_len] = '\0';
+    }
+    if (!file_object_ino(object_name, &ino)) {
+        interval_other++;
+        total_other++;
+        return;
+    }
+    add_file_stats(interval_files[ino], event->length, event->latency_us);
+    add_file_stats(total_files[ino], event->length, event->latency_us);
+}
+
+// Drop `ino` from the BPF seen_inodes map, so its dentry chain is sent
+// again on its next access
+static void forget_inode(__u64 ino)
+{
+    if (seen_inodes_fd >= 0)
+        bpf_map_delete_elem(seen_inodes_fd, &ino);
+}
+
+// Record or refresh (a rename sends the inode again) the name of `ino`
+static void set_inode_name(__u64 ino, __u64 parent_ino, const std::string &name)
+{
+    auto it = inode_names.find(ino);
+    if (it != inode_names.end()) {
+        it->second.parent_ino = parent_ino;
+        it->second.name = name;
+        inode_lru.splice(inode_lru.begin(), inode_lru, it->second.lru);
+        return;
+    }
+    inode_lru.push_front(ino);
+    inode_names[ino] = inode_name{parent_ino, name, inode_lru.begin()};
+    if (inode_names.size() > SEEN_INODES_MAX) {
+        __u64 oldest = inode_lru.back();
+        inode_lru.pop_back();
+        inode_names.erase(oldest);
+        forget_inode(oldest);
+    }
+}
+
+static const inode_name *find_inode_name(__u64 ino)
+{
+    auto it = inode_names.find(ino);
+    if (it == inode_names.end())
+        return NULL;
+    inode_lru.splice(inode_lru.begin(), inode_lru, it->second.lru);
+    return &it->second;
+}
+
+static int handle_dentry_event(void *ctx, void *data, size_t data_sz)
+{
+    (void)ctx;
+    const struct dentry_event *event = (const struct dentry_event *)data;
+
+    if (data_sz < sizeof(*event)) {
+        fprintf(stderr, "Invalid dentry event size: %zu (expected >= %zu)\n", data_sz, sizeof(*event));
+        return 0;
+    }
+
+    set_inode_name(event->ino, event->parent_ino,
+                   std::string(event->name, strnlen(event->name, DENTRY_NAME_MAX)));
+    return 0;
+}
+
 static int handle_event(void *ctx, void *data, size_t data_sz)
 {
     (void)ctx;
@@ -174,6 +348,11 @@ static int handle_event(void *ctx, void *data, size_t data_sz)
         return 0;
     }
 
+    if (files_mode) {
+        account_file_request(event);
+        return 0;
+    }
+
     if (event->latency_us < (__u64)latency_threshold)
         return 0;
 
@@ -224,6 +403,17 @@ static int handle_event(void *ctx, void *data, size_t data_sz)
            ts, event->pid, event->comm, event->client_id, event->tid, event->pool_id, event->pg_id, op_str, acting_set,
            object_name, event->attempts, ops_str.c_str(), event->latency_us);
 
+    if (columnar_osd) {
+        columnar_osd->add(event->tid).add(event->client_id)
+            .add(event->start_time).add(event->end_time).add(event->latency_us)
+            .add(event->pid).add_str(event->comm, strnlen(event->comm, TASK_COMM_LEN))
+            .add(event->pool_id).add(event->pg_id).add(event->primary_osd)
+            .add_str(acting_set).add_str(object_name).add_str(op_str)
+            .add_str(ops_str).add(event->ops_size).add(event->offset)
+            .add(event->length).add(event->attempts);
+        columnar_osd->end_row();
+    }
+
     return 0;
 }
 
@@ -286,6 +476,301 @@ static int handle_mds_event(void *ctx, void *data, size_t data_sz)
            ts, event->pid, event->comm, event->client_id, event->tid, event->mds_rank,
            event->op_name, display_path, event->attempts, unsafe_lat, safe_lat, result_str);
 
+    if (columnar_mds) {
+        columnar_mds->add(event->tid).add(event->client_id)
+            .add(event->submit_time).add(event->unsafe_reply_time)
+            .add(event->safe_reply_time).add(event->unsafe_latency_us)
+            .add(event->safe_latency_us).add(event->pid)
+            .add_str(event->comm, strnlen(event->comm, TASK_COMM_LEN))
+            .add(event->mds_rank).add(event->op)
+            .add_str(event->op_name, strnlen(event->op_name, CEPH_MDS_OP_NAME_MAX))
+            .add_str(event->path, strnlen(event->path, CEPH_MDS_PATH_MAX))
+            .add(event->result).add(event->got_unsafe_reply)
+            .add(event->got_safe_reply).add(event->is_write_op)
+            .add(event->attempts);
+        columnar_mds->end_row();
+    }
+
+    return 0;
+}
+
+// Same names as get_mds_op_name() in kfstrace.bpf.c
+static std::string mds_op_name(__u32 op)
+{
+    switch (op) {
+    case 0x00100: return "LOOKUP";
+    case 0x00101: return "GETATTR";
+    case 0x00305: return "READDIR";
+    case 0x01301: return "CREATE";
+    case 0x01203: return "UNLINK";
+    case 0x01204: return "RENAME";
+    case 0x01220: return "MKDIR";
+    case 0x01221: return "RMDIR";
+    case 0x01108: return "SETATTR";
+    case 0x00302: return "OPEN";
+    }
+    char name[16];
+    snprintf(name, sizeof(name), "OP_%05X", op);
+    return name;
+}
+
+// Sum of every CPU's copy of the agg_hists entries.
+static agg_snapshot_t read_agg_hists(int map_fd)
+{
+    agg_snapshot_t snap;
+    int ncpus = libbpf_num_possible_cpus();
+    if (ncpus <= 0)
+        return snap;
+    std::vector<agg_hist> percpu(ncpus);
+    agg_key key, next;
+    agg_key *prev = NULL;
+    while (bpf_map_get_next_key(map_fd, prev, &next) == 0) {
+        key = next;
+        prev = &key;
+        if (bpf_map_lookup_elem(map_fd, &key, percpu.data()) != 0)
+            continue;
+        agg_hist &sum = snap[key];
+        memset(&sum, 0, sizeof(sum));
+        for (const agg_hist &h : percpu) {
+            sum.count += h.count;
+            sum.sum_us += h.sum_us;
+            if (h.max_us > sum.max_us)
+                sum.max_us = h.max_us;
+            for (int i = 0; i < AGG_SLOTS; i++)
+                sum.slots[i] += h.slots[i];
+        }
+    }
+    return snap;
+}
+
+// hist_percentile() of h, capped by the largest latency seen.
+static __u64 agg_percentile(const agg_hist &h, double p)
+{
+    return std::min(hist_percentile(h.slots, AGG_SLOTS, h.count, p), h.max_us);
+}
+
+// One table row per histogram: the change since `prev` for an interval, or
+// the totals at exit.  An interval cannot tell its own maximum, so only the
+// totals print one; interval percentiles are capped by the overall maximum.
+static void print_agg_hists(const agg_snapshot_t &cur, const agg_snapshot_t &prev,
+                            bool totals, const char *label)
+{
+    char ts[32];
+    time_t t = time(NULL);
+    strftime(ts, sizeof(ts), "%H:%M:%S", localtime(&t));
+
+    const char *section = NULL;
+    for (const auto &kv : cur) {
+        const agg_key &k = kv.first;
+        agg_hist h = kv.second;
+        if (!totals) {
+            auto it = prev.find(k);
+            if (it != prev.end()) {
+                h.count -= it->second.count;
+                h.sum_us -= it->second.sum_us;
+                for (int i = 0; i < AGG_SLOTS; i++)
+                    h.slots[i] -= it->second.slots[i];
+            }
+        }
+        if (h.count == 0)
+            continue;
+
+        const char *kind_section = k.kind == AGG_OSD ? "OSD" : "MDS";
+        if (section != kind_section) {
+            section = kind_section;
+            printf("%s %s requests, %s\n", ts, section, label);
+            printf("  %-8s %-16s %-6s %10s %10s %10s %10s %10s%s\n",
+                   section, "OP", k.kind == AGG_OSD ? "RW" : "REPLY", "COUNT",
+                   "AVG(us)", "P50(us)", "P90(us)", "P99(us)", totals ? "    MAX(us)" : "");
+        }
+
+        char target[16];
+        std::string op;
+        const char *dir;
+        if (k.kind == AGG_OSD) {
+            snprintf(target, sizeof(target), "osd.%u", k.target);
+            const char *name = ceph_osd_op_str(k.op);
+            op = name ? name : "op_" + std::to_string(k.op);
+            dir = k.is_write ? "W" : "R";
+        } else {
+            snprintf(target, sizeof(target), "mds.%u", k.target);
+            op = mds_op_name(k.op);
+            dir = k.kind == AGG_MDS_SAFE ? "safe" : "unsafe";
+        }
+        printf("  %-8s %-16s %-6s %10llu %10llu %10llu %10llu %10llu",
+               target, op.c_str(), dir, h.count, h.sum_us / h.count,
+               agg_percentile(h, 50), agg_percentile(h, 90), agg_percentile(h, 99));
+        if (totals)
+            printf(" %10llu", h.max_us);
+        printf("\n");
+    }
+    fflush(stdout);
+}
+
+// The path of `ino` below the mount point, as far as its dentries were
+// seen; an ancestor that was not seen, or was evicted, shows as its inode
+// number, and the inodes below it are sent again on their next access.
+static std::string inode_path(__u64 ino)
+{
+    std::string path;
+    std::vector<__u64> walked;
+    for (size_t depth = 0; depth <= inode_names.size(); depth++) {
+        const inode_name *entry = find_inode_name(ino);
+        if (!entry) {
+            char unknown[32];
+            snprintf(unknown, sizeof(unknown), "[%llx]", (unsigned long long)ino);
+            forget_inode(ino);
+            for (__u64 below : walked)
+                forget_inode(below);
+            return unknown + path;
+        }
+        if (entry->parent_ino == ino)
+            return path.empty() ? "/" : path;
+        path = "/" + entry->name + path;
+        walked.push_back(ino);
+        ino = entry->parent_ino;
+    }
+    return path;  // A loop left by a rename
+}
+
+static void print_file_rows(const file_stats_t &stats, const char *what)
+{
+    std::vector<std::pair<__u64, file_stats>> rows(stats.begin(), stats.end());
+    std::sort(rows.begin(), rows.end(), [](const std::pair<__u64, file_stats> &a,
+                                           const std::pair<__u64, file_stats> &b) {
+        return a.second.sum_us > b.second.sum_us;
+    });
+    if (rows.size() > FILES_TOP)
+        rows.resize(FILES_TOP);
+
+    printf("  %10s %10s %10s %10s %12s  %s\n",
+           "COUNT", "MB", "AVG(us)", "MAX(us)", "TOTAL(ms)", what);
+    for (const auto &row : rows) {
+        const file_stats &st = row.second;
+        printf("  %10llu %10.1f %10llu %10llu %12.1f  %s\n",
+               st.count, st.bytes / 1048576.0, st.sum_us / st.count, st.max_us,
+               st.sum_us / 1000.0, inode_path(row.first).c_str());
+    }
+}
+
+// The busiest files and directory subtrees by total OSD request latency.  A
+// directory counts the requests of every file below it that was seen.
+static void print_file_stats(const file_stats_t &stats, __u64 other, const char *label)
+{
+    char ts[32];
+    time_t t = time(NULL);
+    strftime(ts, sizeof(ts), "%H:%M:%S", localtime(&t));
+
+    __u64 count = 0;
+    file_stats_t dirs;
+    for (const auto &kv : stats) {
+        count += kv.second.count;
+        __u64 ino = kv.first;
+        for (size_t depth = 0; depth <= inode_names.size(); depth++) {
+            const inode_name *entry = find_inode_name(ino);
+            if (!entry || entry->parent_ino == ino)
+                break;
+            ino = entry->parent_ino;
+            file_stats &dir = dirs[ino];
+            dir.count += kv.second.count;
+            dir.bytes += kv.second.bytes;
+            dir.sum_us += kv.second.sum_us;
+            dir.max_us = std::max(dir.max_us, kv.second.max_us);
+        }
+    }
+
+    printf("%s files, %s: %llu OSD requests to file data, %llu to other objects\n",
+           ts, label, count, other);
+    if (!stats.empty()) {
+        print_file_rows(stats, "FILE");
+        printf("%s directory subtrees, %s\n", ts, label);
+        print_file_rows(dirs, "DIRECTORY");
+    }
+    fflush(stdout);
+}
+
+// A CLOCK_MONOTONIC timerfd registered with `epfd` under `tag`, firing after
+// `first_ms` and then every `interval_ms` (never again if 0).
+static int add_timer(int epfd, __u32 tag, long first_ms, long interval_ms)
+{
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    struct itimerspec its = {};
+    its.it_value.tv_sec = first_ms / 1000;
+    its.it_value.tv_nsec = (first_ms % 1000) * 1000000;
+    its.it_interval.tv_sec = interval_ms / 1000;
+    its.it_interval.tv_nsec = (interval_ms % 1000) * 1000000;
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.u32 = tag;
+    if (timerfd_settime(fd, 0, &its, NULL) != 0 ||
+        epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Declare the --columnar tables; the column order must match handle_event()
+// and handle_mds_event().
+static int open_columnar(ColumnarWriter *writer, bool osd, bool mds)
+{
+    typedef ColumnarWriter CW;
+    char host[256] = "";
+    gethostname(host, sizeof(host) - 1);
+    writer->set_meta("tool", "kfstrace");
+    writer->set_meta("hostname", host);
+    writer->set_meta("latency_unit", "us");
+    if (osd) {
+        columnar_osd = writer->add_table("osd_request", {
+            {"tid", CW::U64, CW::NO_CLOCK},
+            {"client", CW::U64, CW::NO_CLOCK},
+            {"start_time", CW::U64, CW::MONOTONIC_NS},
+            {"end_time", CW::U64, CW::MONOTONIC_NS},
+            {"latency", CW::U64, CW::NO_CLOCK},
+            {"pid", CW::U32, CW::NO_CLOCK},
+            {"comm", CW::STR, CW::NO_CLOCK},
+            {"pool", CW::U64, CW::NO_CLOCK},
+            {"pg_seed", CW::U32, CW::NO_CLOCK},
+            {"primary_osd", CW::U32, CW::NO_CLOCK},
+            {"acting", CW::STR, CW::NO_CLOCK},
+            {"object", CW::STR, CW::NO_CLOCK},
+            {"op", CW::STR, CW::NO_CLOCK},
+            {"ops", CW::STR, CW::NO_CLOCK},
+            {"ops_total", CW::U8, CW::NO_CLOCK},
+            {"offset", CW::U64, CW::NO_CLOCK},
+            {"length", CW::U64, CW::NO_CLOCK},
+            {"attempts", CW::U32, CW::NO_CLOCK},
+        });
+    }
+    if (mds) {
+        columnar_mds = writer->add_table("mds_request", {
+            {"tid", CW::U64, CW::NO_CLOCK},
+            {"client", CW::U64, CW::NO_CLOCK},
+            {"submit_time", CW::U64, CW::MONOTONIC_NS},
+            {"unsafe_reply_time", CW::U64, CW::MONOTONIC_NS},
+            {"safe_reply_time", CW::U64, CW::MONOTONIC_NS},
+            {"unsafe_latency", CW::U64, CW::NO_CLOCK},
+            {"safe_latency", CW::U64, CW::NO_CLOCK},
+            {"pid", CW::U32, CW::NO_CLOCK},
+            {"comm", CW::STR, CW::NO_CLOCK},
+            {"mds_rank", CW::U32, CW::NO_CLOCK},
+            {"op_code", CW::U32, CW::NO_CLOCK},
+            {"op", CW::STR, CW::NO_CLOCK},
+            {"path", CW::STR, CW::NO_CLOCK},
+            {"result", CW::I32, CW::NO_CLOCK},
+            {"got_unsafe_reply", CW::U8, CW::NO_CLOCK},
+            {"got_safe_reply", CW::U8, CW::NO_CLOCK},
+            {"is_write", CW::U8, CW::NO_CLOCK},
+            {"attempts", CW::U32, CW::NO_CLOCK},
+        });
+    }
+    if (!writer->open()) {
+        fprintf(stderr, "Failed to create %s: %s\n", writer->path().c_str(), strerror(errno));
+        columnar_osd = columnar_mds = NULL;
+        return -1;
+    }
     return 0;
 }
 
@@ -298,6 +783,11 @@ static void print_usage(const char *prog)
     printf("  -t, --timeout <s>            Set execution timeout (default: no timeout)\n");
     printf("  -m, --mode <mode>            Tracing mode: osd, mds, or all (default: mds)\n");
     printf("  -l, --latency <microseconds> Set operation latency threshold to capture (default: 0)\n");
+    printf("      --columnar <file>        Also record every event to a columnar file (see tools/columnar_reader.py)\n");
+    printf("      --aggregate <s>          Count requests into in-kernel per-OSD/per-MDS latency histograms\n");
+    printf("                               and print them every <s> seconds instead of every request\n");
+    printf("      --files <s>              Print OSD request latency and bytes per CephFS file and directory\n");
+    printf("                               subtree every <s> seconds instead of every request (OSD mode)\n");
     printf("\nDescription:\n");
     printf("  Traces Ceph kernel client requests using kprobes.\n");
     printf("  OSD mode: Shows data requests to OSDs with latencies and operation details.\n");
@@ -308,20 +798,37 @@ static void print_usage(const char *prog)
     printf("  sudo %s -m osd         # Trace OSD requests only\n", prog);
     printf("  sudo %s -m all         # Trace both OSD and MDS requests\n", prog);
     printf("  sudo %s -t 30 -m all   # Trace both for 30 seconds\n", prog);
+    printf("  sudo %s -m all --aggregate 5  # Latency tables every 5 seconds\n", prog);
+    printf("  sudo %s --files 10     # Busiest files and directories every 10 seconds\n", prog);
     printf("\nNote: Requires root privileges and kernel v5.8+\n");
 }
 
 int main(int argc, char **argv)
 {
     struct kfstrace_bpf *skel = NULL;
+    // One ring_buffer manager for both maps, and one epoll set for it and
+    // the timers, so a busy ring never delays the other one or a timer
     struct ring_buffer *rb = NULL;
-    struct ring_buffer *mds_rb = NULL;
+    int epfd = -1;
+    int timer_fds[3] = {-1, -1, -1};
+    int sig_fd = -1;
+    sigset_t sigs;
+    enum { EV_RING, EV_TIMEOUT, EV_REPORT, EV_FLUSH, EV_SIGNAL };
     int err = 0;
     int timeout_seconds = 0;
-    time_t start_time;
+    const char *columnar_file = NULL;
+    int aggregate_interval = 0;
+    int files_interval = 0;
+    int report_interval;
+    agg_snapshot_t agg_prev;
 
     // Tracing mode configuration
     enum trace_mode { MODE_OSD, MODE_MDS, MODE_ALL } mode = MODE_MDS;
+    bool mode_set = false;
+    bool trace_osd, trace_mds;
+
+    // Long-only options
+    enum { OPT_COLUMNAR = 256, OPT_AGGREGATE, OPT_FILES };
 
     static const struct option long_options[] = {
         {"help", no_argument, NULL, 'h'},
@@ -329,6 +836,9 @@ int main(int argc, char **argv)
         {"timeout", required_argument, NULL, 't'},
         {"mode", required_argument, NULL, 'm'},
         {"latency", required_argument, NULL, 'l'},
+        {"columnar", required_argument, NULL, OPT_COLUMNAR},
+        {"aggregate", required_argument, NULL, OPT_AGGREGATE},
+        {"files", required_argument, NULL, OPT_FILES},
         {NULL, 0, NULL, 0}
     };
 
@@ -360,6 +870,7 @@ int main(int argc, char **argv)
                 fprintf(stderr, "Invalid mode: %s (must be osd, mds, or all)\n", optarg);
                 return 1;
             }
+            mode_set = true;
             break;
         case 'l':
             latency_threshold=atoll(optarg);
@@ -368,12 +879,53 @@ int main(int argc, char **argv)
                 return 1;
             }
             break;
+        case OPT_COLUMNAR:
+            columnar_file = optarg;
+            break;
+        case OPT_AGGREGATE:
+            aggregate_interval = atoi(optarg);
+            if (aggregate_interval <= 0) {
+                fprintf(stderr, "Invalid aggregate interval: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case OPT_FILES:
+            files_interval = atoi(optarg);
+            if (files_interval <= 0) {
+                fprintf(stderr, "Invalid files interval: %s\n", optarg);
+                return 1;
+            }
+            break;
         default:
             print_usage(argv[0]);
             return 1;
         }
     }
 
+    if ((aggregate_interval > 0 || files_interval > 0) && latency_threshold > 0) {
+        fprintf(stderr, "-l filters single requests and cannot be combined with --aggregate or --files\n");
+        return 1;
+    }
+
+    if (aggregate_interval > 0 && columnar_file) {
+        fprintf(stderr, "--columnar records every request and cannot be combined with --aggregate\n");
+        return 1;
+    }
+
+    if (files_interval > 0) {
+        if (aggregate_interval > 0 || columnar_file) {
+            fprintf(stderr, "--files cannot be combined with --aggregate or --columnar\n");
+            return 1;
+        }
+        if (mode_set && mode != MODE_OSD) {
+            fprintf(stderr, "--files attributes OSD requests and only works with -m osd\n");
+            return 1;
+        }
+        mode = MODE_OSD;
+        files_mode = true;
+    }
+    report_interval = files_mode ? files_interval : aggregate_interval;
+
     signal(SIGINT, sig_handler);
     signal(SIGTERM, sig_handler);
 
@@ -401,6 +953,9 @@ int main(int argc, char **argv)
         return 1;
     }
 
+    skel->rodata->aggregate = aggregate_interval > 0;
+    skel->rodata->files = files_mode;
+
     // Load BPF program
     err = kfstrace_bpf__load(skel);
     if (err) {
@@ -426,6 +981,21 @@ int main(int argc, char **argv)
         }
     }
 
+    if (files_mode) {
+        // Attach the kprobes that name the inodes and follow their renames
+        skel->links.trace_read_iter = bpf_program__attach(skel->progs.trace_read_iter);
+        skel->links.trace_write_iter = bpf_program__attach(skel->progs.trace_write_iter);
+        skel->links.trace_ceph_open = bpf_program__attach(skel->progs.trace_ceph_open);
+        skel->links.trace_d_move = bpf_program__attach(skel->progs.trace_d_move);
+        if (!skel->links.trace_read_iter || !skel->links.trace_write_iter ||
+            !skel->links.trace_ceph_open || !skel->links.trace_d_move) {
+            fprintf(stderr, "Failed to attach CephFS file kprobes (is the ceph module loaded?)\n");
+            err = 1;
+            goto cleanup;
+        }
+        seen_inodes_fd = bpf_map__fd(skel->maps.seen_inodes);
+    }
+
     if (mode == MODE_MDS || mode == MODE_ALL) {
         // Attach MDS-related kprobes
         skel->links.trace_prepare_send_request = bpf_program__attach(skel->progs.trace_prepare_send_request);
@@ -443,8 +1013,11 @@ int main(int argc, char **argv)
         }
     }
 
-    // Create ring buffers based on tracing mode
-    if (mode == MODE_OSD || mode == MODE_ALL) {
+    // Create the ring buffer manager based on tracing mode; in aggregate
+    // mode the kprobes send nothing through the rings
+    trace_osd = aggregate_interval == 0 && (mode == MODE_OSD || mode == MODE_ALL);
+    trace_mds = aggregate_interval == 0 && (mode == MODE_MDS || mode == MODE_ALL);
+    if (trace_osd) {
         rb = ring_buffer__new(bpf_map__fd(skel->maps.rb), handle_event, NULL, NULL);
         if (!rb) {
             fprintf(stderr, "Failed to create OSD ring buffer\n");
@@ -453,17 +1026,91 @@ int main(int argc, char **argv)
         }
     }
 
-    if (mode == MODE_MDS || mode == MODE_ALL) {
-        mds_rb = ring_buffer__new(bpf_map__fd(skel->maps.mds_rb), handle_mds_event, NULL, NULL);
-        if (!mds_rb) {
+    if (trace_mds) {
+        if (rb)
+            err = ring_buffer__add(rb, bpf_map__fd(skel->maps.mds_rb), handle_mds_event, NULL);
+        else if (!(rb = ring_buffer__new(bpf_map__fd(skel->maps.mds_rb), handle_mds_event, NULL, NULL)))
+            err = -errno;
+        if (err) {
             fprintf(stderr, "Failed to create MDS ring buffer\n");
             err = 1;
             goto cleanup;
         }
     }
 
+    if (files_mode && ring_buffer__add(rb, bpf_map__fd(skel->maps.dentry_rb), handle_dentry_event, NULL) != 0) {
+        fprintf(stderr, "Failed to create dentry ring buffer\n");
+        err = 1;
+        goto cleanup;
+    }
+
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0) {
+        fprintf(stderr, "Failed to create epoll instance: %s\n", strerror(errno));
+        err = 1;
+        goto cleanup;
+    }
+    if (rb) {
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.u32 = EV_RING;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, ring_buffer__epoll_fd(rb), &ev) != 0) {
+            fprintf(stderr, "Failed to add ring buffer to epoll: %s\n", strerror(errno));
+            err = 1;
+            goto cleanup;
+        }
+    }
+    // From here on SIGINT/SIGTERM are only taken from a signalfd in the
+    // epoll set: one caught by sig_handler between the exiting check and
+    // epoll_wait() would otherwise leave the wait blocked
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGINT);
+    sigaddset(&sigs, SIGTERM);
+    if (sigprocmask(SIG_BLOCK, &sigs, NULL) != 0 ||
+        (sig_fd = signalfd(-1, &sigs, SFD_NONBLOCK | SFD_CLOEXEC)) < 0) {
+        fprintf(stderr, "Failed to create signalfd: %s\n", strerror(errno));
+        err = 1;
+        goto cleanup;
+    }
+    {
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.u32 = EV_SIGNAL;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, sig_fd, &ev) != 0) {
+            fprintf(stderr, "Failed to add signalfd to epoll: %s\n", strerror(errno));
+            err = 1;
+            goto cleanup;
+        }
+    }
+    if ((timeout_seconds > 0 &&
+         (timer_fds[0] = add_timer(epfd, EV_TIMEOUT, timeout_seconds * 1000L, 0)) < 0) ||
+        (report_interval > 0 &&
+         (timer_fds[1] = add_timer(epfd, EV_REPORT, report_interval * 1000L,
+                                   report_interval * 1000L)) < 0) ||
+        (columnar_file &&
+         (timer_fds[2] = add_timer(epfd, EV_FLUSH, 1000, 1000)) < 0)) {
+        fprintf(stderr, "Failed to create timer: %s\n", strerror(errno));
+        err = 1;
+        goto cleanup;
+    }
+
+    if (columnar_file) {
+        columnar = new ColumnarWriter(columnar_file);
+        if (open_columnar(columnar, trace_osd, trace_mds) != 0) {
+            err = 1;
+            goto cleanup;
+        }
+    }
+
     // Print appropriate headers based on mode
-    if (mode == MODE_OSD) {
+    if (aggregate_interval > 0) {
+        printf("Aggregating Ceph kernel %s requests, printing every %d s... Press Ctrl+C to stop.\n",
+               mode == MODE_OSD ? "OSD" : mode == MODE_MDS ? "MDS" : "OSD and MDS",
+               aggregate_interval);
+    } else if (files_mode) {
+        printf("Attributing Ceph kernel OSD requests to files, printing every %d s... Press Ctrl+C to stop.\n",
+               files_interval);
+    } else if (mode == MODE_OSD) {
         printf("Tracing Ceph kernel OSD requests... Press Ctrl+C to stop.\n");
         printf("%-8s %-8s %-12s %-10s %-16s %-8s %-8s %-6s %-20s %-32s %-8s %-30s %-12s\n",
                "TIME", "PID", "COMMAND", "CLIENT_ID", "TID", "POOL", "PG", "OP", "ACTING_SET", "OBJECT", "ATTEMPTS", "OPS", "LATENCY(us)");
@@ -475,53 +1122,87 @@ int main(int argc, char **argv)
         printf("Tracing Ceph kernel OSD and MDS requests... Press Ctrl+C to stop.\n");
     }
 
-    // Set up timeout if specified  
-    start_time = time(NULL);
-    
-    // Poll for events
+    // Wait for ring data, a timer or a signal
     while (!exiting) {
-        // Poll OSD ring buffer if in OSD or ALL mode
-        if (rb) {
-            err = ring_buffer__poll(rb, 100 /* timeout in ms */);
-            if (err == -EINTR) {
+        struct epoll_event events[5];
+        int n = epoll_wait(epfd, events, 5, -1);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "Error waiting for events: %s\n", strerror(errno));
+            err = 1;
+            break;
+        }
+        for (int i = 0; i < n && !exiting; i++) {
+            __u64 expirations;
+            switch (events[i].data.u32) {
+            case EV_RING:
+                err = ring_buffer__consume(rb);
+                if (err < 0) {
+                    fprintf(stderr, "Error consuming ring buffer: %s\n", strerror(-err));
+                    exiting = true;
+                } else {
+                    err = 0;
+                }
                 break;
-            }
-            if (err < 0) {
-                fprintf(stderr, "Error polling OSD ring buffer: %s\n", strerror(-err));
+            case EV_TIMEOUT:
+                printf("\nTimeout reached, exiting...\n");
+                exiting = true;
                 break;
-            }
-        }
-
-        // Poll MDS ring buffer if in MDS or ALL mode
-        if (mds_rb) {
-            err = ring_buffer__poll(mds_rb, 100 /* timeout in ms */);
-            if (err == -EINTR) {
+            case EV_REPORT: {
+                if (read(timer_fds[1], &expirations, sizeof(expirations)) < 0)
+                    break;
+                char label[32];
+                snprintf(label, sizeof(label), "last %d s", report_interval);
+                if (files_mode) {
+                    print_file_stats(interval_files, interval_other, label);
+                    interval_files.clear();
+                    interval_other = 0;
+                    break;
+                }
+                agg_snapshot_t cur = read_agg_hists(bpf_map__fd(skel->maps.agg_hists));
+                print_agg_hists(cur, agg_prev, false, label);
+                agg_prev.swap(cur);
                 break;
             }
-            if (err < 0) {
-                fprintf(stderr, "Error polling MDS ring buffer: %s\n", strerror(-err));
+            case EV_FLUSH:
+                if (read(timer_fds[2], &expirations, sizeof(expirations)) < 0)
+                    break;
+                columnar->tick();
                 break;
-            }
-        }
-
-        // If neither ring buffer is active, sleep briefly to avoid busy loop
-        if (!rb && !mds_rb) {
-            usleep(100000); // 100ms
-        }
-        
-        // Check timeout
-        if (timeout_seconds > 0) {
-            time_t current_time = time(NULL);
-            if (current_time - start_time >= timeout_seconds) {
-                printf("\nTimeout reached, exiting...\n");
+            case EV_SIGNAL: {
+                struct signalfd_siginfo si;
+                if (read(sig_fd, &si, sizeof(si)) == sizeof(si))
+                    exiting = true;
                 break;
             }
+            }
         }
     }
 
+    // Events still queued when tracing stopped
+    if (rb && err == 0)
+        ring_buffer__consume(rb);
+
+    if (files_mode)
+        print_file_stats(total_files, total_other, "totals");
+
+    if (aggregate_interval > 0) {
+        agg_snapshot_t cur = read_agg_hists(bpf_map__fd(skel->maps.agg_hists));
+        print_agg_hists(cur, agg_prev, true, "totals");
+    }
+
 cleanup:
+    columnar_osd = columnar_mds = NULL;
+    delete columnar;
+    for (int fd : timer_fds)
+        if (fd >= 0)
+            close(fd);
+    if (sig_fd >= 0)
+        close(sig_fd);
+    if (epfd >= 0)
+        close(epfd);
     ring_buffer__free(rb);
-    ring_buffer__free(mds_rb);
     kfstrace_bpf__destroy(skel);
 
     return err != 0 ? 1 : 0;
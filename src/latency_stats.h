@@ -0,0 +1,1005 @@
+#ifndef LATENCY_STATS_H
+#define LATENCY_STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "bpf_hist.h"
+#include "output_buffer.h"
+
+// Streaming latency statistics.
+//
+// LatencyHistogram keeps exact count/min/max/sum/sum-of-squares and a
+// log-linear histogram: values below 256 get a bucket each, larger values
+// share 128 buckets per power of two, so any percentile it reports is within
+// 0.4% of the true sample.  Memory is bounded by the largest value seen
+// (a few KiB), not by the number of samples.
+class LatencyHistogram {
+ public:
+  static constexpr unsigned SUB_BITS = 7;
+  static constexpr uint64_t SUB_COUNT = 1ull << SUB_BITS;
+  static constexpr uint64_t EXACT_LIMIT = 2 * SUB_COUNT;
+
+  void record(uint64_t v) {
+    size_t idx = bucket_index(v);
+    if (idx >= buckets_.size()) buckets_.resize(idx + 1);
+    ++buckets_[idx];
+    if (count_ == 0 || v < min_) min_ = v;
+    if (v > max_) max_ = v;
+    ++count_;
+    sum_ += v;
+    sum_sq_ += (unsigned __int128)v * v;
+  }
+
+  void merge(const LatencyHistogram &o) {
+    if (o.count_ == 0) return;
+    if (o.buckets_.size() > buckets_.size()) buckets_.resize(o.buckets_.size());
+    for (size_t i = 0; i < o.buckets_.size(); ++i) buckets_[i] += o.buckets_[i];
+    if (count_ == 0 || o.min_ < min_) min_ = o.min_;
+    if (o.max_ > max_) max_ = o.max_;
+    count_ += o.count_;
+    sum_ += o.sum_;
+    sum_sq_ += o.sum_sq_;
+  }
+
+  void clear() { *this = LatencyHistogram(); }
+
+  uint64_t count() const { return count_; }
+  uint64_t min() const { return min_; }
+  uint64_t max() const { return max_; }
+
+  double mean() const {
+    return count_ ? (double)((long double)sum_ / count_) : 0.0;
+  }
+
+  // Sample standard deviation (n - 1), computed from exact integer sums so
+  // it matches Python's statistics.stdev() on the same samples.
+  double stdev() const {
+    if (count_ < 2) return 0.0;
+    unsigned __int128 n = count_;
+    unsigned __int128 num = n * sum_sq_ - sum_ * sum_;
+    long double var = (long double)num / (long double)(n * (n - 1));
+    return (double)std::sqrt(var);
+  }
+
+  // Nearest-rank percentile, p in (0, 100].
+  uint64_t percentile(double p) const {
+    if (count_ == 0) return 0;
+    uint64_t rank = (uint64_t)std::ceil(p / 100.0 * count_);
+    if (rank < 1) rank = 1;
+    if (rank >= count_) return max_;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets_.size(); ++i) {
+      seen += buckets_[i];
+      if (seen >= rank) {
+        uint64_t lo = bucket_low(i);
+        uint64_t v = lo + (bucket_width(i) - 1) / 2;
+        return std::min(std::max(v, min_), max_);
+      }
+    }
+    return max_;
+  }
+
+  static size_t bucket_index(uint64_t v) {
+    if (v < EXACT_LIMIT) return v;
+    unsigned shift = 63 - __builtin_clzll(v) - SUB_BITS;
+    return EXACT_LIMIT + (shift - 1) * SUB_COUNT + ((v >> shift) - SUB_COUNT);
+  }
+
+  static uint64_t bucket_low(size_t idx) {
+    if (idx < EXACT_LIMIT) return idx;
+    unsigned shift = (idx - EXACT_LIMIT) / SUB_COUNT + 1;
+    return (SUB_COUNT + (idx - EXACT_LIMIT) % SUB_COUNT) << shift;
+  }
+
+  static uint64_t bucket_width(size_t idx) {
+    if (idx < EXACT_LIMIT) return 1;
+    return 1ull << ((idx - EXACT_LIMIT) / SUB_COUNT + 1);
+  }
+
+ private:
+  std::vector<uint64_t> buckets_;
+  uint64_t count_ = 0;
+  uint64_t min_ = 0;
+  uint64_t max_ = 0;
+  unsigned __int128 sum_ = 0;
+  unsigned __int128 sum_sq_ = 0;
+};
+
+// The report of tools/analyze_osdtrace_output.py, built from ops as they
+// are traced instead of from a captured log.  print_analysis() matches the
+// script's default (per-field statistics and percentiles) and print_infer()
+// its --infer output; percentiles come from LatencyHistogram, so values of
+// 256us and above are approximate.
+class OsdLatencyReport {
+ public:
+  // Op kinds in the order the script prints them.
+  static constexpr const char *OP_TYPES[] = {"op_r", "op_w", "subop_r", "subop_w"};
+  static constexpr int NUM_OP_TYPES = 4;
+
+  // Stages whose share of the op latency --infer reports, in line order.
+  static constexpr const char *INFER_FIELDS[] = {
+      "throttle_lat", "recv_lat", "dispatch_lat",
+      "queue_lat", "osd_lat", "bluestore_lat"};
+  static constexpr int NUM_INFER_FIELDS = 6;
+
+  // Fields --analyze-field accepts: "lat", the printed *_lat stages and the
+  // BlueStore stages of the script's "(prepare ... kv_commit ...)" block.
+  static bool valid_field(const std::string &f) {
+    static const char *const fields[] = {
+        "lat", "throttle_lat", "recv_lat", "dispatch_lat", "queue_lat",
+        "osd_lat", "bluestore_lat", "prepare", "aio_wait", "aio_size",
+        "seq_wait", "kv_commit", "kv_batch", "kv_wal", "kv_sync", "kv_fsync",
+        "lock_wait"};
+    for (const char *name : fields)
+      if (f == name) return true;
+    return false;
+  }
+
+  static int op_index(const char *op) {
+    for (int i = 0; i < NUM_OP_TYPES; ++i)
+      if (strcmp(op, OP_TYPES[i]) == 0) return i;
+    return -1;
+  }
+
+  OsdLatencyReport(const std::string &field, uint64_t infer_threshold)
+      : field_(field), infer_threshold_(infer_threshold) {}
+
+  const std::string &field() const { return field_; }
+
+  // Sample of the analyzed field for one op.
+  void add_value(int osd, int op, uint64_t value) {
+    osds_[osd].hist[op].record(value);
+  }
+
+  // Stage latencies of one op for the --infer breakdown; `lat` is the op's
+  // end-to-end latency and `stages` follows INFER_FIELDS.
+  void add_stages(int osd, int op, uint64_t lat, const uint64_t *stages) {
+    if (lat == 0 || lat < infer_threshold_) return;
+    OsdStats &s = osds_[osd];
+    if (s.infer_count[op] == 0) s.infer_order.push_back(op);
+    ++s.infer_count[op];
+    for (int f = 0; f < NUM_INFER_FIELDS; ++f) {
+      double c = (double)stages[f] / (double)lat * 100;
+      if (c >= 100.0) c = 99.99;
+      s.infer_sum[op][f] += c;
+    }
+  }
+
+  bool empty() const { return osds_.empty(); }
+  void clear() { osds_.clear(); }
+
+  void print_analysis(OutputBuffer &out) const {
+    for (const auto &kv : osds_) {
+      bool any = false;
+      for (int op = 0; op < NUM_OP_TYPES; ++op)
+        any |= kv.second.hist[op].count() > 0;
+      if (!any) continue;
+      out.put("osd.").dec(kv.first).put(':').end_line();
+      for (int op = 0; op < NUM_OP_TYPES; ++op) {
+        const LatencyHistogram &h = kv.second.hist[op];
+        if (h.count() == 0) continue;
+        char line[256];
+        snprintf(line, sizeof(line),
+                 "  %s %s (μsec): min=%llu, max=%llu, avg=%.2f, "
+                 "stdev=%.2f, samples=%llu",
+                 OP_TYPES[op], field_.c_str(), (unsigned long long)h.min(),
+                 (unsigned long long)h.max(), h.mean(), h.stdev(),
+                 (unsigned long long)h.count());
+        out.put(line).end_line();
+        out.put("  ").put(field_).put(" percentiles (μsec):").end_line();
+        print_percentiles(out, h);
+        out.end_line();
+      }
+    }
+  }
+
+  void print_infer(OutputBuffer &out) const {
+    for (const auto &kv : osds_) {
+      const OsdStats &s = kv.second;
+      if (s.infer_order.empty()) continue;
+      out.put("osd.").dec(kv.first).put(':').end_line();
+      for (int op : s.infer_order) {
+        out.put("  ").put(OP_TYPES[op]).put(':').end_line();
+        std::vector<std::pair<double, int>> shares;
+        for (int f = 0; f < NUM_INFER_FIELDS; ++f)
+          shares.emplace_back(s.infer_sum[op][f] / s.infer_count[op], f);
+        // Descending by share; equal shares keep field order, as Python's
+        // stable sort does.
+        std::stable_sort(shares.begin(), shares.end(),
+                         [](const std::pair<double, int> &a,
+                            const std::pair<double, int> &b) {
+                           return a.first > b.first;
+                         });
+        char top[32];
+        int width = snprintf(top, sizeof(top), "%.2f", shares[0].first);
+        for (const auto &sh : shares) {
+          char line[96];
+          snprintf(line, sizeof(line), "    %*.2f%% from %s", width, sh.first,
+                   INFER_FIELDS[sh.second]);
+          out.put(line).end_line();
+        }
+      }
+      out.end_line();
+    }
+  }
+
+  // The script's fio-style block: three percentiles per line, values padded
+  // to the width of the largest one.
+  static void print_percentiles(OutputBuffer &out, const LatencyHistogram &h) {
+    static const double thresholds[] = {1, 5, 10, 20, 30, 40, 50, 60,
+                                        70, 80, 90, 95, 99, 99.5, 99.9};
+    const int n = sizeof(thresholds) / sizeof(thresholds[0]);
+    const int per_line = 3;
+    char buf[64];
+    int width = snprintf(buf, sizeof(buf), "%.2f",
+                         (double)h.percentile(thresholds[n - 1]));
+    for (int i = 0; i < n; i += per_line) {
+      out.put("  | ");
+      for (int j = i; j < i + per_line && j < n; ++j) {
+        snprintf(buf, sizeof(buf), " %5.2fth=[%*.2f]", thresholds[j], width,
+                 (double)h.percentile(thresholds[j]));
+        out.put(buf);
+        if (j < n - 1) out.put(',');
+      }
+      out.end_line();
+    }
+  }
+
+ private:
+  struct OsdStats {
+    LatencyHistogram hist[NUM_OP_TYPES];
+    uint64_t infer_count[NUM_OP_TYPES] = {};
+    long double infer_sum[NUM_OP_TYPES][NUM_INFER_FIELDS] = {};
+    std::vector<int> infer_order;  // op kinds by first appearance
+  };
+
+  std::string field_;
+  uint64_t infer_threshold_;
+  std::map<int, OsdStats> osds_;
+};
+
+// Where the time of slow ops goes, per OSD.
+//
+// Each op is split into stages that follow one another on its critical path,
+// so their latencies add up to (at most) the op latency.  Ops are grouped in
+// latency bands of a quarter octave; the stage shares "at p50" are those of
+// the ops in the band holding the median, and "at p99" those of the ops at
+// or above the band holding p99.  Shares therefore describe what the median
+// and the tail ops actually spent their time on, and add up to 100% with the
+// unattributed rest.  The bottleneck is the stage class with the largest p99
+// share.
+class StageAttribution {
+ public:
+  enum stage_e {
+    RECV,       // messenger receive, throttle included
+    DISPATCH,   // receive complete -> enqueued for the op queue
+    QUEUE,      // waiting in the op queue
+    OSD,        // PG processing up to queue_transaction (reads: up to the read)
+    PREPARE,    // BlueStore txc prepare, allocation included
+    AIO_WAIT,   // BlueStore data aio (reads: the whole object read)
+    PG_SEQ,     // waiting for earlier aios of the same PG
+    KV_COMMIT,  // RocksDB commit
+    PEER,       // primary write: waiting for the replicas after local commit
+    NUM_STAGES
+  };
+  static constexpr const char *STAGE_NAMES[] = {
+      "recv", "dispatch", "queue", "osd", "prepare",
+      "aio_wait", "pg_seq", "kv_commit", "peer"};
+
+  enum class_e { MESSENGER, QUEUEING, OSD_CPU, AIO, KV, REPLICATION, NUM_CLASSES };
+  static constexpr const char *CLASS_NAMES[] = {
+      "messenger", "queueing", "osd", "aio", "kv", "peer"};
+  static constexpr class_e STAGE_CLASS[] = {
+      MESSENGER, MESSENGER, QUEUEING, OSD_CPU, OSD_CPU,
+      AIO, AIO, KV, REPLICATION};
+
+  static constexpr int BANDS_PER_OCTAVE = 4;
+
+  // Stage shares of the ops at one percentile, in percent.
+  struct Shares {
+    uint64_t ops = 0;
+    uint64_t lat = 0;  // the percentile itself
+    double stage[NUM_STAGES] = {};
+    double cls[NUM_CLASSES] = {};
+    double other = 0;  // not covered by any stage
+    int bottleneck = -1;
+  };
+
+  // `stages` follows stage_e, in microseconds like `lat`.
+  void add(int osd, uint64_t lat, const uint64_t *stages) {
+    OsdStats &s = osds_[osd];
+    s.hist.record(lat);
+    size_t b = band_index(lat);
+    if (b >= s.bands.size()) s.bands.resize(b + 1);
+    Band &band = s.bands[b];
+    ++band.ops;
+    band.lat_sum += lat;
+    for (int i = 0; i < NUM_STAGES; ++i) band.stage_sum[i] += stages[i];
+  }
+
+  bool empty() const { return osds_.empty(); }
+  void clear() { osds_.clear(); }
+
+  // p50 looks at the median band only; any other p at the tail from its
+  // band up.  Returns false for an OSD without ops.
+  bool shares(int osd, double p, Shares &out) const {
+    auto it = osds_.find(osd);
+    if (it == osds_.end() || it->second.hist.count() == 0) return false;
+    const OsdStats &s = it->second;
+    out = Shares();
+    out.lat = s.hist.percentile(p);
+    size_t first = band_index(out.lat);
+    size_t last = p <= 50 ? first + 1 : s.bands.size();
+    long double lat_sum = 0, stage_sum[NUM_STAGES] = {};
+    for (size_t b = first; b < last && b < s.bands.size(); ++b) {
+      out.ops += s.bands[b].ops;
+      lat_sum += s.bands[b].lat_sum;
+      for (int i = 0; i < NUM_STAGES; ++i) stage_sum[i] += s.bands[b].stage_sum[i];
+    }
+    double covered = 0;
+    for (int i = 0; i < NUM_STAGES; ++i) {
+      out.stage[i] = lat_sum > 0 ? (double)(stage_sum[i] / lat_sum * 100) : 0;
+      out.cls[STAGE_CLASS[i]] += out.stage[i];
+      covered += out.stage[i];
+    }
+    out.other = covered < 100 ? 100 - covered : 0;
+    for (int c = 0; c < NUM_CLASSES; ++c)
+      if (out.cls[c] > 0 && (out.bottleneck < 0 || out.cls[c] > out.cls[out.bottleneck]))
+        out.bottleneck = c;
+    return true;
+  }
+
+  // One block per OSD, then the OSD with the worst p99 and its top stage:
+  //
+  //   osd.3: ops=5120 p50=820us p99=15320us bottleneck=kv (71.3%)
+  //     p50: queue 31.2%, osd 18.0%, kv_commit 15.1%, ..., other 2.0%
+  //     p99: kv_commit 61.2%, aio_wait 10.1%, queue 9.8%, ..., other 0.4%
+  //   slowest: osd.3 p99=15320us, kv_commit 61.2%
+  void print(OutputBuffer &out) const {
+    int slowest = -1;
+    Shares worst;
+    for (const auto &kv : osds_) {
+      Shares p50, p99;
+      if (!shares(kv.first, 50, p50) || !shares(kv.first, 99, p99)) continue;
+      out.put("osd.").dec(kv.first).put(": ops=").dec(kv.second.hist.count())
+         .put(" p50=").dec(p50.lat).put("us p99=").dec(p99.lat).put("us");
+      if (p99.bottleneck >= 0) {
+        char pct[32];
+        snprintf(pct, sizeof(pct), " (%.1f%%)", p99.cls[p99.bottleneck]);
+        out.put(" bottleneck=").put(CLASS_NAMES[p99.bottleneck]).put(pct);
+      }
+      out.end_line();
+      print_shares(out, "p50", p50);
+      print_shares(out, "p99", p99);
+      if (slowest < 0 || p99.lat > worst.lat) {
+        slowest = kv.first;
+        worst = p99;
+      }
+    }
+    if (slowest < 0) return;
+    int top = top_stage(worst);
+    out.put("slowest: osd.").dec(slowest).put(" p99=").dec(worst.lat).put("us");
+    if (top >= 0) {
+      char pct[32];
+      snprintf(pct, sizeof(pct), " %.1f%%", worst.stage[top]);
+      out.put(", ").put(STAGE_NAMES[top]).put(pct);
+    }
+    out.end_line();
+  }
+
+  static size_t band_index(uint64_t lat) {
+    if (lat < BANDS_PER_OCTAVE) return lat;
+    unsigned msb = 63 - __builtin_clzll(lat);
+    return BANDS_PER_OCTAVE * (msb - 1) + ((lat >> (msb - 2)) & 3);
+  }
+
+  static int top_stage(const Shares &s) {
+    int top = -1;
+    for (int i = 0; i < NUM_STAGES; ++i)
+      if (s.stage[i] > 0 && (top < 0 || s.stage[i] > s.stage[top])) top = i;
+    return top;
+  }
+
+ private:
+  struct Band {
+    uint64_t ops = 0;
+    long double lat_sum = 0;
+    long double stage_sum[NUM_STAGES] = {};
+  };
+
+  struct OsdStats {
+    LatencyHistogram hist;
+    std::vector<Band> bands;
+  };
+
+  // Stages by descending share, leaving out those that round to 0.0%.
+  static void print_shares(OutputBuffer &out, const char *label, const Shares &s) {
+    int order[NUM_STAGES];
+    for (int i = 0; i < NUM_STAGES; ++i) order[i] = i;
+    std::stable_sort(order, order + NUM_STAGES,
+                     [&s](int a, int b) { return s.stage[a] > s.stage[b]; });
+    out.put("  ").put(label).put(':');
+    char buf[48];
+    for (int i : order) {
+      if (s.stage[i] < 0.05) break;
+      snprintf(buf, sizeof(buf), " %s %.1f%%,", STAGE_NAMES[i], s.stage[i]);
+      out.put(buf);
+    }
+    snprintf(buf, sizeof(buf), " other %.1f%%", s.other);
+    out.put(buf).end_line();
+  }
+
+  std::map<int, OsdStats> osds_;
+};
+
+// Replication round trips of primary writes, one histogram per
+// (primary, peer) OSD pair.  print() lists the pairs with the worst p99 next
+// to the best p99 any primary sees for the same peer: a slow replica is slow
+// even from its best primary, a bad link only from one.
+class PeerLatencyMatrix {
+ public:
+  void add(int primary, int peer, uint64_t lat) {
+    pairs_[std::make_pair(primary, peer)].record(lat);
+  }
+
+  bool empty() const { return pairs_.empty(); }
+  void clear() { pairs_.clear(); }
+  size_t pairs() const { return pairs_.size(); }
+
+  //   primary  peer     samples   p50(us)   p99(us)   max(us)  peer best p99(us)
+  //   osd.3    osd.7       1234       410     18240     25110              17980
+  void print(OutputBuffer &out, size_t top) const {
+    std::map<int, uint64_t> best;
+    std::vector<std::pair<uint64_t, const Pair *>> order;
+    for (const Pair &p : pairs_) {
+      uint64_t p99 = p.second.percentile(99);
+      auto it = best.emplace(p.first.second, p99).first;
+      it->second = std::min(it->second, p99);
+      order.emplace_back(p99, &p);
+    }
+    std::stable_sort(order.begin(), order.end(),
+                     [](const std::pair<uint64_t, const Pair *> &a,
+                        const std::pair<uint64_t, const Pair *> &b) {
+                       return a.first > b.first;
+                     });
+    out.put("primary  peer     samples   p50(us)   p99(us)   max(us)  peer best p99(us)")
+       .end_line();
+    char line[160];
+    for (size_t i = 0; i < order.size() && i < top; ++i) {
+      const Pair &p = *order[i].second;
+      snprintf(line, sizeof(line), "osd.%-4d osd.%-4d %8llu %9llu %9llu %9llu %18llu",
+               p.first.first, p.first.second,
+               (unsigned long long)p.second.count(),
+               (unsigned long long)p.second.percentile(50),
+               (unsigned long long)order[i].first,
+               (unsigned long long)p.second.max(),
+               (unsigned long long)best[p.first.second]);
+      out.put(line).end_line();
+    }
+    if (order.size() > top)
+      out.put("(").dec(order.size() - top).put(" more pairs)").end_line();
+  }
+
+ private:
+  typedef std::map<std::pair<int, int>, LatencyHistogram>::value_type Pair;
+
+  std::map<std::pair<int, int>, LatencyHistogram> pairs_;
+};
+
+// Op scheduler samples (osdtrace --sched).  The BPF side counts, per
+// (OSD, shard, class), the items enqueued and not yet run, and keeps
+// cumulative enqueue, dequeue and wait totals.  sample() takes one reading
+// per interval; rows() turns the readings into the depth at the sample, its
+// peak during the interval and the deltas since the previous reading.
+class SchedSeries {
+ public:
+  struct Reading {
+    int64_t depth = 0;
+    uint64_t max_depth = 0;    // peak during the interval
+    uint64_t enqueued = 0;     // cumulative
+    uint64_t dequeued = 0;     // cumulative
+    uint64_t wait_sum_us = 0;  // cumulative
+    uint64_t wait_max_us = 0;  // during the interval
+  };
+
+  struct Row {
+    int osd;
+    unsigned shard;
+    std::string cls;
+    int64_t depth;
+    uint64_t max_depth;
+    uint64_t enqueued;
+    uint64_t dequeued;
+    uint64_t wait_avg_us;
+    uint64_t wait_max_us;
+  };
+
+  void sample(int osd, unsigned shard, const std::string &cls, const Reading &r) {
+    Series &s = series_[Key(osd, shard, cls)];
+    s.cur = r;
+    s.fresh = true;
+  }
+
+  // The rows of the keys sampled since the last call that had items queued
+  // or moving, ordered by OSD, shard and class.
+  std::vector<Row> rows() {
+    std::vector<Row> out;
+    for (auto &kv : series_) {
+      Series &s = kv.second;
+      if (!s.fresh) continue;
+      s.fresh = false;
+      Row r;
+      r.osd = std::get<0>(kv.first);
+      r.shard = std::get<1>(kv.first);
+      r.cls = std::get<2>(kv.first);
+      r.depth = s.cur.depth;
+      r.max_depth = s.cur.max_depth;
+      r.enqueued = s.cur.enqueued - s.prev.enqueued;
+      r.dequeued = s.cur.dequeued - s.prev.dequeued;
+      uint64_t wait = s.cur.wait_sum_us - s.prev.wait_sum_us;
+      r.wait_avg_us = r.dequeued ? wait / r.dequeued : 0;
+      r.wait_max_us = s.cur.wait_max_us;
+      s.prev = s.cur;
+      if (r.depth <= 0 && r.max_depth == 0 && r.enqueued == 0 && r.dequeued == 0)
+        continue;
+      out.push_back(r);
+    }
+    return out;
+  }
+
+  //   sched 14:02:10 osd 0 shard 3 class client depth 12 max_depth 40 enqueued 5130 dequeued 5120 wait_avg 310 wait_max 9800
+  static void print_row(OutputBuffer &out, const char *ts, const Row &r) {
+    out.put("sched ").put(ts).put(" osd ").dec(r.osd)
+       .put(" shard ").dec(r.shard).put(" class ").put(r.cls)
+       .put(" depth ").dec((long long)r.depth)
+       .put(" max_depth ").dec(r.max_depth)
+       .put(" enqueued ").dec(r.enqueued)
+       .put(" dequeued ").dec(r.dequeued)
+       .put(" wait_avg ").dec(r.wait_avg_us)
+       .put(" wait_max ").dec(r.wait_max_us).end_line();
+  }
+
+ private:
+  typedef std::tuple<int, unsigned, std::string> Key;
+  struct Series {
+    Reading prev, cur;
+    bool fresh = false;
+  };
+
+  std::map<Key, Series> series_;
+};
+
+// Client vs background load per OSD (osdtrace --background).  Ops are added
+// under their kind ("client" for every client op, else the recovery,
+// backfill or scrub message kind); print() turns one interval into a row per
+// (OSD, kind) with its op and byte rates and latency, then starts over.
+class BackgroundLoad {
+ public:
+  void add(int osd, const std::string &kind, uint64_t bytes, uint64_t lat) {
+    Load &l = loads_[std::make_pair(osd, kind)];
+    l.lat.record(lat);
+    l.bytes += bytes;
+  }
+
+  bool empty() const { return loads_.empty(); }
+  void clear() { loads_.clear(); }
+
+  //   bg 14:02:10 osd 0 kind client ops/s 4210.5 MB/s 16.4 avg_lat 850 p99 4100
+  //   bg 14:02:10 osd 0 kind push ops/s 31.2 MB/s 124.8 avg_lat 22000 p99 61000
+  void print(OutputBuffer &out, const char *ts, unsigned interval) {
+    char line[160];
+    double secs = interval ? interval : 1;
+    for (const auto &kv : loads_) {
+      const LatencyHistogram &h = kv.second.lat;
+      snprintf(line, sizeof(line), " ops/s %.1f MB/s %.1f avg_lat %llu p99 %llu",
+               h.count() / secs, kv.second.bytes / secs / 1000000.0,
+               (unsigned long long)h.mean(),
+               (unsigned long long)h.percentile(99));
+      out.put("bg ").put(ts).put(" osd ").dec(kv.first.first)
+         .put(" kind ").put(kv.first.second).put(line).end_line();
+    }
+    clear();
+  }
+
+ private:
+  struct Load {
+    LatencyHistogram lat;
+    uint64_t bytes = 0;
+  };
+
+  std::map<std::pair<int, std::string>, Load> loads_;
+};
+
+// PG lock waits and holds (osdtrace --pg-lock).  The BPF side keeps a
+// cumulative log2 histogram per (OSD, PG, wait or hold); sample() takes one
+// reading of each per interval and rows() returns the PGs that waited or
+// held during it, most wait time first.  Percentiles are the upper bound of
+// their log2 slot.
+class PgLockReport {
+ public:
+  static constexpr int SLOTS = 32;
+
+  struct Reading {
+    uint64_t count = 0;
+    uint64_t sum_us = 0;
+    uint64_t slots[SLOTS] = {};
+  };
+
+  struct Row {
+    int osd;
+    uint64_t pool;
+    uint32_t seed;
+    uint64_t waits;
+    uint64_t wait_total_us;
+    uint64_t wait_avg_us;
+    uint64_t wait_p99_us;
+    uint64_t holds;
+    uint64_t hold_avg_us;
+    uint64_t hold_p99_us;
+  };
+
+  void sample(int osd, uint64_t pool, uint32_t seed, bool hold, const Reading &r) {
+    Series &s = series_[Key(osd, pool, seed)];
+    (hold ? s.hold : s.wait).cur = r;
+  }
+
+  std::vector<Row> rows() {
+    std::vector<Row> out;
+    for (auto &kv : series_) {
+      Reading wait = kv.second.wait.delta();
+      Reading hold = kv.second.hold.delta();
+      if (wait.count == 0 && hold.count == 0) continue;
+      Row r;
+      r.osd = std::get<0>(kv.first);
+      r.pool = std::get<1>(kv.first);
+      r.seed = std::get<2>(kv.first);
+      r.waits = wait.count;
+      r.wait_total_us = wait.sum_us;
+      r.wait_avg_us = wait.count ? wait.sum_us / wait.count : 0;
+      r.wait_p99_us = percentile(wait, 99);
+      r.holds = hold.count;
+      r.hold_avg_us = hold.count ? hold.sum_us / hold.count : 0;
+      r.hold_p99_us = percentile(hold, 99);
+      out.push_back(r);
+    }
+    std::stable_sort(out.begin(), out.end(), [](const Row &a, const Row &b) {
+      return a.wait_total_us > b.wait_total_us;
+    });
+    return out;
+  }
+
+  static uint64_t percentile(const Reading &r, double p) {
+    return hist_percentile(r.slots, SLOTS, r.count, p);
+  }
+
+  //   pglock 14:02:10 osd 0 pg 2.1a waits 812 wait_total 28420 wait_avg 35 wait_p99 1023 holds 815 hold_avg 120 hold_p99 511
+  static void print_row(OutputBuffer &out, const char *ts, const Row &r) {
+    out.put("pglock ").put(ts).put(" osd ").dec(r.osd)
+       .put(" pg ").dec(r.pool).put('.').hex(r.seed)
+       .put(" waits ").dec(r.waits)
+       .put(" wait_total ").dec(r.wait_total_us)
+       .put(" wait_avg ").dec(r.wait_avg_us)
+       .put(" wait_p99 ").dec(r.wait_p99_us)
+       .put(" holds ").dec(r.holds)
+       .put(" hold_avg ").dec(r.hold_avg_us)
+       .put(" hold_p99 ").dec(r.hold_p99_us).end_line();
+  }
+
+ private:
+  typedef std::tuple<int, uint64_t, uint32_t> Key;
+  struct Counter {
+    Reading prev, cur;
+    Reading delta() {
+      Reading d;
+      d.count = cur.count - prev.count;
+      d.sum_us = cur.sum_us - prev.sum_us;
+      for (int i = 0; i < SLOTS; ++i) d.slots[i] = cur.slots[i] - prev.slots[i];
+      prev = cur;
+      return d;
+    }
+  };
+  struct Series {
+    Counter wait, hold;
+  };
+
+  std::map<Key, Series> series_;
+};
+
+// Async messenger traffic (osdtrace --msgr).  The BPF side keeps cumulative
+// counters per connection; sample() takes one reading of each per interval
+// and print() sums the deltas of the connections to the same peer entity,
+// then lists the peers with the most bandwidth and with the most send stall.
+class MsgrReport {
+ public:
+  struct Reading {
+    uint64_t bytes_in = 0;
+    uint64_t bytes_out = 0;
+    uint64_t msgs_in = 0;
+    uint64_t msgs_out = 0;
+    uint64_t stalls = 0;
+    uint64_t stall_us = 0;  // including a stall still in progress
+  };
+
+  void sample(int osd, uint64_t conn, const std::string &peer, const Reading &r) {
+    Conn &c = conns_[std::make_pair(osd, conn)];
+    // a new connection at the address of one closed since the last interval
+    if (r.bytes_in < c.prev.bytes_in || r.bytes_out < c.prev.bytes_out ||
+        r.msgs_in < c.prev.msgs_in || r.msgs_out < c.prev.msgs_out ||
+        r.stalls < c.prev.stalls || r.stall_us < c.prev.stall_us)
+      c.prev = Reading();
+    c.peer = peer;
+    c.cur = r;
+    c.fresh = true;
+  }
+
+  //   === 14:02:10 messenger, last 5s ===
+  //   top peers by bandwidth:
+  //   osd     peer                 in(MB/s)  out(MB/s)  msgs in/s  msgs out/s  stalls  stall(ms)
+  //   osd.0   client.4567             120.4        0.3     3010.0      3010.0       0        0.0
+  //   top peers by send stall:
+  //   osd.0   osd.3                     2.1       88.0      210.0       212.0      41     2210.5
+  void print(OutputBuffer &out, const char *ts, unsigned interval, size_t top) {
+    std::map<std::pair<int, std::string>, Reading> peers;
+    for (auto it = conns_.begin(); it != conns_.end();) {
+      Conn &c = it->second;
+      if (!c.fresh) {  // gone from the BPF map: the connection was closed
+        it = conns_.erase(it);
+        continue;
+      }
+      c.fresh = false;
+      Reading &p = peers[std::make_pair(it->first.first, c.peer)];
+      p.bytes_in += c.cur.bytes_in - c.prev.bytes_in;
+      p.bytes_out += c.cur.bytes_out - c.prev.bytes_out;
+      p.msgs_in += c.cur.msgs_in - c.prev.msgs_in;
+      p.msgs_out += c.cur.msgs_out - c.prev.msgs_out;
+      p.stalls += c.cur.stalls - c.prev.stalls;
+      p.stall_us += c.cur.stall_us - c.prev.stall_us;
+      c.prev = c.cur;
+      ++it;
+    }
+
+    std::vector<const Peer *> by_bytes, by_stall;
+    for (const Peer &p : peers) {
+      if (p.second.bytes_in + p.second.bytes_out > 0) by_bytes.push_back(&p);
+      if (p.second.stall_us > 0) by_stall.push_back(&p);
+    }
+    std::stable_sort(by_bytes.begin(), by_bytes.end(), [](const Peer *a, const Peer *b) {
+      return a->second.bytes_in + a->second.bytes_out >
+             b->second.bytes_in + b->second.bytes_out;
+    });
+    std::stable_sort(by_stall.begin(), by_stall.end(), [](const Peer *a, const Peer *b) {
+      return a->second.stall_us > b->second.stall_us;
+    });
+
+    double secs = interval ? interval : 1;
+    out.put("=== ").put(ts).put(" messenger, last ").dec(interval).put("s ===").end_line();
+    out.put("top peers by bandwidth:").end_line();
+    print_peers(out, by_bytes, secs, top);
+    out.put("top peers by send stall:").end_line();
+    print_peers(out, by_stall, secs, top);
+  }
+
+ private:
+  struct Conn {
+    std::string peer;
+    Reading prev, cur;
+    bool fresh = false;
+  };
+  typedef std::map<std::pair<int, std::string>, Reading>::value_type Peer;
+
+  static void print_peers(OutputBuffer &out, const std::vector<const Peer *> &peers,
+                          double secs, size_t top) {
+    if (peers.empty()) {
+      out.put("none").end_line();
+      return;
+    }
+    out.put("osd     peer                 in(MB/s)  out(MB/s)  msgs in/s  msgs out/s  stalls  stall(ms)")
+       .end_line();
+    char line[160];
+    for (size_t i = 0; i < peers.size() && i < top; ++i) {
+      const Reading &r = peers[i]->second;
+      snprintf(line, sizeof(line), "osd.%-4d %-18s %10.1f %10.1f %10.1f %11.1f %7llu %10.1f",
+               peers[i]->first.first, peers[i]->first.second.c_str(),
+               r.bytes_in / secs / 1000000.0, r.bytes_out / secs / 1000000.0,
+               r.msgs_in / secs, r.msgs_out / secs,
+               (unsigned long long)r.stalls, r.stall_us / 1000.0);
+      out.put(line).end_line();
+    }
+    if (peers.size() > top)
+      out.put("(").dec(peers.size() - top).put(" more peers)").end_line();
+  }
+
+  std::map<std::pair<int, uint64_t>, Conn> conns_;
+};
+
+// Erasure-coded writes per primary OSD (osdtrace --ec): the encode time,
+// the time until the last shard committed, how long the write waited on
+// that last shard alone, and which OSD was most often the last.
+class EcReport {
+ public:
+  void add(int osd, uint64_t encode, uint64_t commit, uint64_t shard_wait,
+           int slowest_osd) {
+    Osd &o = osds_[osd];
+    o.encode.record(encode);
+    o.commit.record(commit);
+    o.shard_wait.record(shard_wait);
+    if (slowest_osd >= 0) ++o.slowest[slowest_osd];
+  }
+
+  bool empty() const { return osds_.empty(); }
+  void clear() { osds_.clear(); }
+
+  //   ec 14:02:10 osd 0 writes 812 encode p50 95 p99 240 commit p50 1210 p99 8410 shard_wait p99 6900 slowest osd.7 61%
+  void print(OutputBuffer &out, const char *ts) const {
+    for (const auto &kv : osds_) {
+      const Osd &o = kv.second;
+      out.put("ec ").put(ts).put(" osd ").dec(kv.first)
+         .put(" writes ").dec(o.commit.count())
+         .put(" encode p50 ").dec(o.encode.percentile(50))
+         .put(" p99 ").dec(o.encode.percentile(99))
+         .put(" commit p50 ").dec(o.commit.percentile(50))
+         .put(" p99 ").dec(o.commit.percentile(99))
+         .put(" shard_wait p99 ").dec(o.shard_wait.percentile(99));
+      int worst = -1;
+      uint64_t times = 0;
+      for (const auto &s : o.slowest)
+        if (s.second > times) {
+          worst = s.first;
+          times = s.second;
+        }
+      if (worst >= 0)
+        out.put(" slowest osd.").dec(worst).put(' ')
+           .dec(times * 100 / o.commit.count()).put('%');
+      out.end_line();
+    }
+  }
+
+ private:
+  struct Osd {
+    LatencyHistogram encode, commit, shard_wait;
+    std::map<int, uint64_t> slowest;
+  };
+
+  std::map<int, Osd> osds_;
+};
+
+// Block requests per OSD device (osdtrace --blk): the io scheduler queue
+// time and device service time, from the cumulative log2(us) histograms the
+// BPF program keeps, reported as the change over each interval.
+class BlkReport {
+ public:
+  static constexpr int SLOTS = 32;
+
+  struct Reading {
+    uint64_t count = 0;
+    uint64_t bytes = 0;
+    uint64_t queue_sum_us = 0;
+    uint64_t device_sum_us = 0;
+    uint64_t queue_slots[SLOTS] = {};
+    uint64_t device_slots[SLOTS] = {};
+  };
+
+  void sample(const std::string &dev, const Reading &r) { devs_[dev].cur = r; }
+
+  //   blk 14:02:10 dev nvme0n1 ios/s 5120.0 MB/s 80.0 queue avg 3 p99 15 device avg 88 p99 255
+  //   blk 14:02:10 dev nvme0n1 queue_us 0-1:5000 2-3:120
+  //   blk 14:02:10 dev nvme0n1 device_us 32-63:812 64-127:4105 128-255:203
+  void print(OutputBuffer &out, const char *ts, unsigned interval) {
+    double secs = interval ? interval : 1;
+    char rate[64];
+    for (auto &kv : devs_) {
+      Reading d = kv.second.delta();
+      if (d.count == 0) continue;
+      snprintf(rate, sizeof(rate), " ios/s %.1f MB/s %.1f", d.count / secs,
+               d.bytes / secs / 1000000.0);
+      out.put("blk ").put(ts).put(" dev ").put(kv.first).put(rate)
+         .put(" queue avg ").dec(d.queue_sum_us / d.count)
+         .put(" p99 ").dec(hist_percentile(d.queue_slots, SLOTS, d.count, 99))
+         .put(" device avg ").dec(d.device_sum_us / d.count)
+         .put(" p99 ").dec(hist_percentile(d.device_slots, SLOTS, d.count, 99)).end_line();
+      print_hist(out, ts, kv.first, "queue_us", d.queue_slots);
+      print_hist(out, ts, kv.first, "device_us", d.device_slots);
+    }
+  }
+
+ private:
+  struct Counter {
+    Reading prev, cur;
+    Reading delta() {
+      Reading d;
+      d.count = cur.count - prev.count;
+      d.bytes = cur.bytes - prev.bytes;
+      d.queue_sum_us = cur.queue_sum_us - prev.queue_sum_us;
+      d.device_sum_us = cur.device_sum_us - prev.device_sum_us;
+      for (int i = 0; i < SLOTS; ++i) {
+        d.queue_slots[i] = cur.queue_slots[i] - prev.queue_slots[i];
+        d.device_slots[i] = cur.device_slots[i] - prev.device_slots[i];
+      }
+      prev = cur;
+      return d;
+    }
+  };
+
+  // The non-empty slots, as "<low>-<high>:<count>" in us.
+  static void print_hist(OutputBuffer &out, const char *ts, const std::string &dev,
+                         const char *name, const uint64_t *slots) {
+    out.put("blk ").put(ts).put(" dev ").put(dev).put(' ').put(name);
+    for (int i = 0; i < SLOTS; ++i) {
+      if (slots[i] == 0) continue;
+      out.put(' ').dec(i ? 1ull << i : 0).put('-').dec((2ull << i) - 1)
+         .put(':').dec(slots[i]);
+    }
+    out.end_line();
+  }
+
+  std::map<std::string, Counter> devs_;
+};
+
+// CPU use per op, per OSD and op type (osdtrace --cpu): the cycles and
+// instructions of the worker thread in the osd and bluestore stages, or its
+// task clock (ns) where hardware counters are unavailable.
+class CpuReport {
+ public:
+  explicit CpuReport(bool task_clock) : task_clock_(task_clock) {}
+
+  void add(int osd, const std::string &kind, uint64_t osd_cycles,
+           uint64_t osd_instructions, uint64_t bs_cycles,
+           uint64_t bs_instructions) {
+    Sums &s = sums_[std::make_pair(osd, kind)];
+    ++s.ops;
+    s.osd_cycles += osd_cycles;
+    s.osd_instructions += osd_instructions;
+    s.bs_cycles += bs_cycles;
+    s.bs_instructions += bs_instructions;
+  }
+
+  bool empty() const { return sums_.empty(); }
+  void clear() { sums_.clear(); }
+
+  //   cpu 14:02:10 osd 0 op_w ops 812 osd kcycles/op 152.3 ipc 1.21 bluestore kcycles/op 80.2 ipc 0.95
+  //   cpu 14:02:10 osd 0 op_w ops 812 osd cpu_us/op 48.1 bluestore cpu_us/op 25.3
+  void print(OutputBuffer &out, const char *ts) const {
+    char line[160];
+    for (const auto &kv : sums_) {
+      const Sums &s = kv.second;
+      out.put("cpu ").put(ts).put(" osd ").dec(kv.first.first)
+         .put(' ').put(kv.first.second).put(" ops ").dec(s.ops);
+      if (task_clock_)
+        snprintf(line, sizeof(line), " osd cpu_us/op %.1f bluestore cpu_us/op %.1f",
+                 s.osd_cycles / 1000.0 / s.ops, s.bs_cycles / 1000.0 / s.ops);
+      else
+        snprintf(line, sizeof(line),
+                 " osd kcycles/op %.1f ipc %.2f bluestore kcycles/op %.1f ipc %.2f",
+                 s.osd_cycles / 1000.0 / s.ops, ipc(s.osd_instructions, s.osd_cycles),
+                 s.bs_cycles / 1000.0 / s.ops, ipc(s.bs_instructions, s.bs_cycles));
+      out.put(line).end_line();
+    }
+  }
+
+ private:
+  struct Sums {
+    uint64_t ops = 0;
+    uint64_t osd_cycles = 0;
+    uint64_t osd_instructions = 0;
+    uint64_t bs_cycles = 0;
+    uint64_t bs_instructions = 0;
+  };
+
+  static double ipc(uint64_t instructions, uint64_t cycles) {
+    return cycles ? (double)instructions / cycles : 0;
+  }
+
+  bool task_clock_;
+  std::map<std::pair<int, std::string>, Sums> sums_;
+};
+
+#endif  // LATENCY_STATS_H
@@ -9,6 +9,7 @@
 
 #include "bpf_ceph_types.h"
 #include "bpf_utils.h"
+#include "bpf_hist.h"
 // Reminding:  Use "swtich" statement in the bpf program might cause issues
 
 // TODO: performance improvement: We can avoid fetching the common sturct multiple times for different var
@@ -22,6 +23,16 @@ struct {
   __uint(max_entries, 8192);
 } ops SEC(".maps");
 
+// The --ec/--offcpu/--blk/--cpu data of the ops in `ops`, filled only while
+// one of those modes is on; not preallocated, so it costs nothing otherwise.
+struct {
+  __uint(type, BPF_MAP_TYPE_HASH);
+  __type(key, struct op_k);
+  __type(value, struct op_ext);
+  __uint(max_entries, 8192);
+  __uint(map_flags, BPF_F_NO_PREALLOC);
+} op_exts SEC(".maps");
+
 struct {
   __uint(type, BPF_MAP_TYPE_HASH);
   __type(key, __u64);
@@ -48,8 +59,186 @@ struct {
   __uint(max_entries, 8192);
 } hprobes SEC(".maps");
 
+// --kv: per kv_sync_thread batch state, and the sync timing of each batch,
+// which every txc of the batch copies when it reaches STATE_KV_SUBMITTED.
+struct {
+  __uint(type, BPF_MAP_TYPE_HASH);
+  __type(key, __u64);
+  __type(value, struct kv_thread_v);
+  __uint(max_entries, 128);
+} kv_threads SEC(".maps");
+
+struct {
+  __uint(type, BPF_MAP_TYPE_LRU_HASH);
+  __type(key, struct kv_batch_k);
+  __type(value, struct kv_batch_v);
+  __uint(max_entries, 1024);
+} kv_batches SEC(".maps");
+
+// --sched: items waiting in the op scheduler, the class learnt for each
+// OpQueueable vtable, and the counters userspace samples.  sched_epoch[0] is
+// bumped by userspace at every sample and restarts the maxima.
+struct {
+  __uint(type, BPF_MAP_TYPE_LRU_HASH);
+  __type(key, struct sched_item_k);
+  __type(value, struct sched_item_v);
+  __uint(max_entries, 65536);
+} sched_items SEC(".maps");
+
+struct {
+  __uint(type, BPF_MAP_TYPE_LRU_HASH);
+  __type(key, struct sched_vtable_k);
+  __type(value, __u32);
+  __uint(max_entries, 1024);
+} sched_classes SEC(".maps");
+
+struct {
+  __uint(type, BPF_MAP_TYPE_HASH);
+  __type(key, struct sched_k);
+  __type(value, struct sched_v);
+  __uint(max_entries, 4096);
+} sched_stats SEC(".maps");
+
+struct {
+  __uint(type, BPF_MAP_TYPE_ARRAY);
+  __type(key, __u32);
+  __type(value, __u64);
+  __uint(max_entries, 1);
+} sched_epoch SEC(".maps");
+
+// --pg-lock: the state of each (thread, PG) lock, the PG each thread is
+// waiting to lock, and the wait and hold histograms.  The histograms are
+// per-CPU, so the probes update them without atomics; userspace sums the
+// CPUs.
+struct {
+  __uint(type, BPF_MAP_TYPE_LRU_HASH);
+  __type(key, struct pglock_thread_k);
+  __type(value, struct pglock_thread_v);
+  __uint(max_entries, 8192);
+} pglock_threads SEC(".maps");
+
+struct {
+  __uint(type, BPF_MAP_TYPE_HASH);
+  __type(key, __u64);
+  __type(value, __u64);
+  __uint(max_entries, 4096);
+} pglock_pending SEC(".maps");
+
+struct {
+  __uint(type, BPF_MAP_TYPE_PERCPU_HASH);
+  __uint(map_flags, BPF_F_NO_PREALLOC);
+  __type(key, struct pglock_k);
+  __type(value, struct pglock_hist);
+  __uint(max_entries, 16384);
+} pglock_hists SEC(".maps");
+
+// --msgr: the counters of each connection, and the read_bulk or _try_send
+// each thread is in.
+struct {
+  __uint(type, BPF_MAP_TYPE_LRU_HASH);
+  __type(key, struct msgr_conn_k);
+  __type(value, struct msgr_conn_v);
+  __uint(max_entries, 16384);
+} msgr_conns SEC(".maps");
+
+struct {
+  __uint(type, BPF_MAP_TYPE_HASH);
+  __type(key, __u64);
+  __type(value, struct msgr_call_v);
+  __uint(max_entries, 4096);
+} msgr_calls SEC(".maps");
+
+// --ec: the op of each ECBackend write tid, and the encode stamps of the
+// thread that is building a write's shard transactions.
+struct {
+  __uint(type, BPF_MAP_TYPE_LRU_HASH);
+  __type(key, struct ec_tid_k);
+  __type(value, struct op_k);
+  __uint(max_entries, 65536);
+} ec_tids SEC(".maps");
+
+struct {
+  __uint(type, BPF_MAP_TYPE_LRU_HASH);
+  __type(key, __u64);
+  __type(value, struct ec_thread_v);
+  __uint(max_entries, 4096);
+} ec_threads SEC(".maps");
+
+// --offcpu: the op each thread inside dequeue_op is running, keyed by the
+// kernel's thread id as sched_switch reports it, and the stacks it blocked in.
+// Only dequeue_op of the traced OSDs adds threads, so the sched_switch
+// program ignores every other task after one lookup.
+struct {
+  __uint(type, BPF_MAP_TYPE_HASH);
+  __type(key, __u32);
+  __type(value, struct offcpu_thread_v);
+  __uint(max_entries, 4096);
+} offcpu_threads SEC(".maps");
+
+struct {
+  __uint(type, BPF_MAP_TYPE_STACK_TRACE);
+  __uint(key_size, sizeof(__u32));
+  __uint(value_size, OFFCPU_STACK_DEPTH * sizeof(__u64));
+  __uint(max_entries, 16384);
+} offcpu_stacks SEC(".maps");
+
+// --blk: the OSDs' devices (filled by userspace), the op whose aio each
+// thread inside dequeue_op is submitting, the requests in flight and a
+// queue and service time histogram per device.
+struct {
+  __uint(type, BPF_MAP_TYPE_HASH);
+  __type(key, __u32);
+  __type(value, __u8);
+  __uint(max_entries, 256);
+} blk_devs SEC(".maps");
+
+struct {
+  __uint(type, BPF_MAP_TYPE_HASH);
+  __type(key, __u32);
+  __type(value, struct op_k);
+  __uint(max_entries, 4096);
+} blk_threads SEC(".maps");
+
+struct {
+  __uint(type, BPF_MAP_TYPE_LRU_HASH);
+  __type(key, struct blk_rq_k);
+  __type(value, struct blk_rq_v);
+  __uint(max_entries, 65536);
+} blk_rqs SEC(".maps");
+
+struct {
+  __uint(type, BPF_MAP_TYPE_PERCPU_HASH);
+  __type(key, __u32);
+  __type(value, struct blk_hist);
+  __uint(max_entries, 256);
+} blk_hists SEC(".maps");
+
+// --cpu: a cycles and an instructions counter per OSD worker thread, opened
+// by userspace for that thread only, and the threads' slots in the arrays.
+struct {
+  __uint(type, BPF_MAP_TYPE_PERF_EVENT_ARRAY);
+  __uint(key_size, sizeof(__u32));
+  __uint(value_size, sizeof(__u32));
+  __uint(max_entries, CPU_MAX_THREADS);
+} cpu_cycles SEC(".maps");
+
+struct {
+  __uint(type, BPF_MAP_TYPE_PERF_EVENT_ARRAY);
+  __uint(key_size, sizeof(__u32));
+  __uint(value_size, sizeof(__u32));
+  __uint(max_entries, CPU_MAX_THREADS);
+} cpu_instructions SEC(".maps");
+
+struct {
+  __uint(type, BPF_MAP_TYPE_HASH);
+  __type(key, __u32);
+  __type(value, __u32);
+  __uint(max_entries, CPU_MAX_THREADS);
+} cpu_threads SEC(".maps");
+
 // struct op_v no longer fits on the BPF stack after adding object_name.
 static struct op_v zero_op_v = {};
+static struct op_ext zero_op_ext = {};
 
 static __always_inline int read_hprobe_varfield(struct pt_regs *ctx, int varid, void *dst, size_t size) {
   struct VarField *vf = bpf_map_lookup_elem(&hprobes, &varid);
@@ -78,12 +267,34 @@ static __always_inline int read_hprobe_utime(struct pt_regs *ctx, int varid, __u
   return -1;
 }
 
+// The address of the member a hprobe var path names, instead of its value.
+static __always_inline int read_hprobe_addr(struct pt_regs *ctx, int varid, __u64 *addr_dst) {
+  struct VarField *vf = bpf_map_lookup_elem(&hprobes, &varid);
+  if (NULL != vf) {
+    __u64 v = fetch_register(ctx, vf->varloc.reg);
+    *addr_dst = fetch_var_member_addr(v, vf);
+    return 0;
+  }
+  bpf_printk("got NULL vf at varid %d\n", varid);
+  return -1;
+}
+
 // Set by userspace before BPF load. OSDOp changed size in Squid when
 // buffer::list became smaller; ceph_osd_op remains the first member.
 const volatile __u32 CEPH_OSD_OP_SIZE = 0;
 const volatile __u32 CEPH_OSD_OP_BUFFER_CARRIAGE_OFFSET = 0;
 const volatile __u32 CEPH_OSD_OP_CLS_CLASS_OFFSET = 0;
 const volatile __u32 CEPH_OSD_OP_CLS_METHOD_OFFSET = 0;
+// --background: also track recovery, backfill and scrub messages
+const volatile bool trace_background = false;
+// --ec: keep erasure-coded writes and follow their sub-writes
+const volatile bool trace_ec = false;
+// --offcpu: account the off-CPU time of the threads running ops
+const volatile bool trace_offcpu = false;
+// --blk: charge the block requests of a txc's aio to its op
+const volatile bool trace_blk = false;
+// --cpu: read the worker thread's cycles and instructions at the op stamps
+const volatile bool trace_cpu = false;
 
 static __always_inline void capture_decoded_osd_ops(
     struct op_v *vp, __u64 ops_start, __u64 ops_finish)
@@ -135,6 +346,61 @@ static __always_inline void capture_decoded_osd_ops(
   }
 }
 
+static __always_inline bool op_ext_on(void)
+{
+  return trace_ec || trace_offcpu || trace_blk || trace_cpu;
+}
+
+static __always_inline void forget_op(struct op_k *key)
+{
+  bpf_map_delete_elem(&ops, key);
+  if (op_ext_on())
+    bpf_map_delete_elem(&op_exts, key);
+}
+
+// --cpu: read the current thread's counters into the cpu_reading at offset
+// `at` of the op's cpu_info, but only on the thread that dequeued the op, so
+// that the stages of one op compare like with like.  Per-thread events keep
+// counting the thread wherever it migrates and stop while it is switched out.
+static __always_inline void cpu_read(struct op_k *key, __u32 at)
+{
+  if (!trace_cpu) return;
+  struct op_ext *xp = bpf_map_lookup_elem(&op_exts, key);
+  if (NULL == xp) return;
+  __u32 tid = (__u32)bpf_get_current_pid_tgid();
+  if (tid != xp->cpu.tid) return;
+  __u32 *idx = bpf_map_lookup_elem(&cpu_threads, &tid);
+  if (NULL == idx) return;
+  struct cpu_reading *r = (struct cpu_reading *)((char *)&xp->cpu + at);
+  struct bpf_perf_event_value v = {};
+  __u64 flags = *idx & BPF_F_INDEX_MASK;
+  if (bpf_perf_event_read_value(&cpu_cycles, flags, &v, sizeof(v)) == 0)
+    r->cycles = v.counter;
+  if (bpf_perf_event_read_value(&cpu_instructions, flags, &v, sizeof(v)) == 0)
+    r->instructions = v.counter;
+}
+
+// Report a finished op and stop tracking it.  The op_ext follows the op in
+// the record only while a mode that fills it is on.
+static __always_inline void submit_op(struct op_k *key, struct op_v *vp) {
+  if (op_ext_on()) {
+    struct op_ext_v *e = bpf_ringbuf_reserve(&rb, sizeof(struct op_ext_v), 0);
+    if (NULL != e) {
+      struct op_ext *xp = bpf_map_lookup_elem(&op_exts, key);
+      e->op = *vp;
+      e->ext = NULL != xp ? *xp : zero_op_ext;
+      bpf_ringbuf_submit(e, 0);
+    }
+  } else {
+    struct op_v *e = bpf_ringbuf_reserve(&rb, sizeof(struct op_v), 0);
+    if (NULL != e) {
+      *e = *vp;
+      bpf_ringbuf_submit(e, 0);
+    }
+  }
+  forget_op(key);
+}
+
 SEC("uprobe")
 int uprobe_enqueue_op(struct pt_regs *ctx) {
   int varid = 0;
@@ -142,17 +408,26 @@ int uprobe_enqueue_op(struct pt_regs *ctx) {
   memset(&key, 0, sizeof(key));
 
   __u16 op_type = 0;
-  read_hprobe_varfield(ctx, varid++, &op_type, sizeof(op_type));
-  if (op_type != MSG_OSD_OP && op_type != MSG_OSD_REPOP) {
+  read_hprobe_varfield(ctx, varid + ENQ_VAR_TYPE, &op_type, sizeof(op_type));
+  bool background = trace_background && ceph_background_msg(op_type);
+  if (op_type != MSG_OSD_OP && op_type != MSG_OSD_REPOP && !background) {
     bpf_printk("uprobe_enqueue_op got a non osdop/osdrepop %d, ignore\n", op_type);
     return 0;
   }
 
-  if (read_hprobe_varfield(ctx, varid++, &key.owner, sizeof(key.owner)) != 0)
-    return 0;
+  if (background) {
+    __u64 src = 0;
+    if (read_hprobe_varfield(ctx, varid + ENQ_VAR_SEQ, &key.tid, sizeof(key.tid)) != 0 ||
+        read_hprobe_varfield(ctx, varid + ENQ_VAR_SRC, &src, sizeof(src)) != 0)
+      return 0;
+    key.owner = OSDTRACE_BACKGROUND_OWNER | src;
+  } else {
+    if (read_hprobe_varfield(ctx, varid + ENQ_VAR_OWNER, &key.owner, sizeof(key.owner)) != 0)
+      return 0;
 
-  if (read_hprobe_varfield(ctx, varid++, &key.tid, sizeof(key.tid)) != 0)
-    return 0;
+    if (read_hprobe_varfield(ctx, varid + ENQ_VAR_TID, &key.tid, sizeof(key.tid)) != 0)
+      return 0;
+  }
 
   key.pid = get_pid();
 
@@ -197,6 +472,8 @@ int uprobe_enqueue_op(struct pt_regs *ctx) {
   struct op_v *value = bpf_map_lookup_elem(&ops, &key);
   if (value == NULL)
     return 0;
+  if (op_ext_on())
+    bpf_map_update_elem(&op_exts, &key, &zero_op_ext, 0);
 
   value->enqueue_stamp = bpf_ktime_get_boot_ns();
   value->pid = key.pid;
@@ -205,12 +482,17 @@ int uprobe_enqueue_op(struct pt_regs *ctx) {
   value->op_type = op_type;
   value->pi.peer1 = -1;
   value->pi.peer2 = -1;
+  if (background) {
+    __u32 front_len = 0;
+    read_hprobe_varfield(ctx, varid + ENQ_VAR_FRONT_LEN, &front_len, sizeof(front_len));
+    value->wb = front_len;
+  }
 
-  if (read_hprobe_utime(ctx, varid++, &value->recv_stamp) != 0 ||
-      read_hprobe_utime(ctx, varid++, &value->throttle_stamp) != 0 ||
-      read_hprobe_utime(ctx, varid++, &value->recv_complete_stamp) != 0 ||
-      read_hprobe_utime(ctx, varid++, &value->dispatch_stamp) != 0) {
-    bpf_map_delete_elem(&ops, &key);
+  if (read_hprobe_utime(ctx, varid + ENQ_VAR_RECV_STAMP, &value->recv_stamp) != 0 ||
+      read_hprobe_utime(ctx, varid + ENQ_VAR_THROTTLE_STAMP, &value->throttle_stamp) != 0 ||
+      read_hprobe_utime(ctx, varid + ENQ_VAR_RECV_COMPLETE_STAMP, &value->recv_complete_stamp) != 0 ||
+      read_hprobe_utime(ctx, varid + ENQ_VAR_DISPATCH_STAMP, &value->dispatch_stamp) != 0) {
+    forget_op(&key);
   }
   return 0;
 }
@@ -224,15 +506,24 @@ int uprobe_dequeue_op(struct pt_regs *ctx) {
   int varid = 10;
 
   __u16 op_type = 0;
-  read_hprobe_varfield(ctx, varid++, &op_type, sizeof(op_type));
-  if (op_type != MSG_OSD_OP && op_type != MSG_OSD_REPOP) {
+  read_hprobe_varfield(ctx, varid + DEQ_VAR_TYPE, &op_type, sizeof(op_type));
+  bool background = trace_background && ceph_background_msg(op_type);
+  if (op_type != MSG_OSD_OP && op_type != MSG_OSD_REPOP && !background) {
     bpf_printk("uprobe_dequeue_op got non osdop or repop type %d, ignore\n", op_type);
     return 0;
   }
 
-  read_hprobe_varfield(ctx, varid++, &key.owner, sizeof(key.owner));
-  if (read_hprobe_varfield(ctx, varid++, &key.tid, sizeof(key.tid)) != 0)
-    return 0;
+  if (background) {
+    __u64 src = 0;
+    if (read_hprobe_varfield(ctx, varid + DEQ_VAR_SEQ, &key.tid, sizeof(key.tid)) != 0 ||
+        read_hprobe_varfield(ctx, varid + DEQ_VAR_SRC, &src, sizeof(src)) != 0)
+      return 0;
+    key.owner = OSDTRACE_BACKGROUND_OWNER | src;
+  } else {
+    read_hprobe_varfield(ctx, varid + DEQ_VAR_OWNER, &key.owner, sizeof(key.owner));
+    if (read_hprobe_varfield(ctx, varid + DEQ_VAR_TID, &key.tid, sizeof(key.tid)) != 0)
+      return 0;
+  }
 
   key.pid = get_pid();
 
@@ -245,22 +536,49 @@ int uprobe_dequeue_op(struct pt_regs *ctx) {
     return 0;
   }
 
-  if (vp->dequeue_stamp == 0)
+  if (vp->dequeue_stamp == 0) {
     vp->dequeue_stamp = bpf_ktime_get_boot_ns();
+    if (trace_cpu) {
+      struct op_ext *xp = bpf_map_lookup_elem(&op_exts, &key);
+      if (NULL != xp)
+        xp->cpu.tid = (__u32)bpf_get_current_pid_tgid();
+    }
+    cpu_read(&key, offsetof(struct cpu_info, dequeue));
+  }
 
   __u64 m_pool = 0;
-  if (read_hprobe_varfield(ctx, varid++, &m_pool, sizeof(m_pool)) != 0)
+  if (read_hprobe_varfield(ctx, varid + DEQ_VAR_POOL, &m_pool, sizeof(m_pool)) != 0)
     return 0;
   vp->m_pool = m_pool;
 
   __u32 m_seed = 0;
-  if (read_hprobe_varfield(ctx, varid++, &m_seed, sizeof(m_seed)) != 0)
+  if (read_hprobe_varfield(ctx, varid + DEQ_VAR_SEED, &m_seed, sizeof(m_seed)) != 0)
     return 0;
   vp->m_seed = m_seed;
 
   __u64 ptid = bpf_get_current_pid_tgid();
   bpf_map_update_elem(&ptid_opk, &ptid, &key, 0);
 
+  // --offcpu: ptid_opk outlives dequeue_op for reads, so the thread is
+  // followed in its own map until uretprobe_dequeue_op
+  if (trace_offcpu) {
+    __u32 tid = (__u32)ptid;
+    struct offcpu_thread_v t = {};
+    t.key = key;
+    bpf_map_update_elem(&offcpu_threads, &tid, &t, 0);
+  }
+
+  // --pg-lock: the op runs under the lock of its PG, which this thread
+  // just waited for
+  struct pglock_thread_k lk = {.ptid = ptid};
+  if (read_hprobe_addr(ctx, varid + DEQ_VAR_POOL, &lk.pg) == 0) {
+    struct pglock_thread_v *lt = bpf_map_lookup_elem(&pglock_threads, &lk);
+    if (NULL != lt && lt->acquired != 0) {
+      vp->pg_lock_wait_ns += lt->wait_ns;
+      lt->wait_ns = 0;
+    }
+  }
+
   return 0;
 }
 
@@ -283,6 +601,7 @@ int uprobe_execute_ctx(struct pt_regs *ctx) {
   struct op_v *vp = bpf_map_lookup_elem(&ops, &key);
   if (NULL != vp) {
     vp->execute_ctx_stamp = bpf_ktime_get_boot_ns();
+    cpu_read(&key, offsetof(struct cpu_info, execute_ctx));
   } else {
     bpf_printk(
         "uprobe_execute_ctx, no previous op info, owner %lld, tid %lld\n",
@@ -367,6 +686,7 @@ int uprobe_queue_transactions(struct pt_regs *ctx) {
     struct op_v *vp = bpf_map_lookup_elem(&ops, key);
     if (NULL != vp) {
       vp->queue_transaction_stamp = bpf_ktime_get_boot_ns();
+      cpu_read(key, offsetof(struct cpu_info, queue_transaction));
     } else {
       bpf_printk(
           "uprobe_queue_transaction, no previous key matched owner %lld, tid "
@@ -464,12 +784,18 @@ int uprobe_txc_state_proc(struct pt_regs *ctx) {
 
   if (state == 0) {  // STATE_PREPARE
     vp->aio_submit_stamp = bpf_ktime_get_boot_ns();
+    cpu_read(key, offsetof(struct cpu_info, aio_submit));
     __u64 pending_addr = fetch_var_member_addr(v, vf);
     int pending_num = 0;
     bpf_probe_read_user(&pending_num, sizeof(pending_num), (void *)pending_addr);
     vp->aio_size = pending_num;
     if (pending_num == 0)
       vp->aio_done_stamp = vp->aio_submit_stamp;
+    // --blk: _txc_aio_submit issues the aio next, on this thread
+    else if (trace_blk) {
+      __u32 tid = (__u32)bpf_get_current_pid_tgid();
+      bpf_map_update_elem(&blk_threads, &tid, key, 0);
+    }
     bpf_printk("uprobe_txc_state_proc owner %lld tid %lld aio_submit_stamp = %lld", key->owner, key->tid, vp->aio_submit_stamp);
   } else if (state == 1) {  // STATE_AIO_WAIT
     vp->aio_done_stamp = bpf_ktime_get_boot_ns();
@@ -480,7 +806,22 @@ int uprobe_txc_state_proc(struct pt_regs *ctx) {
   } else if (state == 4) {  // STATE_KV_SUBMITTED
     vp->kv_committed_stamp = bpf_ktime_get_boot_ns();
     bpf_printk("uprobe_txc_state_proc owner %lld tid %lld kv_committed_stamp = %lld", key->owner, key->tid, vp->kv_committed_stamp);
+    struct op_k k = *key;
+    if (vp->kv_sync_ptid != 0) {
+      struct kv_batch_k bk = {.ptid = vp->kv_sync_ptid, .batch = vp->kv_batch};
+      struct kv_batch_v *bv = bpf_map_lookup_elem(&kv_batches, &bk);
+      if (NULL != bv) {
+        vp->kv_sync_start_stamp = bv->sync_start;
+        vp->kv_sync_end_stamp = bv->sync_end;
+        vp->kv_fsync_ns = bv->fsync_ns;
+      }
+    }
     bpf_map_delete_elem(&ctx_opk, &ck);
+    // a background op has no reply to wait for: its write is done
+    if (k.owner & OSDTRACE_BACKGROUND_OWNER) {
+      vp->reply_stamp = vp->kv_committed_stamp;
+      submit_op(&k, vp);
+    }
   }
 
   return 0;
@@ -501,21 +842,15 @@ int uprobe_log_op_stats(struct pt_regs *ctx) {
   struct op_v *vp = bpf_map_lookup_elem(&ops, &key);
   if (NULL != vp) {
     vp->reply_stamp = bpf_ktime_get_boot_ns();
+    cpu_read(&key, offsetof(struct cpu_info, reply));
     vp->wb = PT_REGS_PARM3(ctx);
     vp->rb = PT_REGS_PARM4(ctx);
-    struct op_v *e = bpf_ringbuf_reserve(&rb, sizeof(struct op_v), 0);
-    if (NULL == e) {
-      return 0;
-    }
-    *e = *vp;
-    bpf_ringbuf_submit(e, 0);
+    submit_op(&key, vp);
   } else {
     bpf_printk(
         "uprobe_log_op_stats, no previous op info, owner %lld, tid %lld\n",
         key.owner, key.tid);
   }
-
-  bpf_map_delete_elem(&ops, &key);
   return 0;
 }
 
@@ -708,14 +1043,7 @@ int uprobe_log_subop_stats(struct pt_regs *ctx)
   vp->wb = len;
   vp->reply_stamp = bpf_ktime_get_boot_ns();
 
-  struct op_v *e = bpf_ringbuf_reserve(&rb, sizeof(struct op_v), 0);
-  if (NULL == e) {
-    return 0;
-  }
-  *e = *vp;
-  bpf_ringbuf_submit(e, 0);
-
-  bpf_map_delete_elem(&ops, &key);
+  submit_op(&key, vp);
   return 0;
 }
 
@@ -733,9 +1061,20 @@ int uprobe_ec_submit_transaction(struct pt_regs *ctx) {
   key.pid = get_pid();
 
   struct op_v *vp = bpf_map_lookup_elem(&ops, &key);
-  if (NULL != vp) {
-    bpf_map_delete_elem(&ops, &key);
+  if (NULL == vp)
+    return 0;
+  // without --ec, erasure-coded writes are not reported
+  if (!trace_ec) {
+    forget_op(&key);
+    return 0;
   }
+  struct op_ext *xp = bpf_map_lookup_elem(&op_exts, &key);
+  if (NULL != xp)
+    xp->ec.submit_stamp = bpf_ktime_get_boot_ns();
+  struct ec_tid_k ek = {};
+  ek.pid = key.pid;
+  if (read_hprobe_varfield(ctx, varid++, &ek.tid, sizeof(ek.tid)) == 0)
+    bpf_map_update_elem(&ec_tids, &ek, &key, 0);
   return 0;
 }
 
@@ -817,14 +1156,7 @@ int uprobe_repop_commit(struct pt_regs *ctx)
     }
   }
 
-  struct op_v *e = bpf_ringbuf_reserve(&rb, sizeof(struct op_v), 0);
-  if (NULL == e) {
-    return 0;
-  }
-  *e = *vp;
-  bpf_ringbuf_submit(e, 0);
-
-  bpf_map_delete_elem(&ops, &key);
+  submit_op(&key, vp);
   return 0;
 }
 
@@ -969,3 +1301,728 @@ int uprobe_txc_add_transaction(struct pt_regs *ctx)
 
   return 0;
 }
+
+// --kv probes.  The kv_sync_thread applies every queued txc to a RocksDB
+// batch (_txc_apply_kv), then commits them all with one
+// submit_transaction_sync, whose WAL sync ends in BlueFS::fsync.  A txc is
+// found again through ctx_opk, like in _txc_state_proc.
+SEC("uprobe")
+int uprobe_txc_apply_kv(struct pt_regs *ctx)
+{
+  int varid = 81;
+  __u32 seqid = 0;
+  if (read_hprobe_varfield(ctx, varid++, &seqid, sizeof(seqid)) != 0) return 0;
+  __u64 start = 0;
+  if (read_hprobe_varfield(ctx, varid++, &start, sizeof(start)) != 0) return 0;
+
+  __u64 ptid = bpf_get_current_pid_tgid();
+  struct kv_thread_v *tv = bpf_map_lookup_elem(&kv_threads, &ptid);
+  if (NULL == tv) {
+    struct kv_thread_v zero = {};
+    bpf_map_update_elem(&kv_threads, &ptid, &zero, BPF_NOEXIST);
+    tv = bpf_map_lookup_elem(&kv_threads, &ptid);
+    if (NULL == tv) return 0;
+  }
+  // the first apply after a sync opens the next batch
+  if (tv->synced) {
+    tv->batch++;
+    tv->synced = 0;
+  }
+  struct ctx_k ck = {};
+  ck.seqid = seqid;
+  ck.start_stamp = start;
+  ck.pid = get_pid();
+  tv->applying = ck;
+
+  struct op_k *key = bpf_map_lookup_elem(&ctx_opk, &ck);
+  if (NULL == key) return 0;
+  struct op_v *vp = bpf_map_lookup_elem(&ops, key);
+  if (NULL == vp) return 0;
+  vp->kv_apply_stamp = bpf_ktime_get_boot_ns();
+  vp->kv_sync_ptid = ptid;
+  vp->kv_batch = tv->batch;
+  bpf_printk("uprobe_txc_apply_kv owner %lld tid %lld batch %lld", key->owner, key->tid, tv->batch);
+  return 0;
+}
+
+SEC("uretprobe")
+int uretprobe_txc_apply_kv(struct pt_regs *ctx)
+{
+  __u64 ptid = bpf_get_current_pid_tgid();
+  struct kv_thread_v *tv = bpf_map_lookup_elem(&kv_threads, &ptid);
+  if (NULL == tv) return 0;
+  struct op_k *key = bpf_map_lookup_elem(&ctx_opk, &tv->applying);
+  if (NULL == key) return 0;
+  struct op_v *vp = bpf_map_lookup_elem(&ops, key);
+  if (NULL == vp) return 0;
+  vp->kv_applied_stamp = bpf_ktime_get_boot_ns();
+  return 0;
+}
+
+SEC("uprobe")
+int uprobe_submit_transaction_sync(struct pt_regs *ctx)
+{
+  __u64 ptid = bpf_get_current_pid_tgid();
+  struct kv_thread_v *tv = bpf_map_lookup_elem(&kv_threads, &ptid);
+  // not a kv_sync_thread, or nothing applied since the last sync
+  if (NULL == tv || tv->synced) return 0;
+  struct kv_batch_k bk = {.ptid = ptid, .batch = tv->batch};
+  struct kv_batch_v bv = {};
+  bv.sync_start = bpf_ktime_get_boot_ns();
+  bpf_map_update_elem(&kv_batches, &bk, &bv, 0);
+  return 0;
+}
+
+SEC("uretprobe")
+int uretprobe_submit_transaction_sync(struct pt_regs *ctx)
+{
+  __u64 ptid = bpf_get_current_pid_tgid();
+  struct kv_thread_v *tv = bpf_map_lookup_elem(&kv_threads, &ptid);
+  if (NULL == tv || tv->synced) return 0;
+  struct kv_batch_k bk = {.ptid = ptid, .batch = tv->batch};
+  struct kv_batch_v *bv = bpf_map_lookup_elem(&kv_batches, &bk);
+  if (NULL != bv)
+    bv->sync_end = bpf_ktime_get_boot_ns();
+  tv->synced = 1;
+  tv->fsync_start = 0;
+  return 0;
+}
+
+SEC("uprobe")
+int uprobe_bluefs_fsync(struct pt_regs *ctx)
+{
+  __u64 ptid = bpf_get_current_pid_tgid();
+  struct kv_thread_v *tv = bpf_map_lookup_elem(&kv_threads, &ptid);
+  // only the fsyncs inside a batch's submit_transaction_sync count
+  if (NULL == tv || tv->synced) return 0;
+  struct kv_batch_k bk = {.ptid = ptid, .batch = tv->batch};
+  if (NULL == bpf_map_lookup_elem(&kv_batches, &bk)) return 0;
+  tv->fsync_start = bpf_ktime_get_boot_ns();
+  return 0;
+}
+
+SEC("uretprobe")
+int uretprobe_bluefs_fsync(struct pt_regs *ctx)
+{
+  __u64 ptid = bpf_get_current_pid_tgid();
+  struct kv_thread_v *tv = bpf_map_lookup_elem(&kv_threads, &ptid);
+  if (NULL == tv || tv->fsync_start == 0) return 0;
+  struct kv_batch_k bk = {.ptid = ptid, .batch = tv->batch};
+  struct kv_batch_v *bv = bpf_map_lookup_elem(&kv_batches, &bk);
+  if (NULL != bv)
+    bv->fsync_ns += bpf_ktime_get_boot_ns() - tv->fsync_start;
+  tv->fsync_start = 0;
+  return 0;
+}
+
+// --sched probes.  ShardedOpWQ::_enqueue hands an item to the scheduler of
+// the shard its PG hashes to; the item's OpQueueable::run() executes it once
+// the scheduler gave it out and the PG lock was taken.
+static __always_inline struct sched_v *sched_stats_of(struct sched_k *sk)
+{
+  struct sched_v *sv = bpf_map_lookup_elem(&sched_stats, sk);
+  if (NULL == sv) {
+    struct sched_v zero = {};
+    bpf_map_update_elem(&sched_stats, sk, &zero, BPF_NOEXIST);
+    sv = bpf_map_lookup_elem(&sched_stats, sk);
+    if (NULL == sv) return NULL;
+  }
+  __u32 zero_idx = 0;
+  __u64 *epoch = bpf_map_lookup_elem(&sched_epoch, &zero_idx);
+  if (NULL != epoch && sv->epoch != *epoch) {
+    sv->epoch = *epoch;
+    sv->max_depth = sv->depth > 0 ? sv->depth : 0;
+    sv->wait_max_ns = 0;
+  }
+  return sv;
+}
+
+SEC("uprobe")
+int uprobe_sharded_enqueue(struct pt_regs *ctx)
+{
+  int varid = 230;
+  __u64 qitem = 0;
+  if (read_hprobe_varfield(ctx, varid++, &qitem, sizeof(qitem)) != 0) return 0;
+  __u64 shards_start = 0;
+  if (read_hprobe_varfield(ctx, varid++, &shards_start, sizeof(shards_start)) != 0) return 0;
+  __u64 shards_finish = 0;
+  if (read_hprobe_varfield(ctx, varid++, &shards_finish, sizeof(shards_finish)) != 0) return 0;
+  struct sched_item_k ik = {};
+  if (read_hprobe_addr(ctx, varid++, &ik.addr) != 0) return 0;
+  __u32 m_seed = 0;
+  if (read_hprobe_varfield(ctx, varid++, &m_seed, sizeof(m_seed)) != 0) return 0;
+
+  // OSDShard* vector; the shard is spg_t::hash_to_shard(), ps() % size
+  __u64 num_shards = (shards_finish - shards_start) / sizeof(__u64);
+  if (qitem == 0 || ik.addr == 0 || num_shards == 0) return 0;
+
+  struct sched_item_v iv = {};
+  iv.enqueue_stamp = bpf_ktime_get_boot_ns();
+  bpf_probe_read_user(&iv.vtable, sizeof(iv.vtable), (void *)qitem);
+  iv.shard = m_seed % num_shards;
+  ik.pid = get_pid();
+  struct sched_vtable_k ck = {.pid = ik.pid, .vtable = iv.vtable};
+  __u32 *cls = bpf_map_lookup_elem(&sched_classes, &ck);
+  iv.cls = NULL != cls ? *cls : SCHED_OTHER;
+  bpf_map_update_elem(&sched_items, &ik, &iv, 0);
+
+  struct sched_k sk = {.pid = ik.pid, .shard = iv.shard, .cls = iv.cls};
+  struct sched_v *sv = sched_stats_of(&sk);
+  if (NULL == sv) return 0;
+  __sync_fetch_and_add(&sv->depth, 1);
+  __sync_fetch_and_add(&sv->enqueued, 1);
+  __s64 depth = sv->depth;
+  if (depth > 0 && (__u64)depth > sv->max_depth)
+    sv->max_depth = depth;
+  return 0;
+}
+
+static __always_inline int sched_run(struct pt_regs *ctx, int varid, __u32 cls)
+{
+  struct sched_item_k ik = {};
+  if (read_hprobe_addr(ctx, varid, &ik.addr) != 0) return 0;
+  ik.pid = get_pid();
+  struct sched_item_v *iv = bpf_map_lookup_elem(&sched_items, &ik);
+  // enqueued before tracing started
+  if (NULL == iv) return 0;
+  __u64 wait = bpf_ktime_get_boot_ns() - iv->enqueue_stamp;
+
+  struct sched_vtable_k ck = {.pid = ik.pid, .vtable = iv->vtable};
+  bpf_map_update_elem(&sched_classes, &ck, &cls, 0);
+
+  // counted where the item was enqueued, so that depth stays balanced
+  struct sched_k sk = {.pid = ik.pid, .shard = iv->shard, .cls = iv->cls};
+  bpf_map_delete_elem(&sched_items, &ik);
+  struct sched_v *sv = sched_stats_of(&sk);
+  if (NULL == sv) return 0;
+  __sync_fetch_and_add(&sv->depth, -1);
+  __sync_fetch_and_add(&sv->dequeued, 1);
+  __sync_fetch_and_add(&sv->wait_sum_ns, wait);
+  if (wait > sv->wait_max_ns)
+    sv->wait_max_ns = wait;
+  return 0;
+}
+
+SEC("uprobe")
+int uprobe_pg_op_item_run(struct pt_regs *ctx)
+{
+  return sched_run(ctx, 240, SCHED_CLIENT);
+}
+
+SEC("uprobe")
+int uprobe_pg_peering_item_run(struct pt_regs *ctx)
+{
+  return sched_run(ctx, 250, SCHED_PEERING);
+}
+
+SEC("uprobe")
+int uprobe_pg_recovery_run(struct pt_regs *ctx)
+{
+  return sched_run(ctx, 260, SCHED_RECOVERY);
+}
+
+SEC("uprobe")
+int uprobe_pg_recovery_context_run(struct pt_regs *ctx)
+{
+  return sched_run(ctx, 270, SCHED_RECOVERY);
+}
+
+SEC("uprobe")
+int uprobe_pg_recovery_msg_run(struct pt_regs *ctx)
+{
+  return sched_run(ctx, 280, SCHED_RECOVERY);
+}
+
+SEC("uprobe")
+int uprobe_pg_scrub_run(struct pt_regs *ctx)
+{
+  return sched_run(ctx, 290, SCHED_SCRUB);
+}
+
+SEC("uprobe")
+int uprobe_pg_rep_scrub_run(struct pt_regs *ctx)
+{
+  return sched_run(ctx, 300, SCHED_SCRUB);
+}
+
+SEC("uprobe")
+int uprobe_pg_snap_trim_run(struct pt_regs *ctx)
+{
+  return sched_run(ctx, 310, SCHED_SNAPTRIM);
+}
+
+SEC("uprobe")
+int uprobe_pg_delete_run(struct pt_regs *ctx)
+{
+  return sched_run(ctx, 320, SCHED_PG_DELETE);
+}
+
+// --background: a recovery, backfill or scrub message that queued no
+// BlueStore transaction (a pull, a scan, a scrub request...) is done when
+// dequeue_op returns.  One that did is reported at its kv commit instead, by
+// _txc_state_proc; _txc_calc_cost already dropped its ptid_opk entry.
+// --offcpu, --blk: the thread is no longer running the op.
+SEC("uretprobe")
+int uretprobe_dequeue_op(struct pt_regs *ctx)
+{
+  __u64 ptid = bpf_get_current_pid_tgid();
+  __u32 tid = (__u32)ptid;
+  if (trace_offcpu)
+    bpf_map_delete_elem(&offcpu_threads, &tid);
+  if (trace_blk)
+    bpf_map_delete_elem(&blk_threads, &tid);
+  struct op_k *key = bpf_map_lookup_elem(&ptid_opk, &ptid);
+  if (NULL == key || !(key->owner & OSDTRACE_BACKGROUND_OWNER)) return 0;
+  struct op_k k = *key;
+  bpf_map_delete_elem(&ptid_opk, &ptid);
+  struct op_v *vp = bpf_map_lookup_elem(&ops, &k);
+  if (NULL == vp) return 0;
+  vp->reply_stamp = bpf_ktime_get_boot_ns();
+  submit_op(&k, vp);
+  return 0;
+}
+
+// --pg-lock probes.  ShardedOpWQ::_process takes the PG lock before it runs
+// an item, so the wait of an op lies between its enqueue and dequeue_op.
+// A thread can hold one PG lock while it takes another, so locks are kept
+// per (thread, PG).
+
+// A subprogram, so the zeroed histogram is not on the stack of every caller.
+static __noinline void pglock_record(struct pglock_k *key, __u64 lat_us)
+{
+  struct pglock_hist *h = bpf_map_lookup_elem(&pglock_hists, key);
+  if (NULL == h) {
+    struct pglock_hist zero = {};
+    bpf_map_update_elem(&pglock_hists, key, &zero, BPF_NOEXIST);
+    h = bpf_map_lookup_elem(&pglock_hists, key);
+    if (NULL == h) return;
+  }
+  h->slots[hist_slot(lat_us, PGLOCK_SLOTS)]++;
+  h->count++;
+  h->sum_us += lat_us;
+}
+
+SEC("uprobe")
+int uprobe_pg_lock(struct pt_regs *ctx)
+{
+  int varid = 330;
+  struct pglock_thread_k k = {};
+  struct pglock_thread_v t = {};
+  if (read_hprobe_addr(ctx, varid, &k.pg) != 0 ||
+      read_hprobe_varfield(ctx, varid++, &t.pool, sizeof(t.pool)) != 0 ||
+      read_hprobe_varfield(ctx, varid++, &t.seed, sizeof(t.seed)) != 0)
+    return 0;
+  t.wait_start = bpf_ktime_get_boot_ns();
+  k.ptid = bpf_get_current_pid_tgid();
+  bpf_map_update_elem(&pglock_threads, &k, &t, 0);
+  bpf_map_update_elem(&pglock_pending, &k.ptid, &k.pg, 0);
+  return 0;
+}
+
+SEC("uretprobe")
+int uretprobe_pg_lock(struct pt_regs *ctx)
+{
+  struct pglock_thread_k k = {};
+  k.ptid = bpf_get_current_pid_tgid();
+  __u64 *pg = bpf_map_lookup_elem(&pglock_pending, &k.ptid);
+  if (NULL == pg) return 0;
+  k.pg = *pg;
+  bpf_map_delete_elem(&pglock_pending, &k.ptid);
+  struct pglock_thread_v *t = bpf_map_lookup_elem(&pglock_threads, &k);
+  if (NULL == t || t->acquired != 0) return 0;
+  t->acquired = bpf_ktime_get_boot_ns();
+  t->wait_ns = t->acquired - t->wait_start;
+  struct pglock_k hk = {};
+  hk.pid = get_pid();
+  hk.pool = t->pool;
+  hk.seed = t->seed;
+  hk.kind = PGLOCK_WAIT;
+  pglock_record(&hk, t->wait_ns / 1000);
+  return 0;
+}
+
+SEC("uprobe")
+int uprobe_pg_unlock(struct pt_regs *ctx)
+{
+  struct pglock_thread_k k = {};
+  if (read_hprobe_addr(ctx, 340, &k.pg) != 0) return 0;
+  k.ptid = bpf_get_current_pid_tgid();
+  struct pglock_thread_v *t = bpf_map_lookup_elem(&pglock_threads, &k);
+  if (NULL == t) return 0;
+  if (t->acquired != 0) {
+    struct pglock_k hk = {};
+    hk.pid = get_pid();
+    hk.pool = t->pool;
+    hk.seed = t->seed;
+    hk.kind = PGLOCK_HOLD;
+    pglock_record(&hk, (bpf_ktime_get_boot_ns() - t->acquired) / 1000);
+  }
+  bpf_map_delete_elem(&pglock_threads, &k);
+  return 0;
+}
+
+// --msgr probes.  Each reads the connection's peer_type and peer_id at
+// varid and varid + 1, and names the connection by the peer_type address.
+// An accepted connection learns its peer only in the ProtocolV2 handshake,
+// after the first read_bulk, so the peer is read again until it is known.
+static __always_inline struct msgr_conn_v *msgr_conn_of(struct pt_regs *ctx,
+                                                       int varid)
+{
+  struct msgr_conn_k k = {};
+  if (read_hprobe_addr(ctx, varid, &k.conn) != 0) return NULL;
+  k.pid = get_pid();
+  struct msgr_conn_v *v = bpf_map_lookup_elem(&msgr_conns, &k);
+  if (NULL != v && !v->closed && v->peer_type >= 0) return v;
+  struct msgr_conn_v peer = {};
+  if (read_hprobe_varfield(ctx, varid, &peer.peer_type, sizeof(peer.peer_type)) != 0 ||
+      read_hprobe_varfield(ctx, varid + 1, &peer.peer_id, sizeof(peer.peer_id)) != 0)
+    return v;
+  if (NULL != v && !v->closed) {
+    v->peer_type = peer.peer_type;
+    v->peer_id = peer.peer_id;
+    return v;
+  }
+  // a new connection, or a new one at the address of a closed one
+  bpf_map_update_elem(&msgr_conns, &k, &peer, 0);
+  return bpf_map_lookup_elem(&msgr_conns, &k);
+}
+
+static __always_inline struct msgr_conn_v *msgr_call_conn(struct msgr_call_v *c)
+{
+  struct msgr_conn_k k = {};
+  k.pid = get_pid();
+  k.conn = c->conn;
+  return bpf_map_lookup_elem(&msgr_conns, &k);
+}
+
+SEC("uprobe")
+int uprobe_read_bulk(struct pt_regs *ctx)
+{
+  int varid = 350;
+  struct msgr_call_v c = {};
+  if (NULL == msgr_conn_of(ctx, varid) ||
+      read_hprobe_addr(ctx, varid, &c.conn) != 0)
+    return 0;
+  __u64 ptid = bpf_get_current_pid_tgid();
+  bpf_map_update_elem(&msgr_calls, &ptid, &c, 0);
+  return 0;
+}
+
+SEC("uretprobe")
+int uretprobe_read_bulk(struct pt_regs *ctx)
+{
+  __u64 ptid = bpf_get_current_pid_tgid();
+  struct msgr_call_v *c = bpf_map_lookup_elem(&msgr_calls, &ptid);
+  if (NULL == c) return 0;
+  long ret = PT_REGS_RC(ctx);
+  struct msgr_conn_v *v = msgr_call_conn(c);
+  if (NULL != v && ret > 0)
+    v->bytes_in += ret;
+  bpf_map_delete_elem(&msgr_calls, &ptid);
+  return 0;
+}
+
+SEC("uprobe")
+int uprobe_try_send(struct pt_regs *ctx)
+{
+  int varid = 360;
+  struct msgr_call_v c = {};
+  __u32 len = 0;
+  if (NULL == msgr_conn_of(ctx, varid) ||
+      read_hprobe_addr(ctx, varid, &c.conn) != 0 ||
+      read_hprobe_varfield(ctx, varid + 2, &len, sizeof(len)) != 0)
+    return 0;
+  c.len = len;
+  __u64 ptid = bpf_get_current_pid_tgid();
+  bpf_map_update_elem(&msgr_calls, &ptid, &c, 0);
+  return 0;
+}
+
+// _try_send returns what is left of outgoing_bl: the socket took the rest.
+// Anything left waits for the socket to become writable again.
+SEC("uretprobe")
+int uretprobe_try_send(struct pt_regs *ctx)
+{
+  __u64 ptid = bpf_get_current_pid_tgid();
+  struct msgr_call_v *c = bpf_map_lookup_elem(&msgr_calls, &ptid);
+  if (NULL == c) return 0;
+  long ret = PT_REGS_RC(ctx);
+  struct msgr_conn_v *v = msgr_call_conn(c);
+  if (NULL != v && ret >= 0) {
+    if ((__u64)ret <= c->len)
+      v->bytes_out += c->len - ret;
+    __u64 now = bpf_ktime_get_boot_ns();
+    if (ret > 0 && v->stall_start == 0) {
+      v->stall_start = now;
+      v->stalls++;
+    } else if (ret == 0 && v->stall_start != 0) {
+      v->stall_ns += now - v->stall_start;
+      v->stall_start = 0;
+    }
+  }
+  bpf_map_delete_elem(&msgr_calls, &ptid);
+  return 0;
+}
+
+SEC("uprobe")
+int uprobe_write_message(struct pt_regs *ctx)
+{
+  struct msgr_conn_v *v = msgr_conn_of(ctx, 370);
+  if (NULL != v)
+    v->msgs_out++;
+  return 0;
+}
+
+SEC("uprobe")
+int uprobe_handle_message(struct pt_regs *ctx)
+{
+  struct msgr_conn_v *v = msgr_conn_of(ctx, 380);
+  if (NULL != v)
+    v->msgs_in++;
+  return 0;
+}
+
+SEC("uprobe")
+int uprobe_conn_stop(struct pt_regs *ctx)
+{
+  struct msgr_conn_k k = {};
+  if (read_hprobe_addr(ctx, 420, &k.conn) != 0) return 0;
+  k.pid = get_pid();
+  struct msgr_conn_v *v = bpf_map_lookup_elem(&msgr_conns, &k);
+  if (NULL != v)
+    v->closed = 1;
+  return 0;
+}
+
+// --ec probes.  try_reads_to_commit() encodes a write with
+// generate_transactions(), sends the remote sub-writes and then hands its
+// own shard to handle_sub_write(), all on one thread.  Every shard's commit,
+// the primary's own included, comes back through handle_sub_write_reply().
+SEC("uprobe")
+int uprobe_ec_generate_transactions(struct pt_regs *ctx)
+{
+  __u64 ptid = bpf_get_current_pid_tgid();
+  struct ec_thread_v t = {};
+  t.encode_start = bpf_ktime_get_boot_ns();
+  bpf_map_update_elem(&ec_threads, &ptid, &t, 0);
+  return 0;
+}
+
+SEC("uretprobe")
+int uretprobe_ec_generate_transactions(struct pt_regs *ctx)
+{
+  __u64 ptid = bpf_get_current_pid_tgid();
+  struct ec_thread_v *t = bpf_map_lookup_elem(&ec_threads, &ptid);
+  if (NULL != t)
+    t->encode_end = bpf_ktime_get_boot_ns();
+  return 0;
+}
+
+static __always_inline struct op_ext *ec_op_of(struct pt_regs *ctx, int varid,
+                                               struct op_k *key)
+{
+  struct ec_tid_k ek = {};
+  if (read_hprobe_varfield(ctx, varid, &ek.tid, sizeof(ek.tid)) != 0)
+    return NULL;
+  ek.pid = get_pid();
+  struct op_k *k = bpf_map_lookup_elem(&ec_tids, &ek);
+  if (NULL == k)
+    return NULL;
+  *key = *k;
+  return bpf_map_lookup_elem(&op_exts, key);
+}
+
+SEC("uprobe")
+int uprobe_ec_handle_sub_write(struct pt_regs *ctx)
+{
+  int varid = 390;
+  struct op_k key;
+  struct op_ext *xp = ec_op_of(ctx, varid++, &key);
+  if (NULL == xp) return 0;
+  // a shard of another primary's write whose tid happens to match
+  __u64 owner = 0, tid = 0;
+  if (read_hprobe_varfield(ctx, varid++, &owner, sizeof(owner)) != 0 ||
+      read_hprobe_varfield(ctx, varid++, &tid, sizeof(tid)) != 0 ||
+      owner != key.owner || tid != key.tid)
+    return 0;
+  if (xp->ec.sent_stamp != 0) return 0;
+  xp->ec.sent_stamp = bpf_ktime_get_boot_ns();
+  __u64 ptid = bpf_get_current_pid_tgid();
+  struct ec_thread_v *t = bpf_map_lookup_elem(&ec_threads, &ptid);
+  if (NULL != t && t->encode_end >= t->encode_start) {
+    xp->ec.encode_start_stamp = t->encode_start;
+    xp->ec.encode_end_stamp = t->encode_end;
+  }
+  bpf_map_delete_elem(&ec_threads, &ptid);
+  return 0;
+}
+
+SEC("uprobe")
+int uprobe_ec_handle_sub_write_reply(struct pt_regs *ctx)
+{
+  int varid = 400;
+  struct op_k key;
+  struct op_ext *xp = ec_op_of(ctx, varid++, &key);
+  if (NULL == xp) return 0;
+  __u8 committed = 0;
+  __s32 osd = -1;
+  __s8 shard = -1;
+  if (read_hprobe_varfield(ctx, varid++, &committed, sizeof(committed)) != 0 ||
+      read_hprobe_varfield(ctx, varid++, &osd, sizeof(osd)) != 0 ||
+      read_hprobe_varfield(ctx, varid++, &shard, sizeof(shard)) != 0)
+    return 0;
+  if (!committed || shard < 0 || shard >= EC_MAX_SHARDS) return 0;
+  __u32 s = shard & (EC_MAX_SHARDS - 1);
+  xp->ec.osd[s] = osd;
+  xp->ec.commit_stamp[s] = bpf_ktime_get_boot_ns();
+  xp->ec.shard_mask |= 1u << s;
+  return 0;
+}
+
+// --offcpu.  The sched/sched_switch tracepoint record; it runs in the
+// context of the task being switched out.  A preempted task is reported as
+// TASK_REPORT_MAX (0x100), above the sleep states.
+#define SCHED_SWITCH_SLEEP_STATES 0xff
+
+struct sched_switch_args {
+  __u64 common;
+  char prev_comm[16];
+  __s32 prev_pid;
+  __s32 prev_prio;
+  long prev_state;
+  char next_comm[16];
+  __s32 next_pid;
+  __s32 next_prio;
+};
+
+SEC("tracepoint/sched/sched_switch")
+int tp_sched_switch(struct sched_switch_args *args)
+{
+  __u64 now = bpf_ktime_get_boot_ns();
+  __u32 prev = args->prev_pid;
+  struct offcpu_thread_v *t = bpf_map_lookup_elem(&offcpu_threads, &prev);
+  if (NULL != t) {
+    t->start = now;
+    t->runnable = (args->prev_state & SCHED_SWITCH_SLEEP_STATES) == 0;
+    t->kstack = bpf_get_stackid(args, &offcpu_stacks, 0);
+    t->ustack = bpf_get_stackid(args, &offcpu_stacks, BPF_F_USER_STACK);
+  }
+
+  __u32 next = args->next_pid;
+  t = bpf_map_lookup_elem(&offcpu_threads, &next);
+  if (NULL == t || t->start == 0) return 0;
+  __u64 delta = now - t->start;
+  t->start = 0;
+  struct op_ext *xp = bpf_map_lookup_elem(&op_exts, &t->key);
+  if (NULL == xp) return 0;
+  struct offcpu_info *oc = &xp->offcpu;
+  oc->total_ns += delta;
+  if (t->runnable) oc->runnable_ns += delta;
+  oc->switches++;
+  if (delta > oc->max_ns) {
+    oc->max_ns = delta;
+    oc->max_runnable = t->runnable;
+    oc->max_kstack = t->kstack;
+    oc->max_ustack = t->ustack;
+  }
+  return 0;
+}
+
+// --blk.  The block_rq_insert, block_rq_issue and block_rq_complete
+// tracepoint records start alike; only the fields used are declared.  dev is
+// the whole disk and sector the request's first, in all three.
+struct block_rq_args {
+  __u64 common;
+  __u32 dev;
+  __u32 pad;
+  __u64 sector;
+  __u32 nr_sector;
+};
+
+static struct blk_hist zero_blk_hist = {};
+
+// A new request on an OSD device, charged to the op whose aio the current
+// thread is submitting, if any.
+static __always_inline struct blk_rq_v *blk_rq_new(struct blk_rq_k *rk,
+                                                   __u64 now)
+{
+  struct blk_rq_v v = {};
+  v.insert_stamp = now;
+  __u32 tid = (__u32)bpf_get_current_pid_tgid();
+  struct op_k *key = bpf_map_lookup_elem(&blk_threads, &tid);
+  if (NULL != key) v.key = *key;
+  bpf_map_update_elem(&blk_rqs, rk, &v, 0);
+  return bpf_map_lookup_elem(&blk_rqs, rk);
+}
+
+// With an io scheduler, a request is inserted into its queue on the
+// submitting thread and dispatched to the driver later, maybe by a kworker.
+SEC("tracepoint/block/block_rq_insert")
+int tp_block_rq_insert(struct block_rq_args *args)
+{
+  __u32 dev = args->dev;
+  if (NULL == bpf_map_lookup_elem(&blk_devs, &dev)) return 0;
+  struct blk_rq_k rk = {.dev = dev, .sector = args->sector};
+  blk_rq_new(&rk, bpf_ktime_get_boot_ns());
+  return 0;
+}
+
+// Without one (none, typical for NVMe), the submitting thread issues the
+// request directly and it never queued.
+SEC("tracepoint/block/block_rq_issue")
+int tp_block_rq_issue(struct block_rq_args *args)
+{
+  __u32 dev = args->dev;
+  if (NULL == bpf_map_lookup_elem(&blk_devs, &dev)) return 0;
+  __u64 now = bpf_ktime_get_boot_ns();
+  struct blk_rq_k rk = {.dev = dev, .sector = args->sector};
+  struct blk_rq_v *rv = bpf_map_lookup_elem(&blk_rqs, &rk);
+  // a completion we missed leaves an issued request behind
+  if (NULL == rv || rv->issue_stamp != 0)
+    rv = blk_rq_new(&rk, now);
+  if (NULL == rv) return 0;
+  rv->issue_stamp = now;
+  return 0;
+}
+
+SEC("tracepoint/block/block_rq_complete")
+int tp_block_rq_complete(struct block_rq_args *args)
+{
+  // only requests on the OSD devices are in blk_rqs
+  struct blk_rq_k rk = {.dev = args->dev, .sector = args->sector};
+  struct blk_rq_v *rv = bpf_map_lookup_elem(&blk_rqs, &rk);
+  if (NULL == rv) return 0;
+  __u64 now = bpf_ktime_get_boot_ns();
+  struct blk_rq_v v = *rv;
+  bpf_map_delete_elem(&blk_rqs, &rk);
+  if (v.issue_stamp == 0) return 0;
+  __u64 queue_ns = v.issue_stamp - v.insert_stamp;
+  __u64 device_ns = now - v.issue_stamp;
+  __u64 bytes = (__u64)args->nr_sector << 9;
+
+  struct blk_hist *h = bpf_map_lookup_elem(&blk_hists, &rk.dev);
+  if (NULL == h) {
+    bpf_map_update_elem(&blk_hists, &rk.dev, &zero_blk_hist, BPF_NOEXIST);
+    h = bpf_map_lookup_elem(&blk_hists, &rk.dev);
+  }
+  if (NULL != h) {
+    h->count++;
+    h->bytes += bytes;
+    h->queue_sum_us += queue_ns / 1000;
+    h->device_sum_us += device_ns / 1000;
+    h->queue_slots[hist_slot(queue_ns / 1000, BLK_SLOTS)]++;
+    h->device_slots[hist_slot(device_ns / 1000, BLK_SLOTS)]++;
+  }
+
+  if (v.key.pid == 0) return 0;
+  struct op_ext *xp = bpf_map_lookup_elem(&op_exts, &v.key);
+  if (NULL == xp) return 0;
+  xp->blk.ios++;
+  xp->blk.bytes += bytes;
+  if (now > xp->blk.complete_stamp) {
+    xp->blk.complete_stamp = now;
+    xp->blk.queue_ns = queue_ns;
+    xp->blk.device_ns = device_ns;
+  }
+  return 0;
+}
@@ -1,11 +1,18 @@
+#include <bpf/bpf.h>
 #include <bpf/libbpf.h>
 #include <errno.h>
 #include <getopt.h>
 #include <stdio.h>
 #include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <limits.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
 #include <csignal>
 #include <set>
 #include <algorithm>
+#include <functional>
 #include <chrono>
 #include <sstream>
 #include <cstring>
@@ -19,6 +26,7 @@
 #include <fstream>
 #include <dirent.h>
 #include <ctype.h>
+#include <cxxabi.h>
 
 #include "osdtrace.skel.h"
 
@@ -31,6 +39,9 @@ extern "C" {
 #include "dwarf_parser.h"
 #include "version_utils.h"
 #include "utils.h"
+#include "output_buffer.h"
+#include "columnar_writer.h"
+#include "latency_stats.h"
 
 #define MAX_OSD 4000
 using namespace std;
@@ -61,50 +72,115 @@ func_id_t func_id = {
     {"ReplicatedBackend::repop_commit", 170},
     {"OpRequest::mark_flag_point", 180},
     {"BlueStore::log_latency_fn", 190},
-    {"BlueStore::_txc_add_transaction", 200}
+    {"BlueStore::_txc_add_transaction", 200},
+    {"RocksDBStore::submit_transaction_sync", 210},
+    {"BlueFS::fsync", 220},
+    {"ShardedOpWQ::_enqueue", 230},
+    {"PGOpItem::run", 240},
+    {"PGPeeringItem::run", 250},
+    {"PGRecovery::run", 260},
+    {"PGRecoveryContext::run", 270},
+    {"PGRecoveryMsg::run", 280},
+    {"PGScrub::run", 290},
+    {"PGRepScrub::run", 300},
+    {"PGSnapTrim::run", 310},
+    {"PGDelete::run", 320},
+    {"PG::lock", 330},
+    {"PG::unlock", 340},
+    {"AsyncConnection::read_bulk", 350},
+    {"AsyncConnection::_try_send", 360},
+    {"ProtocolV2::write_message", 370},
+    {"ProtocolV2::handle_message", 380},
+    {"ECBackend::handle_sub_write", 390},
+    {"ECBackend::handle_sub_write_reply", 400},
+    {"ECTransaction::generate_transactions", 410},
+    {"AsyncConnection::_stop", 420}
 };
 
-std::map<std::string, int> func_progid = {
-    {"OSD::enqueue_op", 0},
-    {"OSD::dequeue_op", 1},
-    {"PrimaryLogPG::execute_ctx", 2},
-    {"ReplicatedBackend::submit_transaction", 3},
-    {"BlueStore::queue_transactions", 4},
-    {"BlueStore::_do_write", 5},
-    {"BlueStore::_wctx_finish", 6},
-    {"BlueStore::_txc_state_proc", 7},
-    {"PrimaryLogPG::log_op_stats", 8},
-    {"PrimaryLogPG::log_op_stats_v2", 9},
-    {"ReplicatedBackend::generate_subop", 10},
-    {"ReplicatedBackend::do_repop_reply", 11},
-    {"OpRequest::mark_flag_point_string", 12},
-    {"BlueStore::log_latency", 13},
-    {"log_subop_stats", 14},
-    {"ECBackend::submit_transaction", 15},
-    {"BlueStore::_txc_calc_cost", 16},
-    {"ReplicatedBackend::repop_commit", 17},
-    {"OpRequest::mark_flag_point", 18},
-    {"BlueStore::log_latency_fn", 19},
-    {"BlueStore::_txc_add_transaction", 20}
+// BPF program for each probed function, by name: libbpf orders skeleton
+// programs by ELF section, so SEC("uretprobe") programs do not keep their
+// source-file position and cannot be addressed by index.
+std::map<std::string, std::string> func_progname = {
+    {"OSD::enqueue_op", "uprobe_enqueue_op"},
+    {"OSD::dequeue_op", "uprobe_dequeue_op"},
+    {"PrimaryLogPG::execute_ctx", "uprobe_execute_ctx"},
+    {"ReplicatedBackend::submit_transaction", "uprobe_submit_transaction"},
+    {"BlueStore::queue_transactions", "uprobe_queue_transactions"},
+    {"BlueStore::_do_write", "uprobe_do_write"},
+    {"BlueStore::_wctx_finish", "uprobe_wctx_finish"},
+    {"BlueStore::_txc_state_proc", "uprobe_txc_state_proc"},
+    {"PrimaryLogPG::log_op_stats", "uprobe_log_op_stats"},
+    {"PrimaryLogPG::log_op_stats_v2", "uprobe_log_op_stats_v2"},
+    {"ReplicatedBackend::generate_subop", "uprobe_generate_subop"},
+    {"ReplicatedBackend::do_repop_reply", "uprobe_do_repop_reply"},
+    {"OpRequest::mark_flag_point_string", "uprobe_mark_flag_point_string"},
+    {"BlueStore::log_latency", "uprobe_log_latency"},
+    {"log_subop_stats", "uprobe_log_subop_stats"},
+    {"ECBackend::submit_transaction", "uprobe_ec_submit_transaction"},
+    {"BlueStore::_txc_calc_cost", "uprobe_txc_calc_cost"},
+    {"ReplicatedBackend::repop_commit", "uprobe_repop_commit"},
+    {"OpRequest::mark_flag_point", "uprobe_mark_flag_point"},
+    {"BlueStore::log_latency_fn", "uprobe_log_latency_fn"},
+    {"BlueStore::_txc_add_transaction", "uprobe_txc_add_transaction"},
+    {"BlueStore::_txc_apply_kv", "uprobe_txc_apply_kv"},
+    {"BlueStore::_txc_apply_kv_ret", "uretprobe_txc_apply_kv"},
+    {"RocksDBStore::submit_transaction_sync", "uprobe_submit_transaction_sync"},
+    {"RocksDBStore::submit_transaction_sync_ret", "uretprobe_submit_transaction_sync"},
+    {"BlueFS::fsync", "uprobe_bluefs_fsync"},
+    {"BlueFS::fsync_ret", "uretprobe_bluefs_fsync"},
+    {"ShardedOpWQ::_enqueue", "uprobe_sharded_enqueue"},
+    {"PGOpItem::run", "uprobe_pg_op_item_run"},
+    {"PGPeeringItem::run", "uprobe_pg_peering_item_run"},
+    {"PGRecovery::run", "uprobe_pg_recovery_run"},
+    {"PGRecoveryContext::run", "uprobe_pg_recovery_context_run"},
+    {"PGRecoveryMsg::run", "uprobe_pg_recovery_msg_run"},
+    {"PGScrub::run", "uprobe_pg_scrub_run"},
+    {"PGRepScrub::run", "uprobe_pg_rep_scrub_run"},
+    {"PGSnapTrim::run", "uprobe_pg_snap_trim_run"},
+    {"PGDelete::run", "uprobe_pg_delete_run"},
+    {"OSD::dequeue_op_ret", "uretprobe_dequeue_op"},
+    {"PG::lock", "uprobe_pg_lock"},
+    {"PG::lock_ret", "uretprobe_pg_lock"},
+    {"PG::unlock", "uprobe_pg_unlock"},
+    {"AsyncConnection::read_bulk", "uprobe_read_bulk"},
+    {"AsyncConnection::read_bulk_ret", "uretprobe_read_bulk"},
+    {"AsyncConnection::_try_send", "uprobe_try_send"},
+    {"AsyncConnection::_try_send_ret", "uretprobe_try_send"},
+    {"ProtocolV2::write_message", "uprobe_write_message"},
+    {"ProtocolV2::handle_message", "uprobe_handle_message"},
+    {"ECTransaction::generate_transactions", "uprobe_ec_generate_transactions"},
+    {"ECTransaction::generate_transactions_ret", "uretprobe_ec_generate_transactions"},
+    {"ECBackend::handle_sub_write", "uprobe_ec_handle_sub_write"},
+    {"ECBackend::handle_sub_write_reply", "uprobe_ec_handle_sub_write_reply"},
+    {"AsyncConnection::_stop", "uprobe_conn_stop"}
 };
 
 DwarfParser::probes_t osd_probes = {
 
+    // The uprobe_enqueue_op and uprobe_dequeue_op var paths go by the
+    // ENQ_VAR_* and DEQ_VAR_* names in bpf_ceph_types.h: keep them in step.
     {"OSD::enqueue_op",
-     {{"op", "px", "request", "header", "type"},
-      {"op", "px", "reqid", "name", "_num"},
-      {"op", "px", "reqid", "tid"},
-      {"op", "px", "request", "recv_stamp"},
-      {"op", "px", "request", "throttle_stamp"},
-      {"op", "px", "request", "recv_complete_stamp"},
-      {"op", "px", "request", "dispatch_stamp"}}},
+     {{"op", "px", "request", "header", "type"},           // ENQ_VAR_TYPE
+      {"op", "px", "reqid", "name", "_num"},               // ENQ_VAR_OWNER
+      {"op", "px", "reqid", "tid"},                        // ENQ_VAR_TID
+      {"op", "px", "request", "recv_stamp"},               // ENQ_VAR_RECV_STAMP
+      {"op", "px", "request", "throttle_stamp"},           // ENQ_VAR_THROTTLE_STAMP
+      {"op", "px", "request", "recv_complete_stamp"},      // ENQ_VAR_RECV_COMPLETE_STAMP
+      {"op", "px", "request", "dispatch_stamp"},           // ENQ_VAR_DISPATCH_STAMP
+      // --background: recovery messages carry no reqid, key them by
+      // (source osd, message seq) instead
+      {"op", "px", "request", "header", "seq"},            // ENQ_VAR_SEQ
+      {"op", "px", "request", "header", "src", "num"},     // ENQ_VAR_SRC
+      {"op", "px", "request", "header", "front_len"}}},    // ENQ_VAR_FRONT_LEN
 
     {"OSD::dequeue_op",
-     {{"op", "px", "request", "header", "type"},
-      {"op", "px", "reqid", "name", "_num"},
-      {"op", "px", "reqid", "tid"},
-      {"pg", "px", "pg_id", "pgid", "m_pool"},
-      {"pg", "px", "pg_id", "pgid", "m_seed"}}},
+     {{"op", "px", "request", "header", "type"},           // DEQ_VAR_TYPE
+      {"op", "px", "reqid", "name", "_num"},               // DEQ_VAR_OWNER
+      {"op", "px", "reqid", "tid"},                        // DEQ_VAR_TID
+      {"pg", "px", "pg_id", "pgid", "m_pool"},             // DEQ_VAR_POOL
+      {"pg", "px", "pg_id", "pgid", "m_seed"},             // DEQ_VAR_SEED
+      {"op", "px", "request", "header", "seq"},            // DEQ_VAR_SEQ
+      {"op", "px", "request", "header", "src", "num"}}},   // DEQ_VAR_SRC
 
     {"PrimaryLogPG::execute_ctx",
      {{"ctx", "reqid", "name", "_num"},
@@ -144,7 +220,10 @@ DwarfParser::probes_t osd_probes = {
       {"txc", "state"},
       {"txc", "ioc", "num_pending"}}},
 
-    {"BlueStore::_txc_apply_kv", {{"txc", "state"}}},
+    {"BlueStore::_txc_apply_kv",
+     {{"txc", "state"},
+      {"txc", "osr", "px", "sequencer_id"},
+      {"txc", "start", "__d", "__r"}}},
 
     {"PrimaryLogPG::log_op_stats",
      {{"op", "reqid", "name", "_num"},
@@ -187,7 +266,9 @@ DwarfParser::probes_t osd_probes = {
       {"op", "px", "request", "data", "_len"}}},
     
     {"ECBackend::submit_transaction",
-     {{"reqid", "name", "_num"}, {"reqid", "tid"}}},
+     {{"reqid", "name", "_num"}, {"reqid", "tid"},
+      // --ec: ECBackend's own tid, carried by the sub-writes and replies
+      {"tid"}}},
 
     {"ReplicatedBackend::repop_commit",
      {{"rm", "_M_ptr", "op", "px", "reqid", "name", "_num"},
@@ -206,7 +287,71 @@ DwarfParser::probes_t osd_probes = {
     {"BlueStore::_txc_add_transaction",
      {{"t", "data", "ops"},
       {"t", "op_bl", "_carriage"},
-      {"t", "op_bl", "_num"}}}
+      {"t", "op_bl", "_num"}}},
+
+    {"RocksDBStore::submit_transaction_sync", {}},
+
+    {"BlueFS::fsync", {}},
+
+    // OSD::ShardedOpWQ; the DWARF name carries only the innermost scope
+    {"ShardedOpWQ::_enqueue",
+     {{"item", "qitem", "_M_t", "_M_t", "_M_head_impl"},
+      {"this", "osd", "shards", "_M_impl", "_M_start"},
+      {"this", "osd", "shards", "_M_impl", "_M_finish"},
+      {"item", "qitem", "_M_t", "_M_t", "_M_head_impl", "cast:PGOpQueueable",
+       "pgid"},
+      {"item", "qitem", "_M_t", "_M_t", "_M_head_impl", "cast:PGOpQueueable",
+       "pgid", "pgid", "m_seed"}}},
+
+    {"PGOpItem::run", {{"this", "pgid"}}},
+    {"PGPeeringItem::run", {{"this", "pgid"}}},
+    {"PGRecovery::run", {{"this", "pgid"}}},
+    {"PGRecoveryContext::run", {{"this", "pgid"}}},
+    {"PGRecoveryMsg::run", {{"this", "pgid"}}},
+    {"PGScrub::run", {{"this", "pgid"}}},
+    {"PGRepScrub::run", {{"this", "pgid"}}},
+    {"PGSnapTrim::run", {{"this", "pgid"}}},
+    {"PGDelete::run", {{"this", "pgid"}}},
+
+    {"PG::lock",
+     {{"this", "pg_id", "pgid", "m_pool"},
+      {"this", "pg_id", "pgid", "m_seed"}}},
+
+    {"PG::unlock",
+     {{"this", "pg_id", "pgid", "m_pool"}}},
+
+    {"AsyncConnection::read_bulk",
+     {{"this", "peer_type"},
+      {"this", "peer_id"}}},
+
+    {"AsyncConnection::_try_send",
+     {{"this", "peer_type"},
+      {"this", "peer_id"},
+      {"this", "outgoing_bl", "_len"}}},
+
+    {"ProtocolV2::write_message",
+     {{"this", "connection", "peer_type"},
+      {"this", "connection", "peer_id"}}},
+
+    {"ProtocolV2::handle_message",
+     {{"this", "connection", "peer_type"},
+      {"this", "connection", "peer_id"}}},
+
+    {"AsyncConnection::_stop",
+     {{"this", "peer_type"}}},
+
+    {"ECBackend::handle_sub_write",
+     {{"op", "tid"},
+      {"op", "reqid", "name", "_num"},
+      {"op", "reqid", "tid"}}},
+
+    {"ECBackend::handle_sub_write_reply",
+     {{"op", "tid"},
+      {"op", "committed"},
+      {"op", "from", "osd"},
+      {"op", "from", "shard", "id"}}},
+
+    {"ECTransaction::generate_transactions", {}}
 };
 
 enum mode_e { MODE_AVG = 1, MODE_MAX, MODE_ALL };
@@ -216,17 +361,97 @@ enum mode_e mode = MODE_ALL;
 enum probe_mode_e {
     OP_SINGLE_PROBE = 1,
     OP_FULL_PROBE = 2,
-    BLUESTORE_PROBE = 4
+    BLUESTORE_PROBE = 4,
+    KV_PROBE = 8,
+    SCHED_PROBE = 16,
+    BACKGROUND_PROBE = 32,
+    PGLOCK_PROBE = 64,
+    MSGR_PROBE = 128,
+    EC_PROBE = 256,
+    OFFCPU_PROBE = 512,
+    BLK_PROBE = 1024,
+    CPU_PROBE = 2048
 };
 
 int probe_mode = OP_FULL_PROBE;
 
 static __u64 bootstamp = 0;
 
+// --columnar output; the tables are only set when the file is open
+static ColumnarWriter *columnar = nullptr;
+static ColumnarWriter::Table *columnar_ops = nullptr;
+static ColumnarWriter::Table *columnar_bluestore = nullptr;
+static ColumnarWriter::Table *columnar_sched = nullptr;
+static ColumnarWriter::Table *columnar_pglock = nullptr;
+static ColumnarWriter::Table *columnar_msgr = nullptr;
+static ColumnarWriter::Table *columnar_blk = nullptr;
+
+// --analyze: aggregate ops in-process instead of printing them
+static std::unique_ptr<OsdLatencyReport> analyze_report;
+bool analyze = false;
+std::string analyze_field = "lat";
+unsigned analyze_interval = 0;  // seconds, 0 = one report at exit
+// Stage shares cover ops at least this slow: -l if given, else the
+// script's --infer default.
+__u64 analyze_infer_threshold = 100000;  // us
+
+// --bottleneck: per-interval stage attribution
+static std::unique_ptr<StageAttribution> attribution;
+unsigned bottleneck_interval = 0;  // seconds, 0 = off
+
+// --peer-matrix: primary x peer replication latency since start
+static std::unique_ptr<PeerLatencyMatrix> peer_matrix;
+unsigned peer_matrix_interval = 0;  // seconds, 0 = off
+const size_t PEER_MATRIX_TOP = 20;
+
+// --sched: op scheduler depth and wait time series
+static std::unique_ptr<SchedSeries> sched_series;
+unsigned sched_interval = 0;  // seconds, 0 = off
+static const char *const SCHED_CLASS_NAMES[SCHED_NUM_CLASSES] = {
+    "other", "client", "peering", "recovery", "scrub", "snaptrim", "pg_delete"};
+
+// --background: recovery, backfill and scrub ops next to the client load
+static std::unique_ptr<BackgroundLoad> background_load;
+unsigned background_interval = 0;  // seconds, 0 = off
+
+// --pg-lock: PG lock wait and hold per PG, and the wait of each op
+static std::unique_ptr<PgLockReport> pglock_report;
+unsigned pglock_interval = 0;  // seconds, 0 = off
+const size_t PGLOCK_TOP = 20;
+static_assert(PGLOCK_SLOTS == PgLockReport::SLOTS, "pglock_hist slots");
+
+// --msgr: async messenger traffic per peer entity
+static std::unique_ptr<MsgrReport> msgr_report;
+unsigned msgr_interval = 0;  // seconds, 0 = off
+const size_t MSGR_TOP = 10;
+
+// --ec: erasure-coded write pipeline summary
+static std::unique_ptr<EcReport> ec_report;
+unsigned ec_interval = 0;  // seconds, 0 = off
+
+// --blk: block request queue and service time per OSD device
+static std::unique_ptr<BlkReport> blk_report;
+unsigned blk_interval = 0;  // seconds, 0 = off
+static std::map<__u32, std::string> blk_dev_names;  // kernel dev_t -> "sda"
+static_assert(BLK_SLOTS == BlkReport::SLOTS, "blk_hist slots");
+
+// --cpu: cycles and IPC per op stage and op type
+static std::unique_ptr<CpuReport> cpu_report;
+unsigned cpu_interval = 0;  // seconds, 0 = off
+// set when the hardware counters could not be opened: "cycles" are then the
+// task clock in ns, and there are no instructions
+static bool cpu_task_clock = false;
+
 __u64 threshold = 0; //in millisecond
+bool threshold_set = false;
 int timeout = -1; //in seconds
 
 volatile sig_atomic_t timeout_occurred = 0;
+// Set once the ring buffer is polled: signals then only stop the loop, and
+// the main thread flushes the output and finishes the columnar file.  Before
+// that nothing is buffered and a signal exits at once.
+volatile sig_atomic_t polling = 0;
+volatile sig_atomic_t caught_signal = 0;
 
 
 static int libbpf_print_fn(enum libbpf_print_level level, const char *format,
@@ -248,6 +473,12 @@ struct pgid_t {
   __u32 m_seed;
 };
 
+struct ec_shard_t {
+  int shard;
+  int osd;
+  __u64 commit_lat;  // sub-write sent to shard committed
+};
+
 typedef struct osd_op {
   __u16 type;
   __u32 wb;
@@ -265,6 +496,7 @@ typedef struct osd_op {
 
 //OSD level
   __u64 queue_lat;
+  __u64 lock_wait;  // --pg-lock: the part of queue_lat waiting for the PG lock
   __u32 delayed_cnt;
   std::vector<std::string> delayed_strs;
   __u64 osd_lat;
@@ -280,8 +512,51 @@ typedef struct osd_op {
   __u64 bs_pg_seq_lat;  //The time to wait for previous ops's aio to the same PG to finish
   __u64 bs_kv_commit_lat;
   __u64 bs_lat;  
+  // --kv split of kv_commit: waiting for the kv_sync_thread, applying the
+  // txc to the batch, the batch's submit_transaction_sync and the BlueFS
+  // fsync inside it.  kv_seen is false when the kv probes missed the txc.
+  bool kv_seen;
+  __u64 bs_kv_batch_lat;
+  __u64 bs_kv_wal_lat;
+  __u64 bs_kv_sync_lat;
+  __u64 bs_kv_fsync_lat;
   int aio_size;
 
+// --ec: a write of an erasure-coded pool
+  bool is_ec;
+  __u64 ec_prep_lat;    // submit_transaction to encode: pipeline and RMW reads
+  __u64 ec_encode_lat;
+  __u64 ec_commit_lat;  // sub-writes sent to the last shard committed
+  __u64 ec_shard_wait;  // last shard commit minus the one before it
+  int ec_slowest_shard;
+  std::vector<ec_shard_t> ec_shards;
+
+// --offcpu: how long the thread running the op was switched out, and
+// its longest switch
+  __u32 pid;
+  __u64 offcpu_lat;
+  __u64 offcpu_runnable;  // preempted, waiting for a CPU
+  __u32 offcpu_switches;
+  __u64 offcpu_max;
+  bool offcpu_max_runnable;
+  __s32 offcpu_kstack;
+  __s32 offcpu_ustack;
+
+// --blk: the block requests of the op's aio, and the io scheduler queue and
+// device time of the one that completed last and so ended aio_wait
+  __u32 blk_ios;
+  __u64 blk_queue_lat;
+  __u64 blk_device_lat;
+
+// --cpu: the dequeuing thread's cycles and instructions from dequeue to the
+// end of osd_lat, and over the BlueStore stage on that thread (prepare for
+// writes, the read itself for reads)
+  bool cpu_seen;
+  __u64 cpu_osd_cycles;
+  __u64 cpu_osd_instructions;
+  __u64 cpu_bs_cycles;
+  __u64 cpu_bs_instructions;
+
 // op lat
   __u64 op_lat;
 
@@ -321,6 +596,143 @@ std::vector<string> size_ranges = {"(0, 4k)",
 typedef std::vector<std::vector<__u64>> SizeRangeLatVec;   
 std::map<int, SizeRangeLatVec> osd_wsrl, osd_rsrl;
 
+// --offcpu: names the stacks the sched_switch program recorded, innermost
+// frame first: "<kernel frames> | <user frames>".  Kernel frames come from
+// /proc/kallsyms and user frames from the OSD's ELF symbols.  A stack id
+// keeps its stack for the whole run, so each stack is named only once.
+class OffcpuSymbolizer {
+ public:
+  static const int FRAMES = 5;  // per side
+
+  explicit OffcpuSymbolizer(int stacks_fd) : fd(stacks_fd) {
+    std::ifstream ifs("/proc/kallsyms");
+    std::string line;
+    while (std::getline(ifs, line)) {
+      char type = 0;
+      char name[256];
+      unsigned long long addr = 0;
+      if (sscanf(line.c_str(), "%llx %c %255s", &addr, &type, name) != 3 ||
+          addr == 0)
+        continue;
+      if (type == 't' || type == 'T' || type == 'w' || type == 'W')
+        ksyms.emplace_back(addr, name);
+    }
+    std::sort(ksyms.begin(), ksyms.end());
+  }
+
+  ~OffcpuSymbolizer() {
+    for (auto &x : dwfls)
+      if (x.second) dwfl_end(x.second);
+  }
+
+  const std::string &name(__u32 pid, __s32 kstack, __s32 ustack) {
+    auto key = std::make_tuple(pid, kstack, ustack);
+    auto it = names.find(key);
+    if (it != names.end()) return it->second;
+    std::string &s = names[key];
+    put_kernel(s, kstack);
+    s += " | ";
+    put_user(s, pid, ustack);
+    return s;
+  }
+
+ private:
+  bool read_stack(__s32 id, __u64 *ips) {
+    memset(ips, 0, OFFCPU_STACK_DEPTH * sizeof(__u64));
+    return id >= 0 && bpf_map_lookup_elem(fd, &id, ips) == 0;
+  }
+
+  static void put_addr(std::string &s, __u64 ip) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "0x%llx", (unsigned long long)ip);
+    s += buf;
+  }
+
+  void put_kernel(std::string &s, __s32 id) {
+    __u64 ips[OFFCPU_STACK_DEPTH];
+    if (!read_stack(id, ips)) {
+      s += "?";
+      return;
+    }
+    int n = 0;
+    bool inner = true;
+    for (int i = 0; i < OFFCPU_STACK_DEPTH && ips[i] && n < FRAMES; ++i) {
+      auto it = std::upper_bound(
+          ksyms.begin(), ksyms.end(), std::make_pair(ips[i], std::string()),
+          [](const std::pair<__u64, std::string> &a,
+             const std::pair<__u64, std::string> &b) {
+            return a.first < b.first;
+          });
+      const std::string *sym =
+          it == ksyms.begin() ? nullptr : &std::prev(it)->second;
+      // every stack starts in the scheduler; say where it was entered from
+      if (inner && sym && (*sym == "schedule" || sym->rfind("__schedule", 0) == 0 ||
+                           sym->rfind("preempt_schedule", 0) == 0))
+        continue;
+      inner = false;
+      if (n++) s += " <- ";
+      if (sym) s += *sym;
+      else put_addr(s, ips[i]);
+    }
+    if (n == 0) s += "schedule";
+  }
+
+  void put_user(std::string &s, __u32 pid, __s32 id) {
+    __u64 ips[OFFCPU_STACK_DEPTH];
+    if (!read_stack(id, ips)) {
+      s += "?";
+      return;
+    }
+    Dwfl *dwfl = dwfl_of(pid);
+    for (int i = 0; i < OFFCPU_STACK_DEPTH && ips[i] && i < FRAMES; ++i) {
+      if (i) s += " <- ";
+      Dwfl_Module *mod = dwfl ? dwfl_addrmodule(dwfl, ips[i]) : nullptr;
+      const char *sym = mod ? dwfl_module_addrname(mod, ips[i]) : nullptr;
+      if (!sym) {
+        put_addr(s, ips[i]);
+        continue;
+      }
+      int status = -1;
+      char *demangled = abi::__cxa_demangle(sym, nullptr, nullptr, &status);
+      std::string fn = status == 0 ? demangled : sym;
+      free(demangled);
+      // drop the parameter list, the frames are long enough without it
+      size_t paren = fn.find('(');
+      if (paren != std::string::npos && paren > 0) fn.resize(paren);
+      s += fn;
+    }
+  }
+
+  Dwfl *dwfl_of(__u32 pid) {
+    auto it = dwfls.find(pid);
+    if (it != dwfls.end()) return it->second;
+    static const Dwfl_Callbacks callbacks = {
+        .find_elf = dwfl_linux_proc_find_elf,
+        .find_debuginfo = dwfl_standard_find_debuginfo,
+        .section_address = nullptr,
+        .debuginfo_path = nullptr,
+    };
+    Dwfl *dwfl = dwfl_begin(&callbacks);
+    if (dwfl) {
+      dwfl_report_begin(dwfl);
+      if (dwfl_linux_proc_report(dwfl, pid) != 0) {
+        dwfl_end(dwfl);
+        dwfl = nullptr;
+      } else {
+        dwfl_report_end(dwfl, NULL, NULL);
+      }
+    }
+    return dwfls[pid] = dwfl;
+  }
+
+  int fd;
+  std::vector<std::pair<__u64, std::string>> ksyms;
+  std::map<__u32, Dwfl *> dwfls;
+  std::map<std::tuple<__u32, __s32, __s32>, std::string> names;
+};
+
+static std::unique_ptr<OffcpuSymbolizer> offcpu_symbolizer;
+
 int exists(int id) {
   for (int i = 0; i < num_osd; ++i) {
     if (osds[i] == id) return 1;
@@ -483,33 +895,60 @@ void print_all_srl() {
   }
 }
 
-void print_delayed_info(const osd_op_t &op) {
+void print_delayed_info(OutputBuffer &out, const osd_op_t &op) {
   for (__u32 i = 0; i < op.delayed_cnt; ++i) {
-    printf("[delayed%d %s ]", i + 1, op.delayed_strs[i].c_str());
+    out.put("[delayed").dec(i + 1).put(' ').put(op.delayed_strs[i]).put(" ]");
   }
   if (op.delayed_cnt > 0)
-    printf("\n");
+    out.end_line();
+}
+
+// --cpu: the stage counters at the end of an op line
+void put_cpu(OutputBuffer &out, const osd_op_t &op) {
+  if (!(probe_mode & CPU_PROBE))
+    return;
+  if (cpu_task_clock) {
+    out.put(" cpu_osd_us ").dec((long long)op.cpu_osd_cycles/1000)
+       .put(" cpu_bs_us ").dec((long long)op.cpu_bs_cycles/1000);
+    return;
+  }
+  char ipc[64];
+  snprintf(ipc, sizeof(ipc), " ipc_osd %.2f ipc_bs %.2f",
+           op.cpu_osd_cycles ? (double)op.cpu_osd_instructions / op.cpu_osd_cycles : 0,
+           op.cpu_bs_cycles ? (double)op.cpu_bs_instructions / op.cpu_bs_cycles : 0);
+  out.put(" cycles_osd ").dec((long long)op.cpu_osd_cycles)
+     .put(" cycles_bs ").dec((long long)op.cpu_bs_cycles).put(ipc);
+}
+
+// --offcpu: a line after the op's, attributing its longest switch to the
+// stack the thread blocked (or was preempted) in.
+void print_offcpu_info(OutputBuffer &out, const osd_op_t &op) {
+  if (!offcpu_symbolizer || op.offcpu_switches == 0)
+    return;
+  out.put("[offcpu ").dec((long long)op.offcpu_lat)
+     .put(" runnable ").dec((long long)op.offcpu_runnable)
+     .put(" switches ").dec(op.offcpu_switches)
+     .put("] ").put(op.offcpu_max_runnable ? "preempted " : "blocked ")
+     .dec((long long)op.offcpu_max).put(" us in ")
+     .put(offcpu_symbolizer->name(op.pid, op.offcpu_kstack, op.offcpu_ustack));
+  out.end_line();
 }
 
-std::string format_object_name(const std::string& name) {
+void put_object_name(OutputBuffer &out, const std::string& name) {
   if (name.empty()) {
-    return "-";
+    out.put('-');
+    return;
   }
 
   static constexpr char hex[] = "0123456789ABCDEF";
-  std::string result;
-  result.reserve(name.size());
   for (unsigned char c : name) {
     if (c > 0x20 && c != 0x7f && c != '%' &&
         (c != '-' || name.size() != 1)) {
-      result.push_back(c);
+      out.put((char)c);
       continue;
     }
-    result.push_back('%');
-    result.push_back(hex[c >> 4]);
-    result.push_back(hex[c & 0x0f]);
+    out.put('%').put(hex[c >> 4]).put(hex[c & 0x0f]);
   }
-  return result;
 }
 
 const char *ceph_osd_op_str(int opcode) {
@@ -533,121 +972,196 @@ const char *objectstore_txn_op_str(__u32 opcode) {
   }
 }
 
-std::string format_detail_ops(const osd_op_t& op, bool transaction_ops) {
-  std::stringstream out;
+void put_detail_ops(OutputBuffer &out, const osd_op_t& op, bool transaction_ops) {
   if (op.detail_ops_unavailable) {
-    out << "[unavailable+" << op.detail_ops_total << "]";
-    return out.str();
+    out.put("[unavailable+").dec(op.detail_ops_total).put(']');
+    return;
   }
-  out << "[";
+  out.put('[');
   for (std::size_t i = 0; i < op.detail_ops.size(); ++i) {
     if (i != 0)
-      out << ",";
+      out.put(',');
     __u32 opcode = op.detail_ops[i];
     if (!transaction_ops && ceph_osd_op_call(opcode) && i < MAX_DETAIL_OPS &&
         op.cls_ops[i].cls_name[0] != '\0') {
-      out << "call(" << op.cls_ops[i].cls_name << "." << op.cls_ops[i].method_name << ")";
+      out.put("call(")
+         .put_bounded(op.cls_ops[i].cls_name, sizeof(op.cls_ops[i].cls_name))
+         .put('.')
+         .put_bounded(op.cls_ops[i].method_name, sizeof(op.cls_ops[i].method_name))
+         .put(')');
     } else {
       const char *name = transaction_ops
                              ? objectstore_txn_op_str(opcode)
                              : ceph_osd_op_str(opcode);
       if (name != nullptr)
-        out << name;
+        out.put(name);
       else
-        out << "unknown-" << opcode;
+        out.put("unknown-").dec(opcode);
     }
   }
   if (op.detail_ops_total > op.detail_ops.size()) {
     if (!op.detail_ops.empty())
-      out << ",";
-    out << "...+" << (op.detail_ops_total - op.detail_ops.size());
+      out.put(',');
+    out.put("...+").dec(op.detail_ops_total - op.detail_ops.size());
   }
-  out << "]";
-  return out.str();
+  out.put(']');
+}
+
+// Everything an op line has in common, from "osd N" up to osd_lat.
+void put_op_head(OutputBuffer &out, const osd_op_t &op, int osd_id,
+                 const char *kind, __u32 size, bool transaction_ops) {
+  out.put("osd ").dec(osd_id)
+     .put(" pg ").dec((long long)op.pg.m_pool).put('.').hex(op.pg.m_seed)
+     .put(' ').put(kind)
+     .put(" size ").dec((int)size)
+     .put(" client ").dec((long long)op.client_id)
+     .put(" tid ").dec((long long)op.req_id)
+     .put(" object ");
+  put_object_name(out, op.object_name);
+  out.put(transaction_ops ? " txn_ops " : " osd_ops ");
+  put_detail_ops(out, op, transaction_ops);
+  out.put(" throttle_lat ").dec((long long)op.throttle_lat)
+     .put(" recv_lat ").dec((long long)op.recv_lat)
+     .put(" dispatch_lat ").dec((long long)op.dispatch_lat)
+     .put(" queue_lat ").dec((long long)op.queue_lat);
+  if (probe_mode & PGLOCK_PROBE)
+    out.put(" lock_wait ").dec((long long)op.lock_wait);
+  out.put(" osd_lat ").dec((long long)op.osd_lat);
+}
+
+// --kv: the BlueStore stages of a write, in the "(prepare ... kv_commit ...)"
+// block that tools/analyze_osdtrace_output.py reads after bluestore_lat.
+// --blk adds the block requests behind aio_wait to it.
+void put_bluestore_details(OutputBuffer &out, const osd_op_t &op) {
+  if (!(probe_mode & (KV_PROBE | BLK_PROBE)))
+    return;
+  out.put(" (prepare ").dec((long long)op.bs_prepare_lat)
+     .put(" aio_wait ").dec((long long)op.bs_aio_wait_lat)
+     .put(" aio_size ").dec(op.aio_size);
+  if (probe_mode & BLK_PROBE)
+    out.put(" blk_ios ").dec(op.blk_ios)
+       .put(" blk_queue ").dec((long long)op.blk_queue_lat)
+       .put(" blk_device ").dec((long long)op.blk_device_lat);
+  out.put(" seq_wait ").dec((long long)op.bs_pg_seq_lat)
+     .put(" kv_commit ").dec((long long)op.bs_kv_commit_lat);
+  if (op.kv_seen)
+    out.put(" kv_batch ").dec((long long)op.bs_kv_batch_lat)
+       .put(" kv_wal ").dec((long long)op.bs_kv_wal_lat)
+       .put(" kv_sync ").dec((long long)op.bs_kv_sync_lat)
+       .put(" kv_fsync ").dec((long long)op.bs_kv_fsync_lat);
+  out.put(')');
+}
+
+// The op kind of a --background message, nullptr for client ops and repops.
+const char *background_kind(__u16 type) {
+  switch (type) {
+    case MSG_OSD_PG_PUSH: return "push";
+    case MSG_OSD_PG_PULL: return "pull";
+    case MSG_OSD_PG_PUSH_REPLY: return "push_reply";
+    case MSG_OSD_PG_BACKFILL: return "backfill";
+    case MSG_OSD_PG_SCAN: return "backfill_scan";
+    case MSG_OSD_PG_BACKFILL_REMOVE: return "backfill_remove";
+    case MSG_OSD_PG_RECOVERY_DELETE: return "recovery_delete";
+    case MSG_OSD_REP_SCRUB: return "rep_scrub";
+    case MSG_OSD_REP_SCRUBMAP: return "rep_scrubmap";
+    default: return nullptr;
+  }
+}
+
+// A recovery, backfill or scrub message.  It has no client: "peer" is the
+// sending OSD and "seq" its message sequence number.  Only those that wrote
+// to BlueStore have a bluestore_lat.
+void print_background_op(osd_op_t &op, int osd_id, const char *kind) {
+  OutputBuffer &out = stdout_buffer();
+  out.put("osd ").dec(osd_id)
+     .put(" pg ").dec((long long)op.pg.m_pool).put('.').hex(op.pg.m_seed)
+     .put(" bg_").put(kind)
+     .put(" size ").dec((int)op.wb)
+     .put(" peer ").dec((long long)op.client_id)
+     .put(" seq ").dec((long long)op.req_id)
+     .put(" recv_lat ").dec((long long)op.recv_lat)
+     .put(" dispatch_lat ").dec((long long)op.dispatch_lat)
+     .put(" queue_lat ").dec((long long)op.queue_lat);
+  if (probe_mode & PGLOCK_PROBE)
+    out.put(" lock_wait ").dec((long long)op.lock_wait);
+  out.put(" osd_lat ").dec((long long)op.osd_lat)
+     .put(" bluestore_lat ").dec((long long)op.bs_lat);
+  if (op.is_write)
+    put_bluestore_details(out, op);
+  out.put(" op_lat ").dec((long long)op.op_lat);
+  out.end_line();
+  print_offcpu_info(out, op);
+}
+
+// A write of an erasure-coded pool, "shards" listing (shard, osd,
+// commit latency) of each shard from the sub-writes being sent.
+void print_ec_op(osd_op_t &op, int osd_id) {
+  OutputBuffer &out = stdout_buffer();
+  put_op_head(out, op, osd_id, "ec_w", op.wb, false);
+  out.put(" ec_prep_lat ").dec((long long)op.ec_prep_lat)
+     .put(" encode_lat ").dec((long long)op.ec_encode_lat)
+     .put(" shards [");
+  for (size_t i = 0; i < op.ec_shards.size(); ++i) {
+    const ec_shard_t &s = op.ec_shards[i];
+    if (i) out.put(", ");
+    out.put('(').dec(s.shard).put(", ").dec(s.osd).put(", ")
+       .dec((long long)s.commit_lat).put(')');
+  }
+  out.put("] slowest_shard ").dec(op.ec_slowest_shard)
+     .put(" shard_wait ").dec((long long)op.ec_shard_wait)
+     .put(" bluestore_lat ").dec((long long)op.bs_lat);
+  put_bluestore_details(out, op);
+  out.put(" op_lat ").dec((long long)op.op_lat);
+  put_cpu(out, op);
+  out.end_line();
+  print_delayed_info(out, op);
+  print_offcpu_info(out, op);
 }
 
 void print_op_r(osd_op_t &op, int osd_id) {
-  std::stringstream ss;
-  ss << std::hex << op.pg.m_seed;
-  std::string pgid(ss.str());
-  std::string object_name = format_object_name(op.object_name);
-  std::string detail_ops = format_detail_ops(op, false);
-
-  printf("osd %d pg %lld.%s op_r "
-         "size %d client %lld tid %lld "
-	 "object %s osd_ops %s "
-	 "throttle_lat %lld recv_lat %lld dispatch_lat %lld "
-	 "queue_lat %lld osd_lat %lld "
-	 "bluestore_lat %lld "
-	 "op_lat %lld\n",
-         osd_id, op.pg.m_pool, pgid.c_str(),
-	  op.rb, op.client_id, op.req_id,
-	  object_name.c_str(),
-	  detail_ops.c_str(),
-	  op.throttle_lat, op.recv_lat, op.dispatch_lat,
-	  op.queue_lat, op.osd_lat,
-	  op.bs_lat,
-	  op.op_lat);
-  print_delayed_info(op);
+  OutputBuffer &out = stdout_buffer();
+  put_op_head(out, op, osd_id, "op_r", op.rb, false);
+  out.put(" bluestore_lat ").dec((long long)op.bs_lat)
+     .put(" op_lat ").dec((long long)op.op_lat);
+  put_cpu(out, op);
+  out.end_line();
+  print_delayed_info(out, op);
+  print_offcpu_info(out, op);
 }
 
 void print_subop_w(osd_op_t &op, int osd_id) {
-  std::stringstream ss;
-  ss << std::hex << op.pg.m_seed;
-  std::string pgid(ss.str());
-  std::string object_name = format_object_name(op.object_name);
-  std::string detail_ops = format_detail_ops(op, true);
-
-  printf("osd %d pg %lld.%s subop_w "
-         "size %d client %lld tid %lld "
-	 "object %s txn_ops %s "
-	 "throttle_lat %lld recv_lat %lld dispatch_lat %lld "
-	 "queue_lat %lld osd_lat %lld "
-	 "bluestore_lat %lld "
-	 "subop_lat %lld\n",
-         osd_id, op.pg.m_pool, pgid.c_str(),
-	  op.wb, op.client_id, op.req_id,
-	  object_name.c_str(),
-	  detail_ops.c_str(),
-	  op.throttle_lat, op.recv_lat, op.dispatch_lat,
-	  op.queue_lat, op.osd_lat,
-	  op.bs_lat,
-	  op.op_lat);
-  print_delayed_info(op);
+  OutputBuffer &out = stdout_buffer();
+  put_op_head(out, op, osd_id, "subop_w", op.wb, true);
+  out.put(" bluestore_lat ").dec((long long)op.bs_lat);
+  put_bluestore_details(out, op);
+  out.put(" subop_lat ").dec((long long)op.op_lat);
+  put_cpu(out, op);
+  out.end_line();
+  print_delayed_info(out, op);
+  print_offcpu_info(out, op);
 }
 
 void print_op_w(osd_op_t &op, int osd_id) {
-
-  std::stringstream ss;
-  ss << std::hex << op.pg.m_seed;
-  std::string pgid(ss.str());
-  std::string object_name = format_object_name(op.object_name);
-  std::string detail_ops = format_detail_ops(op, false);
-
-  printf("osd %d pg %lld.%s op_w "
-         "size %d client %lld tid %lld "
-	 "object %s osd_ops %s "
-	 "throttle_lat %lld recv_lat %lld dispatch_lat %lld "
-	 "queue_lat %lld osd_lat %lld peers [(%d, %lld), (%d, %lld)] "
-	 "bluestore_lat %lld "
-	 "op_lat %lld\n",
-         osd_id, op.pg.m_pool, pgid.c_str(),
-	  op.wb, op.client_id, op.req_id,
-	  object_name.c_str(),
-	  detail_ops.c_str(),
-	  op.throttle_lat, op.recv_lat, op.dispatch_lat,
-	  op.queue_lat, op.osd_lat,  op.peers[0].peer, op.peers[0].latency, op.peers[1].peer, op.peers[1].latency,
-	  op.bs_lat,
-	  op.op_lat);
-  print_delayed_info(op);
+  OutputBuffer &out = stdout_buffer();
+  put_op_head(out, op, osd_id, "op_w", op.wb, false);
+  out.put(" peers [(").dec(op.peers[0].peer).put(", ").dec((long long)op.peers[0].latency)
+     .put("), (").dec(op.peers[1].peer).put(", ").dec((long long)op.peers[1].latency)
+     .put(")]");
+  out.put(" bluestore_lat ").dec((long long)op.bs_lat);
+  put_bluestore_details(out, op);
+  out.put(" op_lat ").dec((long long)op.op_lat);
+  put_cpu(out, op);
+  out.end_line();
+  print_delayed_info(out, op);
+  print_offcpu_info(out, op);
 }
 
 void signal_handler(int signum){
-  clog << "Caught signal " << signum << endl;
-  if (signum == SIGINT) {
-      print_all_srl();
+  if (polling) {
+    caught_signal = signum;
+    return;
   }
-  exit(signum);
+  _exit(signum);
 }
 
 void timeout_handler(int signum) {
@@ -656,7 +1170,7 @@ void timeout_handler(int signum) {
     }
 }
 
-osd_op_t generate_op(op_v *val) {
+osd_op_t generate_op(op_v *val, const op_ext &ext) {
   osd_op_t op = osd_op_t();
 
   op.type = val->op_type;
@@ -673,8 +1187,12 @@ osd_op_t generate_op(op_v *val) {
   // submit_transaction probe could not be attached.
   op.is_write = val->op_type == MSG_OSD_REPOP ||
                 val->submit_transaction_stamp != 0 || val->wb > 0;
+  // wb of a background op is its message size, whatever it does
+  bool background = val->owner & OSDTRACE_BACKGROUND_OWNER;
+  if (background)
+    op.is_write = val->queue_transaction_stamp != 0;
 
-  op.client_id = val->owner;
+  op.client_id = val->owner & ~OSDTRACE_BACKGROUND_OWNER;
   op.req_id = val->tid;
 
   op.pg.m_pool = val->m_pool;
@@ -705,11 +1223,14 @@ osd_op_t generate_op(op_v *val) {
       (val->enqueue_stamp - (val->recv_complete_stamp - bootstamp))/1000;
 
   op.queue_lat += (val->dequeue_stamp - val->enqueue_stamp)/1000;
+  op.lock_wait = val->pg_lock_wait_ns/1000;
 
   if (op.is_write)
     op.osd_lat = (val->queue_transaction_stamp - val->dequeue_stamp)/1000;
   else if (op.rb > 0)
     op.osd_lat = (val->execute_ctx_stamp - val->dequeue_stamp) /1000;
+  else if (background)
+    op.osd_lat = (val->reply_stamp - val->dequeue_stamp)/1000;
 
   op.delayed_cnt = val->di.cnt;
   for(int i = 0; i < val->di.cnt; ++i) {
@@ -725,6 +1246,14 @@ osd_op_t generate_op(op_v *val) {
   op.bs_aio_wait_lat = (val->aio_done_stamp - val->aio_submit_stamp)/1000;
   op.bs_pg_seq_lat = (val->kv_submit_stamp - val->aio_done_stamp)/1000;
   op.bs_kv_commit_lat = (val->kv_committed_stamp - val->kv_submit_stamp)/1000;
+  op.kv_seen = val->kv_sync_ptid != 0 && val->kv_apply_stamp != 0 &&
+               val->kv_applied_stamp != 0 && val->kv_sync_end_stamp != 0;
+  if (op.kv_seen) {
+    op.bs_kv_batch_lat = (val->kv_apply_stamp - val->kv_submit_stamp)/1000;
+    op.bs_kv_wal_lat = (val->kv_applied_stamp - val->kv_apply_stamp)/1000;
+    op.bs_kv_sync_lat = (val->kv_sync_end_stamp - val->kv_applied_stamp)/1000;
+    op.bs_kv_fsync_lat = val->kv_fsync_ns/1000;
+  }
   if (op.is_write)
     op.bs_lat = (val->kv_committed_stamp - val->queue_transaction_stamp)/1000;
   else if (op.rb > 0)
@@ -732,24 +1261,577 @@ osd_op_t generate_op(op_v *val) {
 
   op.op_lat = (val->reply_stamp - (recv_stamp - bootstamp))/1000;
 
+  const struct ec_info &ec = ext.ec;
+  op.is_ec = ec.submit_stamp != 0;
+  op.ec_slowest_shard = -1;
+  if (op.is_ec) {
+    op.is_write = true;
+    op.osd_lat = (ec.submit_stamp - val->dequeue_stamp)/1000;
+    if (ec.encode_end_stamp) {
+      op.ec_prep_lat = (ec.encode_start_stamp - ec.submit_stamp)/1000;
+      op.ec_encode_lat = (ec.encode_end_stamp - ec.encode_start_stamp)/1000;
+    }
+    __u64 last = 0, before_last = 0;
+    for (int s = 0; s < EC_MAX_SHARDS; ++s) {
+      if (!(ec.shard_mask & (1u << s)) || !ec.sent_stamp ||
+          ec.commit_stamp[s] < ec.sent_stamp)
+        continue;
+      __u64 lat = (ec.commit_stamp[s] - ec.sent_stamp)/1000;
+      op.ec_shards.push_back({s, ec.osd[s], lat});
+      if (op.ec_slowest_shard < 0 || lat >= last) {
+        before_last = last;
+        last = lat;
+        op.ec_slowest_shard = s;
+      } else if (lat > before_last) {
+        before_last = lat;
+      }
+    }
+    op.ec_commit_lat = last;
+    op.ec_shard_wait = op.ec_shards.size() > 1 ? last - before_last : 0;
+  }
+
+  const struct offcpu_info &oc = ext.offcpu;
+  op.pid = val->pid;
+  op.offcpu_lat = oc.total_ns/1000;
+  op.offcpu_runnable = oc.runnable_ns/1000;
+  op.offcpu_switches = oc.switches;
+  op.offcpu_max = oc.max_ns/1000;
+  op.offcpu_max_runnable = oc.max_runnable != 0;
+  op.offcpu_kstack = oc.max_kstack;
+  op.offcpu_ustack = oc.max_ustack;
+
+  op.blk_ios = ext.blk.ios;
+  op.blk_queue_lat = ext.blk.queue_ns/1000;
+  op.blk_device_lat = ext.blk.device_ns/1000;
+
+  // the readings that bound each stage on the dequeuing thread; one it did
+  // not reach itself stays 0
+  const struct cpu_info &cpu = ext.cpu;
+  const struct cpu_reading &mid =
+      op.is_write ? cpu.queue_transaction : cpu.execute_ctx;
+  const struct cpu_reading &end = op.is_write ? cpu.aio_submit : cpu.reply;
+  if (cpu.dequeue.cycles && mid.cycles >= cpu.dequeue.cycles) {
+    op.cpu_seen = true;
+    op.cpu_osd_cycles = mid.cycles - cpu.dequeue.cycles;
+    op.cpu_osd_instructions = mid.instructions - cpu.dequeue.instructions;
+    if (end.cycles >= mid.cycles) {
+      op.cpu_bs_cycles = end.cycles - mid.cycles;
+      op.cpu_bs_instructions = end.instructions - mid.instructions;
+    }
+  }
+
   return op;
 }
 
-void handle_full(struct op_v *val, int osd_id) {
+// One row of the columnar "osd_op" table: every raw stamp of the event next
+// to the latencies derived from them, so a reader never has to redo the
+// recv_stamp fixups in generate_op().
+void put_columnar_op(const struct op_v *val, const struct op_ext &ext,
+                     const osd_op_t &op, int osd_id, const char *kind) {
+  static OutputBuffer scratch(-1, 1024);
+  bool transaction_ops = op.type == MSG_OSD_REPOP;
+  ColumnarWriter::Table &t = *columnar_ops;
+  t.add(osd_id).add(val->pid).add_str(kind).add(op.type)
+   .add(op.client_id).add(op.req_id).add(op.pg.m_pool).add(op.pg.m_seed)
+   .add_str(op.object_name);
+  scratch.clear();
+  put_detail_ops(scratch, op, transaction_ops);
+  t.add_str(scratch.data(), scratch.size())
+   .add(op.detail_ops_total).add(op.detail_ops_unavailable)
+   .add(val->wb).add(val->rb).add(val->aio_size);
+
+  t.add(val->recv_stamp).add(val->throttle_stamp).add(val->recv_complete_stamp)
+   .add(val->dispatch_stamp).add(val->enqueue_stamp).add(val->dequeue_stamp)
+   .add(val->execute_ctx_stamp).add(val->submit_transaction_stamp)
+   .add(val->queue_transaction_stamp).add(val->do_write_stamp)
+   .add(val->wctx_finish_stamp).add(val->aio_submit_stamp)
+   .add(val->aio_done_stamp).add(val->kv_submit_stamp)
+   .add(val->kv_committed_stamp).add(val->reply_stamp);
+
+  t.add(val->pi.peer1).add(val->pi.peer2).add(val->pi.sent_stamp)
+   .add(val->pi.recv_stamp1).add(val->pi.recv_stamp2);
+
+  scratch.clear();
+  for (__u32 i = 0; i < op.delayed_cnt; ++i) {
+    if (i) scratch.put(',');
+    scratch.put(op.delayed_strs[i]);
+  }
+  t.add_str(scratch.data(), scratch.size());
+
+  t.add(op.throttle_lat).add(op.recv_lat).add(op.dispatch_lat)
+   .add(op.queue_lat).add(op.osd_lat).add(op.bs_prepare_lat)
+   .add(op.bs_aio_wait_lat).add(op.bs_pg_seq_lat).add(op.bs_kv_commit_lat)
+   .add(op.bs_lat).add(op.op_lat);
+
+  t.add(val->kv_apply_stamp).add(val->kv_applied_stamp)
+   .add(val->kv_sync_start_stamp).add(val->kv_sync_end_stamp)
+   .add(val->kv_batch).add(op.bs_kv_batch_lat).add(op.bs_kv_wal_lat)
+   .add(op.bs_kv_sync_lat).add(op.bs_kv_fsync_lat);
+  t.add(val->pg_lock_wait_ns);
+
+  scratch.clear();
+  for (size_t i = 0; i < op.ec_shards.size(); ++i) {
+    const ec_shard_t &s = op.ec_shards[i];
+    if (i) scratch.put(',');
+    scratch.dec(s.shard).put(':').dec(s.osd).put(':')
+           .dec((long long)s.commit_lat);
+  }
+  t.add(ext.ec.submit_stamp).add(ext.ec.encode_start_stamp)
+   .add(ext.ec.encode_end_stamp).add(ext.ec.sent_stamp)
+   .add_str(scratch.data(), scratch.size())
+   .add(op.ec_encode_lat).add(op.ec_commit_lat).add(op.ec_shard_wait);
+  t.add(op.offcpu_lat).add(op.offcpu_runnable).add(op.offcpu_switches)
+   .add(op.offcpu_max);
+  if (offcpu_symbolizer && op.offcpu_switches)
+    t.add_str(offcpu_symbolizer->name(op.pid, op.offcpu_kstack,
+                                      op.offcpu_ustack));
+  else
+    t.add_str("");
+  t.add(op.blk_ios).add(ext.blk.complete_stamp).add(op.blk_queue_lat)
+   .add(op.blk_device_lat);
+  t.add(op.cpu_osd_cycles).add(op.cpu_osd_instructions)
+   .add(op.cpu_bs_cycles).add(op.cpu_bs_instructions);
+  t.end_row();
+}
+
+// Feed one op to the --analyze report, using the same field names as the
+// op lines and tools/analyze_osdtrace_output.py.
+void analyze_op(const osd_op_t &op, int osd_id, const char *kind) {
+  OsdLatencyReport &r = *analyze_report;
+  int idx = OsdLatencyReport::op_index(kind);
+  const std::string &f = r.field();
+  bool bluestore_detail = op.is_write;
+  if (f == "lat") r.add_value(osd_id, idx, op.op_lat);
+  else if (f == "throttle_lat") r.add_value(osd_id, idx, op.throttle_lat);
+  else if (f == "recv_lat") r.add_value(osd_id, idx, op.recv_lat);
+  else if (f == "dispatch_lat") r.add_value(osd_id, idx, op.dispatch_lat);
+  else if (f == "queue_lat") r.add_value(osd_id, idx, op.queue_lat);
+  else if (f == "osd_lat") r.add_value(osd_id, idx, op.osd_lat);
+  else if (f == "bluestore_lat") r.add_value(osd_id, idx, op.bs_lat);
+  else if (f == "lock_wait") r.add_value(osd_id, idx, op.lock_wait);
+  else if (!bluestore_detail) {}
+  else if (f == "prepare") r.add_value(osd_id, idx, op.bs_prepare_lat);
+  else if (f == "aio_wait") r.add_value(osd_id, idx, op.bs_aio_wait_lat);
+  else if (f == "aio_size") r.add_value(osd_id, idx, op.aio_size);
+  else if (f == "seq_wait") r.add_value(osd_id, idx, op.bs_pg_seq_lat);
+  else if (f == "kv_commit") r.add_value(osd_id, idx, op.bs_kv_commit_lat);
+  else if (!op.kv_seen) {}
+  else if (f == "kv_batch") r.add_value(osd_id, idx, op.bs_kv_batch_lat);
+  else if (f == "kv_wal") r.add_value(osd_id, idx, op.bs_kv_wal_lat);
+  else if (f == "kv_sync") r.add_value(osd_id, idx, op.bs_kv_sync_lat);
+  else if (f == "kv_fsync") r.add_value(osd_id, idx, op.bs_kv_fsync_lat);
+
+  const uint64_t stages[OsdLatencyReport::NUM_INFER_FIELDS] = {
+      op.throttle_lat, op.recv_lat, op.dispatch_lat,
+      op.queue_lat, op.osd_lat, op.bs_lat};
+  r.add_stages(osd_id, idx, op.op_lat, stages);
+}
+
+// Split an op into the consecutive stages of StageAttribution.  What is
+// left after the local commit of a primary write is put on the replicas, up
+// to the slowest peer round trip.
+void attribute_op(const osd_op_t &op, int osd_id) {
+  uint64_t st[StageAttribution::NUM_STAGES] = {};
+  st[StageAttribution::RECV] = op.recv_lat;
+  st[StageAttribution::DISPATCH] = op.dispatch_lat;
+  st[StageAttribution::QUEUE] = op.queue_lat;
+  st[StageAttribution::OSD] = op.osd_lat;
+  if (op.is_write) {
+    st[StageAttribution::PREPARE] = op.bs_prepare_lat;
+    st[StageAttribution::AIO_WAIT] = op.bs_aio_wait_lat;
+    st[StageAttribution::PG_SEQ] = op.bs_pg_seq_lat;
+    st[StageAttribution::KV_COMMIT] = op.bs_kv_commit_lat;
+  } else {
+    st[StageAttribution::AIO_WAIT] = op.bs_lat;
+  }
+  if (op.type == MSG_OSD_OP && op.is_write) {
+    uint64_t local = 0;
+    for (uint64_t v : st) local += v;
+    uint64_t peer = 0;
+    for (const peer_lat &p : op.peers)
+      // a peer that never replied leaves a wrapped-around latency
+      if (p.latency <= op.op_lat) peer = std::max<uint64_t>(peer, p.latency);
+    if (op.op_lat > local)
+      st[StageAttribution::PEER] = std::min<uint64_t>(op.op_lat - local, peer);
+  }
+  attribution->add(osd_id, op.op_lat, st);
+}
+
+// Round trip to each replica of a primary write, from the raw stamps: a
+// replica that has not answered by the time the op was reported leaves its
+// recv stamp at 0 and is skipped.
+void add_peer_latencies(const struct op_v *val, int osd_id) {
+  const struct peers_info &pi = val->pi;
+  if (pi.peer1 >= 0 && pi.recv_stamp1 && pi.recv_stamp1 >= pi.sent_stamp)
+    peer_matrix->add(osd_id, pi.peer1, (pi.recv_stamp1 - pi.sent_stamp) / 1000);
+  if (pi.peer2 >= 0 && pi.recv_stamp2 && pi.recv_stamp2 >= pi.sent_stamp)
+    peer_matrix->add(osd_id, pi.peer2, (pi.recv_stamp2 - pi.sent_stamp) / 1000);
+}
+
+// The wall clock time that heads each interval report: "14:02:10"
+struct WallTime {
+  char ts[16];
+  WallTime() {
+    time_t t = time(NULL);
+    strftime(ts, sizeof(ts), "%H:%M:%S", localtime(&t));
+  }
+  operator const char *() const { return ts; }
+};
+
+// CLOCK_BOOTTIME in ns, the clock of the BPF stamps and columnar rows
+static __u64 boottime_ns() {
+  struct timespec now;
+  clock_gettime(CLOCK_BOOTTIME, &now);
+  return (__u64)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+void print_peer_matrix(unsigned interval) {
+  OutputBuffer &out = stdout_buffer();
+  if (interval) {
+    WallTime ts;
+    out.put("=== ").put(ts).put(" replication latency by primary and peer, since start ===").end_line();
+  }
+  if (peer_matrix->empty())
+    out.put("no replicated writes traced").end_line();
+  else
+    peer_matrix->print(out, PEER_MATRIX_TOP);
+  out.end_line();
+  out.flush();
+}
+
+void print_bottleneck_report(unsigned interval) {
+  OutputBuffer &out = stdout_buffer();
+  if (interval) {
+    WallTime ts;
+    out.put("=== ").put(ts).put(" bottleneck, last ").dec(interval).put("s ===").end_line();
+  }
+  if (attribution->empty())
+    out.put("no ops traced").end_line();
+  else
+    attribution->print(out);
+  out.flush();
+  attribution->clear();
+}
+
+// --sched: restart the BPF maxima by bumping the epoch, then read every
+// (pid, shard, class) counter set and print the rows of the interval.
+void sample_sched(int stats_fd, int epoch_fd) {
+  __u32 zero = 0;
+  __u64 epoch = 0;
+  bpf_map_lookup_elem(epoch_fd, &zero, &epoch);
+  ++epoch;
+  bpf_map_update_elem(epoch_fd, &zero, &epoch, 0);
+
+  struct sched_k key, next;
+  struct sched_k *prev = NULL;
+  while (bpf_map_get_next_key(stats_fd, prev, &next) == 0) {
+    key = next;
+    prev = &key;
+    struct sched_v v;
+    if (bpf_map_lookup_elem(stats_fd, &key, &v) != 0 ||
+        key.cls >= SCHED_NUM_CLASSES)
+      continue;
+    SchedSeries::Reading r;
+    r.depth = v.depth;
+    r.enqueued = v.enqueued;
+    r.dequeued = v.dequeued;
+    r.wait_sum_us = v.wait_sum_ns / 1000;
+    // maxima of an earlier epoch: nothing moved in this interval
+    bool idle = v.epoch + 1 < epoch;
+    r.max_depth = idle ? (v.depth > 0 ? v.depth : 0) : v.max_depth;
+    r.wait_max_us = idle ? 0 : v.wait_max_ns / 1000;
+    sched_series->sample(osd_pid_to_id(key.pid), key.shard,
+                         SCHED_CLASS_NAMES[key.cls], r);
+  }
+
+  WallTime ts;
+  __u64 stamp = boottime_ns();
+  OutputBuffer &out = stdout_buffer();
+  for (const SchedSeries::Row &r : sched_series->rows()) {
+    SchedSeries::print_row(out, ts, r);
+    if (columnar_sched) {
+      columnar_sched->add(stamp).add(r.osd).add(r.shard).add_str(r.cls)
+          .add(r.depth).add(r.max_depth).add(r.enqueued).add(r.dequeued)
+          .add(r.wait_avg_us).add(r.wait_max_us);
+      columnar_sched->end_row();
+    }
+  }
+  out.flush();
+}
+
+void print_background_load(unsigned interval) {
+  WallTime ts;
+  OutputBuffer &out = stdout_buffer();
+  background_load->print(out, ts, interval);
+  out.flush();
+}
+
+// --pg-lock: sum the per-CPU histograms of every (pid, PG, kind) and print
+// the PGs with the most lock wait during the interval.
+void sample_pg_locks(int hists_fd) {
+  int ncpus = libbpf_num_possible_cpus();
+  if (ncpus <= 0)
+    return;
+  std::vector<struct pglock_hist> percpu(ncpus);
+  struct pglock_k key, next;
+  struct pglock_k *prev = NULL;
+  while (bpf_map_get_next_key(hists_fd, prev, &next) == 0) {
+    key = next;
+    prev = &key;
+    if (bpf_map_lookup_elem(hists_fd, &key, percpu.data()) != 0)
+      continue;
+    PgLockReport::Reading r;
+    for (const struct pglock_hist &h : percpu) {
+      r.count += h.count;
+      r.sum_us += h.sum_us;
+      for (int i = 0; i < PGLOCK_SLOTS; ++i)
+        r.slots[i] += h.slots[i];
+    }
+    pglock_report->sample(osd_pid_to_id(key.pid), key.pool, key.seed,
+                          key.kind == PGLOCK_HOLD, r);
+  }
+
+  WallTime ts;
+  __u64 stamp = boottime_ns();
+  OutputBuffer &out = stdout_buffer();
+  std::vector<PgLockReport::Row> rows = pglock_report->rows();
+  for (size_t i = 0; i < rows.size(); ++i) {
+    const PgLockReport::Row &r = rows[i];
+    if (i < PGLOCK_TOP)
+      PgLockReport::print_row(out, ts, r);
+    if (columnar_pglock) {
+      columnar_pglock->add(stamp).add(r.osd).add(r.pool).add(r.seed)
+          .add(r.waits).add(r.wait_total_us).add(r.wait_avg_us)
+          .add(r.wait_p99_us).add(r.holds).add(r.hold_avg_us)
+          .add(r.hold_p99_us);
+      columnar_pglock->end_row();
+    }
+  }
+  if (rows.size() > PGLOCK_TOP)
+    out.put("pglock ").put(ts).put(" (").dec(rows.size() - PGLOCK_TOP)
+       .put(" more PGs)").end_line();
+  out.flush();
+}
+
+// "client.4567", "osd.3"...: the peer entity of a --msgr connection.
+std::string msgr_peer_name(int type, long long id) {
+  const char *name;
+  switch (type) {
+    case CEPH_ENTITY_TYPE_MON: name = "mon"; break;
+    case CEPH_ENTITY_TYPE_MDS: name = "mds"; break;
+    case CEPH_ENTITY_TYPE_OSD: name = "osd"; break;
+    case CEPH_ENTITY_TYPE_CLIENT: name = "client"; break;
+    case CEPH_ENTITY_TYPE_MGR: name = "mgr"; break;
+    default: name = "unknown"; break;
+  }
+  if (id < 0)
+    return name;
+  return std::string(name) + "." + std::to_string(id);
+}
+
+// --msgr: read the counters of every connection and print the top peers of
+// the interval.
+void sample_msgr(int conns_fd, unsigned interval) {
+  __u64 stamp = boottime_ns();
+
+  struct msgr_conn_k key, next;
+  struct msgr_conn_k *prev = NULL;
+  std::vector<struct msgr_conn_k> closed;
+  while (bpf_map_get_next_key(conns_fd, prev, &next) == 0) {
+    key = next;
+    prev = &key;
+    struct msgr_conn_v v;
+    if (bpf_map_lookup_elem(conns_fd, &key, &v) != 0)
+      continue;
+    if (v.closed)
+      closed.push_back(key);
+    MsgrReport::Reading r;
+    r.bytes_in = v.bytes_in;
+    r.bytes_out = v.bytes_out;
+    r.msgs_in = v.msgs_in;
+    r.msgs_out = v.msgs_out;
+    r.stalls = v.stalls;
+    __u64 stall_ns = v.stall_ns;
+    if (v.stall_start && v.stall_start < stamp)
+      stall_ns += stamp - v.stall_start;
+    r.stall_us = stall_ns / 1000;
+    std::string peer = msgr_peer_name(v.peer_type, v.peer_id);
+    int osd = osd_pid_to_id(key.pid);
+    msgr_report->sample(osd, key.conn, peer, r);
+    if (columnar_msgr) {
+      columnar_msgr->add(stamp).add(osd).add(key.conn).add_str(peer)
+          .add(r.bytes_in).add(r.bytes_out).add(r.msgs_in).add(r.msgs_out)
+          .add(r.stalls).add(r.stall_us);
+      columnar_msgr->end_row();
+    }
+  }
+  // after the walk: deleting the current key would restart it
+  for (const auto &k : closed)
+    bpf_map_delete_elem(conns_fd, &k);
+
+  WallTime ts;
+  OutputBuffer &out = stdout_buffer();
+  msgr_report->print(out, ts, interval, MSGR_TOP);
+  out.end_line();
+  out.flush();
+}
+
+// --blk: sum each device's per-CPU histograms, and print the change since
+// the last interval.  The columnar osd_blk rows keep the cumulative counts,
+// the histograms as "<slot>:<count>,..." where slot i holds [2^i, 2^(i+1)) us.
+void sample_blk(int hists_fd, unsigned interval) {
+  int ncpus = libbpf_num_possible_cpus();
+  if (ncpus <= 0)
+    return;
+  std::vector<struct blk_hist> percpu(ncpus);
+  __u64 stamp = boottime_ns();
+  static OutputBuffer scratch(-1, 1024);
+  __u32 key, next;
+  __u32 *prev = NULL;
+  while (bpf_map_get_next_key(hists_fd, prev, &next) == 0) {
+    key = next;
+    prev = &key;
+    if (bpf_map_lookup_elem(hists_fd, &key, percpu.data()) != 0)
+      continue;
+    BlkReport::Reading r;
+    for (const struct blk_hist &h : percpu) {
+      r.count += h.count;
+      r.bytes += h.bytes;
+      r.queue_sum_us += h.queue_sum_us;
+      r.device_sum_us += h.device_sum_us;
+      for (int i = 0; i < BLK_SLOTS; ++i) {
+        r.queue_slots[i] += h.queue_slots[i];
+        r.device_slots[i] += h.device_slots[i];
+      }
+    }
+    auto name = blk_dev_names.find(key);
+    const std::string dev = name != blk_dev_names.end()
+        ? name->second
+        : std::to_string(key >> 20) + ":" + std::to_string(key & 0xfffff);
+    blk_report->sample(dev, r);
+    if (columnar_blk) {
+      columnar_blk->add(stamp).add_str(dev).add(r.count).add(r.bytes)
+          .add(r.queue_sum_us).add(r.device_sum_us);
+      for (const uint64_t *slots : {r.queue_slots, r.device_slots}) {
+        scratch.clear();
+        for (int i = 0; i < BLK_SLOTS; ++i) {
+          if (!slots[i]) continue;
+          if (scratch.size()) scratch.put(',');
+          scratch.dec(i).put(':').dec(slots[i]);
+        }
+        columnar_blk->add_str(scratch.data(), scratch.size());
+      }
+      columnar_blk->end_row();
+    }
+  }
+
+  WallTime ts;
+  OutputBuffer &out = stdout_buffer();
+  blk_report->print(out, ts, interval);
+  out.flush();
+}
+
+void print_cpu_report() {
+  WallTime ts;
+  OutputBuffer &out = stdout_buffer();
+  cpu_report->print(out, ts);
+  out.flush();
+  cpu_report->clear();
+}
+
+void print_ec_report() {
+  WallTime ts;
+  OutputBuffer &out = stdout_buffer();
+  ec_report->print(out, ts);
+  out.flush();
+  ec_report->clear();
+}
+
+void print_analyze_report(unsigned interval) {
+  OutputBuffer &out = stdout_buffer();
+  if (interval) {
+    WallTime ts;
+    out.put("=== ").put(ts).put(" last ").dec(interval).put("s ===").end_line();
+  }
+  if (analyze_report->empty()) {
+    out.put("no ops traced").end_line();
+    out.end_line();
+  } else {
+    analyze_report->print_analysis(out);
+    out.put("latency contributions (ops with lat >= ")
+       .dec(analyze_infer_threshold).put(" μsec):").end_line();
+    analyze_report->print_infer(out);
+  }
+  out.flush();
+  analyze_report->clear();
+}
+
+void handle_full(struct op_v *val, const struct op_ext &ext, int osd_id) {
     //if (val->wb == 0)
       //return;
-    osd_op_t op = generate_op(val);
+    osd_op_t op = generate_op(val, ext);
     if (op.op_lat/(1000) < threshold)
       return;
+    const char *bg_kind = (val->owner & OSDTRACE_BACKGROUND_OWNER)
+                              ? background_kind(op.type) : nullptr;
+    if (background_load) {
+      if (bg_kind)
+        background_load->add(osd_id, bg_kind, op.wb, op.op_lat);
+      else if (op.type == MSG_OSD_OP)
+        background_load->add(osd_id, "client", op.is_write ? op.wb : op.rb,
+                             op.op_lat);
+    }
+    if (cpu_report && op.cpu_seen && !bg_kind) {
+      const char *kind = op.type == MSG_OSD_REPOP ? "subop_w"
+                         : op.is_ec               ? "ec_w"
+                         : op.is_write            ? "op_w"
+                                                  : "op_r";
+      cpu_report->add(osd_id, kind, op.cpu_osd_cycles, op.cpu_osd_instructions,
+                      op.cpu_bs_cycles, op.cpu_bs_instructions);
+    }
+    if (ec_report && op.is_ec && !op.ec_shards.empty()) {
+      int slowest_osd = -1;
+      for (const ec_shard_t &s : op.ec_shards)
+        if (s.shard == op.ec_slowest_shard) slowest_osd = s.osd;
+      ec_report->add(osd_id, op.ec_encode_lat, op.ec_commit_lat,
+                     op.ec_shard_wait, slowest_osd);
+    }
+    if (bg_kind) {
+      if (!(analyze_report || attribution || peer_matrix))
+        print_background_op(op, osd_id, bg_kind);
+      if (columnar_ops) put_columnar_op(val, ext, op, osd_id, bg_kind);
+      return;
+    }
+    if (analyze_report || attribution || peer_matrix) {
+      const char *kind = nullptr;
+      if (op.type == MSG_OSD_REPOP)
+        kind = "subop_w";
+      else if (op.type == MSG_OSD_OP)
+        kind = op.is_write ? "op_w" : "op_r";
+      if (!kind)
+        return;
+      if (analyze_report) analyze_op(op, osd_id, kind);
+      if (attribution) attribute_op(op, osd_id);
+      if (peer_matrix && op.type == MSG_OSD_OP && op.is_write)
+        add_peer_latencies(val, osd_id);
+      if (columnar_ops) put_columnar_op(val, ext, op, osd_id, kind);
+      return;
+    }
     if (op.type == MSG_OSD_REPOP) {
       print_subop_w(op, osd_id);
+      if (columnar_ops) put_columnar_op(val, ext, op, osd_id, "subop_w");
+    } else if (op.type == MSG_OSD_OP && op.is_ec) {
+      print_ec_op(op, osd_id);
+      if (columnar_ops) put_columnar_op(val, ext, op, osd_id, "ec_w");
     } else if (op.type == MSG_OSD_OP) {
+      const char *kind = op.is_write ? "op_w" : "op_r";
       if (op.is_write)
         print_op_w(op, osd_id);
       else
         print_op_r(op, osd_id);
+      if (columnar_ops) put_columnar_op(val, ext, op, osd_id, kind);
     } else {
-      printf("unsupported op type %d\n", op.type);
+      stdout_buffer().put("unsupported op type ").dec(op.type).end_line();
     }
 }
 
@@ -760,7 +1842,14 @@ void handle_bluestore(struct bluestore_lat_v *val, int osd_id) {
     // The `name` argument captured from the probe is the authoritative,
     // version-stable label for the operation.
     const char *name = val->name[0] ? val->name : "?";
-    printf("osd %d bluestore %s lat %lld us\n", osd_id, name, lat_us);
+    OutputBuffer &out = stdout_buffer();
+    out.put("osd ").dec(osd_id).put(" bluestore ").put(name)
+       .put(" lat ").dec((long long)lat_us).put(" us");
+    out.end_line();
+    if (columnar_bluestore) {
+      columnar_bluestore->add(osd_id).add(val->pid).add_str(name).add(val->lat);
+      columnar_bluestore->end_row();
+    }
 }
 
 static int handle_event(void *ctx, void *data, size_t size) {
@@ -770,17 +1859,22 @@ static int handle_event(void *ctx, void *data, size_t size) {
 
   // Determine event type based on size
   bool is_bluestore_event = (size == sizeof(struct bluestore_lat_v));
-  bool is_op_event = (size == sizeof(struct op_v));
+  // an op carries its op_ext only when --ec, --offcpu, --blk or --cpu is on
+  static const struct op_ext no_op_ext = {};
+  bool is_op_ext_event = (size == sizeof(struct op_ext_v));
+  bool is_op_event = is_op_ext_event || (size == sizeof(struct op_v));
 
   if (is_op_event && (probe_mode & (OP_SINGLE_PROBE | OP_FULL_PROBE))) {
     struct op_v *val = (struct op_v *)data;
+    const struct op_ext &ext =
+        is_op_ext_event ? ((struct op_ext_v *)data)->ext : no_op_ext;
     pid = val->pid;
     osd_id = osd_pid_to_id(pid);
 
     if (probe_mode == OP_SINGLE_PROBE) {
       handle_single(val, osd_id);
     } else if (probe_mode & OP_FULL_PROBE) {
-      handle_full(val, osd_id);
+      handle_full(val, ext, osd_id);
     }
   } else if (is_bluestore_event && (probe_mode & BLUESTORE_PROBE)) {
     struct bluestore_lat_v *val = (struct bluestore_lat_v *) data;
@@ -811,6 +1905,7 @@ bool skip_version_check = false;
 bool list_only = false;
 bool list_embedded = false;
 bool trace_all = false;
+std::string columnar_file;
 
 struct OsdProcessInfo {
   int pid;
@@ -972,6 +2067,21 @@ int parse_args(int argc, char **argv) {
     {"list-embedded", no_argument, 0, 0},
     {"id", required_argument, 0, 0},
     {"all", no_argument, 0, 'a'},
+    {"columnar", required_argument, 0, 0},
+    {"analyze", no_argument, 0, 0},
+    {"analyze-field", required_argument, 0, 0},
+    {"analyze-interval", required_argument, 0, 0},
+    {"bottleneck", required_argument, 0, 0},
+    {"peer-matrix", required_argument, 0, 0},
+    {"kv", no_argument, 0, 0},
+    {"sched", required_argument, 0, 0},
+    {"background", required_argument, 0, 0},
+    {"pg-lock", required_argument, 0, 0},
+    {"msgr", required_argument, 0, 0},
+    {"ec", required_argument, 0, 0},
+    {"offcpu", no_argument, 0, 0},
+    {"blk", required_argument, 0, 0},
+    {"cpu", required_argument, 0, 0},
     {0, 0, 0, 0}
   };
 
@@ -1006,6 +2116,79 @@ int parse_args(int argc, char **argv) {
               return -1;
             }
           }
+        } else if (strcmp(long_options[option_index].name, "columnar") == 0) {
+          columnar_file = optarg;
+        } else if (strcmp(long_options[option_index].name, "analyze") == 0) {
+          analyze = true;
+        } else if (strcmp(long_options[option_index].name, "analyze-field") == 0) {
+          if (!OsdLatencyReport::valid_field(optarg)) {
+            std::cerr << optarg << " is not a latency field (e.g. lat, recv_lat, queue_lat, kv_commit)" << std::endl;
+            return -1;
+          }
+          analyze_field = optarg;
+          analyze = true;
+        } else if (strcmp(long_options[option_index].name, "analyze-interval") == 0) {
+          if (!parse_duration_arg(optarg, analyze_interval)) {
+            std::cerr << "Invalid analyze interval. Use seconds with optional s/m/h suffix." << std::endl;
+            return -1;
+          }
+          analyze = true;
+        } else if (strcmp(long_options[option_index].name, "bottleneck") == 0) {
+          if (!parse_duration_arg(optarg, bottleneck_interval) || bottleneck_interval == 0) {
+            std::cerr << "Invalid bottleneck interval. Use seconds with optional s/m/h suffix." << std::endl;
+            return -1;
+          }
+        } else if (strcmp(long_options[option_index].name, "kv") == 0) {
+          probe_mode |= KV_PROBE;
+        } else if (strcmp(long_options[option_index].name, "sched") == 0) {
+          if (!parse_duration_arg(optarg, sched_interval) || sched_interval == 0) {
+            std::cerr << "Invalid sched interval. Use seconds with optional s/m/h suffix." << std::endl;
+            return -1;
+          }
+          probe_mode |= SCHED_PROBE;
+        } else if (strcmp(long_options[option_index].name, "background") == 0) {
+          if (!parse_duration_arg(optarg, background_interval) || background_interval == 0) {
+            std::cerr << "Invalid background interval. Use seconds with optional s/m/h suffix." << std::endl;
+            return -1;
+          }
+          probe_mode |= BACKGROUND_PROBE;
+        } else if (strcmp(long_options[option_index].name, "pg-lock") == 0) {
+          if (!parse_duration_arg(optarg, pglock_interval) || pglock_interval == 0) {
+            std::cerr << "Invalid pg-lock interval. Use seconds with optional s/m/h suffix." << std::endl;
+            return -1;
+          }
+          probe_mode |= PGLOCK_PROBE;
+        } else if (strcmp(long_options[option_index].name, "msgr") == 0) {
+          if (!parse_duration_arg(optarg, msgr_interval) || msgr_interval == 0) {
+            std::cerr << "Invalid msgr interval. Use seconds with optional s/m/h suffix." << std::endl;
+            return -1;
+          }
+          probe_mode |= MSGR_PROBE;
+        } else if (strcmp(long_options[option_index].name, "ec") == 0) {
+          if (!parse_duration_arg(optarg, ec_interval) || ec_interval == 0) {
+            std::cerr << "Invalid ec interval. Use seconds with optional s/m/h suffix." << std::endl;
+            return -1;
+          }
+          probe_mode |= EC_PROBE;
+        } else if (strcmp(long_options[option_index].name, "offcpu") == 0) {
+          probe_mode |= OFFCPU_PROBE;
+        } else if (strcmp(long_options[option_index].name, "blk") == 0) {
+          if (!parse_duration_arg(optarg, blk_interval) || blk_interval == 0) {
+            std::cerr << "Invalid blk interval. Use seconds with optional s/m/h suffix." << std::endl;
+            return -1;
+          }
+          probe_mode |= BLK_PROBE;
+        } else if (strcmp(long_options[option_index].name, "cpu") == 0) {
+          if (!parse_duration_arg(optarg, cpu_interval) || cpu_interval == 0) {
+            std::cerr << "Invalid cpu interval. Use seconds with optional s/m/h suffix." << std::endl;
+            return -1;
+          }
+          probe_mode |= CPU_PROBE;
+        } else if (strcmp(long_options[option_index].name, "peer-matrix") == 0) {
+          if (!parse_duration_arg(optarg, peer_matrix_interval) || peer_matrix_interval == 0) {
+            std::cerr << "Invalid peer matrix interval. Use seconds with optional s/m/h suffix." << std::endl;
+            return -1;
+          }
         }
         break;
       case 'V':
@@ -1021,6 +2204,7 @@ int parse_args(int argc, char **argv) {
         break;
       case 'l':
         threshold = stoi(optarg);
+        threshold_set = true;
         break;
       case 'b':
         probe_mode |= BLUESTORE_PROBE;
@@ -1060,16 +2244,31 @@ int parse_args(int argc, char **argv) {
         break;
       case '?':
       case 'h':
-        std::cout << "Usage: " << argv[0] << " [-s] [-l <milliseconds>] [-b] [-j] [-i <filename>] [-t <seconds>] [-a] [-p <pid1,pid2,...>] [--id <osd-id1,osd-id2,...>] [--skip-version-check] [--list] [--list-embedded]\n";
+        std::cout << "Usage: " << argv[0] << " [-s] [-l <milliseconds>] [-b] [-j] [-i <filename>] [-t <seconds>] [-a] [-p <pid1,pid2,...>] [--id <osd-id1,osd-id2,...>] [--columnar <filename>] [--analyze] [--analyze-field <field>] [--analyze-interval <seconds>] [--bottleneck <seconds>] [--peer-matrix <seconds>] [--kv] [--sched <seconds>] [--background <seconds>] [--pg-lock <seconds>] [--msgr <seconds>] [--ec <seconds>] [--offcpu] [--blk <seconds>] [--cpu <seconds>] [--skip-version-check] [--list] [--list-embedded]\n";
         std::cout << "  -s                        Set probe mode to Single OP (logs PrimaryLogPG::log_op_stats only)\n";
         std::cout << "  -l <milliseconds>         Set operation latency threshold to capture\n";
         std::cout << "  -b                        Set probe mode to Bluestore\n";
-        std::cout << "  -j                        Export DWARF info to JSON file\n";
-        std::cout << "  -i <filename>             Import DWARF info from JSON file\n";
+        std::cout << "  -j                        Export DWARF info to JSON file (binary format if it ends in .bin)\n";
+        std::cout << "  -i <filename>             Import DWARF info from JSON or binary file\n";
         std::cout << "  -t <seconds>              Set execution timeout in seconds\n";
         std::cout << "  -a, --all                 Trace ALL traceable ceph-osd processes on the host (native and containerized)\n";
         std::cout << "  -p <pid1,pid2,...>        Probe using Process IDs (comma-separated, mandatory for tracing containerized processes)\n";
         std::cout << "  --id <osd-id1,osd-id2,...> Probe by OSD ID (comma-separated; resolves to PIDs via discovery)\n";
+        std::cout << "  --columnar <filename>     Also record every op (and -b bluestore event) to a columnar file, see tools/columnar_reader.py\n";
+        std::cout << "  --analyze                 Print latency statistics per OSD and op type at exit instead of every op\n";
+        std::cout << "  --analyze-field <field>   Latency field to analyze (default: lat; e.g. recv_lat, queue_lat, kv_commit)\n";
+        std::cout << "  --analyze-interval <secs> Print the analysis every <secs> seconds, each covering only that interval\n";
+        std::cout << "  --bottleneck <secs>       Every <secs> seconds, print each OSD's p50/p99 latency split by stage and its bottleneck instead of every op\n";
+        std::cout << "  --peer-matrix <secs>      Every <secs> seconds, print the primary/replica OSD pairs with the slowest replication round trips instead of every op\n";
+        std::cout << "  --kv                      Also probe the RocksDB batch sync and BlueFS fsync, splitting kv_commit into kv_batch, kv_wal, kv_sync and kv_fsync\n";
+        std::cout << "  --sched <secs>            Every <secs> seconds, also print the op scheduler queue depth and wait per OSD shard and op class\n";
+        std::cout << "  --background <secs>       Also trace recovery, backfill and scrub ops, and every <secs> seconds print their rate and latency beside the client ops\n";
+        std::cout << "  --pg-lock <secs>          Every <secs> seconds, print the PGs with the most PG lock wait, and add each op's lock_wait\n";
+        std::cout << "  --msgr <secs>             Every <secs> seconds, print the messenger peers with the most bandwidth and send stall\n";
+        std::cout << "  --ec <secs>               Also trace erasure-coded writes with their encode and per-shard commit times, summarized every <secs> seconds\n";
+        std::cout << "  --offcpu                  Also trace when the thread running an op is switched out, and print the stack of its longest block\n";
+        std::cout << "  --blk <secs>              Split each write's aio_wait into block queue and device time, and every <secs> seconds print per-device histograms\n";
+        std::cout << "  --cpu <secs>              Count each op's CPU cycles and instructions per stage, and every <secs> seconds print cycles/op and IPC per op type\n";
         std::cout << "  --skip-version-check      Skip version check when importing DWARF JSON (currently needed for containers)\n";
         std::cout << "  --list                    List active ceph-osd processes on the host, their PIDs and OSD IDs, and exit\n";
         std::cout << "  --list-embedded           List the Ceph versions with DWARF data compiled into this binary, and exit\n";
@@ -1081,6 +2280,25 @@ int parse_args(int argc, char **argv) {
         return -1;
     }
   }
+  if ((analyze || bottleneck_interval || peer_matrix_interval) &&
+      !(probe_mode & OP_FULL_PROBE)) {
+    std::cerr << "--analyze, --bottleneck and --peer-matrix need the full probe mode (not -s)" << std::endl;
+    return -1;
+  }
+  // the modes that add to the full op events
+  static const struct { int mode; const char *option; } full_only[] = {
+    {KV_PROBE, "--kv"}, {BACKGROUND_PROBE, "--background"},
+    {EC_PROBE, "--ec"}, {OFFCPU_PROBE, "--offcpu"}, {BLK_PROBE, "--blk"},
+    {CPU_PROBE, "--cpu"},
+  };
+  for (const auto &f : full_only) {
+    if ((probe_mode & (f.mode | OP_FULL_PROBE)) == f.mode) {
+      std::cerr << f.option << " needs the full probe mode (not -s)" << std::endl;
+      return -1;
+    }
+  }
+  if (analyze && threshold_set)
+    analyze_infer_threshold = threshold * 1000;
   return 0;
 }
 
@@ -1091,6 +2309,11 @@ void fill_map_hprobes(std::string mod_path, DwarfParser &dwarfparser, struct bpf
     std::string funcname = x.first;
     int key_idx = func_id[funcname];
     for (auto vf : x.second) {
+      // a var path the DWARF parser couldn't resolve keeps its varid
+      if (vf.fields.empty()) {
+        ++key_idx;
+        continue;
+      }
       struct VarField_Kernel vfk;
       vfk.varloc = vf.varloc;
       clog << "fill_map_hprobes: "
@@ -1125,11 +2348,19 @@ int attach_probe(struct osdtrace_bpf *skel,
   }
   if (v > 0)
       funcname = funcname + "_v" + std::to_string(v);
-  int pid = func_progid[funcname];
+  if (is_retprobe)
+      funcname = funcname + "_ret";
+  auto prog_it = func_progname.find(funcname);
+  struct bpf_program *prog = prog_it == func_progname.end() ? NULL :
+      bpf_object__find_program_by_name(skel->obj, prog_it->second.c_str());
+  if (!prog) {
+    cerr << "No BPF program for " << funcname << ", skipping " << pname << endl;
+    return -1;
+  }
 
   std::string attach_path = (process_id == -1) ? path : "/proc/" + std::to_string(process_id) + "/root/" + path;
   struct bpf_link *ulink = bpf_program__attach_uprobe(
-      *skel->skeleton->progs[pid].prog,
+      prog,
       is_retprobe,
       process_id,
       attach_path.c_str(), func_addr);
@@ -1436,6 +2667,127 @@ static int resolve_trace_targets(TraceTarget &target) {
   return 0;
 }
 
+// Every probe osdtrace can attach, with the probe_mode that enables it.
+// A `retprobe` entry attaches the function's "<func>_ret" program on return.
+// `exact` preserves the historical gating: the single-op probe
+// (log_op_stats_v2) is only attached when -s is the *only* mode requested.
+// Attach order matches the historical call order.
+struct AttachEntry {
+  const char *func;
+  int mode;
+  bool exact;
+  int v;
+  bool retprobe = false;
+};
+
+static const AttachEntry ATTACH_LIST[] = {
+    {"PrimaryLogPG::log_op_stats", OP_SINGLE_PROBE, /*exact=*/true, 2},
+    {"OSD::dequeue_op", OP_FULL_PROBE, false, 0},
+    {"PrimaryLogPG::execute_ctx", OP_FULL_PROBE, false, 0},
+    {"ReplicatedBackend::submit_transaction", OP_FULL_PROBE, false, 0},
+    {"ECBackend::submit_transaction", OP_FULL_PROBE, false, 0},
+    {"OpRequest::mark_flag_point_string", OP_FULL_PROBE, false, 0},
+    {"OpRequest::mark_flag_point", OP_FULL_PROBE, false, 0},
+    {"ReplicatedBackend::generate_subop", OP_FULL_PROBE, false, 0},
+    {"ReplicatedBackend::do_repop_reply", OP_FULL_PROBE, false, 0},
+    {"BlueStore::queue_transactions", OP_FULL_PROBE, false, 0},
+    {"BlueStore::_txc_calc_cost", OP_FULL_PROBE, false, 0},
+    {"BlueStore::_txc_state_proc", OP_FULL_PROBE, false, 0},
+    {"BlueStore::_txc_add_transaction", OP_FULL_PROBE, false, 0},
+    {"PrimaryLogPG::log_op_stats", OP_FULL_PROBE, false, 0},
+    {"ReplicatedBackend::repop_commit", OP_FULL_PROBE, false, 0},
+    {"OSD::enqueue_op", OP_FULL_PROBE, false, 0},
+    {"BlueStore::log_latency", BLUESTORE_PROBE, false, 0},
+    {"BlueStore::log_latency_fn", BLUESTORE_PROBE, false, 0},
+    {"BlueStore::_txc_apply_kv", KV_PROBE, false, 0},
+    {"BlueStore::_txc_apply_kv", KV_PROBE, false, 0, /*retprobe=*/true},
+    {"RocksDBStore::submit_transaction_sync", KV_PROBE, false, 0},
+    {"RocksDBStore::submit_transaction_sync", KV_PROBE, false, 0, true},
+    {"BlueFS::fsync", KV_PROBE, false, 0},
+    {"BlueFS::fsync", KV_PROBE, false, 0, true},
+    {"ShardedOpWQ::_enqueue", SCHED_PROBE, false, 0},
+    {"PGOpItem::run", SCHED_PROBE, false, 0},
+    {"PGPeeringItem::run", SCHED_PROBE, false, 0},
+    {"PGRecovery::run", SCHED_PROBE, false, 0},
+    {"PGRecoveryContext::run", SCHED_PROBE, false, 0},
+    {"PGRecoveryMsg::run", SCHED_PROBE, false, 0},
+    {"PGScrub::run", SCHED_PROBE, false, 0},
+    {"PGRepScrub::run", SCHED_PROBE, false, 0},
+    {"PGSnapTrim::run", SCHED_PROBE, false, 0},
+    {"PGDelete::run", SCHED_PROBE, false, 0},
+    {"OSD::dequeue_op", BACKGROUND_PROBE | OFFCPU_PROBE | BLK_PROBE, false, 0, true},
+    {"PG::lock", PGLOCK_PROBE, false, 0},
+    {"PG::lock", PGLOCK_PROBE, false, 0, true},
+    {"PG::unlock", PGLOCK_PROBE, false, 0},
+    {"AsyncConnection::read_bulk", MSGR_PROBE, false, 0},
+    {"AsyncConnection::read_bulk", MSGR_PROBE, false, 0, true},
+    {"AsyncConnection::_try_send", MSGR_PROBE, false, 0},
+    {"AsyncConnection::_try_send", MSGR_PROBE, false, 0, true},
+    {"ProtocolV2::write_message", MSGR_PROBE, false, 0},
+    {"ProtocolV2::handle_message", MSGR_PROBE, false, 0},
+    {"AsyncConnection::_stop", MSGR_PROBE, false, 0},
+    {"ECTransaction::generate_transactions", EC_PROBE, false, 0},
+    {"ECTransaction::generate_transactions", EC_PROBE, false, 0, true},
+    {"ECBackend::handle_sub_write", EC_PROBE, false, 0},
+    {"ECBackend::handle_sub_write_reply", EC_PROBE, false, 0},
+};
+
+// The modes that are off unless asked for.  Their functions and the units
+// below are only parsed when the mode is on (or for -j, which exports every
+// mode), so a run does not pay the DWARF parse for modes it does not trace.
+static const int OPTIONAL_PROBES = KV_PROBE | SCHED_PROBE | BACKGROUND_PROBE |
+    PGLOCK_PROBE | MSGR_PROBE | EC_PROBE | OFFCPU_PROBE | BLK_PROBE | CPU_PROBE;
+
+static const std::pair<int, std::vector<std::string>> OPTIONAL_UNITS[] = {
+    {KV_PROBE, {"RocksDBStore.cc", "BlueFS.cc"}},
+    {SCHED_PROBE, {"OpSchedulerItem.cc"}},
+    {PGLOCK_PROBE, {"PG.cc"}},
+    {MSGR_PROBE, {"AsyncConnection.cc", "ProtocolV2.cc"}},
+    {EC_PROBE, {"ECTransaction.cc"}},
+};
+
+// Functions probed only by optional modes, none of which is in `modes`
+static std::set<std::string> unused_mode_functions(int modes) {
+  std::set<std::string> used, unused;
+  for (const auto &e : ATTACH_LIST) {
+    if ((e.mode & ~OPTIONAL_PROBES) || (e.mode & modes))
+      used.insert(e.func);
+    else
+      unused.insert(e.func);
+  }
+  for (const auto &f : used)
+    unused.erase(f);
+  return unused;
+}
+
+// Trim the probes and units handed to the DwarfParser to the modes in use.
+static void select_probes(int modes, DwarfParser::probes_t &probes,
+                          std::vector<std::string> &units) {
+  for (const auto &f : unused_mode_functions(modes))
+    probes.erase(f);
+  for (const auto &u : OPTIONAL_UNITS) {
+    if (u.first & modes)
+      units.insert(units.end(), u.second.begin(), u.second.end());
+  }
+}
+
+// Functions of the enabled optional modes that the loaded DWARF data lacks.
+// Embedded data and JSON exported before a mode existed do not have them.
+static std::vector<std::string> missing_mode_functions(DwarfParser &dp,
+                                                       const std::string &path) {
+  std::set<std::string> unused = unused_mode_functions(probe_mode);
+  auto &func2pc = dp.mod_func2pc[get_basename(path)];
+  std::vector<std::string> missing;
+  for (const auto &e : ATTACH_LIST) {
+    if (!(e.mode & OPTIONAL_PROBES) || !(e.mode & probe_mode) ||
+        unused.count(e.func) || func2pc.count(e.func))
+      continue;
+    if (std::find(missing.begin(), missing.end(), e.func) == missing.end())
+      missing.push_back(e.func);
+  }
+  return missing;
+}
+
 // Populate the DwarfParser from JSON import, embedded DWARF, or a live parse
 // of the target binary.
 static int load_dwarf_data(DwarfParser &dwarfparser, const TraceTarget &target) {
@@ -1451,6 +2803,17 @@ static int load_dwarf_data(DwarfParser &dwarfparser, const TraceTarget &target)
     return 1;
   }
 
+  // osd_path is the in-process view ("/usr/bin/ceph-osd"), which for a
+  // containerized OSD doesn't exist on the host.  Reach into the target's
+  // mount namespace via /proc/<pid>/root/ so the build-id read sees the
+  // same binary the kernel uprobe will attach to.
+  std::string osd_buildid_path = target.osd_path;
+  if (!target.pids.empty()) {
+    osd_buildid_path = "/proc/" + std::to_string(*target.pids.begin())
+                       + "/root" + target.osd_path;
+  }
+  std::string osd_buildid = get_elf_build_id(osd_buildid_path);
+
   if (import_json) {
     // Import dwarf data from JSON file
     std::string version = "";
@@ -1468,32 +2831,40 @@ static int load_dwarf_data(DwarfParser &dwarfparser, const TraceTarget &target)
       }
     }
 
-    if (!dwarfparser.import_from_json(json_input_file, version)) {
+    // The build-id is checked even without the version check: it is read
+    // through the target's mount namespace, so it holds for containers too.
+    if (!dwarfparser.import_from_json(json_input_file, version,
+                                      {{get_basename(target.osd_path), osd_buildid}})) {
       cerr << "Failed to import dwarf data from " << json_input_file << endl;
       return 1;
     }
     clog << "Successfully imported dwarf data from " << json_input_file << endl;
+    std::vector<std::string> missing = missing_mode_functions(dwarfparser, target.osd_path);
+    if (!missing.empty()) {
+      cerr << "Error: " << json_input_file << " has no DWARF data for " << missing[0]
+           << (missing.size() > 1 ? " and " + std::to_string(missing.size() - 1) + " more" : "")
+           << ", which the requested modes probe. Re-export it with -j from this osdtrace." << endl;
+      return 1;
+    }
   } else {
     // When -j is used to export JSON, force live parsing so the output reflects
     // the installed binary (not a re-dump of the embedded data the header came
     // from). Otherwise try embedded DWARF data first, keyed by the on-disk
     // ELF build-id (arch-safe, snap-safe, custom-rebuild-safe).
-    //
-    // osd_path is the in-process view ("/usr/bin/ceph-osd"), which for a
-    // containerized OSD doesn't exist on the host.  Reach into the target's
-    // mount namespace via /proc/<pid>/root/ so the build-id read sees the
-    // same binary the kernel uprobe will attach to.
-    std::string osd_buildid_path = target.osd_path;
-    if (!target.pids.empty()) {
-      osd_buildid_path = "/proc/" + std::to_string(*target.pids.begin())
-                         + "/root" + target.osd_path;
-    }
-    std::string osd_buildid = get_elf_build_id(osd_buildid_path);
-    if (!export_json && !osd_buildid.empty() &&
+    bool embedded = !export_json && !osd_buildid.empty() &&
         dwarfparser.import_from_embedded(
-            {{get_basename(target.osd_path), osd_buildid}}, "osdtrace")) {
-      // Detailed match info already logged inside import_from_embedded.
-    } else {
+            {{get_basename(target.osd_path), osd_buildid}}, "osdtrace");
+    // Detailed match info already logged inside import_from_embedded.
+    if (embedded && !missing_mode_functions(dwarfparser, target.osd_path).empty()) {
+      clog << "Embedded DWARF data lacks functions the requested modes probe, "
+              "parsing the binary instead" << endl;
+      dwarfparser.mod_func2pc.clear();
+      dwarfparser.mod_func2vf.clear();
+      dwarfparser.mod_type_sizes.clear();
+      dwarfparser.mod_member_offsets.clear();
+      embedded = false;
+    }
+    if (!embedded) {
       clog << "Start to parse dwarf info" << endl;
       dwarfparser.add_module(target.osd_path);
       dwarfparser.parse();
@@ -1512,42 +2883,321 @@ static int do_export_json(DwarfParser &dwarfparser, const TraceTarget &target) {
     clog << "Could not determine package version for ceph-osd, using 'unknown'" << endl;
   }
 
-  dwarfparser.export_to_json(json_output_file, version);
+  if (DwarfParser::is_binary_export(json_output_file))
+    dwarfparser.export_to_binary(json_output_file, version);
+  else
+    dwarfparser.export_to_json(json_output_file, version);
   clog << "Dwarf parsing data exported to " << json_output_file << endl;
   return 0;
 }
 
-// Every probe osdtrace can attach, with the probe_mode that enables it.
-// `exact` preserves the historical gating: the single-op probe
-// (log_op_stats_v2) is only attached when -s is the *only* mode requested.
-// Attach order matches the historical call order.
-struct AttachEntry {
-  const char *func;
-  int mode;
-  bool exact;
-  int v;
-};
 
-static const AttachEntry ATTACH_LIST[] = {
-    {"PrimaryLogPG::log_op_stats", OP_SINGLE_PROBE, /*exact=*/true, 2},
-    {"OSD::dequeue_op", OP_FULL_PROBE, false, 0},
-    {"PrimaryLogPG::execute_ctx", OP_FULL_PROBE, false, 0},
-    {"ReplicatedBackend::submit_transaction", OP_FULL_PROBE, false, 0},
-    {"ECBackend::submit_transaction", OP_FULL_PROBE, false, 0},
-    {"OpRequest::mark_flag_point_string", OP_FULL_PROBE, false, 0},
-    {"OpRequest::mark_flag_point", OP_FULL_PROBE, false, 0},
-    {"ReplicatedBackend::generate_subop", OP_FULL_PROBE, false, 0},
-    {"ReplicatedBackend::do_repop_reply", OP_FULL_PROBE, false, 0},
-    {"BlueStore::queue_transactions", OP_FULL_PROBE, false, 0},
-    {"BlueStore::_txc_calc_cost", OP_FULL_PROBE, false, 0},
-    {"BlueStore::_txc_state_proc", OP_FULL_PROBE, false, 0},
-    {"BlueStore::_txc_add_transaction", OP_FULL_PROBE, false, 0},
-    {"PrimaryLogPG::log_op_stats", OP_FULL_PROBE, false, 0},
-    {"ReplicatedBackend::repop_commit", OP_FULL_PROBE, false, 0},
-    {"OSD::enqueue_op", OP_FULL_PROBE, false, 0},
-    {"BlueStore::log_latency", BLUESTORE_PROBE, false, 0},
-    {"BlueStore::log_latency_fn", BLUESTORE_PROBE, false, 0},
-};
+// --blk: the whole disks under a block device, which is where the request
+// tracepoints fire: the device itself, the disk of a partition, or the disks
+// below a device-mapper (LVM) device.
+static std::string sysfs_read_line(const std::string &path) {
+  std::ifstream ifs(path);
+  std::string line;
+  std::getline(ifs, line);
+  return line;
+}
+
+static void blk_whole_disks(const std::string &majmin,
+                            std::map<std::string, std::string> &disks,
+                            int depth = 0) {
+  std::string sys = "/sys/dev/block/" + majmin;
+  char real[PATH_MAX];
+  if (depth > 8 || realpath(sys.c_str(), real) == NULL)
+    return;
+  std::string dir = real;
+  std::string name = dir.substr(dir.rfind('/') + 1);
+  bool below = false;
+  if (DIR *d = opendir((dir + "/slaves").c_str())) {
+    while (struct dirent *e = readdir(d)) {
+      if (e->d_name[0] == '.') continue;
+      below = true;
+      blk_whole_disks(sysfs_read_line(dir + "/slaves/" + e->d_name + "/dev"),
+                      disks, depth + 1);
+    }
+    closedir(d);
+  }
+  if (below)
+    return;
+  if (access((dir + "/partition").c_str(), F_OK) == 0) {
+    std::string parent = dir.substr(0, dir.rfind('/'));
+    disks[sysfs_read_line(parent + "/dev")] = parent.substr(parent.rfind('/') + 1);
+  } else {
+    disks[majmin] = name;
+  }
+}
+
+// --blk: put the disks of the traced OSDs' block, block.db and block.wal in
+// blk_devs.  Returns how many there are.
+static size_t find_blk_devices(const TraceTarget &target, int devs_fd) {
+  std::vector<int> osd_pids(target.pids.begin(), target.pids.end());
+  if (osd_pids.empty())
+    for (const auto &p : discover_ceph_osd_processes())
+      if (!p.is_container) osd_pids.push_back(p.pid);
+  for (int pid : osd_pids) {
+    int osd_id = osd_pid_to_id(pid);
+    if (osd_id < 0) continue;
+    for (const char *link : {"block", "block.db", "block.wal"}) {
+      std::string path = "/proc/" + std::to_string(pid) +
+                         "/root/var/lib/ceph/osd/ceph-" +
+                         std::to_string(osd_id) + "/" + link;
+      struct stat st;
+      if (stat(path.c_str(), &st) != 0 || !S_ISBLK(st.st_mode)) continue;
+      std::map<std::string, std::string> disks;
+      blk_whole_disks(std::to_string(major(st.st_rdev)) + ":" +
+                          std::to_string(minor(st.st_rdev)),
+                      disks);
+      for (const auto &d : disks) {
+        unsigned ma = 0, mi = 0;
+        if (sscanf(d.first.c_str(), "%u:%u", &ma, &mi) != 2) continue;
+        __u32 dev = (ma << 20) | mi;  // the kernel's dev_t
+        __u8 one = 1;
+        bpf_map_update_elem(devs_fd, &dev, &one, 0);
+        blk_dev_names[dev] = d.second;
+        clog << "--blk: osd." << osd_id << " " << link << " is on "
+             << d.second << endl;
+      }
+    }
+  }
+  return blk_dev_names.size();
+}
+
+// A counting perf event that follows one thread across CPUs.
+static int open_thread_counter(__u32 type, __u64 config, int tid) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  return syscall(__NR_perf_event_open, &attr, tid, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
+
+// --cpu: open a cycles and an instructions counter for each OSD worker
+// thread (tp_osd_tp), and put them in the BPF perf event arrays.  Without
+// hardware counters (most VMs), the task clock stands in for the cycles.
+// Returns the event fds, or an empty vector on failure.
+static std::vector<int> open_cpu_counters(const TraceTarget &target,
+                                          struct osdtrace_bpf *skel) {
+  std::vector<int> fds;
+  std::vector<int> osd_pids(target.pids.begin(), target.pids.end());
+  if (osd_pids.empty())
+    for (const auto &p : discover_ceph_osd_processes())
+      if (!p.is_container) osd_pids.push_back(p.pid);
+  __u32 idx = 0;
+  for (int pid : osd_pids) {
+    std::string task_dir = "/proc/" + std::to_string(pid) + "/task";
+    DIR *d = opendir(task_dir.c_str());
+    if (!d) continue;
+    while (struct dirent *e = readdir(d)) {
+      if (e->d_name[0] == '.' || idx >= CPU_MAX_THREADS) continue;
+      std::ifstream comm(task_dir + "/" + e->d_name + "/comm");
+      std::string name;
+      std::getline(comm, name);
+      if (name != "tp_osd_tp") continue;
+      int tid = atoi(e->d_name);
+      int cycles = -1, instructions = -1;
+      if (!cpu_task_clock) {
+        cycles = open_thread_counter(PERF_TYPE_HARDWARE,
+                                     PERF_COUNT_HW_CPU_CYCLES, tid);
+        if (cycles >= 0)
+          instructions = open_thread_counter(PERF_TYPE_HARDWARE,
+                                             PERF_COUNT_HW_INSTRUCTIONS, tid);
+        if (cycles < 0 && idx == 0 && (errno == ENOENT || errno == EOPNOTSUPP)) {
+          clog << "--cpu: no hardware counters, using the task clock" << endl;
+          cpu_task_clock = true;
+        }
+      }
+      if (cpu_task_clock)
+        cycles = open_thread_counter(PERF_TYPE_SOFTWARE,
+                                     PERF_COUNT_SW_TASK_CLOCK, tid);
+      if (cycles < 0) {
+        cerr << "--cpu: cannot count thread " << tid << ": " << strerror(errno)
+             << endl;
+        if (instructions >= 0) close(instructions);
+        continue;
+      }
+      fds.push_back(cycles);
+      bpf_map_update_elem(bpf_map__fd(skel->maps.cpu_cycles), &idx, &cycles, 0);
+      if (instructions >= 0) {
+        fds.push_back(instructions);
+        bpf_map_update_elem(bpf_map__fd(skel->maps.cpu_instructions), &idx,
+                            &instructions, 0);
+      }
+      __u32 t = tid;
+      bpf_map_update_elem(bpf_map__fd(skel->maps.cpu_threads), &t, &idx, 0);
+      ++idx;
+    }
+    closedir(d);
+  }
+  clog << "--cpu: counting " << idx << " OSD worker threads" << endl;
+  return fds;
+}
+
+// Declare the --columnar tables; the column order must match
+// put_columnar_op() and handle_bluestore().
+static int open_columnar(ColumnarWriter &writer) {
+  using CW = ColumnarWriter;
+  char host[256] = "";
+  gethostname(host, sizeof(host) - 1);
+  writer.set_meta("tool", "osdtrace");
+  writer.set_meta("hostname", host);
+  writer.set_meta("latency_unit", "us");
+  // what the cpu_*_cycles columns count
+  writer.set_meta("cpu_counter", cpu_task_clock ? "task_clock_ns" : "cycles");
+  columnar_ops = writer.add_table("osd_op", {
+      {"osd", CW::I32, CW::NO_CLOCK},
+      {"pid", CW::U32, CW::NO_CLOCK},
+      {"kind", CW::STR, CW::NO_CLOCK},
+      {"msg_type", CW::U16, CW::NO_CLOCK},
+      {"client", CW::U64, CW::NO_CLOCK},
+      {"tid", CW::U64, CW::NO_CLOCK},
+      {"pool", CW::U64, CW::NO_CLOCK},
+      {"pg_seed", CW::U32, CW::NO_CLOCK},
+      {"object", CW::STR, CW::NO_CLOCK},
+      {"ops", CW::STR, CW::NO_CLOCK},
+      {"ops_total", CW::U32, CW::NO_CLOCK},
+      {"ops_unavailable", CW::U8, CW::NO_CLOCK},
+      {"wb", CW::U64, CW::NO_CLOCK},
+      {"rb", CW::U64, CW::NO_CLOCK},
+      {"aio_size", CW::I32, CW::NO_CLOCK},
+      // Message stamps come from Ceph's utime_t, the rest from the probes.
+      {"recv_stamp", CW::U64, CW::REALTIME_NS},
+      {"throttle_stamp", CW::U64, CW::REALTIME_NS},
+      {"recv_complete_stamp", CW::U64, CW::REALTIME_NS},
+      {"dispatch_stamp", CW::U64, CW::REALTIME_NS},
+      {"enqueue_stamp", CW::U64, CW::BOOTTIME_NS},
+      {"dequeue_stamp", CW::U64, CW::BOOTTIME_NS},
+      {"execute_ctx_stamp", CW::U64, CW::BOOTTIME_NS},
+      {"submit_transaction_stamp", CW::U64, CW::BOOTTIME_NS},
+      {"queue_transaction_stamp", CW::U64, CW::BOOTTIME_NS},
+      {"do_write_stamp", CW::U64, CW::BOOTTIME_NS},
+      {"wctx_finish_stamp", CW::U64, CW::BOOTTIME_NS},
+      {"aio_submit_stamp", CW::U64, CW::BOOTTIME_NS},
+      {"aio_done_stamp", CW::U64, CW::BOOTTIME_NS},
+      {"kv_submit_stamp", CW::U64, CW::BOOTTIME_NS},
+      {"kv_committed_stamp", CW::U64, CW::BOOTTIME_NS},
+      {"reply_stamp", CW::U64, CW::BOOTTIME_NS},
+      {"peer1", CW::I32, CW::NO_CLOCK},
+      {"peer2", CW::I32, CW::NO_CLOCK},
+      {"peer_sent_stamp", CW::U64, CW::BOOTTIME_NS},
+      {"peer1_recv_stamp", CW::U64, CW::BOOTTIME_NS},
+      {"peer2_recv_stamp", CW::U64, CW::BOOTTIME_NS},
+      {"delays", CW::STR, CW::NO_CLOCK},
+      {"throttle_lat", CW::U64, CW::NO_CLOCK},
+      {"recv_lat", CW::U64, CW::NO_CLOCK},
+      {"dispatch_lat", CW::U64, CW::NO_CLOCK},
+      {"queue_lat", CW::U64, CW::NO_CLOCK},
+      {"osd_lat", CW::U64, CW::NO_CLOCK},
+      {"bs_prepare_lat", CW::U64, CW::NO_CLOCK},
+      {"bs_aio_wait_lat", CW::U64, CW::NO_CLOCK},
+      {"bs_pg_seq_lat", CW::U64, CW::NO_CLOCK},
+      {"bs_kv_commit_lat", CW::U64, CW::NO_CLOCK},
+      {"bluestore_lat", CW::U64, CW::NO_CLOCK},
+      {"op_lat", CW::U64, CW::NO_CLOCK},
+      // --kv; zero without it
+      {"kv_apply_stamp", CW::U64, CW::BOOTTIME_NS},
+      {"kv_applied_stamp", CW::U64, CW::BOOTTIME_NS},
+      {"kv_sync_start_stamp", CW::U64, CW::BOOTTIME_NS},
+      {"kv_sync_end_stamp", CW::U64, CW::BOOTTIME_NS},
+      {"kv_batch", CW::U64, CW::NO_CLOCK},
+      {"bs_kv_batch_lat", CW::U64, CW::NO_CLOCK},
+      {"bs_kv_wal_lat", CW::U64, CW::NO_CLOCK},
+      {"bs_kv_sync_lat", CW::U64, CW::NO_CLOCK},
+      {"bs_kv_fsync_lat", CW::U64, CW::NO_CLOCK},
+      // --pg-lock; zero without it
+      {"pg_lock_wait_ns", CW::U64, CW::NO_CLOCK},
+      // --ec; zero and empty without it.  ec_shards is
+      // "shard:osd:commit_lat,..."
+      {"ec_submit_stamp", CW::U64, CW::BOOTTIME_NS},
+      {"ec_encode_start_stamp", CW::U64, CW::BOOTTIME_NS},
+      {"ec_encode_end_stamp", CW::U64, CW::BOOTTIME_NS},
+      {"ec_sent_stamp", CW::U64, CW::BOOTTIME_NS},
+      {"ec_shards", CW::STR, CW::NO_CLOCK},
+      {"ec_encode_lat", CW::U64, CW::NO_CLOCK},
+      {"ec_commit_lat", CW::U64, CW::NO_CLOCK},
+      {"ec_shard_wait", CW::U64, CW::NO_CLOCK},
+      {"offcpu_lat", CW::U64, CW::NO_CLOCK},
+      {"offcpu_runnable", CW::U64, CW::NO_CLOCK},
+      {"offcpu_switches", CW::U32, CW::NO_CLOCK},
+      {"offcpu_max", CW::U64, CW::NO_CLOCK},
+      {"offcpu_stack", CW::STR, CW::NO_CLOCK},
+      {"blk_ios", CW::U32, CW::NO_CLOCK},
+      {"blk_complete_stamp", CW::U64, CW::BOOTTIME_NS},
+      {"blk_queue_lat", CW::U64, CW::NO_CLOCK},
+      {"blk_device_lat", CW::U64, CW::NO_CLOCK},
+      {"cpu_osd_cycles", CW::U64, CW::NO_CLOCK},
+      {"cpu_osd_instructions", CW::U64, CW::NO_CLOCK},
+      {"cpu_bs_cycles", CW::U64, CW::NO_CLOCK},
+      {"cpu_bs_instructions", CW::U64, CW::NO_CLOCK},
+  });
+  columnar_bluestore = writer.add_table("bluestore_lat", {
+      {"osd", CW::I32, CW::NO_CLOCK},
+      {"pid", CW::U32, CW::NO_CLOCK},
+      {"name", CW::STR, CW::NO_CLOCK},
+      {"lat_ns", CW::U64, CW::NO_CLOCK},
+  });
+  columnar_sched = writer.add_table("osd_sched", {
+      {"stamp", CW::U64, CW::BOOTTIME_NS},
+      {"osd", CW::I32, CW::NO_CLOCK},
+      {"shard", CW::U32, CW::NO_CLOCK},
+      {"class", CW::STR, CW::NO_CLOCK},
+      {"depth", CW::I64, CW::NO_CLOCK},
+      {"max_depth", CW::U64, CW::NO_CLOCK},
+      {"enqueued", CW::U64, CW::NO_CLOCK},
+      {"dequeued", CW::U64, CW::NO_CLOCK},
+      {"wait_avg", CW::U64, CW::NO_CLOCK},
+      {"wait_max", CW::U64, CW::NO_CLOCK},
+  });
+  columnar_pglock = writer.add_table("osd_pg_lock", {
+      {"stamp", CW::U64, CW::BOOTTIME_NS},
+      {"osd", CW::I32, CW::NO_CLOCK},
+      {"pool", CW::U64, CW::NO_CLOCK},
+      {"pg_seed", CW::U32, CW::NO_CLOCK},
+      {"waits", CW::U64, CW::NO_CLOCK},
+      {"wait_total", CW::U64, CW::NO_CLOCK},
+      {"wait_avg", CW::U64, CW::NO_CLOCK},
+      {"wait_p99", CW::U64, CW::NO_CLOCK},
+      {"holds", CW::U64, CW::NO_CLOCK},
+      {"hold_avg", CW::U64, CW::NO_CLOCK},
+      {"hold_p99", CW::U64, CW::NO_CLOCK},
+  });
+  // cumulative per connection, as kept by the BPF side
+  columnar_msgr = writer.add_table("osd_msgr", {
+      {"stamp", CW::U64, CW::BOOTTIME_NS},
+      {"osd", CW::I32, CW::NO_CLOCK},
+      {"conn", CW::U64, CW::NO_CLOCK},
+      {"peer", CW::STR, CW::NO_CLOCK},
+      {"bytes_in", CW::U64, CW::NO_CLOCK},
+      {"bytes_out", CW::U64, CW::NO_CLOCK},
+      {"msgs_in", CW::U64, CW::NO_CLOCK},
+      {"msgs_out", CW::U64, CW::NO_CLOCK},
+      {"stalls", CW::U64, CW::NO_CLOCK},
+      {"stall_us", CW::U64, CW::NO_CLOCK},
+  });
+  columnar_blk = writer.add_table("osd_blk", {
+      {"stamp", CW::U64, CW::BOOTTIME_NS},
+      {"dev", CW::STR, CW::NO_CLOCK},
+      {"ios", CW::U64, CW::NO_CLOCK},
+      {"bytes", CW::U64, CW::NO_CLOCK},
+      {"queue_sum_us", CW::U64, CW::NO_CLOCK},
+      {"device_sum_us", CW::U64, CW::NO_CLOCK},
+      {"queue_hist", CW::STR, CW::NO_CLOCK},
+      {"device_hist", CW::STR, CW::NO_CLOCK},
+  });
+  if (!writer.open()) {
+    cerr << "Failed to create " << writer.path() << ": " << strerror(errno)
+         << endl;
+    columnar_ops = columnar_bluestore = columnar_sched = nullptr;
+    columnar_pglock = columnar_msgr = columnar_blk = nullptr;
+    return -1;
+  }
+  columnar = &writer;
+  return 0;
+}
 
 // Load the BPF skeleton, attach the probes selected by probe_mode, and poll
 // the ring buffer until timeout or error.
@@ -1596,6 +3246,19 @@ static int run_tracer(DwarfParser &dwarfparser, const TraceTarget &target) {
          << endl;
   }
 
+  skel->rodata->trace_background = probe_mode & BACKGROUND_PROBE;
+  skel->rodata->trace_ec = probe_mode & EC_PROBE;
+  skel->rodata->trace_offcpu = probe_mode & OFFCPU_PROBE;
+  // the sched_switch program is only loaded when it is attached
+  bpf_program__set_autoload(skel->progs.tp_sched_switch,
+                            probe_mode & OFFCPU_PROBE);
+  skel->rodata->trace_blk = probe_mode & BLK_PROBE;
+  skel->rodata->trace_cpu = probe_mode & CPU_PROBE;
+  for (struct bpf_program *prog : {skel->progs.tp_block_rq_insert,
+                                   skel->progs.tp_block_rq_issue,
+                                   skel->progs.tp_block_rq_complete})
+    bpf_program__set_autoload(prog, probe_mode & BLK_PROBE);
+
   int load_ret = osdtrace_bpf__load(skel.get());
   if (load_ret) {
     cerr << "Failed to load BPF skeleton: " << load_ret << endl;
@@ -1608,10 +3271,13 @@ static int run_tracer(DwarfParser &dwarfparser, const TraceTarget &target) {
 
   int attached = 0;
   for (const auto &e : ATTACH_LIST) {
-    bool enabled = e.exact ? (probe_mode == e.mode) : (probe_mode & e.mode);
+    // --sched, --pg-lock and --msgr sample next to any op mode
+    int sampled = SCHED_PROBE | PGLOCK_PROBE | MSGR_PROBE;
+    bool enabled = e.exact ? ((probe_mode & ~sampled) == e.mode)
+                           : (probe_mode & e.mode);
     if (!enabled) continue;
     if (attach_probes(skel.get(), dwarfparser, target.osd_path, target.pids,
-                      e.func, /*is_retprobe=*/false, e.v) == 0)
+                      e.func, e.retprobe, e.v) == 0)
       ++attached;
   }
   if (attached == 0) {
@@ -1619,6 +3285,56 @@ static int run_tracer(DwarfParser &dwarfparser, const TraceTarget &target) {
     return 1;
   }
 
+  // --offcpu: sched_switch is a kernel tracepoint, not one per OSD; the
+  // threads it accounts are the ones dequeue_op registered
+  std::unique_ptr<bpf_link, decltype(&bpf_link__destroy)> offcpu_link(
+      nullptr, bpf_link__destroy);
+  if (probe_mode & OFFCPU_PROBE) {
+    offcpu_link.reset(bpf_program__attach_tracepoint(
+        skel->progs.tp_sched_switch, "sched", "sched_switch"));
+    if (!offcpu_link) {
+      cerr << "Failed to attach the sched_switch tracepoint for --offcpu" << endl;
+      return 1;
+    }
+    offcpu_symbolizer.reset(
+        new OffcpuSymbolizer(bpf_map__fd(skel->maps.offcpu_stacks)));
+  }
+
+  // --cpu: the worker threads must exist by now, threads started later are
+  // not counted
+  std::vector<int> cpu_fds;
+  if (probe_mode & CPU_PROBE) {
+    cpu_fds = open_cpu_counters(target, skel.get());
+    if (cpu_fds.empty()) {
+      cerr << "--cpu could not count any OSD worker thread" << endl;
+      return 1;
+    }
+  }
+
+  // --blk: the block tracepoints, limited to the OSDs' disks by blk_devs
+  std::vector<std::unique_ptr<bpf_link, decltype(&bpf_link__destroy)>> blk_links;
+  if (probe_mode & BLK_PROBE) {
+    if (find_blk_devices(target, bpf_map__fd(skel->maps.blk_devs)) == 0) {
+      cerr << "--blk found no block device of the traced OSDs" << endl;
+      return 1;
+    }
+    const std::pair<struct bpf_program *, const char *> tps[] = {
+        {skel->progs.tp_block_rq_insert, "block_rq_insert"},
+        {skel->progs.tp_block_rq_issue, "block_rq_issue"},
+        {skel->progs.tp_block_rq_complete, "block_rq_complete"},
+    };
+    for (const auto &tp : tps) {
+      blk_links.emplace_back(
+          bpf_program__attach_tracepoint(tp.first, "block", tp.second),
+          bpf_link__destroy);
+      if (!blk_links.back()) {
+        cerr << "Failed to attach the " << tp.second << " tracepoint for --blk"
+             << endl;
+        return 1;
+      }
+    }
+  }
+
   bootstamp = get_bootstamp();
   clog << "New a ring buffer" << endl;
 
@@ -1640,11 +3356,114 @@ static int run_tracer(DwarfParser &dwarfparser, const TraceTarget &target) {
     std::cout << "No execution timeout set (unlimited).\n";
   }
 
+  std::unique_ptr<ColumnarWriter> columnar_writer;
+  if (!columnar_file.empty()) {
+    columnar_writer.reset(new ColumnarWriter(columnar_file));
+    if (open_columnar(*columnar_writer) != 0) return 1;
+  }
+
+  if (analyze)
+    analyze_report.reset(new OsdLatencyReport(analyze_field, analyze_infer_threshold));
+  if (bottleneck_interval) attribution.reset(new StageAttribution());
+  if (peer_matrix_interval) peer_matrix.reset(new PeerLatencyMatrix());
+  if (sched_interval) sched_series.reset(new SchedSeries());
+  if (background_interval) background_load.reset(new BackgroundLoad());
+  if (pglock_interval) pglock_report.reset(new PgLockReport());
+  if (msgr_interval) msgr_report.reset(new MsgrReport());
+  if (ec_interval) ec_report.reset(new EcReport());
+  if (blk_interval) blk_report.reset(new BlkReport());
+  if (cpu_interval) cpu_report.reset(new CpuReport(cpu_task_clock));
+
+  // The reports printed every <secs> of their mode, 0 = off.  report() gets
+  // the seconds the print covers; the reports without a summary of their
+  // own (`last`) print once more at exit for the partial interval.
+  struct IntervalReport {
+    unsigned interval;
+    std::function<void(unsigned secs)> report;
+    bool last;
+    time_t next;
+  };
+  int sched_stats_fd = bpf_map__fd(skel->maps.sched_stats);
+  int sched_epoch_fd = bpf_map__fd(skel->maps.sched_epoch);
+  int pglock_hists_fd = bpf_map__fd(skel->maps.pglock_hists);
+  int msgr_conns_fd = bpf_map__fd(skel->maps.msgr_conns);
+  int blk_hists_fd = bpf_map__fd(skel->maps.blk_hists);
+  IntervalReport reports[] = {
+      {analyze_interval, [](unsigned secs) { print_analyze_report(secs); }, false, 0},
+      {bottleneck_interval, [](unsigned secs) { print_bottleneck_report(secs); }, false, 0},
+      {peer_matrix_interval, [](unsigned secs) { print_peer_matrix(secs); }, false, 0},
+      {sched_interval, [=](unsigned) { sample_sched(sched_stats_fd, sched_epoch_fd); }, true, 0},
+      {background_interval, [](unsigned secs) { print_background_load(secs); }, true, 0},
+      {pglock_interval, [=](unsigned) { sample_pg_locks(pglock_hists_fd); }, true, 0},
+      {msgr_interval, [=](unsigned secs) { sample_msgr(msgr_conns_fd, secs); }, true, 0},
+      {ec_interval, [](unsigned) { print_ec_report(); }, true, 0},
+      {blk_interval, [=](unsigned secs) { sample_blk(blk_hists_fd, secs); }, true, 0},
+      {cpu_interval, [](unsigned) { print_cpu_report(); }, true, 0},
+  };
+  for (IntervalReport &r : reports)
+    r.next = r.interval ? time(NULL) + r.interval : 0;
+
   clog << "Started to poll from ring buffer" << endl;
 
   int ret = 0;
-  while ((!timeout_occurred || timeout == -1) && (ret = ring_buffer__poll(rb.get(), 1000)) >= 0) {
+  polling = 1;
+  while (!caught_signal && (!timeout_occurred || timeout == -1) &&
+         (ret = ring_buffer__poll(rb.get(), 1000)) >= 0) {
     // Continue polling while timeout hasn't occurred or if unlimited execution time
+    stdout_buffer().flush();
+    if (columnar) columnar->tick();
+    time_t now = time(NULL);
+    for (IntervalReport &r : reports) {
+      if (r.next && now >= r.next) {
+        r.report(r.interval);
+        r.next += r.interval;
+      }
+    }
+  }
+  if (caught_signal)
+    clog << "Caught signal " << caught_signal << endl;
+  stdout_buffer().flush();
+  if (analyze_report) {
+    print_analyze_report(0);
+    analyze_report.reset();
+  }
+  if (attribution) {
+    if (!attribution->empty())
+      print_bottleneck_report(0);
+    attribution.reset();
+  }
+  if (peer_matrix) {
+    print_peer_matrix(0);
+    peer_matrix.reset();
+  }
+  time_t now = time(NULL);
+  for (IntervalReport &r : reports) {
+    if (r.next && r.last) {
+      time_t since = now - (r.next - r.interval);
+      r.report(since > 0 ? since : 1);
+    }
+  }
+  sched_series.reset();
+  background_load.reset();
+  pglock_report.reset();
+  msgr_report.reset();
+  ec_report.reset();
+  offcpu_symbolizer.reset();
+  blk_report.reset();
+  cpu_report.reset();
+  for (int fd : cpu_fds)
+    close(fd);
+  if (columnar) {
+    columnar->close();
+    columnar = nullptr;
+    columnar_ops = columnar_bluestore = columnar_sched = nullptr;
+    columnar_pglock = columnar_msgr = columnar_blk = nullptr;
+  }
+
+  if (caught_signal) {
+    if (caught_signal == SIGINT)
+      print_all_srl();
+    exit(caught_signal);
   }
 
   if (timeout_occurred)
@@ -1667,7 +3486,10 @@ int main(int argc, char **argv) {
   TraceTarget target;
   if (resolve_trace_targets(target) != 0) return 1;
 
-  DwarfParser dwarfparser(osd_probes, probe_units);
+  DwarfParser::probes_t probes = osd_probes;
+  std::vector<std::string> units = probe_units;
+  select_probes(export_json ? OPTIONAL_PROBES : probe_mode, probes, units);
+  DwarfParser dwarfparser(probes, units);
   dwarfparser.request_type_size("OSDOp");
   dwarfparser.request_member_offset("OSDOp", {"indata", "_carriage"});
   dwarfparser.request_member_offset("OSDOp", {"op", "cls", "class_len"});
@@ -0,0 +1,196 @@
+#ifndef OUTPUT_BUFFER_H
+#define OUTPUT_BUFFER_H
+
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <charconv>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Shared output layer for the per-op trace lines.
+//
+// Every tool used to build each line out of std::stringstream / std::string
+// temporaries and hand it to printf piecemeal.  OutputBuffer instead appends
+// into one reusable byte buffer, formats integers with std::to_chars, and
+// hands the accumulated lines to the kernel with a single write(2) per ring
+// buffer poll batch (or earlier once the buffer passes its flush threshold).
+// Nothing in the append path allocates once the buffer has grown to the size
+// of a batch.
+//
+// A buffer constructed without a descriptor (fd < 0) only accumulates; its
+// owner drains it through data()/size()/clear().
+class OutputBuffer {
+ public:
+  static constexpr size_t DEFAULT_FLUSH_THRESHOLD = 64 * 1024;
+
+  explicit OutputBuffer(int fd = STDOUT_FILENO,
+                        size_t flush_threshold = DEFAULT_FLUSH_THRESHOLD)
+      : fd_(fd), flush_threshold_(flush_threshold) {
+    buf_.resize(flush_threshold_ + LINE_RESERVE);
+  }
+
+  ~OutputBuffer() { flush(); }
+
+  OutputBuffer(const OutputBuffer &) = delete;
+  OutputBuffer &operator=(const OutputBuffer &) = delete;
+
+  int fd() const { return fd_; }
+  // Redirect the buffer to another descriptor; pending bytes go to the old one.
+  void set_fd(int fd) {
+    flush();
+    fd_ = fd;
+  }
+
+  const char *data() const { return buf_.data(); }
+  size_t size() const { return len_; }
+  bool empty() const { return len_ == 0; }
+  void clear() { len_ = 0; }
+
+  OutputBuffer &put(char c) {
+    reserve(1);
+    buf_[len_++] = c;
+    return *this;
+  }
+
+  OutputBuffer &put(const char *s, size_t n) {
+    reserve(n);
+    memcpy(buf_.data() + len_, s, n);
+    len_ += n;
+    return *this;
+  }
+
+  OutputBuffer &put(const char *s) { return put(s, strlen(s)); }
+  OutputBuffer &put(const std::string &s) { return put(s.data(), s.size()); }
+
+  // NUL-terminated string stored in a fixed-size array (BPF event fields).
+  OutputBuffer &put_bounded(const char *s, size_t max) {
+    return put(s, strnlen(s, max));
+  }
+
+  template <typename T>
+  OutputBuffer &dec(T v) {
+    static_assert(std::is_integral<T>::value, "dec() takes an integer");
+    reserve(MAX_INT_CHARS);
+    char *p = buf_.data() + len_;
+    len_ += std::to_chars(p, p + MAX_INT_CHARS, v).ptr - p;
+    return *this;
+  }
+
+  // Lower-case hex without prefix, as printed by "%x" / std::hex.
+  template <typename T>
+  OutputBuffer &hex(T v) {
+    static_assert(std::is_integral<T>::value, "hex() takes an integer");
+    reserve(MAX_INT_CHARS);
+    char *p = buf_.data() + len_;
+    len_ += std::to_chars(p, p + MAX_INT_CHARS, v, 16).ptr - p;
+    return *this;
+  }
+
+  // Right-aligned in a field of at least `width` characters ("%*s").
+  OutputBuffer &pad(const char *s, size_t n, int width) {
+    if (width > 0 && (size_t)width > n) fill(' ', width - n);
+    return put(s, n);
+  }
+
+  OutputBuffer &pad(const char *s, int width) {
+    return pad(s, strlen(s), width);
+  }
+
+  // Right-aligned integer ("%*d" / "%*lld").
+  template <typename T>
+  OutputBuffer &dec_pad(T v, int width) {
+    char tmp[MAX_INT_CHARS];
+    size_t n = std::to_chars(tmp, tmp + sizeof(tmp), v).ptr - tmp;
+    return pad(tmp, n, width);
+  }
+
+  OutputBuffer &fill(char c, size_t n) {
+    reserve(n);
+    memset(buf_.data() + len_, c, n);
+    len_ += n;
+    return *this;
+  }
+
+  // A CSV field, quoted (with embedded quotes doubled) only when it contains
+  // a separator, quote or line break.
+  OutputBuffer &csv(const char *s, size_t n) {
+    bool need_quotes = false;
+    for (size_t i = 0; i < n; ++i) {
+      char c = s[i];
+      if (c == ',' || c == '"' || c == '\n' || c == '\r') {
+        need_quotes = true;
+        break;
+      }
+    }
+    if (!need_quotes) return put(s, n);
+    reserve(2 * n + 2);
+    put('"');
+    for (size_t i = 0; i < n; ++i) {
+      if (s[i] == '"') put('"');
+      put(s[i]);
+    }
+    return put('"');
+  }
+
+  OutputBuffer &csv(const std::string &s) { return csv(s.data(), s.size()); }
+
+  // Terminate the current line; flushes once the threshold is crossed so a
+  // long poll batch never grows the buffer without bound.
+  void end_line() {
+    put('\n');
+    if (fd_ >= 0 && len_ >= flush_threshold_) flush();
+  }
+
+  // Bytes appended since `mark` (a previous size()), e.g. to measure or
+  // reuse a field that was just formatted.
+  const char *since(size_t mark) const { return buf_.data() + mark; }
+
+  // Write all pending bytes with as few write(2) calls as the kernel allows.
+  // Returns 0 or -errno; on error the pending bytes are dropped so a closed
+  // pipe cannot make the buffer grow forever.
+  int flush() {
+    if (len_ == 0 || fd_ < 0) return 0;
+    // Keep ordering with anything printed through stdio (headers, notices).
+    if (fd_ == STDOUT_FILENO) fflush(stdout);
+    size_t off = 0;
+    int ret = 0;
+    while (off < len_) {
+      ssize_t n = write(fd_, buf_.data() + off, len_ - off);
+      if (n < 0) {
+        if (errno == EINTR) continue;
+        ret = -errno;
+        break;
+      }
+      off += n;
+    }
+    len_ = 0;
+    return ret;
+  }
+
+ private:
+  // Enough for any 64-bit integer in base 10 (20 digits plus sign).
+  static constexpr size_t MAX_INT_CHARS = 24;
+  // Headroom so a single line rarely has to grow the buffer.
+  static constexpr size_t LINE_RESERVE = 4096;
+
+  void reserve(size_t n) {
+    if (len_ + n > buf_.size()) buf_.resize(2 * (len_ + n));
+  }
+
+  int fd_;
+  size_t flush_threshold_;
+  std::vector<char> buf_;
+  size_t len_ = 0;
+};
+
+// Per-thread stdout buffer shared by all line formatters of a tool.
+inline OutputBuffer &stdout_buffer() {
+  static thread_local OutputBuffer buf(STDOUT_FILENO);
+  return buf;
+}
+
+#endif  // OUTPUT_BUFFER_H
@@ -37,6 +37,9 @@ extern "C" {
 #include "dwarf_parser.h"
 #include "version_utils.h"
 #include "utils.h"
+#include "output_buffer.h"
+#include "rotating_writer.h"
+#include "columnar_writer.h"
 
 #define MAX(x, y) (((x) > (y)) ? (x) : (y))
 #define MIN(x, y) (((x) < (y)) ? (x) : (y))
@@ -85,10 +88,39 @@ DwarfParser::probes_t rados_probes = {
 };
 
 volatile sig_atomic_t timeout_occurred = 0;
+// Set once the ring buffer is being polled; from then on SIGINT/SIGTERM end
+// the poll loop instead of exiting, so the CSV writer can finish its files.
+// Before that nothing is buffered and a signal exits at once.
+volatile sig_atomic_t polling = 0;
+volatile sig_atomic_t exiting = 0;  // The signal that ended the poll loop
+volatile sig_atomic_t flush_requested = 0;
 
 // CSV Output
 bool export_csv = false;
 std::string csv_output_file = "radostrace_events.csv";
+static RotatingWriter::Options csv_options;
+static RotatingWriter *csv_writer = nullptr;
+static const char CSV_HEADER[] =
+    "pid,client,tid,pool,pg,acting,WR,size,latency,object,ops,offset,length\n";
+
+// Columnar Output
+std::string columnar_file;
+static ColumnarWriter *columnar = nullptr;
+static ColumnarWriter::Table *columnar_ops = nullptr;
+
+// Hand everything formatted during the last poll batch to the kernel; CSV
+// rows go out on size, on time, or when SIGUSR1 asked for it.
+static void flush_output() {
+    stdout_buffer().flush();
+    if (columnar) columnar->tick();
+    if (!csv_writer) return;
+    if (flush_requested) {
+        flush_requested = 0;
+        csv_writer->flush();
+    } else {
+        csv_writer->tick();
+    }
+}
 
 const char * ceph_osd_op_str(int opc) {
     const char *op_str = NULL;
@@ -124,11 +156,15 @@ void fill_map_hprobes(std::string mod_path, DwarfParser &dwarfparser, struct bpf
 }
 
 void signal_handler(int signum){
-  clog << "Caught signal " << signum << endl;
-  if (signum == SIGINT) {
-      clog << "process killed" << endl;
+  if (signum == SIGUSR1) {
+      flush_requested = 1;
+      return;
   }
-  exit(signum);
+  if (polling) {
+      exiting = signum;
+      return;
+  }
+  _exit(signum);
 }
 
 void timeout_handler(int signum) {
@@ -232,34 +268,63 @@ int digitnum(int x) {
   return cnt;
 }
 
+// Write the acting set as "[1,5,9]" into buf (sized for MAX_ACTING ids);
+// returns the length.
+static size_t format_acting(char *buf, size_t cap,
+                            const struct client_op_v *op_v) {
+    char *p = buf;
+    char *end = buf + cap;
+    *p++ = '[';
+    for (int i = 0; i < MAX_ACTING; ++i) {
+        if (op_v->acting[i] < 0) break;
+        if (i) *p++ = ',';
+        p = std::to_chars(p, end - 1, op_v->acting[i]).ptr;
+    }
+    *p++ = ']';
+    return p - buf;
+}
+
+// Append the op list ("[read call(rbd.get_size) ...+2]") and report whether
+// any of the ops carries an extent, i.e. whether offset/length are meaningful.
+static bool put_ops(OutputBuffer &out, const struct client_op_v *op_v) {
+    bool has_extent = false;
+    out.put('[');
+    __u32 shown_ops = op_v->ops_size < MAX_CLIENT_OPS ? op_v->ops_size
+                                                      : MAX_CLIENT_OPS;
+    for (__u32 i = 0; i < shown_ops; ++i) {
+        if (i) out.put(' ');
+        if (ceph_osd_op_extent(op_v->ops[i])) {
+            has_extent = true;
+        } else if (ceph_osd_op_call(op_v->ops[i])) {
+            out.put("call(")
+                .put_bounded(op_v->cls_ops[i].cls_name, sizeof(op_v->cls_ops[i].cls_name))
+                .put('.')
+                .put_bounded(op_v->cls_ops[i].method_name, sizeof(op_v->cls_ops[i].method_name))
+                .put(')');
+            continue;
+        }
+        const char *name = ceph_osd_op_str(op_v->ops[i]);
+        if (name) out.put(name);
+    }
+    if (op_v->ops_size > shown_ops) {
+        if (shown_ops) out.put(' ');
+        out.put("...+").dec(op_v->ops_size - shown_ops);
+    }
+    out.put(']');
+    return has_extent;
+}
+
 static int handle_event(void *ctx, void *data, size_t size) {
     (void)ctx;
     (void)size;
     struct client_op_v * op_v = (struct client_op_v *)data;
-    std::stringstream ss;
-    ss << std::hex << op_v->m_seed;
-    std::string pgid(ss.str());
-
-    // Properly Escape CSV Characters
-    auto csv_escape = [](const std::string& in) -> std::string {
-        bool need_quotes = false;
-        for (char c : in) {
-            if (c == ',' || c == '"' || c == '\n' || c == '\r') {
-                need_quotes = true;
-                break;
-            }
-        }
-        if (!need_quotes) return in;
-        std::string out;
-        out.reserve(in.size() + 2);
-        out.push_back('"');
-        for (char c : in) {
-            if (c == '"') out.push_back('"');
-            out.push_back(c);
-        }
-        out.push_back('"');
-        return out;
-    };
+    OutputBuffer &out = stdout_buffer();
+
+    char pgid[sizeof(op_v->m_seed) * 2];
+    size_t pgid_len = std::to_chars(pgid, pgid + sizeof(pgid), op_v->m_seed, 16).ptr - pgid;
+    char acting[MAX_ACTING * 12 + 2];
+    size_t acting_len = format_acting(acting, sizeof(acting), op_v);
+    size_t object_len = strnlen(op_v->object_name, sizeof(op_v->object_name));
 
     // Define field widths based on actual data
     struct FieldWidths {
@@ -276,92 +341,9 @@ static int handle_event(void *ctx, void *data, size_t size) {
     
     static FieldWidths widths;
     static bool firsttime = true;
-    
-    // Compile acting OSD list
-    std::stringstream acting_osd_list;
-    acting_osd_list << "[";
-    {
-        bool first = true;
-        for (int i = 0; i < MAX_ACTING; ++i) {
-            if (op_v->acting[i] < 0) break;
-            if (!first) acting_osd_list << ",";
-            acting_osd_list << op_v->acting[i];
-            first = false;
-        }
-        acting_osd_list << "]";
-    }
-    std::string acting_str = acting_osd_list.str();
-
-    // Compile Ops list
-    std::stringstream ops_list;
-    bool print_offset_length = false;
-    ops_list << "[";
-    __u32 shown_ops = op_v->ops_size < MAX_CLIENT_OPS ? op_v->ops_size
-                                                      : MAX_CLIENT_OPS;
-    for (__u32 i = 0; i < shown_ops; ++i) {
-        if (i) ops_list << " ";
-        if (ceph_osd_op_extent(op_v->ops[i])) {
-            ops_list << ceph_osd_op_str(op_v->ops[i]);
-            print_offset_length = true;
-        } else if (ceph_osd_op_call(op_v->ops[i])) {
-            ops_list << "call(" << op_v->cls_ops[i].cls_name
-                   << "." << op_v->cls_ops[i].method_name << ")";
-        } else {
-            ops_list << ceph_osd_op_str(op_v->ops[i]);
-        }
-    }
-    if (op_v->ops_size > shown_ops) {
-        if (shown_ops) ops_list << " ";
-        ops_list << "...+" << (op_v->ops_size - shown_ops);
-    }
-    ops_list << "]";
-    std::string ops_str = ops_list.str();
 
     long long latency_us = (op_v->finish_stamp - op_v->sent_stamp) / 1000;
-    std::string wr_str = (op_v->rw & CEPH_OSD_FLAG_WRITE) ? "W" : "R";
-
-    // CSV output
-    if (export_csv) {
-        static bool csv_headers_printed = false;
-        static FILE* csv_fp = nullptr;
-
-        // Open CSV file
-        if (!csv_fp) {
-            csv_fp = fopen(csv_output_file.c_str(), "w");
-            if (!csv_fp) {
-                perror("fopen for CSV output failure");
-                export_csv = false; // disable CSV output on failure
-            }
-        }
-        // Print CSV Headers
-        if (csv_fp && !csv_headers_printed) {
-            fprintf(csv_fp, "pid,client,tid,pool,pg,acting,WR,size,latency,object,ops,offset,length\n");
-            csv_headers_printed = true;
-        }
-
-        std::string offset_field = print_offset_length ? std::to_string(op_v->offset) : "";
-        std::string length_field = print_offset_length ? std::to_string(op_v->length) : "";
-
-        if (csv_fp) {
-            fprintf(csv_fp,
-               "%d,%lld,%lld,%lld,%s,%s,%s,%lld,%lld,%s,%s,%s,%s\n",
-                op_v->pid,
-                (long long)op_v->cid,
-                (long long)op_v->tid,
-                (long long)op_v->m_pool,
-                pgid.c_str(),
-                csv_escape(acting_str).c_str(),
-                wr_str.c_str(),
-                (long long)op_v->length,
-                (long long)latency_us,
-                csv_escape(op_v->object_name).c_str(),
-                csv_escape(ops_str).c_str(),
-                csv_escape(offset_field).c_str(),
-                csv_escape(length_field).c_str());
-
-            fflush(csv_fp); // Flush file to disk
-        }
-    }
+    const char *wr_str = (op_v->rw & CEPH_OSD_FLAG_WRITE) ? "W" : "R";
 
     // Standard output
     if (firsttime) {
@@ -370,24 +352,25 @@ static int handle_event(void *ctx, void *data, size_t size) {
         widths.client = MAX(8, (int)std::to_string(op_v->cid).length() + 1);
         widths.tid = MAX(8, (int)std::to_string(op_v->tid).length() + 1);
         widths.pool = MAX(6, (int)std::to_string(op_v->m_pool).length() + 1);
-        widths.pg = MAX(4, (int)pgid.length() + 1);
-        widths.acting = MAX(15, (int)acting_str.length() + 1);
+        widths.pg = MAX(4, (int)pgid_len + 1);
+        widths.acting = MAX(15, (int)acting_len + 1);
         widths.wr = 4;
         widths.size = MAX(9, (int)std::to_string(op_v->length).length() + 1);
         widths.latency = MAX(9, (int)std::to_string(latency_us).length() + 1);
         
         // Print header using calculated widths
-        printf("%*s%*s%*s%*s%*s %*s%*s%*s%*s%s\n",
-               widths.pid, "pid",
-               widths.client, "client",
-               widths.tid, "tid",
-               widths.pool, "pool",
-               widths.pg, "pg",
-               widths.acting, "acting",
-               widths.wr, "WR",
-               widths.size, "size",
-               widths.latency, "latency",
-               "     object[ops]");
+        out.pad("pid", widths.pid)
+           .pad("client", widths.client)
+           .pad("tid", widths.tid)
+           .pad("pool", widths.pool)
+           .pad("pg", widths.pg)
+           .put(' ')
+           .pad("acting", widths.acting)
+           .pad("WR", widths.wr)
+           .pad("size", widths.size)
+           .pad("latency", widths.latency)
+           .put("     object[ops]");
+        out.end_line();
         
         firsttime = false;
     }
@@ -395,28 +378,64 @@ static int handle_event(void *ctx, void *data, size_t size) {
     // Format output using calculated widths
     // Note: explicit space after pg ensures separation from acting column
     // even when acting_str exceeds its calculated width
-    printf("%*d%*lld%*lld%*lld%*s %*s",
-           widths.pid, op_v->pid,
-           widths.client, op_v->cid,
-           widths.tid, op_v->tid,
-           widths.pool, op_v->m_pool,
-           widths.pg, pgid.c_str(),
-           widths.acting, acting_str.c_str());
-
-    printf("%*s%*lld%*lld",
-           widths.wr, wr_str.c_str(),
-           widths.size, op_v->length,
-           widths.latency, latency_us);
+    out.dec_pad(op_v->pid, widths.pid)
+       .dec_pad((long long)op_v->cid, widths.client)
+       .dec_pad((long long)op_v->tid, widths.tid)
+       .dec_pad((long long)op_v->m_pool, widths.pool)
+       .pad(pgid, pgid_len, widths.pg)
+       .put(' ')
+       .pad(acting, acting_len, widths.acting)
+       .pad(wr_str, widths.wr)
+       .dec_pad((long long)op_v->length, widths.size)
+       .dec_pad(latency_us, widths.latency);
 
     // Object name and operations (no fixed width needed)
-    printf("     %s ", op_v->object_name);
-    printf("%s", ops_str.c_str());
+    out.put("     ").put(op_v->object_name, object_len).put(' ');
+    size_t ops_mark = out.size();
+    bool print_offset_length = put_ops(out, op_v);
+    size_t ops_len = out.size() - ops_mark;
+
+    // CSV output, reusing the op list just formatted for stdout
+    if (csv_writer) {
+        OutputBuffer &csv = csv_writer->buffer();
+        csv.dec(op_v->pid).put(',')
+           .dec((long long)op_v->cid).put(',')
+           .dec((long long)op_v->tid).put(',')
+           .dec((long long)op_v->m_pool).put(',')
+           .put(pgid, pgid_len).put(',')
+           .csv(acting, acting_len).put(',')
+           .put(wr_str).put(',')
+           .dec((long long)op_v->length).put(',')
+           .dec(latency_us).put(',')
+           .csv(op_v->object_name, object_len).put(',')
+           .csv(out.since(ops_mark), ops_len).put(',');
+        if (print_offset_length) {
+            csv.dec((long long)op_v->offset).put(',')
+               .dec((long long)op_v->length);
+        } else {
+            csv.put(',');
+        }
+        csv.end_line();
+        csv_writer->commit();
+    }
+
+    if (columnar_ops) {
+        columnar_ops->add(op_v->pid).add(op_v->cid).add(op_v->tid).add(op_v->rw)
+            .add(op_v->sent_stamp).add(op_v->finish_stamp)
+            .add(op_v->target_osd).add(op_v->m_pool).add(op_v->m_seed)
+            .add_str(acting, acting_len)
+            .add_str(op_v->object_name, object_len)
+            .add_str(out.since(ops_mark), ops_len)
+            .add(op_v->ops_size).add(op_v->offset).add(op_v->length)
+            .add(latency_us);
+        columnar_ops->end_row();
+    }
 
     if (print_offset_length) {
-        printf("[%lld, %lld]\n", op_v->offset, op_v->length);
-    } else {
-        printf("\n");
+        out.put('[').dec((long long)op_v->offset).put(", ")
+           .dec((long long)op_v->length).put(']');
     }
+    out.end_line();
 
     return 0;
 }
@@ -529,6 +548,11 @@ int parse_args(int argc, char **argv) {
     {"skip-version-check", no_argument,       0, 0},
     {"list",               no_argument,       0, 0},
     {"list-embedded",      no_argument,       0, 0},
+    {"rotate-size",        required_argument, 0, 0},
+    {"rotate-time",        required_argument, 0, 0},
+    {"rotate-keep",        required_argument, 0, 0},
+    {"compress",           required_argument, 0, 0},
+    {"columnar",           required_argument, 0, 0},
     {"version",            no_argument,       0, 'V'},
     {"help",               no_argument,       0, 'h'},
     {0, 0, 0, 0}
@@ -545,6 +569,40 @@ int parse_args(int argc, char **argv) {
           list_clients_mode = true;
         } else if (strcmp(long_options[option_index].name, "list-embedded") == 0) {
           list_embedded_mode = true;
+        } else if (strcmp(long_options[option_index].name, "rotate-size") == 0) {
+          if (!parse_size_arg(optarg, csv_options.rotate_size)) {
+            std::cerr << "Invalid rotate size. Use a byte count with optional K/M/G/T suffix.\n";
+            return -1;
+          }
+          export_csv = true;
+        } else if (strcmp(long_options[option_index].name, "rotate-time") == 0) {
+          if (!parse_duration_arg(optarg, csv_options.rotate_time)) {
+            std::cerr << "Invalid rotate time. Use seconds with optional s/m/h/d suffix.\n";
+            return -1;
+          }
+          export_csv = true;
+        } else if (strcmp(long_options[option_index].name, "rotate-keep") == 0) {
+          try {
+            int keep = std::stoi(optarg);
+            if (keep <= 0) throw std::invalid_argument("Invalid count");
+            csv_options.keep = keep;
+          } catch (...) {
+            std::cerr << "Invalid rotate keep count. Must be a positive integer.\n";
+            return -1;
+          }
+          export_csv = true;
+        } else if (strcmp(long_options[option_index].name, "compress") == 0) {
+          if (strcmp(optarg, "gzip") == 0) {
+            csv_options.compression = RotatingWriter::COMPRESS_GZIP;
+          } else if (strcmp(optarg, "none") == 0) {
+            csv_options.compression = RotatingWriter::COMPRESS_NONE;
+          } else {
+            std::cerr << "Unsupported compression '" << optarg << "'. Use gzip or none.\n";
+            return -1;
+          }
+          export_csv = true;
+        } else if (strcmp(long_options[option_index].name, "columnar") == 0) {
+          columnar_file = optarg;
         }
         break;
       case 't':
@@ -589,11 +647,17 @@ int parse_args(int argc, char **argv) {
         print_tool_version("radostrace");
         exit(0);
       case 'h':
-        std::cout << "Usage: " << argv[0] << " [-t <timeout seconds>] [-j [filename]] [-i <filename>] [-o [filename]] [-p <pid>] [--skip-version-check] [--list] [--list-embedded]\n";
+        std::cout << "Usage: " << argv[0] << " [-t <timeout seconds>] [-j [filename]] [-i <filename>] [-o [filename]] [--rotate-size <size>] [--rotate-time <duration>] [--rotate-keep <n>] [--compress <gzip|none>] [--columnar <filename>] [-p <pid>] [--skip-version-check] [--list] [--list-embedded]\n";
         std::cout << "  -t, --timeout <seconds>    Set execution timeout in seconds\n";
-        std::cout << "  -j, --export-json <file>   Export DWARF info to JSON (default: radostrace_dwarf.json)\n";
-        std::cout << "  -i, --import-json <file>   Import DWARF info from JSON file\n";
+        std::cout << "  -j, --export-json <file>   Export DWARF info to JSON (default: radostrace_dwarf.json;\n";
+        std::cout << "                             binary format if <file> ends in .bin)\n";
+        std::cout << "  -i, --import-json <file>   Import DWARF info from JSON or binary file\n";
         std::cout << "  -o, --output <file>        Export events data info to CSV (default: radostrace_events.csv)\n";
+        std::cout << "  --rotate-size <size>       Start a new CSV file once the current one reaches <size> on disk (K/M/G suffix)\n";
+        std::cout << "  --rotate-time <duration>   Start a new CSV file every <duration> (seconds, or s/m/h/d suffix)\n";
+        std::cout << "  --rotate-keep <n>          Keep only the newest <n> rotated CSV files\n";
+        std::cout << "  --compress <gzip|none>     Compress the CSV output on a background thread\n";
+        std::cout << "  --columnar <file>          Also record every event to a columnar file, see tools/columnar_reader.py\n";
         std::cout << "  -p, --pid <pid>            Attach uprobes only to the specified process ID (Mandatory for container based process tracing)\n";
         std::cout << "  --skip-version-check       Skip version check when importing DWARF JSON (currently needed for containers)\n";
         std::cout << "  --list                     List client processes using libceph-common (PID, container, traceability, version), and exit\n";
@@ -613,9 +677,46 @@ int parse_args(int argc, char **argv) {
   return 0;
 }
 
+// Declare the --columnar table; the column order must match handle_event().
+static int open_columnar(ColumnarWriter &writer) {
+  using CW = ColumnarWriter;
+  char host[256] = "";
+  gethostname(host, sizeof(host) - 1);
+  writer.set_meta("tool", "radostrace");
+  writer.set_meta("hostname", host);
+  writer.set_meta("latency_unit", "us");
+  columnar_ops = writer.add_table("client_op", {
+      {"pid", CW::U32, CW::NO_CLOCK},
+      {"client", CW::U64, CW::NO_CLOCK},
+      {"tid", CW::U64, CW::NO_CLOCK},
+      {"flags", CW::U16, CW::NO_CLOCK},
+      {"sent_stamp", CW::U64, CW::BOOTTIME_NS},
+      {"finish_stamp", CW::U64, CW::BOOTTIME_NS},
+      {"target_osd", CW::U32, CW::NO_CLOCK},
+      {"pool", CW::U64, CW::NO_CLOCK},
+      {"pg_seed", CW::U32, CW::NO_CLOCK},
+      {"acting", CW::STR, CW::NO_CLOCK},
+      {"object", CW::STR, CW::NO_CLOCK},
+      {"ops", CW::STR, CW::NO_CLOCK},
+      {"ops_total", CW::U32, CW::NO_CLOCK},
+      {"offset", CW::U64, CW::NO_CLOCK},
+      {"length", CW::U64, CW::NO_CLOCK},
+      {"latency", CW::I64, CW::NO_CLOCK},
+  });
+  if (!writer.open()) {
+    cerr << "Failed to create " << writer.path() << ": " << strerror(errno)
+         << endl;
+    columnar_ops = nullptr;
+    return -1;
+  }
+  clog << "Writing columnar events to " << writer.path() << endl;
+  return 0;
+}
 
 int main(int argc, char **argv) {
   signal(SIGINT, signal_handler); 
+  signal(SIGTERM, signal_handler);
+  signal(SIGUSR1, signal_handler);
 
   if (parse_args(argc, argv) != 0) {
     return 1;
@@ -663,7 +764,7 @@ int main(int argc, char **argv) {
   struct radostrace_bpf *skel;
   // long uprobe_offset;
   int ret = 0;
-  struct ring_buffer *rb;
+  struct ring_buffer *rb = NULL;
 
   DwarfParser dwarfparser(rados_probes, probe_units);
   // Layout facts the BPF program needs; must be registered before parse().
@@ -701,6 +802,20 @@ int main(int argc, char **argv) {
 
   std::string embedded_matched_version;
 
+  // The library paths are reported as they appear inside the target's
+  // mount namespace; for containerized rbd clients (podman / docker)
+  // those paths don't exist on the host.  Read the build-id through
+  // /proc/<pid>/root/ when a target PID is specified so the read sees
+  // the same file the uprobe will attach to.
+  auto bid_path = [](const std::string& p) -> std::string {
+      if (process_id == -1) return p;
+      return "/proc/" + std::to_string(process_id) + "/root" + p;
+  };
+  std::vector<std::pair<std::string, std::string>> rados_mods = {
+      {get_basename(libceph_common_path),
+          get_elf_build_id(bid_path(libceph_common_path))},
+  };
+
   if (import_json) {
       clog << "Importing DWARF info from " << json_input_file << endl;
 
@@ -719,7 +834,9 @@ int main(int argc, char **argv) {
           }
       }
 
-      if (!dwarfparser.import_from_json(json_input_file, version)) {
+      // The build-id is checked even without the version check, as it is
+      // read from the file the uprobes attach to.
+      if (!dwarfparser.import_from_json(json_input_file, version, rados_mods)) {
           cerr << "Failed to import DWARF info from " << json_input_file << endl;
           return 1;
       }
@@ -730,20 +847,6 @@ int main(int argc, char **argv) {
       // ELF build-id of libceph-common.so.2.  That single build-id pins the
       // exact package build (all three libs ship from it), so the matcher
       // selects the right entry and loads whatever modules it carries.
-      //
-      // The library paths are reported as they appear inside the target's
-      // mount namespace; for containerized rbd clients (podman / docker)
-      // those paths don't exist on the host.  Read the build-id through
-      // /proc/<pid>/root/ when a target PID is specified so the read sees
-      // the same file the uprobe will attach to.
-      auto bid_path = [](const std::string& p) -> std::string {
-          if (process_id == -1) return p;
-          return "/proc/" + std::to_string(process_id) + "/root" + p;
-      };
-      std::vector<std::pair<std::string, std::string>> rados_mods = {
-          {get_basename(libceph_common_path),
-              get_elf_build_id(bid_path(libceph_common_path))},
-      };
       if (!export_json && dwarfparser.import_from_embedded(
               rados_mods, "radostrace", &embedded_matched_version)) {
           // Detailed match info already logged inside import_from_embedded.
@@ -768,7 +871,10 @@ int main(int argc, char **argv) {
               clog << "Could not determine package version for librados2, using 'unknown'" << endl;
           }
 
-          dwarfparser.export_to_json(json_output_file, version);
+          if (DwarfParser::is_binary_export(json_output_file))
+              dwarfparser.export_to_binary(json_output_file, version);
+          else
+              dwarfparser.export_to_json(json_output_file, version);
           clog << "Dwarf parsing data exported to " << json_output_file << endl;
           return 0;
       }
@@ -892,6 +998,22 @@ int main(int argc, char **argv) {
     attach_uprobe(skel, dwarfparser, p, "Objecter::_finish_op", process_id);
   }
 
+  if (export_csv) {
+    csv_writer = new RotatingWriter(csv_output_file, CSV_HEADER, csv_options);
+    if (!csv_writer->open()) {
+      cerr << "Failed to open CSV output " << csv_output_file << ": "
+           << strerror(errno) << endl;
+      goto cleanup;
+    }
+    clog << "Writing events to " << csv_writer->current_path() << endl;
+  }
+
+  if (!columnar_file.empty()) {
+    columnar = new ColumnarWriter(columnar_file);
+    if (open_columnar(*columnar) != 0)
+      goto cleanup;
+  }
+
   clog << "New a ring buffer" << endl;
 
   rb = ring_buffer__new(bpf_map__fd(skel->maps.rb), handle_event, NULL, NULL);
@@ -911,18 +1033,36 @@ int main(int argc, char **argv) {
 
   clog << "Started to poll from ring buffer" << endl;
 
-  while ((!timeout_occurred || timeout == -1) && (ret = ring_buffer__poll(rb, 1000)) >= 0) {
+  polling = 1;
+  while (!exiting && (!timeout_occurred || timeout == -1) && (ret = ring_buffer__poll(rb, 1000)) >= 0) {
       // Continue polling while timeout hasn't occurred or if unlimited execution time
+      flush_output();
   }
+  flush_output();
 
+  if (exiting) {
+      clog << "Caught signal " << exiting << endl;
+      if (exiting == SIGINT)
+          clog << "process killed" << endl;
+  }
   if (timeout_occurred) {
       cerr << "Timeout occurred. Exiting." << endl;
   }
 
 cleanup:
   clog << "Clean up the eBPF program" << endl;
+  if (csv_writer) {
+    csv_writer->close();
+    delete csv_writer;
+    csv_writer = nullptr;
+  }
+  columnar_ops = nullptr;
+  delete columnar;
+  columnar = nullptr;
   ring_buffer__free(rb);
   radostrace_bpf__destroy(skel);
+  if (exiting)
+    return 0;
   return timeout_occurred ? -1 : -errno;
 }
 
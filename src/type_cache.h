@@ -0,0 +1,210 @@
+#ifndef TYPE_CACHE_H
+#define TYPE_CACHE_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// DwarfParser's cache of named type DIEs.  Every unit of a C++ binary
+// repeats the std:: and Ceph types it includes, so the parser keeps one
+// definition per (module, name) -- the first one met -- instead of one per
+// compile unit.  Names are interned once across modules: libceph-common,
+// librbd and librados share most of theirs.  Both tables are flat
+// open-addressing arrays, so an entry costs a slot rather than a node, a
+// std::string key and a bucket.
+//
+// Neither table ever removes entries.  Pointers returned by TypeCache::find
+// stay valid only until the next insert.
+
+// Maps strings to dense ids, storing each distinct string once in an arena.
+class StringInterner {
+ public:
+  static constexpr uint32_t NONE = UINT32_MAX;
+
+  StringInterner() : slots_(64, NONE) {}
+
+  uint32_t intern(std::string_view s) {
+    uint64_t h = hash(s);
+    size_t slot = probe(s, h);
+    if (slots_[slot] != NONE) return slots_[slot];
+    if ((names_.size() + 1) * 4 > slots_.size() * 3) {
+      grow();
+      slot = probe(s, h);
+    }
+    uint32_t id = static_cast<uint32_t>(names_.size());
+    names_.push_back(store(s));
+    slots_[slot] = id;
+    return id;
+  }
+
+  uint32_t find(std::string_view s) const { return slots_[probe(s, hash(s))]; }
+
+  std::string_view name(uint32_t id) const { return names_[id]; }
+  size_t size() const { return names_.size(); }
+  // Heap held by the interner, for the parse benchmark.
+  size_t bytes() const {
+    return slots_.capacity() * sizeof(uint32_t) +
+           names_.capacity() * sizeof(std::string_view) + arena_bytes_;
+  }
+
+ private:
+  static constexpr size_t BLOCK = 64 * 1024;
+
+  // FNV-1a.
+  static uint64_t hash(std::string_view s) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (unsigned char c : s) h = (h ^ c) * 0x100000001b3ull;
+    return h;
+  }
+
+  // The slot holding `s`, or the empty slot where it would go.
+  size_t probe(std::string_view s, uint64_t h) const {
+    size_t mask = slots_.size() - 1;
+    for (size_t i = h & mask;; i = (i + 1) & mask) {
+      if (slots_[i] == NONE || names_[slots_[i]] == s) return i;
+    }
+  }
+
+  void grow() {
+    std::vector<uint32_t> old(slots_.size() * 2, NONE);
+    old.swap(slots_);
+    size_t mask = slots_.size() - 1;
+    for (uint32_t id : old) {
+      if (id == NONE) continue;
+      size_t i = hash(names_[id]) & mask;
+      while (slots_[i] != NONE) i = (i + 1) & mask;
+      slots_[i] = id;
+    }
+  }
+
+  std::string_view store(std::string_view s) {
+    if (s.empty()) return std::string_view();
+    if (s.size() > block_left_) {
+      size_t n = std::max(s.size(), BLOCK);
+      blocks_.emplace_back(new char[n]);
+      block_ptr_ = blocks_.back().get();
+      block_left_ = n;
+      arena_bytes_ += n;
+    }
+    memcpy(block_ptr_, s.data(), s.size());
+    std::string_view stored(block_ptr_, s.size());
+    block_ptr_ += s.size();
+    block_left_ -= s.size();
+    return stored;
+  }
+
+  std::vector<uint32_t> slots_;  // ids, indexed by hash
+  std::vector<std::string_view> names_;
+  std::vector<std::unique_ptr<char[]>> blocks_;
+  char *block_ptr_ = nullptr;
+  size_t block_left_ = 0;
+  size_t arena_bytes_ = 0;
+};
+
+// (scope, name) -> V, keeping the first value inserted for each key.  A
+// scope is any pointer identifying a group of names (a Dwfl_Module for
+// DwarfParser); there are expected to be only a handful.
+template <typename V>
+class TypeCache {
+ public:
+  TypeCache() : slots_(64) {}
+
+  // False, leaving the cache unchanged, if (scope, name) is already cached.
+  bool insert(const void *scope, std::string_view name, const V &value) {
+    uint64_t key = make_key(scope_id(scope), names_.intern(name));
+    size_t slot = probe(key);
+    if (slots_[slot].key == key) return false;
+    if ((size_ + 1) * 4 > slots_.size() * 3) {
+      grow();
+      slot = probe(key);
+    }
+    slots_[slot].key = key;
+    slots_[slot].value = value;
+    ++size_;
+    return true;
+  }
+
+  V *find(const void *scope, std::string_view name) {
+    uint32_t name_id = names_.find(name);
+    if (name_id == StringInterner::NONE) return nullptr;
+    for (uint32_t id = 0; id < scopes_.size(); ++id) {
+      if (scopes_[id] == scope) return find(id, name_id);
+    }
+    return nullptr;
+  }
+
+  // The entry for `name` in any scope, trying scopes in the order they were
+  // first inserted into.
+  V *find_any(std::string_view name) {
+    uint32_t name_id = names_.find(name);
+    if (name_id == StringInterner::NONE) return nullptr;
+    for (uint32_t id = 0; id < scopes_.size(); ++id) {
+      if (V *v = find(id, name_id)) return v;
+    }
+    return nullptr;
+  }
+
+  bool empty() const { return size_ == 0; }
+  size_t size() const { return size_; }
+  size_t names() const { return names_.size(); }
+  size_t bytes() const {
+    return slots_.capacity() * sizeof(Slot) + names_.bytes();
+  }
+
+ private:
+  static constexpr uint64_t EMPTY = UINT64_MAX;
+
+  struct Slot {
+    uint64_t key = EMPTY;
+    V value{};
+  };
+
+  static uint64_t make_key(uint32_t scope, uint32_t name) {
+    return (uint64_t)scope << 32 | name;
+  }
+  // splitmix64 finalizer: name ids are dense, so spread them over the table.
+  static uint64_t mix(uint64_t k) {
+    k = (k ^ (k >> 30)) * 0xbf58476d1ce4e5b9ull;
+    k = (k ^ (k >> 27)) * 0x94d049bb133111ebull;
+    return k ^ (k >> 31);
+  }
+
+  uint32_t scope_id(const void *scope) {
+    for (uint32_t id = 0; id < scopes_.size(); ++id) {
+      if (scopes_[id] == scope) return id;
+    }
+    scopes_.push_back(scope);
+    return static_cast<uint32_t>(scopes_.size() - 1);
+  }
+
+  size_t probe(uint64_t key) const {
+    size_t mask = slots_.size() - 1;
+    for (size_t i = mix(key) & mask;; i = (i + 1) & mask) {
+      if (slots_[i].key == EMPTY || slots_[i].key == key) return i;
+    }
+  }
+
+  V *find(uint32_t scope, uint32_t name_id) {
+    Slot &slot = slots_[probe(make_key(scope, name_id))];
+    return slot.key == EMPTY ? nullptr : &slot.value;
+  }
+
+  void grow() {
+    std::vector<Slot> old(slots_.size() * 2);
+    old.swap(slots_);
+    for (const Slot &s : old) {
+      if (s.key != EMPTY) slots_[probe(s.key)] = s;
+    }
+  }
+
+  std::vector<Slot> slots_;
+  size_t size_ = 0;
+  std::vector<const void *> scopes_;
+  StringInterner names_;
+};
+
+#endif
@@ -2,6 +2,8 @@
 #define UTILS_H
 
 #include <cctype>
+#include <cstdint>
+#include <cstdlib>
 #include <string>
 #include <unistd.h>
 #include <vector>
@@ -61,5 +63,38 @@ inline int parse_osd_id_from_tokens(const std::vector<std::string> &args) {
     return -1;
 }
 
+// Parse a byte count with an optional K/M/G/T suffix (powers of 1024), e.g.
+// "512M".  Returns false for malformed or zero values.
+inline bool parse_size_arg(const std::string &arg, uint64_t &bytes) {
+    char *end = nullptr;
+    unsigned long long v = strtoull(arg.c_str(), &end, 10);
+    if (end == arg.c_str() || v == 0 || arg[0] == '-')
+        return false;
+    std::string suffix(end);
+    if (suffix == "K" || suffix == "k") v <<= 10;
+    else if (suffix == "M" || suffix == "m") v <<= 20;
+    else if (suffix == "G" || suffix == "g") v <<= 30;
+    else if (suffix == "T" || suffix == "t") v <<= 40;
+    else if (!suffix.empty()) return false;
+    bytes = v;
+    return true;
+}
+
+// Parse a duration in seconds with an optional s/m/h/d suffix, e.g. "6h".
+// Returns false for malformed or zero values.
+inline bool parse_duration_arg(const std::string &arg, unsigned &seconds) {
+    char *end = nullptr;
+    unsigned long v = strtoul(arg.c_str(), &end, 10);
+    if (end == arg.c_str() || v == 0 || arg[0] == '-')
+        return false;
+    std::string suffix(end);
+    if (suffix == "m") v *= 60;
+    else if (suffix == "h") v *= 3600;
+    else if (suffix == "d") v *= 86400;
+    else if (!suffix.empty() && suffix != "s") return false;
+    seconds = v;
+    return true;
+}
+
 #endif // UTILS_H
 
@@ -0,0 +1,307 @@
+// Cold-start DWARF parse benchmark: DwarfParser::add_module + parse() +
+// export_to_json over the synthetic fixture from tools/gen_dwarf_fixture.py,
+// with the per-phase breakdown from DwarfParser::stats.
+//
+//   bench_dwarf_parser <libfixture.so> [runs]
+//
+// Each run uses a fresh DwarfParser, as a tool start does; the fixture's
+// pages stay in the page cache, so runs after the first measure parsing
+// rather than disk reads.  The run fails if any probe stops resolving.
+// Every run is repeated with DwarfParser::use_name_index off and on; on
+// libfixture-index.so (which carries a .gdb_index) the second pass shows
+// the indexed lookup, on libfixture.so both passes walk every CU.  Each
+// pass runs in its own child process so it can report its peak RSS.  The
+// last run's export is then re-imported as JSON and in the binary format
+// (import_from_json accepts both), timing what -i costs at tool start.
+// The binary import copies the blob into DwarfParser's maps; the
+// "in place" line times the same file served through dwarf_blob::Reader
+// alone -- map, verify, and look up every probe -- for comparison.
+
+#include <linux/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "bpf_ceph_types.h"
+#include "dwarf_parser.h"
+#include "utils.h"
+#include "bench.h"
+
+// Mirror of osdtrace's probes on the types in the generated fixture.h.
+static DwarfParser::probes_t fixture_probes = {
+    {"OSD::enqueue_op",
+     {{"op", "px", "request", "header", "type"},
+      {"op", "px", "reqid", "name", "_num"},
+      {"op", "px", "reqid", "tid"},
+      {"op", "px", "request", "recv_stamp"}}},
+
+    {"OSD::dequeue_op",
+     {{"op", "px", "request", "header", "type"},
+      {"op", "px", "reqid", "tid"},
+      {"pg", "px", "pg_id", "pgid", "m_pool"},
+      {"pg", "px", "pg_id", "pgid", "m_seed"}}},
+
+    {"PrimaryLogPG::execute_ctx",
+     {{"ctx", "reqid", "name", "_num"},
+      {"ctx", "reqid", "tid"},
+      {"ctx", "new_obs", "oi", "soid", "oid", "name", "_M_string_length"},
+      {"ctx", "new_obs", "oi", "soid", "oid", "name", "_M_dataplus", "_M_p"},
+      {"ctx", "ops", "_M_impl", "_M_start"},
+      {"ctx", "ops", "_M_impl", "_M_finish"}}},
+
+    {"ReplicatedBackend::submit_transaction",
+     {{"reqid", "name", "_num"}, {"reqid", "tid"}}},
+};
+
+static std::vector<std::string> fixture_units = {
+    "OSD.cc", "PrimaryLogPG.cc", "ReplicatedBackend.cc"};
+
+typedef DwarfParser::PhaseStat DwarfParser::ParseStats::*PhaseField;
+
+static const struct {
+  const char *name;
+  PhaseField field;
+} PHASES[] = {
+    {"add_module", &DwarfParser::ParseStats::add_module},
+    {"preprocess_module", &DwarfParser::ParseStats::preprocess_module},
+    {"  iterate_types_in_cu", &DwarfParser::ParseStats::iterate_types_in_cu},
+    {"handle_module", &DwarfParser::ParseStats::handle_module},
+    {"  handle_function", &DwarfParser::ParseStats::handle_function},
+    {"    translate_fields", &DwarfParser::ParseStats::translate_fields},
+    {"export_to_json", &DwarfParser::ParseStats::export_to_json},
+};
+
+static bool same_vf(const decltype(DwarfParser::mod_func2vf) &a,
+                    const decltype(DwarfParser::mod_func2vf) &b) {
+  auto same_field = [](const Field &x, const Field &y) {
+    return x.offset == y.offset && x.pointer == y.pointer;
+  };
+  auto same_var = [&](const VarField &x, const VarField &y) {
+    return x.varloc.reg == y.varloc.reg && x.varloc.offset == y.varloc.offset &&
+           x.varloc.stack == y.varloc.stack &&
+           std::equal(x.fields.begin(), x.fields.end(), y.fields.begin(),
+                      y.fields.end(), same_field);
+  };
+  auto same_func = [&](const auto &x, const auto &y) {
+    return x.first == y.first &&
+           std::equal(x.second.begin(), x.second.end(), y.second.begin(),
+                      y.second.end(), same_var);
+  };
+  auto same_module = [&](const auto &x, const auto &y) {
+    return x.first == y.first &&
+           std::equal(x.second.begin(), x.second.end(), y.second.begin(),
+                      y.second.end(), same_func);
+  };
+  return std::equal(a.begin(), a.end(), b.begin(), b.end(), same_module);
+}
+
+// What an import serving lookups from the mapping would cost: open the blob
+// and resolve every probe's pc and var fields without copying them out.
+// Returns the number of probes found, or -1 if the blob does not open.
+static volatile int64_t in_place_sink;  // keeps the field reads
+static int lookup_in_place(const std::string &file) {
+  int fd = open(file.c_str(), O_RDONLY);
+  if (fd < 0) return -1;
+  struct stat st;
+  void *map = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size > 0)
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) return -1;
+  dwarf_blob::Reader r;
+  int found = -1;
+  if (r.open(map, st.st_size)) {
+    found = 0;
+    for (const auto &m : r.modules()) {
+      for (const auto &probe : fixture_probes) {
+        bool pc = false, vars = false;
+        for (const auto &rec : r.pcs(m))
+          pc |= r.str(rec.name) == probe.first && rec.pc != 0;
+        for (const auto &func : r.funcs(m)) {
+          if (r.str(func.name) != probe.first) continue;
+          for (const auto &var : r.vars(func))
+            for (const auto &field : r.fields(var)) in_place_sink += field.offset;
+          vars = func.vars.count > 0;
+        }
+        found += pc && vars;
+      }
+    }
+  }
+  munmap(map, st.st_size);
+  return found;
+}
+
+// Time `runs` cold starts in one mode and print the fastest run's phases.
+static int bench_mode(const std::string &path, int runs, bool use_name_index,
+                      const char *json_path) {
+  printf("use_name_index=%d\n", use_name_index);
+  DwarfParser::ParseStats best;
+  uint64_t best_ns = UINT64_MAX, best_allocs = 0;
+  size_t cache_entries = 0, cache_bytes = 0;
+  std::string bin_path = std::string(json_path) + ".bin";
+  decltype(DwarfParser::mod_func2vf) want_vf;
+  decltype(DwarfParser::mod_func2pc) want_pc;
+  for (int r = 0; r < runs; ++r) {
+    DwarfParser dp(fixture_probes, fixture_units);
+    dp.use_name_index = use_name_index;
+    dp.request_type_size("OSDOp");
+    dp.request_member_offset("OSDOp", {"indata", "_carriage"});
+    dp.request_member_offset("OSDOp", {"op", "cls", "method_len"});
+    uint64_t allocs = bench_allocs;
+    uint64_t start = bench::now_ns();
+    {
+      bench::QuietStdout quiet;  // handle_function dumps each probe's attributes
+      dp.add_module(path);
+      dp.parse();
+      dp.export_to_json(json_path);
+    }
+    uint64_t ns = bench::now_ns() - start;
+    allocs = bench_allocs - allocs;
+    printf("  run %d: %.1f ms\n", r + 1, ns / 1e6);
+    fflush(stdout);
+
+    std::string module = get_basename(path);
+    for (const auto &probe : fixture_probes) {
+      if (!dp.mod_func2pc[module].count(probe.first)) {
+        fprintf(stderr, "probe %s did not resolve\n", probe.first.c_str());
+        return 1;
+      }
+    }
+    if (dp.get_type_size(module, "OSDOp") <= 0 ||
+        dp.get_member_offset(module, "OSDOp", {"indata", "_carriage"}) < 0) {
+      fprintf(stderr, "OSDOp size or member offset did not resolve\n");
+      return 1;
+    }
+    dp.export_to_binary(bin_path);
+    want_vf = dp.mod_func2vf;
+    want_pc = dp.mod_func2pc;
+    cache_entries = dp.global_type_cache.size();
+    cache_bytes = dp.global_type_cache.bytes();
+    if (ns < best_ns) {
+      best_ns = ns;
+      best = dp.stats;
+      best_allocs = allocs;
+    }
+  }
+
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  printf("fastest run: %.1f ms, %llu allocations, peak RSS %.1f MiB\n",
+         best_ns / 1e6, (unsigned long long)best_allocs, ru.ru_maxrss / 1024.0);
+  printf("type cache: %zu entries, %.1f KiB\n", cache_entries,
+         cache_bytes / 1024.0);
+  printf("  %-24s %10s %10s %12s\n", "phase", "ms", "calls", "us/call");
+  for (const auto &phase : PHASES) {
+    const DwarfParser::PhaseStat &s = best.*phase.field;
+    printf("  %-24s %10.1f %10llu %12.2f\n", phase.name, s.ns / 1e6,
+           (unsigned long long)s.calls, s.calls ? s.ns / 1e3 / s.calls : 0.0);
+  }
+
+  for (const std::string &file : {std::string(json_path), bin_path}) {
+    uint64_t best_import = UINT64_MAX, import_allocs = 0;
+    for (int r = 0; r < runs; ++r) {
+      DwarfParser imp(fixture_probes, fixture_units);
+      uint64_t allocs = bench_allocs;
+      uint64_t start = bench::now_ns();
+      bool ok;
+      {
+        bench::QuietStdout quiet;
+        ok = imp.import_from_json(file);
+      }
+      uint64_t ns = bench::now_ns() - start;
+      if (!ok || !same_vf(imp.mod_func2vf, want_vf) ||
+          imp.mod_func2pc != want_pc) {
+        fprintf(stderr, "re-import of %s does not match the parse\n", file.c_str());
+        unlink(bin_path.c_str());
+        return 1;
+      }
+      if (ns < best_import) {
+        best_import = ns;
+        import_allocs = bench_allocs - allocs;
+      }
+    }
+    struct stat st;
+    stat(file.c_str(), &st);
+    printf("import %-6s %8.1f KiB %10.3f ms %10llu allocations\n",
+           file == bin_path ? "binary" : "json", st.st_size / 1024.0,
+           best_import / 1e6, (unsigned long long)import_allocs);
+  }
+  uint64_t best_in_place = UINT64_MAX, in_place_allocs = 0;
+  for (int r = 0; r < runs; ++r) {
+    uint64_t allocs = bench_allocs;
+    uint64_t start = bench::now_ns();
+    int found = lookup_in_place(bin_path);
+    uint64_t ns = bench::now_ns() - start;
+    if (found != (int)fixture_probes.size()) {
+      fprintf(stderr, "in-place lookup of %s found %d probes\n",
+              bin_path.c_str(), found);
+      unlink(bin_path.c_str());
+      return 1;
+    }
+    if (ns < best_in_place) {
+      best_in_place = ns;
+      in_place_allocs = bench_allocs - allocs;
+    }
+  }
+  printf("binary in place %*s %10.3f ms %10llu allocations\n", 12, "",
+         best_in_place / 1e6, (unsigned long long)in_place_allocs);
+  unlink(bin_path.c_str());
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <libfixture.so> [runs]\n", argv[0]);
+    return 1;
+  }
+  std::string path = argv[1];
+  int runs = argc > 2 ? atoi(argv[2]) : 3;
+  if (runs < 1) runs = 1;
+  if (access(path.c_str(), R_OK) != 0) {
+    perror(path.c_str());
+    return 1;
+  }
+  char json_path[] = "/tmp/bench_dwarf_parser.XXXXXX";
+  int fd = mkstemp(json_path);
+  if (fd < 0) {
+    perror("mkstemp");
+    return 1;
+  }
+  close(fd);
+
+  printf("DwarfParser cold start on %s, %d runs\n", path.c_str(), runs);
+  fflush(stdout);
+  int rc = 0;
+  for (bool use_name_index : {false, true}) {
+    pid_t pid = fork();
+    if (pid < 0) {
+      perror("fork");
+      rc = 1;
+      break;
+    }
+    if (pid == 0) {
+      int child_rc = bench_mode(path, runs, use_name_index, json_path);
+      fflush(stdout);
+      _exit(child_rc);
+    }
+    int status;
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0) {
+      rc = 1;
+      break;
+    }
+  }
+  unlink(json_path);
+  return rc;
+}
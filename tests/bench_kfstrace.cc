@@ -0,0 +1,115 @@
+// Consumer-path benchmark of kfstrace: synthetic kernel_trace_event and
+// mds_trace_event records through handle_event() / handle_mds_event().
+// See tests/bench.h.
+
+#define main kfstrace_main
+#include "kfstrace.cc"
+#undef main
+
+#include "bench.h"
+
+static const char *const COMMS[] = {"fio", "kworker/u16:3", "cp", "postgres"};
+static const char *const MDS_OPS[][2] = {
+    {"lookup", "0"}, {"getattr", "0"}, {"create", "1"},
+    {"setattr", "1"}, {"unlink", "1"}, {"readdir", "0"}};
+
+// One completed libceph OSD request.
+static void fill_osd_event(bench::Rng &rng, size_t i, struct kernel_trace_event &e) {
+  memset(&e, 0, sizeof(e));
+  e.tid = 200000 + i;
+  e.client_id = rng.range(24100, 24103);
+  e.start_time = 1000000000000ull + i * 20000;
+  e.latency_us = rng.skewed(900, 2000000);
+  e.end_time = e.start_time + e.latency_us * 1000;
+  e.acting_size = rng.chance(20) ? 6 : 3;
+  for (__u32 k = 0; k < e.acting_size; ++k) e.acting_osds[k] = rng.range(0, 120);
+  e.primary_osd = e.acting_osds[0];
+  e.pid = rng.range(7000, 7100);
+  strcpy(e.comm, COMMS[rng.next() % 4]);
+  e.attempts = rng.chance(2) ? 2 : 1;
+  char name[64];
+  snprintf(name, sizeof(name), "%llx.%08llx",
+           (unsigned long long)rng.range(0x10000000000ull, 0x10000100000ull),
+           (unsigned long long)rng.range(0, 4096));
+  e.object_name_len = strnlen(name, CEPH_OID_INLINE_LEN - 1);
+  memcpy(e.object_name, name, e.object_name_len);
+  e.is_write = rng.chance(50);
+  e.is_read = !e.is_write || rng.chance(5);
+  e.pool_id = rng.range(1, 4);
+  e.pg_id = rng.range(0, 255);
+  e.ops_size = rng.range(1, CEPH_OSD_MAX_OPS);
+  for (__u8 k = 0; k < e.ops_size; ++k)
+    e.ops[k] = e.is_write ? (k ? CEPH_OSD_OP_SETXATTR : CEPH_OSD_OP_WRITE)
+                          : (k ? CEPH_OSD_OP_STAT : CEPH_OSD_OP_READ);
+  e.offset = rng.range(0, 1023) * 4096;
+  e.length = 4096 << rng.range(0, 8);
+}
+
+// One completed MDS request; about half the metadata writes get an unsafe
+// reply first.
+static void fill_mds_event(bench::Rng &rng, size_t i, struct mds_trace_event &e) {
+  memset(&e, 0, sizeof(e));
+  e.tid = 300000 + i;
+  e.client_id = rng.range(24100, 24103);
+  e.submit_time = 1000000000000ull + i * 20000;
+  const char *const *op = MDS_OPS[rng.next() % 6];
+  e.is_write_op = op[1][0] == '1';
+  e.got_safe_reply = 1;
+  e.safe_latency_us = rng.skewed(e.is_write_op ? 3000 : 400, 5000000);
+  e.safe_reply_time = e.submit_time + e.safe_latency_us * 1000;
+  if (e.is_write_op && rng.chance(50)) {
+    e.got_unsafe_reply = 1;
+    e.unsafe_latency_us = e.safe_latency_us / 4 + 1;
+    e.unsafe_reply_time = e.submit_time + e.unsafe_latency_us * 1000;
+  }
+  e.pid = rng.range(7000, 7100);
+  e.mds_rank = rng.range(0, 2);
+  strcpy(e.comm, COMMS[rng.next() % 4]);
+  e.attempts = 1;
+  strcpy(e.op_name, op[0]);
+  snprintf(e.path, sizeof(e.path), "/volumes/_nogroup/share%llu/dir%llu/file%llu",
+           (unsigned long long)rng.range(0, 9), (unsigned long long)rng.range(0, 99),
+           (unsigned long long)rng.range(0, 9999));
+}
+
+int main() {
+  size_t n = bench::event_count(500000);
+  bench::Rng rng;
+  std::vector<struct kernel_trace_event> osd(4096);
+  for (size_t i = 0; i < osd.size(); ++i) fill_osd_event(rng, i, osd[i]);
+  std::vector<struct mds_trace_event> mds(4096);
+  for (size_t i = 0; i < mds.size(); ++i) fill_mds_event(rng, i, mds[i]);
+  auto osd_event = [&](size_t i) {
+    handle_event(nullptr, &osd[i % osd.size()], sizeof(struct kernel_trace_event));
+  };
+  auto mds_event = [&](size_t i) {
+    handle_mds_event(nullptr, &mds[i % mds.size()], sizeof(struct mds_trace_event));
+  };
+  auto flush = [] { fflush(stdout); };
+
+  printf("kfstrace consumer path, %zu events per case\n", n);
+  fflush(stdout);
+
+  bench::run("handle_event (osd)", n, osd_event, flush);
+  bench::run("handle_mds_event", n, mds_event, flush);
+
+  {
+    char path[] = "/tmp/bench_kfstrace.XXXXXX";
+    int fd = mkstemp(path);
+    close(fd);
+    ColumnarWriter writer(path);
+    if (open_columnar(&writer, true, true) != 0) return 1;
+    columnar = &writer;
+    auto tick = [&] {
+      fflush(stdout);
+      writer.tick();
+    };
+    bench::run("handle_event (osd) + --columnar", n, osd_event, tick);
+    bench::run("handle_mds_event + --columnar", n, mds_event, tick);
+    writer.close();
+    columnar = NULL;
+    columnar_osd = columnar_mds = NULL;
+    unlink(path);
+  }
+  return 0;
+}
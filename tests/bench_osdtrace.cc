@@ -0,0 +1,399 @@
+// Consumer-path benchmark of osdtrace: synthetic op_v / bluestore_lat_v
+// events through handle_event() in each output mode.  See tests/bench.h.
+//
+// --sched, --pg-lock, --msgr and the --blk histograms are counted in BPF
+// maps that the tool reads once per interval.  Walking the maps needs
+// CAP_BPF, so those cases start from the readings of the walk: each event
+// is one key's reading, and each batch of keys is one interval's report.
+
+#define main osdtrace_main
+#include "osdtrace.cc"
+#undef main
+
+#include "bench.h"
+
+static const __u32 BENCH_PID = 4242;
+static const int BENCH_OSD = 7;
+
+// ObjectStore transaction opcodes of a replica write (write, setallochint)
+// and client opcodes of a primary op.
+static const __u32 TXN_OPS[] = {10, 39, 21};
+static const __u32 CLIENT_WRITE_OPS[] = {CEPH_OSD_OP_SETALLOCHINT, CEPH_OSD_OP_WRITE,
+                                         CEPH_OSD_OP_OMAPSETVALS};
+static const __u32 CLIENT_READ_OPS[] = {CEPH_OSD_OP_READ, CEPH_OSD_OP_STAT,
+                                        CEPH_OSD_OP_CALL};
+static const char *const DELAYS[] = {"waiting for rw locks", "waiting for readable",
+                                     "waiting for degraded object"};
+static const char *const BS_NAMES[] = {"_txc_committed_kv", "kv_commit", "_do_read",
+                                       "_remove", "kv_sync"};
+
+// One op as the BPF program completes it: stamps follow the op through the
+// messenger, op queue, PG and BlueStore, in the clocks osdtrace expects
+// (messenger stamps realtime, the rest boottime).
+static void fill_op(bench::Rng &rng, size_t i, struct op_v &v) {
+  memset(&v, 0, sizeof(v));
+  v.pid = BENCH_PID;
+  v.owner = rng.range(4100, 4400);
+  v.tid = 1000000 + i;
+  bool replica = rng.chance(35);
+  bool write = replica || rng.chance(60);
+  v.op_type = replica ? MSG_OSD_REPOP : MSG_OSD_OP;
+  v.m_pool = rng.range(1, 8);
+  v.m_seed = rng.range(0, 255);
+  bench::object_name(rng, v.object_name, sizeof(v.object_name));
+
+  __u64 t = 1000000000000000ull + i * 20000;  // boottime ns
+  v.recv_stamp = t + bootstamp;
+  v.throttle_stamp = v.recv_stamp + rng.range(0, 2000);
+  v.recv_complete_stamp = v.recv_stamp + rng.skewed(20000, 50000000);
+  v.dispatch_stamp = v.recv_complete_stamp + rng.range(1000, 5000);
+  v.enqueue_stamp = v.recv_complete_stamp - bootstamp + rng.skewed(8000, 10000000);
+  v.dequeue_stamp = v.enqueue_stamp + rng.skewed(50000, 500000000);
+
+  int n = rng.range(1, MAX_DETAIL_OPS);
+  v.detail_ops_total = n + (rng.chance(5) ? 4 : 0);
+  v.detail_ops_captured = n;
+  for (int k = 0; k < n; ++k) {
+    if (replica) {
+      v.detail_ops[k] = TXN_OPS[k % 3];
+    } else if (write) {
+      v.detail_ops[k] = CLIENT_WRITE_OPS[k % 3];
+    } else {
+      v.detail_ops[k] = CLIENT_READ_OPS[k % 3];
+      if (v.detail_ops[k] == CEPH_OSD_OP_CALL) {
+        strcpy(v.cls_ops[k].cls_name, "rbd");
+        strcpy(v.cls_ops[k].method_name, "get_object_map");
+      }
+    }
+  }
+  v.di.cnt = rng.chance(10) ? rng.range(1, 3) : 0;
+  for (int k = 0; k < v.di.cnt; ++k)
+    strcpy(v.di.delays[k], DELAYS[k]);
+
+  if (write) {
+    v.wb = 4096 << rng.range(0, 8);
+    if (!replica) v.submit_transaction_stamp = v.dequeue_stamp + rng.range(10000, 40000);
+    v.queue_transaction_stamp = v.dequeue_stamp + rng.skewed(60000, 50000000);
+    v.aio_size = v.wb;
+    v.aio_submit_stamp = v.queue_transaction_stamp + rng.skewed(30000, 10000000);
+    v.aio_done_stamp = v.aio_submit_stamp + rng.skewed(200000, 500000000);
+    v.kv_submit_stamp = v.aio_done_stamp + rng.skewed(20000, 50000000);
+    v.kv_committed_stamp = v.kv_submit_stamp + rng.skewed(300000, 500000000);
+    v.reply_stamp = v.kv_committed_stamp + rng.range(10000, 30000);
+    v.pi.peer1 = v.pi.peer2 = -1;
+    if (!replica) {
+      v.pi.peer1 = rng.range(0, 40);
+      v.pi.peer2 = rng.range(0, 40);
+      v.pi.sent_stamp = v.queue_transaction_stamp + rng.range(5000, 15000);
+      v.pi.recv_stamp1 = v.pi.sent_stamp + rng.skewed(500000, 500000000);
+      v.pi.recv_stamp2 = rng.chance(1) ? 0 : v.pi.sent_stamp + rng.skewed(500000, 500000000);
+      __u64 last = std::max(v.pi.recv_stamp1, v.pi.recv_stamp2);
+      if (last > v.reply_stamp) v.reply_stamp = last + rng.range(10000, 30000);
+    }
+  } else {
+    v.rb = 4096 << rng.range(0, 8);
+    v.execute_ctx_stamp = v.dequeue_stamp + rng.skewed(50000, 50000000);
+    v.reply_stamp = v.execute_ctx_stamp + rng.skewed(300000, 500000000);
+  }
+}
+
+// The fields the --kv, --pg-lock, --ec, --offcpu, --blk and --cpu probes
+// add to an op; the last four arrive in an op_ext_v.  Each case fills only
+// its own mode's: the --kv and --ec lines are printed whenever their stamps
+// are set.
+static void add_kv(bench::Rng &rng, struct op_v &v) {
+  if (!v.kv_submit_stamp) return;
+  v.kv_apply_stamp = v.kv_submit_stamp + rng.skewed(100000, 100000000);
+  v.kv_applied_stamp = v.kv_apply_stamp + rng.skewed(20000, 10000000);
+  v.kv_sync_start_stamp = v.kv_applied_stamp + rng.range(1000, 5000);
+  v.kv_sync_end_stamp = v.kv_sync_start_stamp + rng.skewed(200000, 500000000);
+  v.kv_fsync_ns = (v.kv_sync_end_stamp - v.kv_sync_start_stamp) / 2;
+  v.kv_sync_ptid = BENCH_PID + 17;
+  v.kv_batch = v.tid / 8;
+  if (v.kv_committed_stamp < v.kv_sync_end_stamp)
+    v.kv_committed_stamp = v.kv_sync_end_stamp + rng.range(1000, 5000);
+}
+
+static void add_pg_lock(bench::Rng &rng, struct op_v &v) {
+  v.pg_lock_wait_ns = rng.chance(20) ? rng.skewed(5000, 50000000) : 0;
+}
+
+// A 4+2 erasure-coded pool: the primary's writes go through ECBackend.
+static void add_ec(bench::Rng &rng, struct op_ext_v &e) {
+  struct op_v &v = e.op;
+  if (v.op_type != MSG_OSD_OP || !v.wb) return;
+  struct ec_info &ec = e.ext.ec;
+  ec.submit_stamp = v.dequeue_stamp + rng.range(10000, 40000);
+  ec.encode_start_stamp = ec.submit_stamp + rng.range(2000, 8000);
+  ec.encode_end_stamp = ec.encode_start_stamp + rng.skewed(20000, 5000000);
+  ec.sent_stamp = ec.encode_end_stamp + rng.range(2000, 8000);
+  for (int s = 0; s < 6; ++s) {
+    if (rng.chance(1)) continue;  // a commit the probes missed
+    ec.shard_mask |= 1u << s;
+    ec.osd[s] = rng.range(0, 40);
+    ec.commit_stamp[s] = ec.sent_stamp + rng.skewed(500000, 500000000);
+    if (ec.commit_stamp[s] > v.reply_stamp)
+      v.reply_stamp = ec.commit_stamp[s] + rng.range(10000, 30000);
+  }
+}
+
+// Stack ids stay below 64 per side, so the symbolizer's names are cached
+// after the warm-up, as they are after a while on a real OSD.
+static void add_offcpu(bench::Rng &rng, struct op_ext_v &e) {
+  if (!rng.chance(40)) return;
+  struct offcpu_info &oc = e.ext.offcpu;
+  oc.switches = rng.range(1, 6);
+  oc.max_ns = rng.skewed(50000, 100000000);
+  oc.total_ns = oc.max_ns + (oc.switches - 1) * rng.range(1000, 20000);
+  oc.max_runnable = rng.chance(30);
+  oc.runnable_ns = oc.max_runnable ? oc.max_ns : 0;
+  oc.max_kstack = rng.range(0, 63);
+  oc.max_ustack = rng.chance(5) ? -1 : (__s32)rng.range(0, 63);
+}
+
+static void add_blk(bench::Rng &rng, struct op_ext_v &e) {
+  const struct op_v &v = e.op;
+  struct blk_info &blk = e.ext.blk;
+  if (!v.aio_done_stamp) return;
+  blk.ios = rng.range(1, 4);
+  blk.bytes = v.wb;
+  blk.complete_stamp = v.aio_done_stamp - rng.range(1000, 5000);
+  blk.queue_ns = rng.skewed(5000, 10000000);
+  blk.device_ns = rng.skewed(100000, 100000000);
+}
+
+static void add_cpu(bench::Rng &rng, struct op_ext_v &e) {
+  const struct op_v &v = e.op;
+  struct cpu_info &cpu = e.ext.cpu;
+  cpu.tid = BENCH_PID + 40;
+  __u64 cycles = rng.range(1, 1ull << 40), instructions = cycles;
+  auto step = [&](struct cpu_reading &r) {
+    cycles += rng.skewed(30000, 10000000);
+    instructions += rng.skewed(40000, 10000000);
+    r.cycles = cycles;
+    r.instructions = instructions;
+  };
+  step(cpu.dequeue);
+  step(v.wb ? cpu.queue_transaction : cpu.execute_ctx);
+  step(v.wb ? cpu.aio_submit : cpu.reply);
+}
+
+static void fill_bluestore(bench::Rng &rng, struct bluestore_lat_v &v) {
+  memset(&v, 0, sizeof(v));
+  v.pid = BENCH_PID;
+  v.lat = rng.skewed(500000, 1000000000);
+  strcpy(v.name, BS_NAMES[rng.next() % 5]);
+}
+
+int main() {
+  size_t n = bench::event_count(500000);
+  bootstamp = 1700000000000000000ull;
+  osds[0] = BENCH_OSD;
+  pids[0] = BENCH_PID;
+  num_osd = 1;
+
+  // Pre-generate so the cases time only the consumer path.
+  bench::Rng rng;
+  std::vector<struct op_v> ops(4096);
+  for (size_t i = 0; i < ops.size(); ++i) fill_op(rng, i, ops[i]);
+  std::vector<struct bluestore_lat_v> bs(4096);
+  for (auto &v : bs) fill_bluestore(rng, v);
+  auto op_event = [&](size_t i) {
+    handle_event(nullptr, &ops[i % ops.size()], sizeof(struct op_v));
+  };
+  auto flush = [] { stdout_buffer().flush(); };
+  // `ops` with one mode's fields added
+  auto with = [&](void (*add)(bench::Rng &, struct op_v &)) {
+    std::vector<struct op_v> v(ops);
+    for (auto &op : v) add(rng, op);
+    return v;
+  };
+  auto with_ext = [&](void (*add)(bench::Rng &, struct op_ext_v &)) {
+    std::vector<struct op_ext_v> v(ops.size());
+    for (size_t i = 0; i < v.size(); ++i) {
+      v[i].op = ops[i];
+      add(rng, v[i]);
+    }
+    return v;
+  };
+  // v holds op_v or op_ext_v records
+  auto run_ops = [&](const char *name, auto v) {
+    bench::run(name, n, [&](size_t i) {
+      handle_event(nullptr, &v[i % v.size()], sizeof(v[0]));
+    }, flush);
+  };
+
+  const struct op_ext no_ext = {};
+
+  printf("osdtrace consumer path, %zu events per case\n", n);
+
+  bench::run("generate_op", n, [&](size_t i) {
+    osd_op_t op = generate_op(&ops[i % ops.size()], no_ext);
+    if (op.op_lat == 1) abort();  // keep the result alive
+  }, [] {});
+
+  probe_mode = OP_FULL_PROBE;
+  bench::run("handle_event full", n, op_event, flush);
+
+  probe_mode = OP_SINGLE_PROBE;
+  bench::run("handle_event single (-s)", n, op_event, flush);
+  osd_wsrl.clear();
+  osd_rsrl.clear();
+
+  probe_mode = BLUESTORE_PROBE;
+  bench::run("handle_event bluestore (-b)", n, [&](size_t i) {
+    handle_event(nullptr, &bs[i % bs.size()], sizeof(struct bluestore_lat_v));
+  }, flush);
+
+  probe_mode = OP_FULL_PROBE;
+  {
+    char path[] = "/tmp/bench_osdtrace.XXXXXX";
+    int fd = mkstemp(path);
+    close(fd);
+    ColumnarWriter writer(path);
+    if (open_columnar(writer) != 0) return 1;
+    bench::run("handle_event full + --columnar", n, op_event, [&] {
+      stdout_buffer().flush();
+      columnar->tick();
+    });
+    columnar->close();
+    columnar = nullptr;
+    columnar_ops = columnar_bluestore = nullptr;
+    unlink(path);
+  }
+
+  analyze_report.reset(new OsdLatencyReport("lat", analyze_infer_threshold));
+  bench::run("handle_event --analyze", n, op_event, flush);
+  analyze_report.reset();
+
+  attribution.reset(new StageAttribution());
+  peer_matrix.reset(new PeerLatencyMatrix());
+  bench::run("handle_event --bottleneck --peer-matrix", n, op_event, flush);
+  attribution.reset();
+  peer_matrix.reset();
+
+  probe_mode = OP_FULL_PROBE | KV_PROBE;
+  run_ops("handle_event full --kv", with(add_kv));
+
+  probe_mode = OP_FULL_PROBE | PGLOCK_PROBE;
+  run_ops("handle_event full --pg-lock", with(add_pg_lock));
+
+  probe_mode = OP_FULL_PROBE | EC_PROBE;
+  ec_report.reset(new EcReport());
+  run_ops("handle_event full --ec", with_ext(add_ec));
+  ec_report.reset();
+
+  // No stack map behind the symbolizer: every stack is named "?", once.
+  probe_mode = OP_FULL_PROBE | OFFCPU_PROBE;
+  offcpu_symbolizer.reset(new OffcpuSymbolizer(-1));
+  run_ops("handle_event full --offcpu", with_ext(add_offcpu));
+  offcpu_symbolizer.reset();
+
+  probe_mode = OP_FULL_PROBE | BLK_PROBE;
+  run_ops("handle_event full --blk", with_ext(add_blk));
+
+  probe_mode = OP_FULL_PROBE | CPU_PROBE;
+  cpu_report.reset(new CpuReport(false));
+  run_ops("handle_event full --cpu", with_ext(add_cpu));
+  cpu_report.reset();
+  probe_mode = OP_FULL_PROBE;
+
+  // 16 OSDs x 4 shards x the scheduler classes
+  const size_t sched_keys = 16 * 4 * SCHED_NUM_CLASSES;
+  sched_series.reset(new SchedSeries());
+  bench::run("interval --sched (per key)", n, [&](size_t i) {
+    size_t k = i % sched_keys, round = i / sched_keys;
+    SchedSeries::Reading r;
+    r.depth = k % 7;
+    r.max_depth = k % 7 + round % 5;
+    r.enqueued = round * (k % 50) + r.depth;
+    r.dequeued = round * (k % 50);
+    r.wait_sum_us = r.dequeued * 300;
+    r.wait_max_us = 2000 + k;
+    sched_series->sample(k / (4 * SCHED_NUM_CLASSES), k / SCHED_NUM_CLASSES % 4,
+                         SCHED_CLASS_NAMES[k % SCHED_NUM_CLASSES], r);
+  }, [] {
+    WallTime ts;
+    OutputBuffer &out = stdout_buffer();
+    for (const SchedSeries::Row &r : sched_series->rows())
+      SchedSeries::print_row(out, ts, r);
+    out.flush();
+  }, sched_keys);
+  sched_series.reset();
+
+  // 1024 PGs, a wait and a hold histogram each
+  const size_t pglock_keys = 2 * 1024;
+  pglock_report.reset(new PgLockReport());
+  bench::run("interval --pg-lock (per key)", n, [&](size_t i) {
+    size_t k = i % pglock_keys, round = i / pglock_keys;
+    PgLockReport::Reading r;
+    r.count = round * (k % 30);
+    r.sum_us = r.count * 40;
+    r.slots[3] = r.count - r.count / 16;
+    r.slots[12] = r.count / 16;
+    pglock_report->sample(k / 256, 1 + k / 2 % 4, k / 8, k & 1, r);
+  }, [] {
+    WallTime ts;
+    OutputBuffer &out = stdout_buffer();
+    std::vector<PgLockReport::Row> rows = pglock_report->rows();
+    for (size_t i = 0; i < rows.size() && i < PGLOCK_TOP; ++i)
+      PgLockReport::print_row(out, ts, rows[i]);
+    if (rows.size() > PGLOCK_TOP)
+      out.put("pglock ").put(ts).put(" (").dec(rows.size() - PGLOCK_TOP)
+         .put(" more PGs)").end_line();
+    out.flush();
+  }, pglock_keys);
+  pglock_report.reset();
+
+  // 512 connections of 16 OSDs to clients and their peers
+  const size_t msgr_conns = 512;
+  msgr_report.reset(new MsgrReport());
+  bench::run("interval --msgr (per key)", n, [&](size_t i) {
+    size_t k = i % msgr_conns, round = i / msgr_conns;
+    MsgrReport::Reading r;
+    r.msgs_in = round * (k % 100);
+    r.msgs_out = r.msgs_in;
+    r.bytes_in = r.msgs_in * 4096;
+    r.bytes_out = r.msgs_out * 200;
+    r.stalls = k % 64 == 0 ? round : 0;
+    r.stall_us = r.stalls * 500;
+    std::string peer = k % 4 ? msgr_peer_name(CEPH_ENTITY_TYPE_CLIENT, 4100 + k)
+                             : msgr_peer_name(CEPH_ENTITY_TYPE_OSD, k % 40);
+    msgr_report->sample(k / 32, 0x7f0000000000ull + k * 0x1000, peer, r);
+  }, [] {
+    WallTime ts;
+    OutputBuffer &out = stdout_buffer();
+    msgr_report->print(out, ts, 5, MSGR_TOP);
+    out.end_line();
+    out.flush();
+  }, msgr_conns);
+  msgr_report.reset();
+
+  // 16 NVMe devices
+  const size_t blk_devs = 16;
+  std::vector<std::string> devs;
+  for (size_t k = 0; k < blk_devs; ++k)
+    devs.push_back("nvme" + std::to_string(k) + "n1");
+  blk_report.reset(new BlkReport());
+  bench::run("interval --blk (per key)", n, [&](size_t i) {
+    size_t k = i % blk_devs, round = i / blk_devs;
+    BlkReport::Reading r;
+    r.count = round * 5000;
+    r.bytes = r.count * 16384;
+    r.queue_sum_us = r.count * 3;
+    r.device_sum_us = r.count * 90;
+    r.queue_slots[1] = r.count - r.count / 50;
+    r.queue_slots[4] = r.count / 50;
+    r.device_slots[6] = r.count / 5;
+    r.device_slots[7] = r.count - r.count / 5 - r.count / 100;
+    r.device_slots[10 + k % 4] = r.count / 100;
+    blk_report->sample(devs[k], r);
+  }, [] {
+    WallTime ts;
+    OutputBuffer &out = stdout_buffer();
+    blk_report->print(out, ts, 5);
+    out.flush();
+  }, blk_devs);
+  blk_report.reset();
+  return 0;
+}
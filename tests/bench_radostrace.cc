@@ -0,0 +1,94 @@
+// Consumer-path benchmark of radostrace: synthetic client_op_v events
+// through handle_event() with each output.  See tests/bench.h.
+
+#define main radostrace_main
+#include "radostrace.cc"
+#undef main
+
+#include "bench.h"
+
+static const __u16 WRITE_OPS[] = {CEPH_OSD_OP_SETALLOCHINT, CEPH_OSD_OP_WRITE,
+                                  CEPH_OSD_OP_OMAPSETVALS};
+static const __u16 READ_OPS[] = {CEPH_OSD_OP_READ, CEPH_OSD_OP_CALL, CEPH_OSD_OP_STAT};
+
+// One completed client op as Objecter::_finish_op reports it.
+static void fill_client_op(bench::Rng &rng, size_t i, struct client_op_v &v) {
+  memset(&v, 0, sizeof(v));
+  v.pid = rng.range(3000, 3003);
+  v.cid = rng.range(14100, 14103);
+  v.tid = 500000 + i;
+  bool write = rng.chance(60);
+  v.rw = write ? CEPH_OSD_FLAG_WRITE : 0;
+  v.sent_stamp = 1000000000000000ull + i * 20000;
+  v.finish_stamp = v.sent_stamp + rng.skewed(800000, 2000000000);
+  v.m_pool = rng.range(1, 8);
+  v.m_seed = rng.range(0, 1023);
+  int replicas = rng.chance(20) ? 6 : 3;  // EC 4+2 or 3x replicated
+  for (int k = 0; k < MAX_ACTING; ++k)
+    v.acting[k] = k < replicas ? (int)rng.range(0, 120) : -1;
+  v.target_osd = v.acting[0];
+  bench::object_name(rng, v.object_name, sizeof(v.object_name));
+  v.offset = rng.range(0, 1023) * 4096;
+  v.length = 4096 << rng.range(0, 8);
+  v.ops_size = rng.range(1, 5);
+  for (__u32 k = 0; k < v.ops_size && k < MAX_CLIENT_OPS; ++k) {
+    v.ops[k] = write ? WRITE_OPS[k] : READ_OPS[k];
+    if (v.ops[k] == CEPH_OSD_OP_CALL) {
+      strcpy(v.cls_ops[k].cls_name, "rbd");
+      strcpy(v.cls_ops[k].method_name, "get_size");
+    }
+  }
+}
+
+// CSV cases write to a scratch directory removed afterwards.
+static void bench_csv(const char *name, size_t n, std::vector<struct client_op_v> &ops,
+                      const RotatingWriter::Options &opts) {
+  char dir[] = "/tmp/bench_radostrace.XXXXXX";
+  if (!mkdtemp(dir)) return;
+  std::string path = std::string(dir) + "/events.csv";
+  RotatingWriter writer(path, CSV_HEADER, opts);
+  if (!writer.open()) return;
+  csv_writer = &writer;
+  bench::run(name, n, [&](size_t i) {
+    handle_event(nullptr, &ops[i % ops.size()], sizeof(struct client_op_v));
+  }, flush_output);
+  writer.close();
+  csv_writer = nullptr;
+  std::string cleanup = std::string("rm -rf ") + dir;
+  if (system(cleanup.c_str()) != 0) fprintf(stderr, "failed to remove %s\n", dir);
+}
+
+int main() {
+  size_t n = bench::event_count(500000);
+  bench::Rng rng;
+  std::vector<struct client_op_v> ops(4096);
+  for (size_t i = 0; i < ops.size(); ++i) fill_client_op(rng, i, ops[i]);
+  auto op_event = [&](size_t i) {
+    handle_event(nullptr, &ops[i % ops.size()], sizeof(struct client_op_v));
+  };
+
+  printf("radostrace consumer path, %zu events per case\n", n);
+
+  bench::run("handle_event", n, op_event, flush_output);
+
+  RotatingWriter::Options opts;
+  bench_csv("handle_event + -o csv", n, ops, opts);
+  opts.rotate_size = 64 << 20;
+  opts.compression = RotatingWriter::COMPRESS_GZIP;
+  bench_csv("handle_event + -o csv --compress", n, ops, opts);
+
+  {
+    char path[] = "/tmp/bench_radostrace.XXXXXX";
+    int fd = mkstemp(path);
+    close(fd);
+    ColumnarWriter writer(path);
+    if (open_columnar(writer) != 0) return 1;
+    columnar = &writer;
+    bench::run("handle_event + --columnar", n, op_event, flush_output);
+    writer.close();
+    columnar = nullptr;
+    columnar_ops = nullptr;
+    unlink(path);
+  }
+  return 0;
+}
@@ -1,12 +1,16 @@
 """
 Pytest configuration and shared fixtures for test data.
 """
+import array
 import io
+import struct
 import tarfile
 from pathlib import Path
 import requests
 import pytest
 
+import columnar_reader  # pylint: disable=E0401
+
 # flake8: noqa: E501
 URL = "https://github.com/taodd/cephtrace/releases/download/fixtures/sample_osdtrace_data.tar.gz"
 
@@ -34,3 +38,69 @@ def sample_osdtrace_log(tmp_path_factory) -> Path:
         pytest.fail(f"Could not find expected sample osdtrace_data log file {log_file}")
 
     return log_file
+
+
+_COLUMNAR_TYPECODES = {
+    columnar_reader.U8: "B", columnar_reader.U16: "H",
+    columnar_reader.U32: "I", columnar_reader.U64: "Q",
+    columnar_reader.I32: "i", columnar_reader.I64: "q",
+    columnar_reader.STR: "I",
+}
+
+
+def _columnar_str(text):
+    data = text.encode()
+    return struct.pack("<H", len(data)) + data
+
+
+@pytest.fixture
+def write_columnar(tmp_path):
+    """Writes small uncompressed columnar files like the tracers' --columnar.
+
+    Call as write_columnar(name, metadata, {table: [(column, type, clock,
+    values)]}, batch_rows=N); returns the file's path.  Types and clocks
+    are the columnar_reader constants.
+    """
+    def write(name, metadata, tables, batch_rows=None):
+        strings = {}
+        out = bytearray(columnar_reader.MAGIC)
+
+        def record(kind, payload):
+            out.extend(struct.pack("<cI", kind, len(payload)) + payload)
+
+        record(b"M", struct.pack("<I", len(metadata)) + b"".join(
+            _columnar_str(k) + _columnar_str(str(v))
+            for k, v in metadata.items()))
+        for table_id, (table, cols) in enumerate(tables.items()):
+            record(b"S", struct.pack("<H", table_id) + _columnar_str(table)
+                   + struct.pack("<H", len(cols)) + b"".join(
+                       struct.pack("<BB", col_type, clock) + _columnar_str(c)
+                       for c, col_type, clock, _ in cols))
+            rows = len(cols[0][3])
+            step = batch_rows or rows
+            for first in range(0, rows, step):
+                new = []
+                chunks = b""
+                for _, col_type, _, values in cols:
+                    values = values[first:first + step]
+                    if col_type == columnar_reader.STR:
+                        for v in values:
+                            if v not in strings:
+                                strings[v] = len(strings)
+                                new.append(v)
+                        values = [strings[v] for v in values]
+                    data = array.array(_COLUMNAR_TYPECODES[col_type],
+                                       values).tobytes()
+                    chunks += struct.pack("<BII", columnar_reader.CODEC_RAW,
+                                          len(data), len(data)) + data
+                if new:
+                    record(b"D", struct.pack("<II", len(strings) - len(new),
+                                             len(new))
+                           + b"".join(_columnar_str(s) for s in new))
+                record(b"B", struct.pack("<HI", table_id,
+                                         len(values)) + chunks)
+        path = tmp_path / name
+        path.write_bytes(bytes(out))
+        return path
+
+    return write
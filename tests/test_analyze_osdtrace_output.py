@@ -77,3 +77,124 @@ def test_e2e_sort_sample_log(
     tail_out = stdout.strip().split("\n")[-3:]
 
     assert "\n" + "\n".join(tail_out) + "\n" == expected_output
+
+
+# osdtrace --kv --pg-lock lines: lock_wait after queue_lat, the BlueStore
+# stages of writes in parentheses after bluestore_lat.
+KV_PGLOCK_LINES = """\
+osd 0 pg 2.1a op_w size 4096 client 4567 tid 88 object rbd_data.1 \
+osd_ops [write] throttle_lat 0 recv_lat 12 dispatch_lat 8 queue_lat 2148 \
+lock_wait 2095 osd_lat 95 peers [(1, 410), (2, 388)] bluestore_lat 520 \
+(prepare 10 aio_wait 200 aio_size 4096 seq_wait 1 kv_commit 300 \
+kv_batch 40 kv_wal 60 kv_sync 150 kv_fsync 50) op_lat 2251
+osd 1 pg 2.1a subop_w size 4096 client 4567 tid 88 object rbd_data.1 \
+txn_ops [write] throttle_lat 0 recv_lat 10 dispatch_lat 6 queue_lat 30 \
+lock_wait 3 osd_lat 40 bluestore_lat 330 (prepare 8 aio_wait 150 \
+aio_size 4096 seq_wait 0 kv_commit 170 kv_batch 20 kv_wal 30 kv_sync 100 \
+kv_fsync 20) subop_lat 410
+osd 0 pg 2.7 op_r size 8192 client 4567 tid 89 object rbd_data.2 \
+osd_ops [read] throttle_lat 0 recv_lat 9 dispatch_lat 5 queue_lat 11 \
+lock_wait 0 osd_lat 60 bluestore_lat 80 op_lat 170
+osd 0 pg 2.1a op_w size 4096 client 4567 tid 90 object rbd_data.1 \
+osd_ops [write] throttle_lat 0 recv_lat 11 dispatch_lat 7 queue_lat 25 \
+lock_wait 12 osd_lat 90 peers [(1, 380), (2, 395)] bluestore_lat 480 \
+(prepare 9 aio_wait 190 aio_size 4096 seq_wait 2 kv_commit 270 \
+kv_batch 35 kv_wal 55 kv_sync 140 kv_fsync 40) op_lat 620
+"""
+
+# The same op from osdtrace without --pg-lock or --kv.
+PLAIN_LINE = (
+    "osd 0 pg 2.1a op_w size 4096 client 4567 tid 91 object rbd_data.1 "
+    "osd_ops [write] throttle_lat 0 recv_lat 11 dispatch_lat 7 "
+    "queue_lat 25 osd_lat 90 peers [(1, 380), (2, 395)] bluestore_lat 480 "
+    "op_lat 620\n"
+)
+
+
+@pytest.fixture
+def kv_pglock_log(tmp_path):
+    """A capture mixing --kv --pg-lock lines and a plain one."""
+    path = tmp_path / "osdtrace.log"
+    path.write_text(KV_PGLOCK_LINES + PLAIN_LINE)
+    return path
+
+
+def test_parse_kv_and_lock_wait():
+    """The kv stages and lock_wait are parsed, in their printed order."""
+    [op_w] = analyze_osdtrace_output.parse_line(
+        KV_PGLOCK_LINES.splitlines()[0])
+    assert op_w["lock_wait"] == 2095
+    assert op_w["queue_lat"] == 2148
+    assert op_w["peers"] == [(1, 410), (2, 388)]
+    assert op_w["bluestore_details"] == {
+        "prepare": 10, "aio_wait": 200, "aio_size": 4096, "seq_wait": 1,
+        "kv_commit": 300, "kv_batch": 40, "kv_wal": 60, "kv_sync": 150,
+        "kv_fsync": 50,
+    }
+    keys = list(op_w)
+    assert keys.index("queue_lat") + 1 == keys.index("lock_wait")
+    assert keys.index("lock_wait") + 1 == keys.index("osd_lat")
+
+    [subop_w] = analyze_osdtrace_output.parse_line(
+        KV_PGLOCK_LINES.splitlines()[1])
+    assert subop_w["op"] == "subop_w"
+    assert subop_w["lat_type"] == "subop_lat"
+    assert subop_w["bluestore_details"]["kv_sync"] == 100
+
+    [plain] = analyze_osdtrace_output.parse_line(PLAIN_LINE)
+    assert "lock_wait" not in plain
+    assert plain["bluestore_details"] == {}
+
+
+def test_parse_blk_details():
+    """--blk adds the block request fields to the BlueStore stages."""
+    line = KV_PGLOCK_LINES.splitlines()[0].replace(
+        "aio_size 4096 ", "aio_size 4096 blk_ios 2 blk_queue 15 "
+        "blk_device 170 ")
+    [op_w] = analyze_osdtrace_output.parse_line(line)
+    details = op_w["bluestore_details"]
+    assert (details["blk_ios"], details["blk_queue"],
+            details["blk_device"]) == (2, 15, 170)
+    assert details["kv_fsync"] == 50
+
+
+def test_analyze_kv_field(kv_pglock_log, capsys):
+    """-f on a kv stage aggregates it from the writes that have it."""
+    parser = analyze_osdtrace_output.create_arg_parser()
+    analyze_osdtrace_output.run(
+        parser.parse_args([str(kv_pglock_log), "-f", "kv_sync"]))
+    out = capsys.readouterr().out
+
+    assert "  op_w kv_sync (μsec): min=140, max=150, avg=145.00, " \
+        "stdev=7.07, samples=2" in out
+    assert "  subop_w kv_sync (μsec): min=100, max=100, avg=100.00, " \
+        "stdev=0.00, samples=1" in out
+    assert "op_r" not in out
+
+
+def test_analyze_lock_wait(kv_pglock_log, capsys):
+    """-f lock_wait skips lines captured without --pg-lock."""
+    parser = analyze_osdtrace_output.create_arg_parser()
+    analyze_osdtrace_output.run(
+        parser.parse_args([str(kv_pglock_log), "-f", "lock_wait", "-o", "0"]))
+    out = capsys.readouterr().out
+
+    assert "  op_r lock_wait (μsec): min=0, max=0, avg=0.00, stdev=0.00, " \
+        "samples=1" in out
+    assert "  op_w lock_wait (μsec): min=12, max=2095, avg=1053.50, " \
+        "stdev=1472.90, samples=2" in out
+
+
+def test_sort_lock_wait(kv_pglock_log, capsys):
+    """-s -f lock_wait orders by the wait and prints it like a latency."""
+    parser = analyze_osdtrace_output.create_arg_parser()
+    analyze_osdtrace_output.run(
+        parser.parse_args([str(kv_pglock_log), "-s", "-f", "lock_wait",
+                           "-m"]))
+    lines = capsys.readouterr().out.splitlines()
+
+    assert [line.split(" tid ")[1].split()[0] for line in lines] == \
+        ["89", "88", "90", "88"]
+    assert " queue_lat 2.15 lock_wait 2.1 osd_lat 0.1 " in lines[-1]
+    assert " seq_wait 0.0 kv_commit 0.3 kv_batch 0.04 kv_wal 0.06 " \
+        "kv_sync 0.15 kv_fsync 0.05) " in lines[-1]
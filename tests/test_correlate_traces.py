@@ -0,0 +1,168 @@
+"""
+Tests for correlate_traces.py: the (client, tid) join and the clock offset
+estimate, on small hand-made captures.
+"""
+
+import io
+
+import pytest
+
+import correlate_traces  # pylint: disable=E0401
+from columnar_reader import BOOTTIME_NS, NO_CLOCK, REALTIME_NS, \
+    I32, I64, STR, U32, U64  # pylint: disable=E0401
+
+# Client 4151 sends tids 1-3 to osd.0; the OSD served tids 1 and 2.
+RADOS_TEXT = """\
+     pid   client   tid  pool     pg    acting  WR  size  latency  object[ops]
+    1234     4151     1     2   2.1a   [0,1,2]   W  4096      800  obj1 [write]
+    1234     4151     2     2   2.1a   [0,1,2]   R  4096      500  obj2 [read]
+    1234     4151     3     2   2.1b   [0,1,2]   W  4096      900  obj3 [write]
+"""
+
+OSD_TEXT = """\
+osd 0 pg 2.1a op_w size 4096 client 4151 tid 1 recv_lat 2 dispatch_lat 3 \
+queue_lat 4 osd_lat 50 bluestore_lat 100 op_lat 300
+osd 0 pg 2.1a op_r size 4096 client 4151 tid 2 recv_lat 2 dispatch_lat 3 \
+queue_lat 4 osd_lat 50 bluestore_lat 100 op_lat 200
+osd 1 pg 2.1a subop_w size 4096 client 4151 tid 1 recv_lat 2 \
+dispatch_lat 3 queue_lat 4 osd_lat 50 bluestore_lat 100 subop_lat 150
+"""
+
+
+def correlate(paths, window=1000000, per_osd=False):
+    """Runs the join over `paths` and returns (stats, correlator, report)."""
+    correlator = correlate_traces.Correlator(window)
+    stats = correlate_traces.Stats()
+    for path in paths:
+        if correlate_traces.is_columnar(path):
+            records = correlate_traces.columnar_records(str(path))
+        else:
+            records = correlate_traces.TextSource(str(path)).poll()
+        for record in records:
+            pair = correlator.add(record)
+            if pair:
+                stats.add(*pair)
+    out = io.StringIO()
+    stats.report(correlator, per_osd, out)
+    return stats, correlator, out.getvalue()
+
+
+def test_text_join(tmp_path):
+    """Client and OSD text lines pair up on (client, tid)."""
+    (tmp_path / "client.log").write_text(RADOS_TEXT)
+    (tmp_path / "osd.log").write_text(OSD_TEXT)
+    stats, correlator, report = correlate(
+        [tmp_path / "osd.log", tmp_path / "client.log"])
+
+    assert stats.count == 2
+    assert correlator.unmatched() == {"ClientOp": 1, "OsdOp": 0}
+    assert report.startswith(
+        "matched 2 ops; unmatched 1 client, 0 osd; evicted 0\n")
+    cols = stats.by_osd[0]
+    assert sorted(cols["client_lat"]) == [500, 800]
+    assert sorted(cols["network_lat"]) == [300, 500]
+    # text captures carry no absolute stamps: no one-way split
+    assert not stats.offsets
+    assert "request_lat" not in report
+
+
+def test_text_no_match(tmp_path):
+    """Ops of another client, or served by another OSD, do not pair."""
+    (tmp_path / "client.log").write_text(RADOS_TEXT)
+    (tmp_path / "osd.log").write_text(
+        OSD_TEXT.replace("client 4151 tid 1 ", "client 9999 tid 1 ")
+        .replace("osd 0 pg 2.1a op_r", "osd 2 pg 2.1a op_r"))
+    stats, correlator, report = correlate(
+        [tmp_path / "client.log", tmp_path / "osd.log"])
+
+    assert stats.count == 0
+    assert correlator.unmatched() == {"ClientOp": 3, "OsdOp": 2}
+    assert report == "matched 0 ops; unmatched 3 client, 2 osd; evicted 0\n"
+
+
+def test_window_evicts_oldest(tmp_path):
+    """Unmatched ops beyond --window are dropped oldest first."""
+    (tmp_path / "client.log").write_text(RADOS_TEXT)
+    (tmp_path / "osd.log").write_text(OSD_TEXT)
+    stats, correlator, _ = correlate(
+        [tmp_path / "client.log", tmp_path / "osd.log"], window=2)
+
+    # tid 1 was pushed out by tid 3 before its OSD side arrived
+    assert stats.count == 1
+    assert correlator.evicted == 1
+    assert correlator.unmatched() == {"ClientOp": 1, "OsdOp": 1}
+
+
+def write_captures(write_columnar, skew_us, batch_rows=None):
+    """Client and OSD captures of 5 ops, the OSD clock `skew_us` ahead.
+
+    Each hop takes 100us + tid us on the wire and the OSD serves in 300us,
+    so the true offset of every op is exactly `skew_us`.
+    """
+    boot_to_real = 1700000000 * 10**9
+    tids = list(range(1, 6))
+    sent = [tid * 10**6 for tid in tids]
+    recv = [s + (100 + t + skew_us) * 1000 + boot_to_real
+            for s, t in zip(sent, tids)]
+    reply = [r + 300 * 1000 for r in recv]
+    finish = [p - boot_to_real - (skew_us - 100 - t) * 1000
+              for p, t in zip(reply, tids)]
+    client = write_columnar(
+        "client.ctc",
+        {"hostname": "client1", "boottime_to_realtime_ns": boot_to_real},
+        {"client_op": [
+            ("client", U64, NO_CLOCK, [4151] * 5),
+            ("tid", U64, NO_CLOCK, tids),
+            ("sent_stamp", U64, BOOTTIME_NS, sent),
+            ("finish_stamp", U64, BOOTTIME_NS, finish),
+            ("target_osd", U32, NO_CLOCK, [3] * 5),
+            ("object", STR, NO_CLOCK, ["obj%d" % t for t in tids]),
+            ("latency", I64, NO_CLOCK,
+             [(f - s) // 1000 for s, f in zip(sent, finish)]),
+        ]},
+        batch_rows)
+    osd = write_columnar(
+        "osd.ctc",
+        {"hostname": "osdhost", "boottime_to_realtime_ns": 0},
+        {"osd_op": [
+            ("osd", I32, NO_CLOCK, [3] * 5 + [4]),
+            ("kind", STR, NO_CLOCK, ["op_w"] * 5 + ["subop_w"]),
+            ("client", U64, NO_CLOCK, [4151] * 6),
+            ("tid", U64, NO_CLOCK, tids + [1]),
+            ("recv_stamp", U64, REALTIME_NS, recv + [recv[0]]),
+            ("reply_stamp", U64, REALTIME_NS, reply + [reply[0]]),
+            ("op_lat", I64, NO_CLOCK, [300] * 6),
+        ]},
+        batch_rows)
+    return client, osd
+
+
+@pytest.mark.parametrize("skew_us", [0, 2500, -700])
+def test_columnar_clock_skew(write_columnar, skew_us):
+    """The offset estimate recovers the skew; one-way times are corrected."""
+    client, osd = write_captures(write_columnar, skew_us)
+    stats, _, report = correlate([client, osd])
+
+    assert stats.count == 5
+    assert list(stats.offsets[("client1", "osdhost")]) == [skew_us] * 5
+    assert ("  client1 -> osdhost: %+.1f (5 ops)" % skew_us) in report
+    # raw one-way times carry the skew; the report takes it out again
+    assert list(stats.by_osd[3]["request_lat"]) == [
+        100 + t + skew_us for t in range(1, 6)]
+    request = next(line for line in report.splitlines()
+                   if line.strip().startswith("request_lat"))
+    assert request.split()[1:] == ["5", "103", "105", "105", "105", "105"]
+
+
+def test_columnar_batches(write_columnar):
+    """A capture split into many batches joins the same as a single one."""
+    client, osd = write_captures(write_columnar, 1000, batch_rows=2)
+    records = list(correlate_traces.columnar_records(str(client)))
+    assert [r.tid for r in records] == [1, 2, 3, 4, 5]
+    assert all(r.host == "client1" for r in records)
+    # the subop_w row is the replica's side and is skipped
+    assert len(list(correlate_traces.columnar_records(str(osd)))) == 5
+
+    stats, correlator, _ = correlate([client, osd])
+    assert stats.count == 5
+    assert correlator.unmatched() == {"ClientOp": 0, "OsdOp": 0}
@@ -0,0 +1,266 @@
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "dwarf_index.h"
+
+typedef std::vector<uint8_t> Bytes;
+typedef std::vector<uint64_t> Offsets;
+
+static void put(Bytes &b, uint64_t v, int n, bool be = false) {
+    for (int i = 0; i < n; ++i)
+        b.push_back((uint8_t)(v >> (8 * (be ? n - 1 - i : i))));
+}
+
+static void put_uleb(Bytes &b, uint64_t v) {
+    do {
+        uint8_t c = v & 0x7f;
+        v >>= 7;
+        b.push_back(c | (v ? 0x80 : 0));
+    } while (v);
+}
+
+struct GdbSymbol {
+    std::string name;
+    std::vector<uint32_t> entries;  // cu index | kind << 28
+};
+
+// A version-7 .gdb_index laid out the way gdb-add-index writes it.
+static Bytes build_gdb_index(const Offsets &cus, const std::vector<GdbSymbol> &syms,
+                             size_t slots) {
+    Bytes pool;
+    std::vector<std::pair<uint32_t, uint32_t>> table(slots, {0, 0});
+    // gdb puts the CU vectors first in the constant pool, then the names.
+    std::vector<uint32_t> vec_off;
+    for (const auto &s : syms) {
+        vec_off.push_back(pool.size());
+        put(pool, s.entries.size(), 4);
+        for (uint32_t e : s.entries) put(pool, e, 4);
+    }
+    for (size_t i = 0; i < syms.size(); ++i) {
+        uint32_t name_off = pool.size();
+        pool.insert(pool.end(), syms[i].name.begin(), syms[i].name.end());
+        pool.push_back(0);
+        uint32_t hash = DwarfNameIndex::gdb_hash(syms[i].name);
+        size_t mask = slots - 1, slot = hash & mask, step = ((hash * 17) & mask) | 1;
+        while (table[slot].first || table[slot].second) slot = (slot + step) & mask;
+        table[slot] = {name_off, vec_off[i]};
+    }
+    Bytes b;
+    uint32_t cu_list = 24, tu_list = cu_list + cus.size() * 16;
+    uint32_t addr = tu_list, symtab = addr, pool_off = symtab + slots * 8;
+    for (uint32_t v : {7u, cu_list, tu_list, addr, symtab, pool_off}) put(b, v, 4);
+    for (uint64_t c : cus) {
+        put(b, c, 8);
+        put(b, 0x100, 8);
+    }
+    for (const auto &t : table) {
+        put(b, t.first, 4);
+        put(b, t.second, 4);
+    }
+    b.insert(b.end(), pool.begin(), pool.end());
+    return b;
+}
+
+struct NamesEntry {
+    uint64_t tag;
+    uint32_t cu;
+    bool in_tu;
+};
+
+struct NamesName {
+    std::string name;
+    std::vector<NamesEntry> entries;
+};
+
+// One DWARF 5 .debug_names unit; names go into `str` (.debug_str).
+static void build_debug_names(Bytes &out, Bytes &str, const Offsets &cus,
+                              std::vector<NamesName> names, uint32_t buckets,
+                              bool be = false) {
+    // Names are sorted by bucket so each bucket's names are contiguous.
+    if (buckets) {
+        std::stable_sort(names.begin(), names.end(),
+                         [&](const NamesName &a, const NamesName &b) {
+                             return DwarfNameIndex::djb_hash(a.name) % buckets <
+                                    DwarfNameIndex::djb_hash(b.name) % buckets;
+                         });
+    }
+    // Abbrev 1: (tag, DW_IDX_compile_unit data1, DW_IDX_die_offset ref4,
+    // DW_IDX_parent flag_present); abbrev 2 adds DW_IDX_type_unit.
+    std::vector<uint64_t> tags;
+    for (const auto &n : names)
+        for (const auto &e : n.entries)
+            if (std::find(tags.begin(), tags.end(), e.tag) == tags.end()) tags.push_back(e.tag);
+    auto code = [&](uint64_t tag, bool tu) {
+        return 1 + 2 * (std::find(tags.begin(), tags.end(), tag) - tags.begin()) + tu;
+    };
+    Bytes abbrevs;
+    for (uint64_t tag : tags) {
+        for (int tu = 0; tu < 2; ++tu) {
+            put_uleb(abbrevs, code(tag, tu));
+            put_uleb(abbrevs, tag);
+            put_uleb(abbrevs, 1); put_uleb(abbrevs, 0x0b);
+            put_uleb(abbrevs, 3); put_uleb(abbrevs, 0x13);
+            put_uleb(abbrevs, 4); put_uleb(abbrevs, 0x19);
+            if (tu) { put_uleb(abbrevs, 2); put_uleb(abbrevs, 0x0b); }
+            put_uleb(abbrevs, 0); put_uleb(abbrevs, 0);
+        }
+    }
+    put_uleb(abbrevs, 0);
+
+    Bytes pool, str_offs, entry_offs, hashes;
+    std::vector<uint32_t> bucket(buckets, 0);
+    for (size_t i = 0; i < names.size(); ++i) {
+        put(str_offs, str.size(), 4, be);
+        str.insert(str.end(), names[i].name.begin(), names[i].name.end());
+        str.push_back(0);
+        put(entry_offs, pool.size(), 4, be);
+        for (const auto &e : names[i].entries) {
+            put_uleb(pool, code(e.tag, e.in_tu));
+            pool.push_back(e.cu);
+            put(pool, 0x2a, 4, be);
+            if (e.in_tu) pool.push_back(0);
+        }
+        pool.push_back(0);
+        uint32_t h = DwarfNameIndex::djb_hash(names[i].name);
+        put(hashes, h, 4, be);
+        if (buckets && !bucket[h % buckets]) bucket[h % buckets] = i + 1;
+    }
+
+    Bytes body;
+    put(body, 5, 2, be);
+    put(body, 0, 2, be);
+    for (uint32_t v : {(uint32_t)cus.size(), 0u, 0u, buckets, (uint32_t)names.size(),
+                       (uint32_t)abbrevs.size(), 4u})
+        put(body, v, 4, be);
+    body.insert(body.end(), {'L', 'L', 'V', 'M'});
+    for (uint64_t c : cus) put(body, c, 4, be);
+    for (uint32_t v : bucket) put(body, v, 4, be);
+    if (buckets) body.insert(body.end(), hashes.begin(), hashes.end());
+    body.insert(body.end(), str_offs.begin(), str_offs.end());
+    body.insert(body.end(), entry_offs.begin(), entry_offs.end());
+    body.insert(body.end(), abbrevs.begin(), abbrevs.end());
+    body.insert(body.end(), pool.begin(), pool.end());
+    put(out, body.size(), 4, be);
+    out.insert(out.end(), body.begin(), body.end());
+}
+
+static const uint32_t TYPE = 1u << 28, VARIABLE = 2u << 28, FUNCTION = 3u << 28;
+
+int main() {
+    std::cout << "Running DwarfNameIndex tests..." << std::endl;
+
+    // Test 1: .gdb_index lookups by qualified name and kind.
+    {
+        Offsets cus = {0x0, 0x1200, 0x5400, 0x9000};
+        std::vector<GdbSymbol> syms = {
+            {"OSD::dequeue_op", {2 | FUNCTION}},
+            {"OSDOp", {1 | TYPE, 2 | TYPE, 3 | TYPE}},
+            {"OpRequest", {3 | TYPE, 0 | FUNCTION}},
+            {"g_conf", {0 | VARIABLE}},
+        };
+        Bytes b = build_gdb_index(cus, syms, 8);
+        DwarfNameIndex idx;
+        assert(idx.load_gdb_index(b.data(), b.size()));
+        assert(std::string(idx.format()) == "gdb_index");
+        assert(idx.lookup("OSD::dequeue_op", DwarfNameIndex::FUNCTION) == Offsets({0x5400}));
+        assert(idx.lookup("OSD::dequeue_op", DwarfNameIndex::TYPE).empty());
+        assert(idx.lookup("OSDOp", DwarfNameIndex::TYPE) == Offsets({0x1200, 0x5400, 0x9000}));
+        assert(idx.lookup("OpRequest") == Offsets({0x9000, 0x0}));
+        assert(idx.lookup("g_conf").empty());           // variables are skipped
+        assert(idx.lookup("dequeue_op").empty());       // names are qualified
+        assert(idx.lookup("osdop").empty());            // hashed case-blind, compared exactly
+        std::cout << "  [PASS] Test 1: .gdb_index lookup" << std::endl;
+    }
+
+    // Test 2: a full table probes through collisions until it finds the
+    // name or an empty slot.
+    {
+        Offsets cus;
+        std::vector<GdbSymbol> syms;
+        for (int i = 0; i < 60; ++i) {
+            cus.push_back(i * 0x100);
+            syms.push_back({"Type" + std::to_string(i), {(uint32_t)i | TYPE}});
+        }
+        Bytes b = build_gdb_index(cus, syms, 64);
+        DwarfNameIndex idx;
+        assert(idx.load_gdb_index(b.data(), b.size()));
+        for (int i = 0; i < 60; ++i)
+            assert(idx.lookup("Type" + std::to_string(i)) == Offsets({(uint64_t)i * 0x100}));
+        assert(idx.lookup("Type60").empty());
+        std::cout << "  [PASS] Test 2: .gdb_index collision probing" << std::endl;
+    }
+
+    // Test 3: unsupported versions and broken headers are rejected.
+    {
+        Bytes b = build_gdb_index({0x0}, {{"A", {TYPE}}}, 4);
+        DwarfNameIndex idx;
+        Bytes v6 = b;
+        v6[0] = 6;
+        assert(!idx.load_gdb_index(v6.data(), v6.size()));
+        assert(!idx.loaded());
+        assert(!idx.load_gdb_index(b.data(), 20));
+        Bytes odd = b;
+        odd[20] -= 8;  // symbol table of 3 slots: not a power of two
+        assert(!idx.load_gdb_index(odd.data(), odd.size()));
+        assert(idx.lookup("A").empty());
+        assert(idx.load_gdb_index(b.data(), b.size()));
+        std::cout << "  [PASS] Test 3: malformed .gdb_index rejected" << std::endl;
+    }
+
+    // Test 4: .debug_names with hash buckets, kinds and type-unit entries.
+    {
+        Offsets cus = {0x0, 0x800, 0x3000};
+        std::vector<NamesName> names = {
+            {"dequeue_op", {{0x2e, 1, false}, {0x2e, 2, false}}},
+            {"OSDOp", {{0x13, 0, false}, {0x13, 2, false}, {0x13, 0, true}}},
+            {"OpRequest", {{0x02, 2, false}}},
+            {"pg_t", {{0x13, 1, false}}},
+        };
+        for (uint32_t buckets : {0u, 1u, 3u}) {
+            Bytes sec, str = {0};
+            build_debug_names(sec, str, cus, names, buckets);
+            DwarfNameIndex idx;
+            assert(idx.load_debug_names(sec.data(), sec.size(), str.data(), str.size()));
+            assert(std::string(idx.format()) == "debug_names");
+            assert(idx.lookup("dequeue_op", DwarfNameIndex::FUNCTION) == Offsets({0x800, 0x3000}));
+            assert(idx.lookup("dequeue_op", DwarfNameIndex::TYPE).empty());
+            assert(idx.lookup("OSDOp", DwarfNameIndex::TYPE) == Offsets({0x0, 0x3000}));
+            assert(idx.lookup("OpRequest", DwarfNameIndex::TYPE) == Offsets({0x3000}));
+            assert(idx.lookup("pg_t") == Offsets({0x800}));
+            assert(idx.lookup("OSD").empty());
+        }
+        std::cout << "  [PASS] Test 4: .debug_names lookup" << std::endl;
+    }
+
+    // Test 5: concatenated per-object units, big-endian, and a truncated
+    // section.
+    {
+        Bytes sec, str = {0};
+        build_debug_names(sec, str, {0x0}, {{"execute_ctx", {{0x2e, 0, false}}}}, 1);
+        build_debug_names(sec, str, {0x4000}, {{"execute_ctx", {{0x2e, 0, false}}},
+                                               {"OpContext", {{0x13, 0, false}}}}, 2);
+        DwarfNameIndex idx;
+        assert(idx.load_debug_names(sec.data(), sec.size(), str.data(), str.size()));
+        assert(idx.lookup("execute_ctx") == Offsets({0x0, 0x4000}));
+        assert(idx.lookup("OpContext") == Offsets({0x4000}));
+
+        Bytes be_sec, be_str = {0};
+        build_debug_names(be_sec, be_str, {0x10, 0x20000},
+                          {{"submit_transaction", {{0x2e, 1, false}}}}, 1, true);
+        assert(idx.load_debug_names(be_sec.data(), be_sec.size(), be_str.data(),
+                                    be_str.size(), true));
+        assert(idx.lookup("submit_transaction") == Offsets({0x20000}));
+
+        assert(!idx.load_debug_names(sec.data(), sec.size() - 3, str.data(), str.size()));
+        assert(!idx.loaded());
+        std::cout << "  [PASS] Test 5: multi-unit and big-endian .debug_names" << std::endl;
+    }
+
+    std::cout << "ALL 5 DWARF INDEX TESTS PASSED SUCCESSFULLY!" << std::endl;
+    return 0;
+}
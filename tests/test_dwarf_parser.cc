@@ -0,0 +1,131 @@
+// DwarfParser against the synthetic fixture from tools/gen_dwarf_fixture.py:
+// var paths a binary does not have are skipped, not fatal, and the name
+// index finds the same functions as the full CU walk.
+//
+//   test_dwarf_parser <libfixture.so>
+//
+// A Ceph release that renamed a parameter or dropped a member leaves the
+// probe's other var paths usable; the parse must go on and leave only the
+// missing ones without fields.  libfixture-index.so, next to libfixture.so
+// when gold is available, carries a .gdb_index.  An exported file is only
+// imported for the build it was exported from.
+
+#include <linux/types.h>
+
+#include <unistd.h>
+
+#include <cassert>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "bpf_ceph_types.h"
+#include "dwarf_parser.h"
+#include "utils.h"
+#include "version_utils.h"
+
+static DwarfParser::probes_t probes = {
+    {"OSD::enqueue_op",
+     {{"op", "px", "reqid", "tid"},
+      // a parameter the function does not have
+      {"no_such_param", "tid"},
+      // a member the type does not have
+      {"op", "px", "reqid", "no_such_member"},
+      {"op", "px", "request", "recv_stamp"}}},
+
+    {"OSD::dequeue_op",
+     {{"op", "px", "reqid", "tid"}}},
+};
+
+static std::vector<std::string> units = {"OSD.cc"};
+
+// PrimaryLogPG.cc is not a probe unit here: execute_ctx must not be found,
+// whether or not the index lists it
+static DwarfParser::probes_t unit_probes = {
+    {"OSD::enqueue_op", {{"op", "px", "reqid", "tid"}}},
+    {"PrimaryLogPG::execute_ctx", {{"ctx", "reqid", "tid"}}},
+};
+
+static void check_unit_filter(const std::string &path) {
+    std::string module = get_basename(path);
+    DwarfParser dp(unit_probes, units);
+    dp.add_module(path);
+    dp.parse();
+    assert(dp.mod_func2pc[module].count("OSD::enqueue_op"));
+    assert(!dp.mod_func2pc[module].count("PrimaryLogPG::execute_ctx"));
+    assert(dp.mod_func2vf[module]["OSD::enqueue_op"][0].fields.size() == 4);
+}
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        std::cerr << "usage: " << argv[0] << " <libfixture.so>" << std::endl;
+        return 1;
+    }
+    std::cout << "Running DwarfParser tests..." << std::endl;
+    std::string module = get_basename(argv[1]);
+
+    // Test 1: missing var paths are skipped, the rest resolve
+    {
+        DwarfParser dp(probes, units);
+        dp.add_module(argv[1]);
+        dp.parse();
+        assert(dp.mod_func2pc[module].count("OSD::enqueue_op"));
+        assert(dp.mod_func2pc[module].count("OSD::dequeue_op"));
+        const auto &vf = dp.mod_func2vf[module]["OSD::enqueue_op"];
+        assert(vf.size() == 4);
+        assert(vf[0].fields.size() == 4);
+        assert(vf[1].fields.empty());
+        assert(vf[2].fields.empty());
+        assert(vf[3].fields.size() == 4);
+        assert(dp.mod_func2vf[module]["OSD::dequeue_op"][0].fields.size() == 4);
+        std::cout << "  [PASS] Test 1: missing var paths skipped" << std::endl;
+    }
+
+    // Test 2: the indexed lookup keeps to the probe units like the walk
+    {
+        std::string path = argv[1];
+        std::string indexed = path.substr(0, path.size() - module.size()) +
+                              "libfixture-index.so";
+        check_unit_filter(path);
+        if (access(indexed.c_str(), R_OK) == 0) {
+            check_unit_filter(indexed);
+            std::cout << "  [PASS] Test 2: probe units filter the name index"
+                      << std::endl;
+        } else {
+            std::cout << "  [SKIP] Test 2: no " << indexed << std::endl;
+        }
+    }
+
+    // Test 3: an exported file is refused for another build of the module
+    {
+        DwarfParser dp(probes, units);
+        dp.add_module(argv[1]);
+        dp.parse();
+        std::string bid = get_elf_build_id(argv[1]);
+        assert(!bid.empty());
+        std::string other = std::string(bid.size(), '0');
+        char dir[] = "/tmp/test_dwarf_parser.XXXXXX";
+        assert(mkdtemp(dir));
+        for (const char *name : {"/dwarf.json", "/dwarf.bin"}) {
+            std::string file = std::string(dir) + name;
+            if (DwarfParser::is_binary_export(file))
+                dp.export_to_binary(file);
+            else
+                dp.export_to_json(file);
+            DwarfParser imp(probes, units);
+            assert(imp.import_from_json(file));
+            assert(imp.import_from_json(file, "", {{module, bid}}));
+            assert(imp.mod_func2pc[module] == dp.mod_func2pc[module]);
+            // an unreadable target build-id or another module is not checked
+            assert(imp.import_from_json(file, "", {{module, ""}}));
+            assert(imp.import_from_json(file, "", {{"ceph-osd", other}}));
+            assert(!imp.import_from_json(file, "", {{module, other}}));
+            unlink(file.c_str());
+        }
+        rmdir(dir);
+        std::cout << "  [PASS] Test 3: build-id mismatch rejected" << std::endl;
+    }
+
+    std::cout << "ALL 3 DWARF PARSER TESTS PASSED SUCCESSFULLY!" << std::endl;
+    return 0;
+}
@@ -0,0 +1,563 @@
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+#include "latency_stats.h"
+
+static std::string contents(const OutputBuffer &out) {
+    return std::string(out.data(), out.size());
+}
+
+struct TracedOp {
+    int osd;
+    const char *op;
+    uint64_t stages[OsdLatencyReport::NUM_INFER_FIELDS];
+    uint64_t lat;
+};
+
+// Synthetic ops; the expected reports below are what
+// tools/analyze_osdtrace_output.py prints for the same ops as log lines.
+static const TracedOp OPS[] = {
+    {1, "op_w", {0, 1, 0, 0, 2, 0}, 4},
+    {3, "op_r", {7, 6, 1, 3, 13, 0}, 32},
+    {3, "subop_w", {1, 11, 2, 6, 24, 26}, 73},
+    {3, "op_w", {8, 5, 3, 9, 12, 39}, 80},
+    {1, "op_r", {2, 10, 0, 12, 23, 0}, 52},
+    {3, "subop_w", {9, 4, 1, 15, 11, 15}, 61},
+    {3, "op_w", {3, 9, 2, 1, 22, 28}, 72},
+    {3, "op_r", {10, 3, 3, 4, 10, 0}, 38},
+    {1, "subop_w", {4, 8, 0, 7, 21, 4}, 53},
+    {3, "op_w", {11, 2, 1, 10, 9, 17}, 51},
+    {3, "op_r", {5, 7, 2, 13, 20, 0}, 49},
+    {3, "subop_w", {12, 1, 3, 16, 8, 43}, 86},
+    {1, "op_w", {6, 6, 0, 2, 19, 6}, 43},
+    {3, "op_r", {0, 11, 1, 5, 7, 0}, 29},
+    {3, "subop_w", {7, 5, 2, 8, 18, 32}, 78},
+    {3, "op_w", {1, 10, 3, 11, 6, 45}, 83},
+    {1, "op_r", {8, 4, 0, 14, 17, 0}, 51},
+    {3, "subop_w", {2, 9, 1, 0, 5, 21}, 47},
+    {3, "op_w", {9, 3, 2, 3, 16, 34}, 68},
+    {3, "op_r", {3, 8, 3, 6, 4, 0}, 26},
+    {1, "subop_w", {10, 2, 0, 9, 15, 10}, 49},
+    {3, "op_w", {4, 7, 1, 12, 3, 23}, 54},
+    {3, "op_r", {11, 1, 2, 15, 14, 0}, 48},
+    {3, "subop_w", {5, 6, 3, 1, 2, 49}, 72},
+    {1, "op_w", {12, 11, 0, 4, 13, 12}, 59},
+    {3, "op_r", {6, 5, 1, 7, 24, 0}, 51},
+    {3, "subop_w", {0, 10, 2, 10, 12, 38}, 81},
+    {3, "op_w", {7, 4, 3, 13, 23, 1}, 52},
+    {1, "op_r", {1, 9, 0, 16, 11, 0}, 39},
+    {3, "subop_w", {8, 3, 1, 2, 22, 27}, 66},
+    {3, "op_w", {2, 8, 2, 5, 10, 40}, 71},
+    {3, "op_r", {9, 2, 3, 8, 21, 0}, 48},
+    {1, "subop_w", {3, 7, 0, 11, 9, 16}, 52},
+    {3, "op_w", {10, 1, 1, 14, 20, 29}, 82},
+    {3, "op_r", {4, 6, 2, 0, 8, 0}, 28},
+    {3, "subop_w", {11, 11, 3, 3, 19, 5}, 61},
+    {1, "op_w", {5, 5, 0, 6, 7, 18}, 42},
+    {3, "op_r", {12, 10, 1, 9, 18, 0}, 52},
+    {3, "subop_w", {6, 4, 2, 12, 6, 44}, 77},
+    {3, "op_w", {0, 9, 3, 15, 17, 7}, 55},
+};
+
+static const char *EXPECTED_ANALYSIS =
+        "osd.1:\n"
+        "  op_r lat (μsec): min=39, max=52, avg=47.33, stdev=7.23, samples=3\n"
+        "  lat percentiles (μsec):\n"
+        "  |   1.00th=[39.00],  5.00th=[39.00], 10.00th=[39.00],\n"
+        "  |  20.00th=[39.00], 30.00th=[39.00], 40.00th=[51.00],\n"
+        "  |  50.00th=[51.00], 60.00th=[51.00], 70.00th=[52.00],\n"
+        "  |  80.00th=[52.00], 90.00th=[52.00], 95.00th=[52.00],\n"
+        "  |  99.00th=[52.00], 99.50th=[52.00], 99.90th=[52.00]\n"
+        "\n"
+        "  op_w lat (μsec): min=4, max=59, avg=37.00, stdev=23.34, samples=4\n"
+        "  lat percentiles (μsec):\n"
+        "  |   1.00th=[ 4.00],  5.00th=[ 4.00], 10.00th=[ 4.00],\n"
+        "  |  20.00th=[ 4.00], 30.00th=[42.00], 40.00th=[42.00],\n"
+        "  |  50.00th=[42.00], 60.00th=[43.00], 70.00th=[43.00],\n"
+        "  |  80.00th=[59.00], 90.00th=[59.00], 95.00th=[59.00],\n"
+        "  |  99.00th=[59.00], 99.50th=[59.00], 99.90th=[59.00]\n"
+        "\n"
+        "  subop_w lat (μsec): min=49, max=53, avg=51.33, stdev=2.08, samples=3\n"
+        "  lat percentiles (μsec):\n"
+        "  |   1.00th=[49.00],  5.00th=[49.00], 10.00th=[49.00],\n"
+        "  |  20.00th=[49.00], 30.00th=[49.00], 40.00th=[52.00],\n"
+        "  |  50.00th=[52.00], 60.00th=[52.00], 70.00th=[53.00],\n"
+        "  |  80.00th=[53.00], 90.00th=[53.00], 95.00th=[53.00],\n"
+        "  |  99.00th=[53.00], 99.50th=[53.00], 99.90th=[53.00]\n"
+        "\n"
+        "osd.3:\n"
+        "  op_r lat (μsec): min=26, max=52, avg=40.10, stdev=10.56, samples=10\n"
+        "  lat percentiles (μsec):\n"
+        "  |   1.00th=[26.00],  5.00th=[26.00], 10.00th=[26.00],\n"
+        "  |  20.00th=[28.00], 30.00th=[29.00], 40.00th=[32.00],\n"
+        "  |  50.00th=[38.00], 60.00th=[48.00], 70.00th=[48.00],\n"
+        "  |  80.00th=[49.00], 90.00th=[51.00], 95.00th=[52.00],\n"
+        "  |  99.00th=[52.00], 99.50th=[52.00], 99.90th=[52.00]\n"
+        "\n"
+        "  op_w lat (μsec): min=51, max=83, avg=66.80, stdev=12.85, samples=10\n"
+        "  lat percentiles (μsec):\n"
+        "  |   1.00th=[51.00],  5.00th=[51.00], 10.00th=[51.00],\n"
+        "  |  20.00th=[52.00], 30.00th=[54.00], 40.00th=[55.00],\n"
+        "  |  50.00th=[68.00], 60.00th=[71.00], 70.00th=[72.00],\n"
+        "  |  80.00th=[80.00], 90.00th=[82.00], 95.00th=[83.00],\n"
+        "  |  99.00th=[83.00], 99.50th=[83.00], 99.90th=[83.00]\n"
+        "\n"
+        "  subop_w lat (μsec): min=47, max=86, avg=70.20, stdev=11.59, samples=10\n"
+        "  lat percentiles (μsec):\n"
+        "  |   1.00th=[47.00],  5.00th=[47.00], 10.00th=[47.00],\n"
+        "  |  20.00th=[61.00], 30.00th=[61.00], 40.00th=[66.00],\n"
+        "  |  50.00th=[72.00], 60.00th=[73.00], 70.00th=[77.00],\n"
+        "  |  80.00th=[78.00], 90.00th=[81.00], 95.00th=[86.00],\n"
+        "  |  99.00th=[86.00], 99.50th=[86.00], 99.90th=[86.00]\n"
+        "\n";
+
+// --infer -t 40
+static const char *EXPECTED_INFER =
+        "osd.1:\n"
+        "  op_r:\n"
+        "    38.78% from osd_lat\n"
+        "    25.26% from queue_lat\n"
+        "    13.54% from recv_lat\n"
+        "     9.77% from throttle_lat\n"
+        "     0.00% from dispatch_lat\n"
+        "     0.00% from bluestore_lat\n"
+        "  subop_w:\n"
+        "    29.18% from osd_lat\n"
+        "    19.57% from bluestore_lat\n"
+        "    17.58% from queue_lat\n"
+        "    11.24% from throttle_lat\n"
+        "    10.88% from recv_lat\n"
+        "     0.00% from dispatch_lat\n"
+        "  op_w:\n"
+        "    27.63% from osd_lat\n"
+        "    25.72% from bluestore_lat\n"
+        "    15.40% from throttle_lat\n"
+        "    14.83% from recv_lat\n"
+        "     8.57% from queue_lat\n"
+        "     0.00% from dispatch_lat\n"
+        "\n"
+        "osd.3:\n"
+        "  subop_w:\n"
+        "    41.71% from bluestore_lat\n"
+        "    18.38% from osd_lat\n"
+        "     9.89% from queue_lat\n"
+        "     9.68% from recv_lat\n"
+        "     8.82% from throttle_lat\n"
+        "     2.82% from dispatch_lat\n"
+        "  op_w:\n"
+        "    37.41% from bluestore_lat\n"
+        "    21.31% from osd_lat\n"
+        "    14.85% from queue_lat\n"
+        "     8.86% from recv_lat\n"
+        "     8.61% from throttle_lat\n"
+        "     3.22% from dispatch_lat\n"
+        "  op_r:\n"
+        "    39.08% from osd_lat\n"
+        "    21.10% from queue_lat\n"
+        "    17.34% from throttle_lat\n"
+        "     9.91% from recv_lat\n"
+        "     3.68% from dispatch_lat\n"
+        "     0.00% from bluestore_lat\n"
+        "\n";
+
+int main() {
+    std::cout << "Running unit tests for latency statistics..." << std::endl;
+
+    // Test 1: values below EXACT_LIMIT get a bucket each
+    {
+        LatencyHistogram h;
+        for (uint64_t v = 1; v <= 200; ++v)
+            h.record(v);
+        assert(h.count() == 200 && h.min() == 1 && h.max() == 200);
+        assert(h.percentile(1) == 2);
+        assert(h.percentile(50) == 100);
+        assert(h.percentile(99.5) == 199);
+        assert(h.percentile(100) == 200);
+        std::cout << "  [PASS] Test 1: exact percentiles for small values" << std::endl;
+    }
+
+    // Test 2: larger values stay within the relative error bound
+    {
+        for (uint64_t v = 256; v < (1ull << 40); v = v * 3 / 2 + 7) {
+            size_t idx = LatencyHistogram::bucket_index(v);
+            uint64_t lo = LatencyHistogram::bucket_low(idx);
+            uint64_t width = LatencyHistogram::bucket_width(idx);
+            assert(lo <= v && v < lo + width);
+            assert(LatencyHistogram::bucket_index(lo + width) == idx + 1);
+
+            LatencyHistogram h;
+            h.record(1);
+            h.record(v);
+            h.record(1ull << 50);
+            double p = h.percentile(50);
+            assert(std::fabs(p - (double)v) <= (double)v / 256);
+        }
+        std::cout << "  [PASS] Test 2: bucket bounds and relative error" << std::endl;
+    }
+
+    // Test 3: mean and sample stdev are exact; merge equals recording both
+    {
+        LatencyHistogram a, b;
+        for (uint64_t v : {2, 4, 4, 4})
+            a.record(v);
+        for (uint64_t v : {5, 5, 7, 9})
+            b.record(v);
+        a.merge(b);
+        assert(a.count() == 8 && a.min() == 2 && a.max() == 9);
+        assert(a.mean() == 5.0);
+        assert(std::fabs(a.stdev() - std::sqrt(32.0 / 7)) < 1e-12);
+        a.clear();
+        assert(a.count() == 0 && a.percentile(50) == 0 && a.stdev() == 0.0);
+        std::cout << "  [PASS] Test 3: mean, stdev, merge" << std::endl;
+    }
+
+    // Test 4: the analysis matches the script's output
+    {
+        OsdLatencyReport report("lat", 40);
+        for (const TracedOp &op : OPS) {
+            int idx = OsdLatencyReport::op_index(op.op);
+            report.add_value(op.osd, idx, op.lat);
+            report.add_stages(op.osd, idx, op.lat, op.stages);
+        }
+        OutputBuffer out(-1);
+        report.print_analysis(out);
+        assert(contents(out) == EXPECTED_ANALYSIS);
+        std::cout << "  [PASS] Test 4: analysis matches analyze_osdtrace_output.py" << std::endl;
+
+        // Test 5: so does the stage breakdown
+        out.clear();
+        report.print_infer(out);
+        assert(contents(out) == EXPECTED_INFER);
+        std::cout << "  [PASS] Test 5: infer matches analyze_osdtrace_output.py --infer" << std::endl;
+
+        report.clear();
+        assert(report.empty());
+    }
+
+    // Test 6: field names follow the script
+    {
+        assert(OsdLatencyReport::valid_field("lat"));
+        assert(OsdLatencyReport::valid_field("queue_lat"));
+        assert(OsdLatencyReport::valid_field("kv_commit"));
+        assert(!OsdLatencyReport::valid_field("op_lat"));
+        assert(!OsdLatencyReport::valid_field("osd"));
+        assert(OsdLatencyReport::op_index("subop_w") == 3);
+        assert(OsdLatencyReport::op_index("op") == -1);
+        std::cout << "  [PASS] Test 6: field and op names" << std::endl;
+    }
+
+    // Test 7: bands are contiguous and a quarter octave wide
+    {
+        for (uint64_t v = 0; v < 64; ++v)
+            assert(StageAttribution::band_index(v + 1) - StageAttribution::band_index(v) <= 1);
+        assert(StageAttribution::band_index(3) == 3);
+        assert(StageAttribution::band_index(1000) == StageAttribution::band_index(1023));
+        assert(StageAttribution::band_index(1024) == StageAttribution::band_index(1023) + 1);
+        std::cout << "  [PASS] Test 7: latency bands" << std::endl;
+    }
+
+    // Test 8: median and tail ops are attributed separately
+    {
+        typedef StageAttribution SA;
+        SA attr;
+        for (int i = 0; i < 100; ++i) {
+            uint64_t st[SA::NUM_STAGES] = {};
+            if (i < 98) {
+                st[SA::RECV] = 10;
+                st[SA::QUEUE] = 60;
+                st[SA::OSD] = 30;
+                attr.add(0, 100, st);
+            } else {
+                st[SA::QUEUE] = 1000;
+                st[SA::KV_COMMIT] = 8000;
+                attr.add(0, 10000, st);
+            }
+        }
+        for (int i = 0; i < 10; ++i) {
+            uint64_t st[SA::NUM_STAGES] = {};
+            st[SA::RECV] = 50;
+            st[SA::OSD] = 50;
+            st[SA::PEER] = 400;
+            attr.add(1, 500, st);
+        }
+
+        SA::Shares p50, p99;
+        assert(attr.shares(0, 50, p50) && attr.shares(0, 99, p99));
+        assert(p50.lat == 100 && p50.ops == 98);
+        assert(std::fabs(p50.stage[SA::QUEUE] - 60) < 1e-9);
+        assert(p50.bottleneck == SA::QUEUEING);
+        assert(p99.lat == 10000 && p99.ops == 2);
+        assert(std::fabs(p99.stage[SA::KV_COMMIT] - 80) < 1e-9);
+        assert(std::fabs(p99.other - 10) < 1e-9);
+        assert(p99.bottleneck == SA::KV);
+        assert(!attr.shares(2, 99, p99));
+
+        OutputBuffer out(-1);
+        attr.print(out);
+        assert(contents(out) ==
+               "osd.0: ops=100 p50=100us p99=10000us bottleneck=kv (80.0%)\n"
+               "  p50: queue 60.0%, osd 30.0%, recv 10.0%, other 0.0%\n"
+               "  p99: kv_commit 80.0%, queue 10.0%, other 10.0%\n"
+               "osd.1: ops=10 p50=500us p99=500us bottleneck=peer (80.0%)\n"
+               "  p50: peer 80.0%, recv 10.0%, osd 10.0%, other 0.0%\n"
+               "  p99: peer 80.0%, recv 10.0%, osd 10.0%, other 0.0%\n"
+               "slowest: osd.0 p99=10000us, kv_commit 80.0%\n");
+        std::cout << "  [PASS] Test 8: stage attribution and bottleneck" << std::endl;
+    }
+
+    // Test 9: pairs are ranked by p99, next to the peer's best p99
+    {
+        PeerLatencyMatrix m;
+        for (int i = 0; i < 100; ++i) {
+            m.add(0, 1, 100);
+            m.add(0, 2, i < 95 ? 100 : 5000);  // bad link 0 -> 2
+            m.add(3, 2, 120);
+            m.add(3, 4, 200);
+        }
+        assert(m.pairs() == 4);
+        OutputBuffer out(-1);
+        m.print(out, 3);
+        assert(contents(out) ==
+               "primary  peer     samples   p50(us)   p99(us)   max(us)  peer best p99(us)\n"
+               "osd.0    osd.2         100       100      5000      5000                120\n"
+               "osd.3    osd.4         100       200       200       200                200\n"
+               "osd.3    osd.2         100       120       120       120                120\n"
+               "(1 more pairs)\n");
+        m.clear();
+        assert(m.empty());
+        std::cout << "  [PASS] Test 9: peer latency matrix" << std::endl;
+    }
+
+    // Test 10: scheduler rows are interval deltas; idle keys are left out
+    {
+        SchedSeries s;
+        SchedSeries::Reading r;
+        r.depth = 4;
+        r.max_depth = 9;
+        r.enqueued = 100;
+        r.dequeued = 96;
+        r.wait_sum_us = 9600;
+        r.wait_max_us = 700;
+        s.sample(1, 3, "client", r);
+        SchedSeries::Reading idle;
+        s.sample(0, 0, "scrub", idle);
+        std::vector<SchedSeries::Row> rows = s.rows();
+        assert(rows.size() == 1);
+        assert(rows[0].osd == 1 && rows[0].shard == 3 && rows[0].cls == "client");
+        assert(rows[0].wait_avg_us == 100);
+
+        r.depth = 0;
+        r.max_depth = 4;
+        r.enqueued = 110;
+        r.dequeued = 110;
+        r.wait_sum_us = 9600 + 14 * 50;
+        r.wait_max_us = 90;
+        s.sample(1, 3, "client", r);
+        rows = s.rows();
+        assert(rows.size() == 1);
+        OutputBuffer out(-1);
+        SchedSeries::print_row(out, "14:02:10", rows[0]);
+        assert(contents(out) ==
+               "sched 14:02:10 osd 1 shard 3 class client depth 0 max_depth 4 "
+               "enqueued 10 dequeued 14 wait_avg 50 wait_max 90\n");
+        // not sampled again: no row
+        assert(s.rows().empty());
+        std::cout << "  [PASS] Test 10: scheduler series" << std::endl;
+    }
+
+    // Test 11: background load rates per interval, client and bg kinds apart
+    {
+        BackgroundLoad l;
+        for (int i = 0; i < 20; ++i)
+            l.add(0, "client", 4096, 100);
+        l.add(0, "push", 4000000, 3000);
+        l.add(0, "push", 4000000, 5000);
+        assert(!l.empty());
+        OutputBuffer out(-1);
+        l.print(out, "14:02:10", 2);
+        assert(contents(out) ==
+               "bg 14:02:10 osd 0 kind client ops/s 10.0 MB/s 0.0 avg_lat 100 p99 100\n"
+               "bg 14:02:10 osd 0 kind push ops/s 1.0 MB/s 4.0 avg_lat 4000 p99 5000\n");
+        // each interval starts over
+        assert(l.empty());
+        std::cout << "  [PASS] Test 11: background load" << std::endl;
+    }
+
+    // Test 12: PG lock rows are interval deltas, most wait time first
+    {
+        PgLockReport p;
+        PgLockReport::Reading w, h;
+        w.count = 100;
+        w.sum_us = 1000;
+        w.slots[3] = 98;   // [8, 16)
+        w.slots[10] = 2;   // [1024, 2048)
+        h.count = 100;
+        h.sum_us = 5000;
+        h.slots[5] = 100;
+        p.sample(0, 2, 0x1a, false, w);
+        p.sample(0, 2, 0x1a, true, h);
+        PgLockReport::Reading quiet;
+        quiet.count = 10;
+        quiet.sum_us = 10;
+        quiet.slots[0] = 10;
+        p.sample(1, 2, 0x7, false, quiet);
+        std::vector<PgLockReport::Row> rows = p.rows();
+        assert(rows.size() == 2);
+        assert(rows[0].osd == 0 && rows[1].osd == 1);
+        assert(rows[0].wait_p99_us == 2047);
+        assert(PgLockReport::percentile(w, 50) == 15);
+        OutputBuffer out(-1);
+        PgLockReport::print_row(out, "14:02:10", rows[0]);
+        assert(contents(out) ==
+               "pglock 14:02:10 osd 0 pg 2.1a waits 100 wait_total 1000 "
+               "wait_avg 10 wait_p99 2047 holds 100 hold_avg 50 hold_p99 63\n");
+        // nothing new: no rows
+        p.sample(0, 2, 0x1a, false, w);
+        assert(p.rows().empty());
+        w.count += 1;
+        w.sum_us += 40;
+        w.slots[5] += 1;
+        p.sample(0, 2, 0x1a, false, w);
+        rows = p.rows();
+        assert(rows.size() == 1 && rows[0].waits == 1 && rows[0].holds == 0);
+        assert(rows[0].wait_avg_us == 40 && rows[0].wait_p99_us == 63);
+        std::cout << "  [PASS] Test 12: PG lock report" << std::endl;
+    }
+
+    // Test 13: messenger peers sum their connections' interval deltas
+    {
+        MsgrReport m;
+        MsgrReport::Reading a, b, c;
+        a.bytes_in = 10000000;
+        a.msgs_in = 100;
+        b.bytes_in = 10000000;
+        b.msgs_in = 100;
+        c.bytes_out = 4000000;
+        c.stalls = 3;
+        c.stall_us = 1500;
+        m.sample(0, 0x1000, "client.4567", a);
+        m.sample(0, 0x2000, "client.4567", b);
+        m.sample(0, 0x3000, "osd.3", c);
+        OutputBuffer out(-1);
+        m.print(out, "14:02:10", 2, 10);
+        std::string text = contents(out);
+        assert(text.find("=== 14:02:10 messenger, last 2s ===\n") == 0);
+        size_t stall = text.find("top peers by send stall:");
+        assert(stall != std::string::npos);
+        // client.4567 moves more bytes, and only osd.3 stalled
+        assert(text.find("client.4567") < text.find("osd.3"));
+        assert(text.find("client.4567", stall) == std::string::npos);
+        assert(text.find("osd.0    client.4567              10.0        0.0      100.0         0.0       0        0.0\n")
+               != std::string::npos);
+        assert(text.find("osd.0    osd.3                     0.0        2.0        0.0         0.0       3        1.5\n", stall)
+               != std::string::npos);
+
+        // only 0x1000 is sampled again: the others were closed
+        a.bytes_in += 2000000;
+        m.sample(0, 0x1000, "client.4567", a);
+        out.clear();
+        m.print(out, "14:02:12", 2, 10);
+        text = contents(out);
+        assert(text.find("client.4567               1.0") != std::string::npos);
+        assert(text.find("top peers by send stall:\nnone\n") != std::string::npos);
+
+        // 0x1000 was closed and a new connection took its address: its
+        // counters start over instead of going backwards
+        MsgrReport::Reading d;
+        d.bytes_out = 2000000;
+        m.sample(0, 0x1000, "osd.5", d);
+        out.clear();
+        m.print(out, "14:02:14", 2, 10);
+        text = contents(out);
+        assert(text.find("osd.0    osd.5                     0.0        1.0") != std::string::npos);
+        assert(text.find("client.4567") == std::string::npos);
+        std::cout << "  [PASS] Test 13: messenger report" << std::endl;
+    }
+
+    // Test 14: EC writes summary names the shard OSD most often last
+    {
+        EcReport e;
+        for (int i = 0; i < 3; ++i)
+            e.add(0, 100, 1000, 600, 7);
+        e.add(0, 100, 1000, 10, 4);
+        OutputBuffer out(-1);
+        e.print(out, "14:02:10");
+        assert(contents(out) ==
+               "ec 14:02:10 osd 0 writes 4 encode p50 100 p99 100 commit p50 1000 "
+               "p99 1000 shard_wait p99 600 slowest osd.7 75%\n");
+        e.clear();
+        assert(e.empty());
+        std::cout << "  [PASS] Test 14: EC report" << std::endl;
+    }
+
+    // Test 15: block device report prints each interval's histogram delta
+    {
+        BlkReport b;
+        BlkReport::Reading r;
+        r.count = 4;
+        r.bytes = 4000000;
+        r.queue_sum_us = 8;
+        r.device_sum_us = 400;
+        r.queue_slots[0] = 3;
+        r.queue_slots[2] = 1;
+        r.device_slots[6] = 3;
+        r.device_slots[7] = 1;
+        b.sample("nvme0n1", r);
+        OutputBuffer out(-1);
+        b.print(out, "14:02:10", 2);
+        assert(contents(out) ==
+               "blk 14:02:10 dev nvme0n1 ios/s 2.0 MB/s 2.0 queue avg 2 p99 7 device avg 100 p99 255\n"
+               "blk 14:02:10 dev nvme0n1 queue_us 0-1:3 4-7:1\n"
+               "blk 14:02:10 dev nvme0n1 device_us 64-127:3 128-255:1\n");
+
+        // only the requests since the last sample count
+        r.count += 2;
+        r.device_sum_us += 60;
+        r.queue_slots[0] += 2;
+        r.device_slots[5] += 2;
+        b.sample("nvme0n1", r);
+        out.clear();
+        b.print(out, "14:02:12", 2);
+        assert(contents(out) ==
+               "blk 14:02:12 dev nvme0n1 ios/s 1.0 MB/s 0.0 queue avg 0 p99 1 device avg 30 p99 63\n"
+               "blk 14:02:12 dev nvme0n1 queue_us 0-1:2\n"
+               "blk 14:02:12 dev nvme0n1 device_us 32-63:2\n");
+
+        // an idle device prints nothing
+        b.sample("nvme0n1", r);
+        out.clear();
+        b.print(out, "14:02:14", 2);
+        assert(contents(out).empty());
+        std::cout << "  [PASS] Test 15: block device report" << std::endl;
+    }
+
+    // Test 16: CPU report averages cycles per op and IPC per stage
+    {
+        CpuReport c(false);
+        c.add(0, "op_w", 100000, 150000, 50000, 40000);
+        c.add(0, "op_w", 200000, 240000, 70000, 56000);
+        c.add(0, "op_r", 30000, 0, 0, 0);
+        OutputBuffer out(-1);
+        c.print(out, "14:02:10");
+        assert(contents(out) ==
+               "cpu 14:02:10 osd 0 op_r ops 1 osd kcycles/op 30.0 ipc 0.00 bluestore kcycles/op 0.0 ipc 0.00\n"
+               "cpu 14:02:10 osd 0 op_w ops 2 osd kcycles/op 150.0 ipc 1.30 bluestore kcycles/op 60.0 ipc 0.80\n");
+        c.clear();
+        assert(c.empty());
+
+        // without hardware counters the "cycles" are task clock ns
+        CpuReport t(true);
+        t.add(1, "subop_w", 48000, 0, 25000, 0);
+        out.clear();
+        t.print(out, "14:02:10");
+        assert(contents(out) ==
+               "cpu 14:02:10 osd 1 subop_w ops 1 osd cpu_us/op 48.0 bluestore cpu_us/op 25.0\n");
+        std::cout << "  [PASS] Test 16: CPU report" << std::endl;
+    }
+
+    std::cout << "ALL 16 LATENCY STATS TESTS PASSED SUCCESSFULLY!" << std::endl;
+    return 0;
+}
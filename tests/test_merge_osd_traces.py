@@ -0,0 +1,159 @@
+"""
+Tests for merge_osd_traces.py: the spill-to-disk sort, the merge of rows
+from several captures, and the clock offsets between hosts.
+"""
+
+import os
+
+import pytest
+
+import merge_osd_traces  # pylint: disable=E0401
+from columnar_reader import BOOTTIME_NS, NO_CLOCK, REALTIME_NS, \
+    I32, STR, U32, U64  # pylint: disable=E0401
+
+CLIENT = 4151
+TIDS = range(1, 9)
+# host -> (osd, clock offset vs true time in us)
+HOSTS = {"host1": (0, 0), "host2": (1, 500), "host3": (2, -300)}
+
+# Stages of one op on the true clock, in us since the primary's recv.
+PRIMARY_STAMPS = {"recv": 0, "peer_sent": 20, "peer1_recv": 220,
+                  "peer2_recv": 220, "reply": 230}
+REPLICA_STAMPS = {"recv": 70, "reply": 170}
+TIMELINE = [
+    (0.0, 0, "recv"), (20.0, 0, "peer_sent"), (70.0, 1, "recv"),
+    (70.0, 2, "recv"), (170.0, 1, "reply"), (170.0, 2, "reply"),
+    (220.0, 0, "peer1_recv"), (220.0, 0, "peer2_recv"), (230.0, 0, "reply"),
+]
+
+
+def capture(write_columnar, name, host, tids, orphan=False):
+    """An osdtrace capture of `host`'s side of the writes `tids`."""
+    osd, skew = HOSTS[host]
+    primary = osd == 0
+    stamps = PRIMARY_STAMPS if primary else REPLICA_STAMPS
+    rows = [(tid, stamps) for tid in tids]
+    kinds = ["op_w" if primary else "subop_w"] * len(rows)
+    osds = [osd] * len(rows)
+    if orphan:
+        # a repop whose primary was not traced, from an OSD whose id the
+        # tracer did not learn
+        rows.append((1000, REPLICA_STAMPS))
+        kinds.append("subop_w")
+        osds.append(-1)
+
+    def column(stage):
+        return [(10**9 * tid + (s[stage] + skew) * 1000) if stage in s else 0
+                for tid, s in rows]
+
+    cols = [
+        ("osd", I32, NO_CLOCK, osds),
+        ("kind", STR, NO_CLOCK, kinds),
+        ("client", U64, NO_CLOCK, [CLIENT] * len(rows)),
+        ("tid", U64, NO_CLOCK, [tid for tid, _ in rows]),
+        ("pool", U64, NO_CLOCK, [1] * len(rows)),
+        ("pg_seed", U32, NO_CLOCK, [0xa] * len(rows)),
+        ("recv_stamp", U64, REALTIME_NS, column("recv")),
+        ("reply_stamp", U64, BOOTTIME_NS, column("reply")),
+        ("peer1", I32, NO_CLOCK, [1 if primary else -1] * len(rows)),
+        ("peer2", I32, NO_CLOCK, [2 if primary else -1] * len(rows)),
+        ("peer_sent_stamp", U64, BOOTTIME_NS, column("peer_sent")),
+        ("peer1_recv_stamp", U64, BOOTTIME_NS, column("peer1_recv")),
+        ("peer2_recv_stamp", U64, BOOTTIME_NS, column("peer2_recv")),
+    ]
+    return write_columnar(name, {"hostname": host,
+                                 "boottime_to_realtime_ns": 0},
+                          {"osd_op": cols}, batch_rows=3)
+
+
+def merge(paths, tmp_path, capsys, *flags):
+    """Runs the tool; returns (stdout, stderr)."""
+    parser = merge_osd_traces.create_arg_parser()
+    args = parser.parse_args([str(p) for p in paths]
+                             + ["--tmpdir", str(tmp_path)] + list(flags))
+    assert merge_osd_traces.run(args) == 0
+    return capsys.readouterr()
+
+
+def parse_timelines(out):
+    """{tid: [(us, osd, stage)]} from the text timelines, in print order."""
+    timelines = {}
+    events = None
+    for line in out.splitlines():
+        if line.startswith("op_w client"):
+            events = timelines.setdefault(int(line.split()[4]), [])
+        elif events is not None and line.startswith("  "):
+            since, osd, stage = line.split()
+            events.append((float(since), int(osd[4:]), stage))
+    return timelines
+
+
+def test_row_osd_is_signed():
+    """An unknown osd id (-1) packs and unpacks."""
+    values = [CLIENT, 7, merge_osd_traces.REPLICA, -1, 0, 1, 0xa, -1, -1]
+    values += [0] * len(merge_osd_traces.STAMPS)
+    row = merge_osd_traces.Row(merge_osd_traces.ROW.pack(*values))
+    assert (row.client, row.tid, row.osd, row.peer1) == (CLIENT, 7, -1, -1)
+
+
+@pytest.mark.parametrize("chunk_rows,fanin", [(1000000, 256), (2, 256),
+                                              (2, 2)],
+                         ids=["in_memory", "spilled", "spilled_remerged"])
+def test_merge_across_inputs(write_columnar, tmp_path, capsys, monkeypatch,
+                             chunk_rows, fanin):
+    """Rows of one write from several captures meet however they spill.
+
+    host2's side is split over two files, and the captures list their ops
+    in different orders; the timelines still come out in tid order with
+    each replica on the primary's clock.
+    """
+    monkeypatch.setattr(merge_osd_traces, "MAX_FANIN", fanin)
+    written = []
+    write_run = merge_osd_traces.RunWriter.write_run
+
+    def counting_write_run(self, rows):
+        written.append(None)
+        return write_run(self, rows)
+
+    monkeypatch.setattr(merge_osd_traces.RunWriter, "write_run",
+                        counting_write_run)
+    tids = list(TIDS)
+    paths = [
+        capture(write_columnar, "h1.ctc", "host1", tids),
+        capture(write_columnar, "h2a.ctc", "host2", tids[5:]),
+        capture(write_columnar, "h3.ctc", "host3", tids[::-1], orphan=True),
+        capture(write_columnar, "h2b.ctc", "host2", tids[4::-1]),
+    ]
+    out, err = merge(paths, tmp_path, capsys, "--chunk-rows",
+                     str(chunk_rows))
+
+    # 25 rows: one run in memory, 13 spilled, and with a fan-in of 2 the
+    # runs are merged down in rounds (13 -> 7 -> 4 -> 2) before the pass
+    runs = (chunk_rows == 2) + (fanin == 2)
+    assert err == ("25 rows from 3 hosts in %d sorted runs\n"
+                   "8 timelines written\n" % [1, 13, 2][runs])
+    assert len(written) == [1, 13, 13 + 7 + 4 + 2][runs]
+    # the run files went with the tool's temporary directory
+    assert sorted(os.listdir(tmp_path)) == sorted(p.name for p in paths)
+
+    assert "8 writes; 1 subop_w rows without their primary's op_w" in out
+    assert "  host2                          +500.0" in out
+    assert "  host3                          -300.0" in out
+    timelines = parse_timelines(out)
+    assert list(timelines) == tids
+    for events in timelines.values():
+        assert events == TIMELINE
+
+
+def test_reference_host(write_columnar, tmp_path, capsys):
+    """--reference puts the timelines on another host's clock."""
+    paths = [capture(write_columnar, "h%d.ctc" % i, host, TIDS)
+             for i, host in enumerate(HOSTS)]
+    out, _ = merge(paths, tmp_path, capsys, "--reference", "host2",
+                   "--min-lat", "200")
+
+    assert "clock offsets vs host2" in out
+    assert "  host1                          -500.0" in out
+    assert "  host3                          -800.0" in out
+    # the primary's recv -> reply is 230us on every clock
+    assert list(parse_timelines(out)) == list(TIDS)
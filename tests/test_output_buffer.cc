@@ -0,0 +1,114 @@
+#include <cassert>
+#include <climits>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+
+#include "output_buffer.h"
+
+static std::string contents(const OutputBuffer &out) {
+    return std::string(out.data(), out.size());
+}
+
+int main() {
+    std::cout << "Running unit tests for OutputBuffer..." << std::endl;
+
+    // Test 1: integers match printf's %lld / %d / %x
+    {
+        OutputBuffer out(-1);
+        out.dec(0).put(' ').dec(-42).put(' ').dec(LLONG_MIN).put(' ')
+           .dec(18446744073709551615ull).put(' ').hex(0x1fu).put(' ').hex(0u);
+        char expect[128];
+        snprintf(expect, sizeof(expect), "%d %d %lld %llu %x %x", 0, -42,
+                 LLONG_MIN, 18446744073709551615ull, 0x1fu, 0u);
+        assert(contents(out) == expect);
+        out.clear();
+        std::cout << "  [PASS] Test 1: dec/hex match printf" << std::endl;
+    }
+
+    // Test 2: right alignment matches %*s / %*lld, including overflow
+    {
+        OutputBuffer out(-1);
+        out.pad("pg", 6).dec_pad(1234LL, 8).dec_pad(123456789, 4).pad("", 0);
+        char expect[64];
+        snprintf(expect, sizeof(expect), "%*s%*lld%*d", 6, "pg", 8, 1234LL, 4,
+                 123456789);
+        assert(contents(out) == expect);
+        out.clear();
+        std::cout << "  [PASS] Test 2: padding matches printf" << std::endl;
+    }
+
+    // Test 3: CSV fields are quoted only when needed
+    {
+        OutputBuffer out(-1);
+        out.csv(std::string("plain")).put('|')
+           .csv(std::string("[1,2]")).put('|')
+           .csv(std::string("say \"hi\"")).put('|')
+           .csv(std::string(""));
+        assert(contents(out) == "plain|\"[1,2]\"|\"say \"\"hi\"\"\"|");
+        out.clear();
+        std::cout << "  [PASS] Test 3: CSV escaping" << std::endl;
+    }
+
+    // Test 4: bounded strings stop at the NUL or the array size
+    {
+        OutputBuffer out(-1);
+        char field[4] = {'a', 'b', 'c', 'd'};
+        out.put_bounded("xy\0z", 4).put('|').put_bounded(field, sizeof(field));
+        assert(contents(out) == "xy|abcd");
+        out.clear();
+        std::cout << "  [PASS] Test 4: bounded strings" << std::endl;
+    }
+
+    // Test 5: lines longer than the initial buffer grow it
+    {
+        OutputBuffer out(-1, 16);
+        std::string big(100000, 'x');
+        out.put(big).dec(7);
+        assert(out.size() == big.size() + 1);
+        assert(contents(out) == big + "7");
+        out.clear();
+        std::cout << "  [PASS] Test 5: buffer growth" << std::endl;
+    }
+
+    // Test 6: one flush hands every pending line to the descriptor
+    {
+        int fds[2];
+        assert(pipe(fds) == 0);
+        {
+            OutputBuffer out(fds[1]);
+            for (int i = 0; i < 3; ++i) {
+                out.put("line ").dec(i);
+                out.end_line();
+            }
+            assert(out.flush() == 0);
+            assert(out.empty());
+        }
+        close(fds[1]);
+        char buf[64];
+        ssize_t n = read(fds[0], buf, sizeof(buf));
+        close(fds[0]);
+        assert(std::string(buf, n) == "line 0\nline 1\nline 2\n");
+        std::cout << "  [PASS] Test 6: batched flush" << std::endl;
+    }
+
+    // Test 7: end_line flushes on its own once past the threshold
+    {
+        int fds[2];
+        assert(pipe(fds) == 0);
+        OutputBuffer out(fds[1], 8);
+        out.put("0123456789");
+        out.end_line();
+        assert(out.empty());
+        close(fds[1]);
+        char buf[64];
+        ssize_t n = read(fds[0], buf, sizeof(buf));
+        close(fds[0]);
+        assert(n == 11);
+        std::cout << "  [PASS] Test 7: threshold flush" << std::endl;
+    }
+
+    std::cout << "ALL 7 OUTPUT BUFFER TESTS PASSED SUCCESSFULLY!" << std::endl;
+    return 0;
+}
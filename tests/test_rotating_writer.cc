@@ -0,0 +1,194 @@
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <dirent.h>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "rotating_writer.h"
+#include "utils.h"
+
+static std::string read_file(const std::string &path) {
+    std::ifstream in(path, std::ios::binary);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+}
+
+static std::string read_gzip(const std::string &path) {
+    gzFile f = gzopen(path.c_str(), "rb");
+    assert(f);
+    std::string out;
+    char buf[4096];
+    int n;
+    while ((n = gzread(f, buf, sizeof(buf))) > 0)
+        out.append(buf, n);
+    gzclose(f);
+    return out;
+}
+
+static std::set<std::string> list_dir(const std::string &dir) {
+    std::set<std::string> names;
+    DIR *d = opendir(dir.c_str());
+    assert(d);
+    while (struct dirent *e = readdir(d)) {
+        if (e->d_name[0] != '.')
+            names.insert(e->d_name);
+    }
+    closedir(d);
+    return names;
+}
+
+static void remove_dir(const std::string &dir) {
+    for (const auto &name : list_dir(dir))
+        unlink((dir + "/" + name).c_str());
+    rmdir(dir.c_str());
+}
+
+static void write_rows(RotatingWriter &w, int first, int count, bool flush_each) {
+    for (int i = first; i < first + count; ++i) {
+        w.buffer().put("row,").dec(i);
+        w.buffer().end_line();
+        w.commit();
+        if (flush_each)
+            w.flush();
+    }
+}
+
+int main() {
+    std::cout << "Running unit tests for RotatingWriter..." << std::endl;
+
+    char tmpl[] = "/tmp/test_rotating_writer.XXXXXX";
+    assert(mkdtemp(tmpl));
+    const std::string dir = tmpl;
+    const std::string header = "name,value\n";
+
+    // Test 1: without rotation everything lands in one file after the header
+    {
+        RotatingWriter w(dir + "/plain.csv", header, RotatingWriter::Options());
+        assert(w.open());
+        write_rows(w, 0, 3, false);
+        w.close();
+        assert(read_file(dir + "/plain.csv") ==
+               "name,value\nrow,0\nrow,1\nrow,2\n");
+        unlink((dir + "/plain.csv").c_str());
+        std::cout << "  [PASS] Test 1: single file" << std::endl;
+    }
+
+    // Test 2: size rotation numbers the files and repeats the header
+    {
+        RotatingWriter::Options opts;
+        opts.rotate_size = 12;
+        RotatingWriter w(dir + "/events.csv", header, opts);
+        assert(w.open());
+        write_rows(w, 0, 4, true);
+        w.close();
+        // the header alone (11 bytes) stays under the limit and header + row
+        // crosses it, so every flushed row ends up in a file of its own
+        std::set<std::string> names = list_dir(dir);
+        assert(names.size() == 4);
+        assert(names.count("events-00000.csv") && names.count("events-00003.csv"));
+        assert(read_file(dir + "/events-00000.csv") == "name,value\nrow,0\n");
+        assert(read_file(dir + "/events-00003.csv") == "name,value\nrow,3\n");
+        remove_dir(dir);
+        assert(mkdir(dir.c_str(), 0700) == 0);
+        std::cout << "  [PASS] Test 2: size rotation" << std::endl;
+    }
+
+    // Test 3: keep bounds the number of files left on disk
+    {
+        RotatingWriter::Options opts;
+        opts.rotate_size = 12;
+        opts.keep = 2;
+        RotatingWriter w(dir + "/events.csv", header, opts);
+        assert(w.open());
+        write_rows(w, 0, 5, true);
+        w.close();
+        std::set<std::string> names = list_dir(dir);
+        assert(names.size() == 2);
+        assert(names.count("events-00003.csv") && names.count("events-00004.csv"));
+        assert(read_file(dir + "/events-00004.csv") == "name,value\nrow,4\n");
+        remove_dir(dir);
+        assert(mkdir(dir.c_str(), 0700) == 0);
+        std::cout << "  [PASS] Test 3: retention" << std::endl;
+    }
+
+    // Test 4: gzip output decompresses to the plain rows
+    {
+        RotatingWriter::Options opts;
+        opts.compression = RotatingWriter::COMPRESS_GZIP;
+        RotatingWriter w(dir + "/events.csv", header, opts);
+        assert(w.open());
+        assert(w.current_path() == dir + "/events.csv.gz");
+        write_rows(w, 0, 1000, false);
+        w.flush();
+        write_rows(w, 1000, 10, false);
+        w.close();
+        std::string expect = header;
+        for (int i = 0; i < 1010; ++i)
+            expect += "row," + std::to_string(i) + "\n";
+        assert(read_gzip(dir + "/events.csv.gz") == expect);
+        remove_dir(dir);
+        assert(mkdir(dir.c_str(), 0700) == 0);
+        std::cout << "  [PASS] Test 4: gzip round-trip" << std::endl;
+    }
+
+    // Test 5: unwritable paths are reported by open()
+    {
+        RotatingWriter w(dir + "/missing/events.csv", header,
+                         RotatingWriter::Options());
+        assert(!w.open());
+        std::cout << "  [PASS] Test 5: open failure" << std::endl;
+    }
+
+    // Test 6: size and duration arguments
+    {
+        uint64_t size;
+        assert(parse_size_arg("4096", size) && size == 4096);
+        assert(parse_size_arg("64K", size) && size == 64ull << 10);
+        assert(parse_size_arg("100M", size) && size == 100ull << 20);
+        assert(parse_size_arg("2g", size) && size == 2ull << 30);
+        assert(!parse_size_arg("", size));
+        assert(!parse_size_arg("10X", size));
+        assert(!parse_size_arg("-1M", size));
+
+        unsigned secs;
+        assert(parse_duration_arg("90", secs) && secs == 90);
+        assert(parse_duration_arg("15m", secs) && secs == 900);
+        assert(parse_duration_arg("2h", secs) && secs == 7200);
+        assert(parse_duration_arg("1d", secs) && secs == 86400);
+        assert(!parse_duration_arg("h", secs));
+        assert(!parse_duration_arg("5w", secs));
+        std::cout << "  [PASS] Test 6: size/duration parsing" << std::endl;
+    }
+
+    // Test 7: current_path() follows the rotation from the tracing thread
+    {
+        RotatingWriter::Options opts;
+        opts.rotate_size = 12;
+        RotatingWriter w(dir + "/events.csv", header, opts);
+        assert(w.open());
+        std::set<std::string> seen;
+        for (int i = 0; i < 50; ++i) {
+            write_rows(w, i, 1, true);
+            seen.insert(w.current_path());
+        }
+        w.close();
+        assert(w.current_path() == dir + "/events-00049.csv");
+        for (const auto &path : seen)
+            assert(list_dir(dir).count(path.substr(dir.size() + 1)));
+        remove_dir(dir);
+        assert(mkdir(dir.c_str(), 0700) == 0);
+        std::cout << "  [PASS] Test 7: current_path during rotation" << std::endl;
+    }
+
+    remove_dir(dir);
+    std::cout << "ALL 7 ROTATING WRITER TESTS PASSED SUCCESSFULLY!" << std::endl;
+    return 0;
+}
@@ -0,0 +1,92 @@
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "type_cache.h"
+
+int main() {
+    std::cout << "Running TypeCache tests..." << std::endl;
+
+    // Test 1: interning returns one id per distinct string and keeps the
+    // bytes, including strings longer than an arena block.
+    {
+        StringInterner in;
+        uint32_t a = in.intern("struct OSDOp");
+        uint32_t b = in.intern("OpRequest");
+        assert(a != b);
+        assert(in.intern(std::string("struct ") + "OSDOp") == a);
+        assert(in.find("OpRequest") == b);
+        assert(in.find("OSDOp") == StringInterner::NONE);
+        assert(in.name(a) == "struct OSDOp");
+
+        std::string big(100000, 'x');
+        uint32_t c = in.intern(big);
+        uint32_t e = in.intern("");
+        assert(in.name(c) == big);
+        assert(in.name(e).empty());
+        assert(in.intern("") == e);
+        assert(in.name(a) == "struct OSDOp");
+        assert(in.size() == 4);
+        std::cout << "  [PASS] Test 1: interning and arena storage" << std::endl;
+    }
+
+    // Test 2: ids and names survive the table growing well past its
+    // initial size.
+    {
+        StringInterner in;
+        std::vector<uint32_t> ids;
+        for (int i = 0; i < 5000; ++i)
+            ids.push_back(in.intern("type_" + std::to_string(i)));
+        for (int i = 0; i < 5000; ++i) {
+            assert(ids[i] == (uint32_t)i);
+            assert(in.find("type_" + std::to_string(i)) == ids[i]);
+            assert(in.name(ids[i]) == "type_" + std::to_string(i));
+        }
+        assert(in.find("type_5000") == StringInterner::NONE);
+        std::cout << "  [PASS] Test 2: interner growth" << std::endl;
+    }
+
+    // Test 3: the first value inserted for a (scope, name) wins, scopes are
+    // separate, and names are shared between scopes.
+    {
+        int osd, common;
+        TypeCache<int> cache;
+        assert(cache.empty());
+        assert(cache.find_any("struct OSDOp") == nullptr);
+        assert(cache.insert(&osd, "struct OSDOp", 1));
+        assert(!cache.insert(&osd, "struct OSDOp", 2));
+        assert(cache.insert(&common, "struct OSDOp", 3));
+        assert(cache.insert(&common, "utime_t", 4));
+        assert(*cache.find(&osd, "struct OSDOp") == 1);
+        assert(*cache.find(&common, "struct OSDOp") == 3);
+        assert(cache.find(&osd, "utime_t") == nullptr);
+        assert(cache.find(&osd, "OSDOp") == nullptr);
+        assert(cache.find(nullptr, "utime_t") == nullptr);
+        assert(*cache.find_any("struct OSDOp") == 1);  // first scope first
+        assert(*cache.find_any("utime_t") == 4);
+        assert(cache.size() == 3);
+        assert(cache.names() == 2);
+        std::cout << "  [PASS] Test 3: first definition wins, per scope" << std::endl;
+    }
+
+    // Test 4: lookups stay correct across growth in several scopes.
+    {
+        int mods[3];
+        TypeCache<uint64_t> cache;
+        for (int m = 0; m < 3; ++m)
+            for (uint64_t i = 0; i < 3000; ++i)
+                assert(cache.insert(&mods[m], "T" + std::to_string(i), i * 3 + m));
+        for (int m = 0; m < 3; ++m)
+            for (uint64_t i = 0; i < 3000; ++i)
+                assert(*cache.find(&mods[m], "T" + std::to_string(i)) == i * 3 + m);
+        assert(cache.size() == 9000);
+        assert(cache.names() == 3000);
+        assert(cache.bytes() > 9000 * sizeof(uint64_t));
+        std::cout << "  [PASS] Test 4: growth across scopes" << std::endl;
+    }
+
+    std::cout << "ALL 4 TYPE CACHE TESTS PASSED SUCCESSFULLY!" << std::endl;
+    return 0;
+}
@@ -13,7 +13,11 @@ from textwrap import dedent
 
 OP_TYPES = ["op_r", "op_w", "subop_r", "subop_w"]
 BLUESTORE_OP_TYPES = {"prepare", "aio_wait", "aio_size", "seq_wait",
-                      "kv_commit"}
+                      "kv_commit", "kv_batch", "kv_wal", "kv_sync",
+                      "kv_fsync"}
+# latencies that do not end in "lat"; lock_wait is the PG lock wait within
+# queue_lat, only with osdtrace --pg-lock
+WAIT_FIELDS = {"lock_wait"}
 NUM_PERCENTILE_PER_LINE = 3  # number of percentile entries per line
 DEFAULT_LATENCY_FIELD = "lat"
 FINAL_LATENCY_FIELD = "lat"
@@ -58,6 +62,8 @@ pattern_lat = re.compile(
     r"recv_lat\s+(?P<recv_lat>\d+)\s+"
     r"dispatch_lat\s+(?P<dispatch_lat>\d+)\s+"
     r"queue_lat\s+(?P<queue_lat>\d+)\s+"
+    # only with osdtrace --pg-lock
+    r"(?:lock_wait\s+(?P<lock_wait>\d+)\s+)?"
     r"osd_lat\s+(?P<osd_lat>\d+)\s+"
     # peers are only in write ops
     r"(?:peers\s+(?P<peers>\[.*?\])\s+)?"
@@ -96,7 +102,7 @@ def parse_line(line: str = "") -> list:
     # existed rather than gaining an "object None ops None".  Deleting (rather
     # than reassigning) also keeps the surviving keys in their printf order,
     # which the sorted view relies on.
-    for key in ("object", "ops"):
+    for key in ("object", "ops", "lock_wait"):
         if data.get(key) is None:
             del data[key]
 
@@ -107,6 +113,8 @@ def parse_line(line: str = "") -> list:
         "osd_lat", "bluestore_lat", "lat"
     ]:
         data[key] = int(data[key])
+    if "lock_wait" in data:
+        data["lock_wait"] = int(data["lock_wait"])
 
     return [data]
 
@@ -134,7 +142,8 @@ def sort(
         field: Single latency field to sort by.
     """
     def _format_ts(key: str, value: int) -> float | int:
-        if key.endswith("lat") or key in BLUESTORE_OP_TYPES:
+        if (key.endswith("lat") or key in BLUESTORE_OP_TYPES
+                or key in WAIT_FIELDS):
             return round(value / 1000, 2) if show_in_ms else value
         return value
 
@@ -143,7 +152,7 @@ def sort(
             data, key=lambda t: t.get(BD, {}).get(field, -1),
         )
     else:
-        sorted_data = sorted(data, key=lambda t: t[field])
+        sorted_data = sorted(data, key=lambda t: t.get(field, -1))
 
     for trace in sorted_data:
         if BD in trace:
@@ -183,7 +192,7 @@ def group_by_osd_and_op(
                     results[osd][f"{trace['op']}_data"].append(
                         trace[BD][field]
                     )
-        else:
+        elif field in trace:
             results[osd][f"{trace['op']}_data"].append(trace[field])
 
     return results
@@ -356,7 +365,8 @@ def run(margs) -> None:
     """ Parse and analyse the osdtrace log """
 
     if (not margs.field.endswith("lat")
-            and margs.field not in BLUESTORE_OP_TYPES):
+            and margs.field not in BLUESTORE_OP_TYPES
+            and margs.field not in WAIT_FIELDS):
         print(f"{margs.field} does not seem like a latency field, exiting...")
         sys.exit(1)
 
@@ -374,6 +384,10 @@ def run(margs) -> None:
         )
     else:
         osd_filtered_data = parsed_data
+    if margs.field in WAIT_FIELDS:
+        # lines from a capture without the field have no value to filter on
+        osd_filtered_data = [t for t in osd_filtered_data
+                             if margs.field in t]
 
     field = DEFAULT_LATENCY_FIELD if margs.infer else margs.field
     if margs.field in BLUESTORE_OP_TYPES:
@@ -0,0 +1,246 @@
+#!/usr/bin/env python3
+"""
+Reads the columnar event files written by osdtrace, radostrace and kfstrace
+with --columnar (see src/columnar_writer.h for the layout).
+
+As a library:
+
+    from tools.columnar_reader import read_columnar
+    f = read_columnar("osd.ctc")
+    ops = f.tables["osd_op"]               # column name -> list of values
+    wall = f.realtime(ops, "dequeue_stamp")  # stamps as realtime ns
+    df = f.to_pandas("osd_op")             # when pandas is installed
+
+    for table, batch in iter_batches("osd.ctc"):  # bounded memory
+        ...
+
+From the command line it prints a summary, or one table as CSV:
+
+    ./columnar_reader.py osd.ctc
+    ./columnar_reader.py osd.ctc --table osd_op --csv > ops.csv
+
+Only the standard library is needed; pandas is used when asked for.
+"""
+import argparse
+import array
+import csv
+import struct
+import sys
+import zlib
+
+MAGIC = b"CTRCOL\x00\x01"
+
+U8, U16, U32, U64, I32, I64, STR = range(1, 8)
+NO_CLOCK, REALTIME_NS, BOOTTIME_NS, MONOTONIC_NS = range(4)
+CODEC_RAW, CODEC_ZLIB, CODEC_SHUFFLE_ZLIB = range(3)
+
+# type -> (width, array typecode)
+_TYPES = {
+    U8: (1, "B"), U16: (2, "H"), U32: (4, "I"), U64: (8, "Q"),
+    I32: (4, "i"), I64: (8, "q"), STR: (4, "I"),
+}
+_CLOCK_OFFSET_KEYS = {
+    BOOTTIME_NS: "boottime_to_realtime_ns",
+    MONOTONIC_NS: "monotonic_to_realtime_ns",
+}
+
+
+class Column:
+    """Schema entry of one column."""
+
+    def __init__(self, name, col_type, clock):
+        self.name = name
+        self.type = col_type
+        self.clock = clock
+
+
+class ColumnarFile:
+    """Decoded contents of a columnar file."""
+
+    def __init__(self):
+        self.metadata = {}
+        self.schemas = {}   # table name -> [Column]
+        self.tables = {}    # table name -> {column name: [values]}
+
+    def realtime(self, table, column, values=None):
+        """Returns a timestamp column converted to CLOCK_REALTIME ns.
+
+        `table` is a table name or one of the dicts in self.tables.  Pass
+        `values` to convert one iter_batches() batch of the column instead
+        of the loaded table.  Zero stamps (event not seen) stay 0.
+        """
+        if isinstance(table, str):
+            name = table
+        else:
+            name = next(n for n, t in self.tables.items() if t is table)
+        col = next(c for c in self.schemas[name] if c.name == column)
+        if values is None:
+            values = self.tables[name][column]
+        if col.clock not in _CLOCK_OFFSET_KEYS:
+            return list(values)
+        offset = self.clock_offset(col.clock)
+        return [v + offset if v else 0 for v in values]
+
+    def clock_offset(self, clock):
+        """Nanoseconds to add to a `clock` stamp to get CLOCK_REALTIME."""
+        if clock not in _CLOCK_OFFSET_KEYS:
+            return 0
+        return int(self.metadata.get(_CLOCK_OFFSET_KEYS[clock], 0))
+
+    def to_pandas(self, table):
+        """Returns a table as a pandas DataFrame."""
+        import pandas  # pylint: disable=import-outside-toplevel
+        return pandas.DataFrame(self.tables[table])
+
+
+def _read_str(buf, pos):
+    (length,) = struct.unpack_from("<H", buf, pos)
+    pos += 2
+    return buf[pos:pos + length].decode("utf-8", "replace"), pos + length
+
+
+def _decode_column(buf, pos, col, rows):
+    codec, raw_len, stored_len = struct.unpack_from("<BII", buf, pos)
+    pos += 9
+    data = buf[pos:pos + stored_len]
+    pos += stored_len
+    width, typecode = _TYPES[col.type]
+    if codec in (CODEC_ZLIB, CODEC_SHUFFLE_ZLIB):
+        data = zlib.decompress(data)
+    elif codec != CODEC_RAW:
+        raise ValueError("unknown codec %d in column %s" % (codec, col.name))
+    if len(data) != raw_len or raw_len != rows * width:
+        raise ValueError("corrupt column %s" % col.name)
+    if codec == CODEC_SHUFFLE_ZLIB:
+        planes = [data[b * rows:(b + 1) * rows] for b in range(width)]
+        unshuffled = bytearray(raw_len)
+        for b, plane in enumerate(planes):
+            unshuffled[b::width] = plane
+        data = bytes(unshuffled)
+    values = array.array(typecode)
+    values.frombytes(data)
+    if sys.byteorder == "big":
+        values.byteswap()
+    return values, pos
+
+
+def iter_batches(path, result=None):
+    """Yields (table name, {column name: values}) one row batch at a time.
+
+    Only one record is held in memory, so files larger than RAM can be
+    streamed.  Metadata and schemas are collected into `result` (a
+    ColumnarFile, whose tables stay empty) as they are met; the writer puts
+    them ahead of the first batch.  A truncated trailing record is ignored.
+    """
+    if result is None:
+        result = ColumnarFile()
+    by_id = {}
+    dictionary = []
+    with open(path, "rb") as file_handle:
+        if file_handle.read(len(MAGIC)) != MAGIC:
+            raise ValueError("%s is not a cephtrace columnar file" % path)
+        while True:
+            head = file_handle.read(5)
+            if len(head) < 5:
+                break
+            kind, length = struct.unpack("<cI", head)
+            buf = file_handle.read(length)
+            if len(buf) < length:
+                break
+            if kind == b"M":
+                (count,) = struct.unpack_from("<I", buf, 0)
+                p = 4
+                for _ in range(count):
+                    key, p = _read_str(buf, p)
+                    value, p = _read_str(buf, p)
+                    result.metadata[key] = value
+            elif kind == b"S":
+                (table_id,) = struct.unpack_from("<H", buf, 0)
+                name, p = _read_str(buf, 2)
+                (ncols,) = struct.unpack_from("<H", buf, p)
+                p += 2
+                cols = []
+                for _ in range(ncols):
+                    col_type, clock = struct.unpack_from("<BB", buf, p)
+                    col_name, p = _read_str(buf, p + 2)
+                    cols.append(Column(col_name, col_type, clock))
+                by_id[table_id] = name
+                result.schemas[name] = cols
+                result.tables[name] = {c.name: [] for c in cols}
+            elif kind == b"D":
+                first_id, count = struct.unpack_from("<II", buf, 0)
+                if first_id == 0:
+                    dictionary = []
+                p = 8
+                for _ in range(count):
+                    entry, p = _read_str(buf, p)
+                    dictionary.append(entry)
+            elif kind == b"B":
+                table_id, rows = struct.unpack_from("<HI", buf, 0)
+                name = by_id[table_id]
+                p = 6
+                batch = {}
+                for col in result.schemas[name]:
+                    values, p = _decode_column(buf, p, col, rows)
+                    if col.type == STR:
+                        values = [dictionary[v] for v in values]
+                    batch[col.name] = values
+                yield name, batch
+            # other record kinds are skipped
+
+
+def read_columnar(path):
+    """Parses a columnar file; a truncated trailing record is ignored."""
+    result = ColumnarFile()
+    for name, batch in iter_batches(path, result):
+        for column, values in batch.items():
+            result.tables[name][column].extend(values)
+    return result
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Summarize or export a cephtrace columnar file")
+    parser.add_argument("file")
+    parser.add_argument("--table", help="table to export")
+    parser.add_argument("--csv", action="store_true",
+                        help="write --table as CSV to stdout")
+    parser.add_argument("--realtime", action="store_true",
+                        help="convert timestamp columns to realtime ns")
+    args = parser.parse_args()
+
+    data = read_columnar(args.file)
+    if args.csv:
+        if not args.table:
+            parser.error("--csv needs --table")
+        if args.table not in data.tables:
+            parser.error("no table %s in %s" % (args.table, args.file))
+        cols = data.schemas[args.table]
+        columns = [data.realtime(args.table, c.name) if args.realtime
+                   else data.tables[args.table][c.name] for c in cols]
+        writer = csv.writer(sys.stdout)
+        writer.writerow([c.name for c in cols])
+        writer.writerows(zip(*columns))
+        return
+
+    for key, value in data.metadata.items():
+        print("%s: %s" % (key, value))
+    for name, cols in data.schemas.items():
+        if args.table and name != args.table:
+            continue
+        rows = len(data.tables[name][cols[0].name]) if cols else 0
+        print("\ntable %s: %d rows" % (name, rows))
+        for col in cols:
+            print("  %-28s %s" % (col.name, _type_name(col)))
+
+
+def _type_name(col):
+    names = {U8: "u8", U16: "u16", U32: "u32", U64: "u64", I32: "i32",
+             I64: "i64", STR: "string"}
+    clocks = {REALTIME_NS: " (realtime ns)", BOOTTIME_NS: " (boottime ns)",
+              MONOTONIC_NS: " (monotonic ns)"}
+    return names.get(col.type, "?") + clocks.get(col.clock, "")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,381 @@
+#!/usr/bin/env python3
+"""
+Joins radostrace and osdtrace captures of the same ops and splits the
+client-observed latency into OSD service time and network time.
+
+radostrace records each client op as (client global id, tid, target OSD);
+osdtrace records the op the primary OSD served under the same client id
+(the message source) and tid.  Matching the two on (client, tid) gives, per
+op:
+
+  client_lat   send_op -> finish_op on the client (radostrace latency)
+  osd_lat      message received -> reply sent on the primary (op_lat)
+  network_lat  client_lat - osd_lat: both messenger hops, the client's
+               messenger queueing included.  Needs no clock alignment.
+
+When both sides are columnar files, the raw stamps are
+converted to wall-clock time with each file's boottime -> realtime offset,
+the same alignment osdtrace applies with its bootstamp, and the network time
+is further split into
+
+  request_lat  client send -> OSD receive
+  reply_lat    OSD reply -> client finish
+
+These two depend on the hosts' clocks agreeing.  The report also estimates
+each client-host/OSD-host offset from the matched pairs, as NTP does:
+((recv - sent) - (finish - reply)) / 2, and prints the one-way times
+corrected by it.
+
+Inputs are recorded files -- columnar (.ctc) or text output, CSV included --
+in any order and mix; the tool and format of each is detected.  With
+--follow the text files are read as they grow, so the tool can run next to
+live tracers, e.g.
+
+    sudo ./radostrace > client.log &
+    sudo ./osdtrace -a > osd.log &
+    ./correlate_traces.py --follow client.log osd.log
+
+The join is a symmetric hash join on (client, tid): each record is matched
+against the other side's pending records and kept only until its partner
+arrives, so the join state is bounded by --window unmatched ops per side.
+Matched ops are reduced to a few numbers each as they are found (and
+streamed to --csv, with uncorrected one-way times).
+"""
+import argparse
+import array
+import csv
+import math
+import re
+import sys
+import time
+from collections import OrderedDict, defaultdict
+
+from columnar_reader import MAGIC, ColumnarFile, iter_batches
+
+PERCENTILES = (50.0, 90.0, 99.0, 99.9, 100.0)
+
+# radostrace text line:
+#   pid client tid pool pg acting WR size latency object[ops]
+RADOS_LINE = re.compile(
+    r"^\s*(?P<pid>\d+)\s+(?P<client>\d+)\s+(?P<tid>\d+)\s+\d+\s+\S+\s+"
+    r"\[(?P<acting>[\d,\s]*)\]\s+[RW]\s+\d+\s+(?P<latency>\d+)\s+"
+    r"(?P<object>\S+)")
+
+# osdtrace text line for client ops; subop_w lines are the replicas' side
+# of the same client op and are not joined.
+OSD_LINE = re.compile(
+    r"osd\s+(?P<osd>\d+)\s+pg\s+\S+\s+(?P<kind>op_[rw])\s+size\s+\d+\s+"
+    r"client\s+(?P<client>\d+)\s+tid\s+(?P<tid>\d+)\s.*?"
+    r"\bop_lat\s+(?P<op_lat>\d+)")
+
+
+class ClientOp:
+    """One radostrace op; stamps are realtime ns, or 0 when not recorded."""
+    __slots__ = ("client", "tid", "osd", "lat", "sent", "finish", "host",
+                 "object")
+
+    def __init__(self, client, tid, osd, lat, sent=0, finish=0, host="",
+                 obj=""):
+        self.client, self.tid, self.osd, self.lat = client, tid, osd, lat
+        self.sent, self.finish, self.host, self.object = sent, finish, host, obj
+
+
+class OsdOp:
+    """One osdtrace client op on its primary; stamps as for ClientOp."""
+    __slots__ = ("client", "tid", "osd", "lat", "recv", "reply", "host",
+                 "kind")
+
+    def __init__(self, client, tid, osd, lat, recv=0, reply=0, host="",
+                 kind=""):
+        self.client, self.tid, self.osd, self.lat = client, tid, osd, lat
+        self.recv, self.reply, self.host, self.kind = recv, reply, host, kind
+
+
+def is_columnar(path):
+    """True if `path` starts with the columnar file magic."""
+    with open(path, "rb") as file_handle:
+        return file_handle.read(len(MAGIC)) == MAGIC
+
+
+def columnar_records(path):
+    """Yields the ClientOp/OsdOp rows of a radostrace or osdtrace capture.
+
+    The file is read one batch at a time, so it need not fit in memory.
+    """
+    data = ColumnarFile()
+    for table, ops in iter_batches(path, data):
+        host = data.metadata.get("hostname", path)
+        if table == "client_op":
+            sent = data.realtime(table, "sent_stamp", ops["sent_stamp"])
+            finish = data.realtime(table, "finish_stamp", ops["finish_stamp"])
+            for i, client in enumerate(ops["client"]):
+                yield ClientOp(client, ops["tid"][i], ops["target_osd"][i],
+                               ops["latency"][i], sent[i], finish[i], host,
+                               ops["object"][i])
+        elif table == "osd_op":
+            recv = data.realtime(table, "recv_stamp", ops["recv_stamp"])
+            reply = data.realtime(table, "reply_stamp", ops["reply_stamp"])
+            for i, kind in enumerate(ops["kind"]):
+                if kind not in ("op_r", "op_w"):
+                    continue
+                yield OsdOp(ops["client"][i], ops["tid"][i], ops["osd"][i],
+                            ops["op_lat"][i], recv[i], reply[i], host, kind)
+
+
+def text_record(line, csv_header):
+    """Parses one line of radostrace or osdtrace text output, or None."""
+    match = OSD_LINE.search(line)
+    if match:
+        return OsdOp(int(match["client"]), int(match["tid"]),
+                     int(match["osd"]), int(match["op_lat"]),
+                     kind=match["kind"])
+    if csv_header:
+        row = dict(zip(csv_header, next(csv.reader([line]))))
+        try:
+            acting = row["acting"].strip("[]").split(",")
+            return ClientOp(int(row["client"]), int(row["tid"]),
+                            int(acting[0]), int(row["latency"]),
+                            obj=row.get("object", ""))
+        except (KeyError, ValueError, IndexError):
+            return None
+    match = RADOS_LINE.match(line)
+    if match:
+        acting = match["acting"].split(",")
+        if acting[0].strip():
+            return ClientOp(int(match["client"]), int(match["tid"]),
+                            int(acting[0]), int(match["latency"]),
+                            obj=match["object"])
+    return None
+
+
+class TextSource:
+    """Incremental reader of a text capture; poll() returns the new records."""
+
+    def __init__(self, path):
+        self.path = path
+        self.handle = open(path, "r", encoding="utf-8", errors="replace")
+        self.partial = ""
+        self.csv_header = None
+
+    def poll(self):
+        records = []
+        for line in self.handle:
+            if not line.endswith("\n"):
+                self.partial += line   # writer is mid-line; finish next poll
+                break
+            line, self.partial = self.partial + line, ""
+            if line.startswith("pid,client,tid"):
+                self.csv_header = line.strip().split(",")
+                continue
+            record = text_record(line, self.csv_header)
+            if record is not None:
+                records.append(record)
+        return records
+
+
+class Correlator:
+    """Symmetric hash join of client and OSD ops on (client, tid)."""
+
+    def __init__(self, window):
+        self.window = window
+        self.pending = {ClientOp: OrderedDict(), OsdOp: OrderedDict()}
+        self.evicted = 0
+
+    def add(self, record):
+        other = OsdOp if isinstance(record, ClientOp) else ClientOp
+        key = (record.client, record.tid)
+        candidates = self.pending[other].get(key)
+        if candidates:
+            # A resent op keeps its tid, so only the attempt served by the
+            # OSD the client sent it to is the same op.
+            for i, cand in enumerate(candidates):
+                if cand.osd == record.osd:
+                    del candidates[i]
+                    if not candidates:
+                        del self.pending[other][key]
+                    return ((record, cand) if other is OsdOp
+                            else (cand, record))
+        own = self.pending[type(record)]
+        own.setdefault(key, []).append(record)
+        own.move_to_end(key)
+        while len(own) > self.window:
+            own.popitem(last=False)
+            self.evicted += 1
+        return None
+
+    def unmatched(self):
+        return {kind.__name__: sum(len(v) for v in table.values())
+                for kind, table in self.pending.items()}
+
+
+def percentiles(values):
+    """Nearest-rank percentiles of `values` at PERCENTILES."""
+    data = sorted(values)
+    if not data:
+        return []
+    return [data[max(1, math.ceil(p / 100.0 * len(data))) - 1]
+            for p in PERCENTILES]
+
+
+def pair_metrics(client_op, osd_op):
+    """Per-op latencies in us; one-way values only when both sides have stamps."""
+    metrics = {
+        "client_lat": client_op.lat,
+        "osd_lat": osd_op.lat,
+        "network_lat": client_op.lat - osd_op.lat,
+    }
+    if client_op.sent and client_op.finish and osd_op.recv and osd_op.reply:
+        metrics["request_lat"] = (osd_op.recv - client_op.sent) / 1000.0
+        metrics["reply_lat"] = (client_op.finish - osd_op.reply) / 1000.0
+        metrics["offset"] = (metrics["request_lat"] - metrics["reply_lat"]) / 2
+    return metrics
+
+
+class Stats:
+    """Latencies of the matched ops, kept as flat arrays per primary OSD."""
+
+    NAMES = ("client_lat", "osd_lat", "network_lat", "request_lat",
+             "reply_lat")
+
+    def __init__(self, csv_path=None):
+        self.count = 0
+        self.by_osd = defaultdict(lambda: {n: array.array("d")
+                                           for n in self.NAMES + ("pair",)})
+        self.pairs = {}     # (client host, osd host) -> index
+        self.offsets = defaultdict(lambda: array.array("d"))
+        self.csv_handle = None
+        self.csv = None
+        if csv_path:
+            self.csv_handle = open(csv_path, "w", newline="", encoding="utf-8")
+            self.csv = csv.writer(self.csv_handle)
+            self.csv.writerow(["client", "tid", "osd", "object",
+                               "client_host", "osd_host"] + list(self.NAMES))
+
+    def add(self, client_op, osd_op):
+        self.count += 1
+        m = pair_metrics(client_op, osd_op)
+        cols = self.by_osd[osd_op.osd]
+        for name in ("client_lat", "osd_lat", "network_lat"):
+            cols[name].append(m[name])
+        if "offset" in m:
+            hosts = (client_op.host, osd_op.host)
+            pair = self.pairs.setdefault(hosts, len(self.pairs))
+            self.offsets[hosts].append(m["offset"])
+            cols["request_lat"].append(m["request_lat"])
+            cols["reply_lat"].append(m["reply_lat"])
+            cols["pair"].append(pair)
+        if self.csv:
+            self.csv.writerow([client_op.client, client_op.tid, osd_op.osd,
+                               client_op.object, client_op.host, osd_op.host]
+                              + [m.get(n, "") for n in self.NAMES])
+
+    def close(self):
+        if self.csv_handle:
+            self.csv_handle.close()
+
+    def report(self, correlator, per_osd, out=sys.stdout):
+        """Prints the matched-op count, clock offsets and percentiles."""
+        unmatched = correlator.unmatched()
+        print("matched %d ops; unmatched %d client, %d osd; evicted %d"
+              % (self.count, unmatched["ClientOp"], unmatched["OsdOp"],
+                 correlator.evicted), file=out)
+        if not self.count:
+            return
+
+        # Clock offset of each OSD host relative to each client host; the
+        # one-way times are printed corrected by it.
+        correction = {}
+        if self.offsets:
+            print("\nclock offset of OSD host vs client host (us, median of "
+                  "matched ops):", file=out)
+            for hosts, values in sorted(self.offsets.items()):
+                median = sorted(values)[len(values) // 2]
+                correction[self.pairs[hosts]] = median
+                print("  %s -> %s: %+.1f (%d ops)"
+                      % (hosts[0], hosts[1], median, len(values)), file=out)
+
+        groups = [("all", list(self.by_osd.values()))]
+        if per_osd:
+            groups += [("osd.%d" % osd, [self.by_osd[osd]])
+                       for osd in sorted(self.by_osd)]
+        header = "  %-12s %8s" % ("", "ops") + "".join(
+            "%10s" % ("p%g" % p if p < 100 else "max") for p in PERCENTILES)
+        for label, group in groups:
+            print("\n%s latency (us):" % label, file=out)
+            print(header, file=out)
+            for name in self.NAMES:
+                values = []
+                for cols in group:
+                    if name == "request_lat":
+                        values += [v - correction[int(p)] for v, p
+                                   in zip(cols[name], cols["pair"])]
+                    elif name == "reply_lat":
+                        values += [v + correction[int(p)] for v, p
+                                   in zip(cols[name], cols["pair"])]
+                    else:
+                        values += cols[name]
+                if values:
+                    print("  %-12s %8d" % (name, len(values)) + "".join(
+                        "%10.0f" % v for v in percentiles(values)), file=out)
+
+
+def create_arg_parser():
+    parser = argparse.ArgumentParser(
+        description="Correlate radostrace and osdtrace captures by "
+                    "(client, tid)",
+        formatter_class=argparse.RawDescriptionHelpFormatter,
+        epilog=__doc__)
+    parser.add_argument("files", nargs="+",
+                        help="radostrace and osdtrace captures, columnar or "
+                             "text")
+    parser.add_argument("--per-osd", action="store_true",
+                        help="also break the percentiles down by primary OSD")
+    parser.add_argument("--csv", metavar="FILE",
+                        help="write one row per matched op to FILE")
+    parser.add_argument("--window", type=int, default=1000000,
+                        help="unmatched ops kept per side before the oldest "
+                             "are dropped (default: 1000000)")
+    parser.add_argument("--follow", action="store_true",
+                        help="keep reading text files as they grow; report "
+                             "on Ctrl-C")
+    parser.add_argument("--interval", type=float, default=0.5,
+                        help="--follow poll interval in seconds")
+    return parser
+
+
+def run(args):
+    correlator = Correlator(args.window)
+    stats = Stats(args.csv)
+    text_sources = []
+    for path in args.files:
+        if is_columnar(path):
+            if args.follow:
+                print("warning: %s is columnar; read once, not followed"
+                      % path, file=sys.stderr)
+            for record in columnar_records(path):
+                pair = correlator.add(record)
+                if pair:
+                    stats.add(*pair)
+        else:
+            text_sources.append(TextSource(path))
+
+    try:
+        while True:
+            for source in text_sources:
+                for record in source.poll():
+                    pair = correlator.add(record)
+                    if pair:
+                        stats.add(*pair)
+            if not args.follow:
+                break
+            time.sleep(args.interval)
+    except KeyboardInterrupt:
+        pass
+
+    stats.close()
+    stats.report(correlator, args.per_osd)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(run(create_arg_parser().parse_args()))
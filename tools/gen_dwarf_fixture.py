@@ -0,0 +1,479 @@
+#!/usr/bin/env python3
+"""Generate and build the synthetic C++ fixture for tests/bench_dwarf_parser.
+
+Cold-start DWARF parsing of ceph-osd is dominated by the size of its debug
+info: thousands of compile units, each repeating the std:: and Ceph types it
+includes, and a few large units holding the probed functions.  This script
+writes a fixture with the same shape and links it into one shared object:
+
+  fixture.h             Ceph-like types the osdtrace probes walk
+                        (OpRequest, Message, PG, OpContext, OSDOp...)
+  OSD.cc, PrimaryLogPG.cc, ReplicatedBackend.cc
+                        the probed functions, plus 25 x --funcs-per-unit
+                        other methods each, some sharing the probes' short
+                        names
+  Message.cc, OpRequest.cc, PG.cc
+                        key functions, so those types are defined in one
+                        unit only
+  unit_NNNN.cc          --units filler units, each with a --depth deep class
+                        hierarchy holding std::string / shared_ptr / map
+                        members and Ceph-style member functions
+
+Two objects are linked from the same units: libfixture.so, and
+libfixture-index.so carrying a .gdb_index built by gold from the
+-ggnu-pubnames tables (as distro debug packages are, via gdb-add-index), so
+the benchmark can compare the full CU walk against the indexed lookup.  The
+indexed variant is skipped with a warning when gold is not available.
+
+The probe list in tests/bench_dwarf_parser.cc matches fixture.h; keep the
+two in step.  Output is deterministic and rebuilt incrementally: sources are
+rewritten and objects recompiled only when their content changes.
+
+  python3 tools/gen_dwarf_fixture.py -o .output/dwarf_fixture --units 2000
+"""
+
+import argparse
+import os
+import subprocess
+import sys
+from concurrent.futures import ThreadPoolExecutor
+from pathlib import Path
+
+FIXTURE_H = r"""// Generated by tools/gen_dwarf_fixture.py -- do not edit.
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define FIXTURE_NOINLINE __attribute__((noinline))
+
+extern volatile uint64_t fixture_sink;
+
+// Same layout and calling convention as boost::intrusive_ptr: one `px`
+// member and a non-trivial destructor, so it is passed by invisible
+// reference.
+template <class T>
+class intrusive_ptr {
+ public:
+  intrusive_ptr() : px(nullptr) {}
+  explicit intrusive_ptr(T *p) : px(p) {}
+  intrusive_ptr(const intrusive_ptr &o) : px(o.px) {}
+  ~intrusive_ptr() { fixture_sink = fixture_sink + 1; }
+  T *get() const { return px; }
+  T *operator->() const { return px; }
+
+ private:
+  T *px;
+};
+
+struct utime_t {
+  uint32_t tv_sec;
+  uint32_t tv_nsec;
+};
+
+struct entity_name_t {
+  uint8_t _type;
+  int64_t _num;
+};
+
+struct osd_reqid_t {
+  entity_name_t name;
+  uint64_t tid;
+  int32_t inc;
+};
+
+struct ceph_msg_header {
+  uint64_t seq;
+  uint64_t tid;
+  uint16_t type;
+  uint16_t priority;
+  uint16_t version;
+  uint32_t front_len;
+  uint32_t middle_len;
+  uint32_t data_len;
+  uint16_t data_off;
+} __attribute__((packed));
+
+class RefCountedObject {
+ public:
+  virtual ~RefCountedObject();
+  mutable std::atomic<uint64_t> nref{1};
+};
+
+class Message : public RefCountedObject {
+ public:
+  ~Message() override;
+  ceph_msg_header header;
+  utime_t recv_stamp;
+  utime_t dispatch_stamp;
+  utime_t throttle_stamp;
+  utime_t recv_complete_stamp;
+  std::string connection_name;
+  std::list<std::function<void()>> completion_hooks;
+};
+
+class MOSDFastDispatchOp : public Message {
+ public:
+  virtual int get_cost() const;
+};
+
+class MOSDOp : public MOSDFastDispatchOp {
+ public:
+  ~MOSDOp() override;
+  std::string oid;
+  std::vector<std::string> op_names;
+};
+
+class TrackedOp : public RefCountedObject {
+ public:
+  ~TrackedOp() override;
+  std::string desc;
+  std::map<std::string, utime_t> events;
+};
+
+class OpRequest : public TrackedOp {
+ public:
+  ~OpRequest() override;
+  Message *request;
+  osd_reqid_t reqid;
+  std::shared_ptr<std::string> hit_flag_points;
+};
+typedef intrusive_ptr<OpRequest> OpRequestRef;
+
+struct pg_t {
+  uint64_t m_pool;
+  uint32_t m_seed;
+};
+
+struct spg_t {
+  pg_t pgid;
+  int8_t shard;
+};
+
+class PG : public RefCountedObject {
+ public:
+  ~PG() override;
+  spg_t pg_id;
+  std::string state;
+  std::map<uint64_t, std::string> log;
+};
+typedef intrusive_ptr<PG> PGRef;
+
+struct object_t {
+  std::string name;
+};
+
+struct hobject_t {
+  object_t oid;
+  uint64_t snap;
+  uint32_t hash;
+  std::string nspace;
+  std::string key;
+  int64_t pool;
+};
+
+struct object_info_t {
+  hobject_t soid;
+  uint64_t size;
+  std::map<std::string, std::string> attrs;
+};
+
+struct ObjectState {
+  object_info_t oi;
+  bool exists;
+};
+
+struct bufferlist {
+  void *_buffers_head;
+  void *_carriage;
+  unsigned _len;
+  unsigned _num;
+};
+
+struct ceph_osd_op {
+  uint16_t op;
+  uint32_t flags;
+  union {
+    struct {
+      uint64_t offset;
+      uint64_t length;
+      uint64_t truncate_size;
+      uint32_t truncate_seq;
+    } __attribute__((packed)) extent;
+    struct {
+      uint8_t class_len;
+      uint8_t method_len;
+      uint8_t argc;
+      uint32_t indata_len;
+    } __attribute__((packed)) cls;
+  };
+  uint32_t payload_len;
+} __attribute__((packed));
+
+struct OSDOp {
+  ceph_osd_op op;
+  bufferlist indata;
+  bufferlist outdata;
+  int rval;
+};
+
+struct OpContext {
+  OpRequestRef op;
+  osd_reqid_t reqid;
+  std::vector<OSDOp> ops;
+  ObjectState obs;
+  ObjectState new_obs;
+  std::shared_ptr<ObjectState> obc;
+};
+
+struct TPHandle {
+  uint64_t grace;
+  std::string name;
+};
+
+class OSD {
+ public:
+  FIXTURE_NOINLINE void enqueue_op(OpRequestRef op);
+  FIXTURE_NOINLINE void dequeue_op(PGRef pg, OpRequestRef op, TPHandle &handle);
+  uint64_t whoami;
+};
+
+class PrimaryLogPG : public PG {
+ public:
+  ~PrimaryLogPG() override;
+  FIXTURE_NOINLINE void execute_ctx(OpContext *ctx);
+};
+
+class ReplicatedBackend {
+ public:
+  FIXTURE_NOINLINE void submit_transaction(const hobject_t &soid,
+                                           uint64_t at_version,
+                                           std::string &&t,
+                                           uint64_t trim_to,
+                                           osd_reqid_t reqid,
+                                           OpRequestRef op);
+  std::map<uint64_t, std::string> in_progress;
+};
+"""
+
+# Key functions of the polymorphic types.  GCC emits a class's full DWARF
+# only in the unit holding its key function and declarations elsewhere, so
+# resolving, say, OpRequest from OSD.cc goes through the module-wide type
+# cache -- as it does in ceph-osd.
+HOME_UNITS = {
+    "Message.cc": r"""
+volatile uint64_t fixture_sink;
+
+RefCountedObject::~RefCountedObject() {}
+Message::~Message() {}
+int MOSDFastDispatchOp::get_cost() const { return header.data_len; }
+MOSDOp::~MOSDOp() {}
+""",
+    "OpRequest.cc": r"""
+TrackedOp::~TrackedOp() {}
+OpRequest::~OpRequest() {}
+""",
+    "PG.cc": r"""
+PG::~PG() {}
+""",
+}
+
+# Probed functions, one per probe unit.  Bodies read the fields the probes
+# in tests/bench_dwarf_parser.cc walk so nothing is optimized away.
+PROBE_BODIES = {
+    "OSD.cc": r"""
+void OSD::enqueue_op(OpRequestRef op) {
+  fixture_sink = op->request->header.type + op->reqid.name._num + op->reqid.tid +
+                 op->request->recv_stamp.tv_nsec + whoami;
+}
+
+void OSD::dequeue_op(PGRef pg, OpRequestRef op, TPHandle &handle) {
+  fixture_sink = op->request->header.type + op->reqid.tid + pg->pg_id.pgid.m_pool +
+                 pg->pg_id.pgid.m_seed + handle.grace;
+}
+""",
+    "PrimaryLogPG.cc": r"""
+PrimaryLogPG::~PrimaryLogPG() {}
+
+void PrimaryLogPG::execute_ctx(OpContext *ctx) {
+  fixture_sink = ctx->reqid.name._num + ctx->reqid.tid +
+                 ctx->new_obs.oi.soid.oid.name.size() + ctx->ops.size() +
+                 pg_id.pgid.m_pool;
+}
+""",
+    "ReplicatedBackend.cc": r"""
+void ReplicatedBackend::submit_transaction(const hobject_t &soid,
+                                           uint64_t at_version,
+                                           std::string &&t,
+                                           uint64_t trim_to,
+                                           osd_reqid_t reqid,
+                                           OpRequestRef op) {
+  in_progress[at_version] = soid.oid.name + t;
+  fixture_sink = reqid.name._num + reqid.tid + trim_to + op->reqid.tid;
+}
+""",
+}
+
+CLASS_PREFIXES = [
+    "OSDService", "PGBackend", "ECBackend", "Objecter", "BlueStore",
+    "BlueFS", "KernelDevice", "OpQueue", "Messenger", "ProtocolV2",
+    "MonClient", "PeeringState", "Scrubber", "SnapMapper", "OSDMap",
+]
+
+# Short names shared with the probes make handle_function resolve the full
+# scope name, as the real ceph-osd's many dequeue_op / submit_transaction
+# overloads do.
+METHOD_NAMES = [
+    "dequeue_op", "enqueue_op", "execute_ctx", "submit_transaction",
+    "handle_message", "ms_dispatch", "do_request", "queue_transactions",
+    "_do_write", "_txc_state_proc", "send_message", "handle_reply",
+    "_finish_op", "get_object_context", "on_commit", "encode_payload",
+]
+
+
+def unit_source(idx, depth, funcs):
+    """One filler compile unit: a class hierarchy and its methods."""
+    ns = f"fixture_u{idx}"
+    cls = f"{CLASS_PREFIXES[idx % len(CLASS_PREFIXES)]}{idx}"
+    out = [f'// Generated by tools/gen_dwarf_fixture.py -- do not edit.\n'
+           f'#include "fixture.h"\n\nnamespace {ns} {{\n']
+    out.append(f"struct Level0 {{\n  virtual ~Level0() {{}}\n"
+               f"  std::string name0;\n  std::shared_ptr<Level0> next0;\n"
+               f"  uint64_t id0;\n}};\n")
+    for d in range(1, depth):
+        out.append(f"struct Level{d} : Level{d - 1} {{\n"
+                   f"  std::string name{d};\n"
+                   f"  std::shared_ptr<OpRequest> req{d};\n"
+                   f"  std::map<std::string, uint64_t> counters{d};\n"
+                   f"  std::vector<hobject_t> objects{d};\n"
+                   f"  uint64_t id{d};\n}};\n")
+    leaf = f"Level{depth - 1}"
+    out.append(f"\nclass {cls} {{\n public:\n")
+    for f in range(funcs):
+        out.append(f"  FIXTURE_NOINLINE uint64_t {METHOD_NAMES[(idx + f) % len(METHOD_NAMES)]}"
+                   f"{'' if f < len(METHOD_NAMES) else f}({leaf} *l, OpRequestRef op);\n")
+    out.append(f"  {leaf} state;\n}};\n\n")
+    for f in range(funcs):
+        name = f"{METHOD_NAMES[(idx + f) % len(METHOD_NAMES)]}{'' if f < len(METHOD_NAMES) else f}"
+        out.append(f"uint64_t {cls}::{name}({leaf} *l, OpRequestRef op) {{\n"
+                   f"  l->name{depth - 1} += state.name0;\n"
+                   f"  return l->id{depth - 1} + l->counters{depth - 1}.size() + "
+                   f"op->reqid.tid + {f};\n}}\n\n")
+    out.append(f"}}  // namespace {ns}\n")
+    return "".join(out)
+
+
+def probe_unit_source(name, idx, funcs):
+    """A probed compile unit: the probe target plus many other methods."""
+    body = PROBE_BODIES.get(name) or HOME_UNITS[name]
+    extra = unit_source(idx, 3, funcs)
+    extra = extra.split('#include "fixture.h"\n', 1)[1]
+    return (f'// Generated by tools/gen_dwarf_fixture.py -- do not edit.\n'
+            f'#include "fixture.h"\n{body}{extra}')
+
+
+def write_if_changed(path, text):
+    if path.exists() and path.read_text() == text:
+        return False
+    path.write_text(text)
+    return True
+
+
+def compile_unit(cxx, cxxflags, src, obj):
+    cmd = [cxx] + cxxflags + ["-fPIC", "-c", str(src), "-o", str(obj)]
+    res = subprocess.run(cmd, capture_output=True, text=True)
+    if res.returncode != 0:
+        sys.stderr.write(" ".join(cmd) + "\n" + res.stderr)
+    return res.returncode
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Generate and build the DWARF parser benchmark fixture.")
+    parser.add_argument("-o", "--output", required=True,
+                        help="output directory; the fixture is <output>/libfixture.so")
+    parser.add_argument("--units", type=int, default=2000,
+                        help="filler compile units (default: 2000)")
+    parser.add_argument("--depth", type=int, default=6,
+                        help="class hierarchy depth per unit (default: 6)")
+    parser.add_argument("--funcs-per-unit", type=int, default=8,
+                        help="methods per filler unit; probe units get 25x "
+                             "(default: 8)")
+    parser.add_argument("--cxx", default=os.environ.get("CXX", "g++"),
+                        help="C++ compiler (default: $CXX or g++)")
+    parser.add_argument("--cxxflags", default="-g -O2 -ggnu-pubnames",
+                        help="fixture compile flags (default: -g -O2 "
+                             "-ggnu-pubnames, as a RelWithDebInfo Ceph build "
+                             "whose debug info gets indexed)")
+    parser.add_argument("-j", "--jobs", type=int, default=os.cpu_count() or 1,
+                        help="parallel compiles (default: CPU count)")
+    args = parser.parse_args()
+
+    out = Path(args.output)
+    src_dir = out / "src"
+    obj_dir = out / "obj"
+    src_dir.mkdir(parents=True, exist_ok=True)
+    obj_dir.mkdir(parents=True, exist_ok=True)
+
+    header_changed = write_if_changed(src_dir / "fixture.h", FIXTURE_H)
+    sources = {}
+    for i, name in enumerate(PROBE_BODIES):
+        sources[name] = probe_unit_source(name, 100000 + i,
+                                          args.funcs_per_unit * 25)
+    for i, name in enumerate(HOME_UNITS):
+        sources[name] = probe_unit_source(name, 100100 + i,
+                                          args.funcs_per_unit)
+    for i in range(args.units):
+        sources[f"unit_{i:04d}.cc"] = unit_source(i, args.depth,
+                                                  args.funcs_per_unit)
+
+    # Drop units left over from a run with a larger --units.
+    for stale in src_dir.glob("unit_*.cc"):
+        if stale.name not in sources:
+            stale.unlink()
+            (obj_dir / (stale.stem + ".o")).unlink(missing_ok=True)
+
+    cxxflags = args.cxxflags.split() + ["-I", str(src_dir)]
+    flags_file = obj_dir / "flags"
+    flags_changed = write_if_changed(flags_file, f"{args.cxx} {args.cxxflags}\n")
+    jobs = []
+    for name, text in sources.items():
+        src = src_dir / name
+        obj = obj_dir / (Path(name).stem + ".o")
+        changed = write_if_changed(src, text)
+        if changed or header_changed or flags_changed or not obj.exists():
+            jobs.append((src, obj))
+
+    lib = out / "libfixture.so"
+    indexed = out / "libfixture-index.so"
+    if jobs:
+        print(f"compiling {len(jobs)} of {len(sources)} fixture units "
+              f"with {args.jobs} jobs", flush=True)
+        with ThreadPoolExecutor(max_workers=args.jobs) as pool:
+            rcs = list(pool.map(lambda j: compile_unit(args.cxx, cxxflags, *j), jobs))
+        if any(rcs):
+            return 1
+    objs = [str(obj_dir / (Path(n).stem + ".o")) for n in sources]
+    if jobs or not lib.exists():
+        res = subprocess.run([args.cxx, "-shared", "-o", str(lib)] + objs)
+        if res.returncode != 0:
+            return res.returncode
+    if jobs or not indexed.exists():
+        res = subprocess.run([args.cxx, "-shared", "-fuse-ld=gold",
+                              "-Wl,--gdb-index", "-o", str(indexed)] + objs)
+        if res.returncode != 0:
+            print(f"warning: could not link {indexed} with gold; "
+                  "benchmarking without a name index", file=sys.stderr)
+            indexed.unlink(missing_ok=True)
+    print(f"{lib}: {len(sources)} compile units, "
+          f"{lib.stat().st_size / (1 << 20):.1f} MiB")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
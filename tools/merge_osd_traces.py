@@ -0,0 +1,398 @@
+#!/usr/bin/env python3
+"""
+Merges osdtrace captures from several OSD hosts into one timeline per
+replicated write: the primary's op_w and each replica's subop_w, on a common
+clock.
+
+Each host stamps events with its own clock.  The primary records when it sent
+the repop to each peer (peer_sent) and when each peer's reply arrived
+(peerN_recv); the replica records when the repop arrived (recv) and when it
+replied (reply).  For every such exchange the replica's clock offset against
+the primary is, as in NTP,
+
+    offset = ((recv - peer_sent) - (peerN_recv - reply)) / 2
+
+and the error of that estimate is at most half the network round trip,
+(peerN_recv - peer_sent) - (reply - recv).  The tool keeps the --samples
+exchanges with the smallest round trip for each host pair, takes their
+median, and chains the pairwise offsets to put every host on the clock of
+the reference host (--reference, default the host of the first file).
+
+Inputs are columnar captures (osdtrace --columnar); text output has no
+absolute timestamps to align.  Stamps are first converted to wall-clock time
+with each file's boottime -> realtime offset.
+
+Memory does not grow with the capture: rows are read one batch at a time,
+sorted on (client, tid) in chunks of --chunk-rows, spilled to temporary run
+files, and k-way merged, so the rows of one op meet however far apart they
+were recorded.  The merge is read twice, once to estimate the offsets and
+once to print the timelines.  Timelines come out in (client, tid) order.
+
+    ./merge_osd_traces.py host1.ctc host2.ctc host3.ctc --min-lat 5000
+    ./merge_osd_traces.py *.ctc --csv timeline.csv --tmpdir /var/tmp
+"""
+import argparse
+import csv
+import heapq
+import itertools
+import os
+import struct
+import sys
+import tempfile
+from collections import defaultdict, deque
+
+from columnar_reader import iter_batches, ColumnarFile
+
+PRIMARY, REPLICA = 0, 1
+KINDS = {"op_w": PRIMARY, "subop_w": REPLICA}
+
+# Stamp columns of the osd_op table, in the order the timeline lists ties.
+STAMPS = ("recv", "throttle", "recv_complete", "dispatch", "enqueue",
+          "dequeue", "execute_ctx", "submit_transaction", "queue_transaction",
+          "do_write", "wctx_finish", "aio_submit", "aio_done", "kv_submit",
+          "kv_committed", "peer_sent", "peer1_recv", "peer2_recv", "reply")
+
+# One spilled row.  Big-endian with the sort key first, so that comparing
+# the packed bytes orders rows by (client, tid, role) and the chunks are
+# sorted and merged as plain bytes.  The osd ids are signed like the osd_op
+# columns they come from; an unknown one (-1) must not break the packing.
+ROW = struct.Struct(">QQBiHQIii%dQ" % len(STAMPS))
+KEY_LEN = 16                        # client, tid
+STAMP0 = 9                          # index of the first stamp in a row
+MAX_FANIN = 256                     # run files open at once while merging
+
+
+class Row:
+    """One unpacked osd_op row."""
+    __slots__ = ("client", "tid", "role", "osd", "host", "pool", "pg_seed",
+                 "peer1", "peer2", "stamps")
+
+    def __init__(self, packed):
+        values = ROW.unpack(packed)
+        (self.client, self.tid, self.role, self.osd, self.host, self.pool,
+         self.pg_seed, self.peer1, self.peer2) = values[:STAMP0]
+        self.stamps = dict(zip(STAMPS, values[STAMP0:]))
+
+
+class RunWriter:
+    """Collects packed rows and spills them to sorted run files."""
+
+    def __init__(self, tmpdir, chunk_rows):
+        self.tmpdir = tmpdir
+        self.chunk_rows = chunk_rows
+        self.chunk = []
+        self.runs = []
+        self.rows = 0
+
+    def add(self, packed):
+        self.chunk.append(packed)
+        self.rows += 1
+        if len(self.chunk) >= self.chunk_rows:
+            self.spill()
+
+    def spill(self):
+        if not self.chunk:
+            return
+        self.chunk.sort()
+        self.runs.append(self.write_run(self.chunk))
+        self.chunk = []
+
+    def write_run(self, rows):
+        fd, path = tempfile.mkstemp(prefix="run-", dir=self.tmpdir)
+        with os.fdopen(fd, "wb", buffering=1 << 20) as file_handle:
+            for packed in rows:
+                file_handle.write(packed)
+        return path
+
+    def finish(self):
+        """Spills the last chunk and merges runs until MAX_FANIN are left."""
+        self.spill()
+        while len(self.runs) > MAX_FANIN:
+            groups = [self.runs[i:i + MAX_FANIN]
+                      for i in range(0, len(self.runs), MAX_FANIN)]
+            self.runs = []
+            for group in groups:
+                self.runs.append(self.write_run(merged(group)))
+                for path in group:
+                    os.unlink(path)
+        return self.runs
+
+
+def read_run(path):
+    with open(path, "rb") as file_handle:
+        while True:
+            block = file_handle.read(ROW.size * 4096)
+            if not block:
+                return
+            for i in range(0, len(block), ROW.size):
+                yield block[i:i + ROW.size]
+
+
+def merged(runs):
+    return heapq.merge(*(read_run(path) for path in runs))
+
+
+def spill_file(path, runs, hosts):
+    """Packs the op_w/subop_w rows of one capture into `runs`."""
+    info = ColumnarFile()
+    host = None
+    for table, batch in iter_batches(path, info):
+        if table != "osd_op":
+            continue
+        if host is None:
+            name = info.metadata.get("hostname", path)
+            if name not in hosts:
+                hosts.append(name)
+            host = hosts.index(name)
+            schema = {c.name: c for c in info.schemas["osd_op"]}
+            stamp_cols = []
+            for stamp in STAMPS:
+                column = stamp + "_stamp"
+                if column in schema:
+                    stamp_cols.append(
+                        (column, info.clock_offset(schema[column].clock)))
+                else:
+                    stamp_cols.append((None, 0))
+        stamps = [batch[c] if c else None for c, _ in stamp_cols]
+        offsets = [off for _, off in stamp_cols]
+        for i, kind in enumerate(batch["kind"]):
+            role = KINDS.get(kind)
+            if role is None:
+                continue
+            values = []
+            for column, off in zip(stamps, offsets):
+                stamp = column[i] if column is not None else 0
+                values.append(stamp + off if stamp else 0)
+            runs.add(ROW.pack(batch["client"][i], batch["tid"][i], role,
+                              batch["osd"][i], host, batch["pool"][i],
+                              batch["pg_seed"][i], batch["peer1"][i],
+                              batch["peer2"][i], *values))
+
+
+def write_ops(runs):
+    """Yields (primary Row or None, [replica Rows]) per replicated write."""
+    for _, group in itertools.groupby(merged(runs), key=lambda p: p[:KEY_LEN]):
+        rows = [Row(packed) for packed in group]
+        replicas = [r for r in rows if r.role == REPLICA]
+        for primary in (r for r in rows if r.role == PRIMARY):
+            # A resent op keeps its (client, tid); its replicas are the
+            # peers of this attempt in the same PG.
+            mine = [r for r in replicas
+                    if r.osd in (primary.peer1, primary.peer2)
+                    and (r.pool, r.pg_seed) == (primary.pool, primary.pg_seed)]
+            replicas = [r for r in replicas if r not in mine]
+            yield primary, mine
+        if replicas:
+            yield None, replicas
+
+
+def exchange(primary, replica):
+    """(offset, round trip) in ns of replica's clock vs primary's, or None."""
+    if replica.osd == primary.peer1:
+        back = primary.stamps["peer1_recv"]
+    elif replica.osd == primary.peer2:
+        back = primary.stamps["peer2_recv"]
+    else:
+        return None
+    sent = primary.stamps["peer_sent"]
+    recv, reply = replica.stamps["recv"], replica.stamps["reply"]
+    if not (sent and back and recv and reply):
+        return None
+    rtt = (back - sent) - (reply - recv)
+    if rtt < 0:
+        return None
+    return ((recv - sent) - (back - reply)) // 2, rtt
+
+
+class OffsetEstimator:
+    """Pairwise host clock offsets from the lowest-round-trip exchanges."""
+
+    def __init__(self, samples):
+        self.samples = samples
+        self.best = defaultdict(list)   # (a, b) -> heap of (-rtt, offset b-a)
+        self.seen = defaultdict(int)
+
+    def add(self, primary_host, replica_host, offset, rtt):
+        if primary_host == replica_host:
+            return
+        if primary_host > replica_host:
+            primary_host, replica_host, offset = (replica_host, primary_host,
+                                                  -offset)
+        pair = (primary_host, replica_host)
+        self.seen[pair] += 1
+        heap = self.best[pair]
+        if len(heap) < self.samples:
+            heapq.heappush(heap, (-rtt, offset))
+        elif -rtt > heap[0][0]:
+            heapq.heapreplace(heap, (-rtt, offset))
+
+    def pairs(self):
+        """{(a, b): (offset of b vs a, max rtt used, exchanges seen)}."""
+        result = {}
+        for pair, heap in self.best.items():
+            offsets = sorted(offset for _, offset in heap)
+            result[pair] = (offsets[len(offsets) // 2],
+                            max(-neg for neg, _ in heap), self.seen[pair])
+        return result
+
+    def host_offsets(self, reference, nhosts):
+        """Offset of every host vs `reference`, chained breadth-first over
+        the measured pairs; None for hosts no exchange connects."""
+        edges = defaultdict(list)
+        for (a, b), (offset, _, _) in self.pairs().items():
+            edges[a].append((b, offset))
+            edges[b].append((a, -offset))
+        result = [None] * nhosts
+        result[reference] = 0
+        queue = deque([reference])
+        while queue:
+            host = queue.popleft()
+            for other, offset in edges[host]:
+                if result[other] is None:
+                    result[other] = result[host] + offset
+                    queue.append(other)
+        return result
+
+
+def timeline(primary, replicas, host_offsets):
+    """[(corrected ns, osd, host, role, stage)] of one op, in time order."""
+    events = []
+    for row in [primary] + replicas:
+        shift = host_offsets[row.host] or 0
+        for order, stage in enumerate(STAMPS):
+            stamp = row.stamps[stage]
+            if stamp:
+                events.append((stamp - shift, order, row.osd, row.host,
+                               row.role, stage))
+    events.sort()
+    return [(t, osd, host, role, stage)
+            for t, _, osd, host, role, stage in events]
+
+
+def create_arg_parser():
+    parser = argparse.ArgumentParser(
+        description="Merge osdtrace columnar captures from several hosts "
+                    "into per-write timelines",
+        formatter_class=argparse.RawDescriptionHelpFormatter,
+        epilog=__doc__)
+    parser.add_argument("files", nargs="+",
+                        help="osdtrace --columnar captures, one or more per "
+                             "host")
+    parser.add_argument("--reference",
+                        help="hostname whose clock the timeline uses "
+                             "(default: host of the first file)")
+    parser.add_argument("--min-lat", type=float, default=0,
+                        help="only print ops whose primary recv -> reply "
+                             "took at least this many us")
+    parser.add_argument("--csv", help="write the timelines to this CSV file "
+                                      "instead of stdout")
+    parser.add_argument("--samples", type=int, default=1000,
+                        help="lowest-round-trip exchanges kept per host pair "
+                             "(default: 1000)")
+    parser.add_argument("--chunk-rows", type=int, default=500000,
+                        help="rows sorted in memory per run file "
+                             "(default: 500000, about 100 MB)")
+    parser.add_argument("--tmpdir", help="directory for the run files "
+                                         "(default: system temp dir)")
+    return parser
+
+
+def run(args):
+    hosts = []
+    with tempfile.TemporaryDirectory(prefix="merge_osd_traces-",
+                                     dir=args.tmpdir) as tmpdir:
+        runs = RunWriter(tmpdir, args.chunk_rows)
+        for path in args.files:
+            spill_file(path, runs, hosts)
+        run_files = runs.finish()
+        print("%d rows from %d hosts in %d sorted runs"
+              % (runs.rows, len(hosts), len(run_files)), file=sys.stderr)
+
+        # Pass 1: clock offsets.
+        estimator = OffsetEstimator(args.samples)
+        ops = orphans = 0
+        for primary, replicas in write_ops(run_files):
+            if primary is None:
+                orphans += len(replicas)
+                continue
+            ops += 1
+            for replica in replicas:
+                measured = exchange(primary, replica)
+                if measured:
+                    estimator.add(primary.host, replica.host, *measured)
+
+        reference = 0
+        if args.reference:
+            if args.reference not in hosts:
+                print("error: no capture from host %s" % args.reference,
+                      file=sys.stderr)
+                return 1
+            reference = hosts.index(args.reference)
+        host_offsets = estimator.host_offsets(reference, len(hosts))
+
+        print("%d writes; %d subop_w rows without their primary's op_w"
+              % (ops, orphans))
+        print("clock offsets vs %s (us; error bound = half the round trip):"
+              % hosts[reference] if hosts else "no hosts")
+        for host, offset in enumerate(host_offsets):
+            if offset is None:
+                print("  %-24s unknown: no exchange with a measured host; "
+                      "left uncorrected" % hosts[host])
+            elif host != reference:
+                print("  %-24s %+12.1f" % (hosts[host], offset / 1000.0))
+        for (a, b), (offset, rtt, seen) in sorted(estimator.pairs().items()):
+            print("  pair %s -> %s: %+.1f, from the %d fastest of %d "
+                  "exchanges, round trip <= %.1f"
+                  % (hosts[a], hosts[b], offset / 1000.0,
+                     min(seen, args.samples), seen, rtt / 1000.0))
+
+        # Pass 2: timelines.
+        if args.csv:
+            out_handle = open(args.csv, "w", newline="", encoding="utf-8")
+            writer = csv.writer(out_handle)
+            writer.writerow(["client", "tid", "pg", "osd", "host", "role",
+                             "stage", "realtime_ns", "since_recv_us"])
+        else:
+            out_handle, writer = sys.stdout, None
+        printed = 0
+        try:
+            for primary, replicas in write_ops(run_files):
+                if primary is None:
+                    continue
+                recv, reply = primary.stamps["recv"], primary.stamps["reply"]
+                if args.min_lat and (not recv or not reply
+                                     or reply - recv < args.min_lat * 1000):
+                    continue
+                printed += 1
+                events = timeline(primary, replicas, host_offsets)
+                start = recv - (host_offsets[primary.host] or 0) \
+                    if recv else events[0][0]
+                pg = "%d.%x" % (primary.pool, primary.pg_seed)
+                if writer:
+                    for t, osd, host, role, stage in events:
+                        writer.writerow([
+                            primary.client, primary.tid, pg, osd, hosts[host],
+                            "primary" if role == PRIMARY else "replica",
+                            stage, int(t), "%.1f" % ((t - start) / 1000.0)])
+                    continue
+                print("\nop_w client %d tid %d pg %s osd.%d@%s%s"
+                      % (primary.client, primary.tid, pg, primary.osd,
+                         hosts[primary.host],
+                         "".join(" osd.%d@%s" % (r.osd, hosts[r.host])
+                                 for r in replicas)), file=out_handle)
+                for t, osd, host, role, stage in events:
+                    print("  %10.1f  osd.%-4d %s" % ((t - start) / 1000.0, osd,
+                                                     stage), file=out_handle)
+        finally:
+            if writer:
+                out_handle.close()
+        print("%d timelines written" % printed, file=sys.stderr)
+    return 0
+
+
+def main():
+    sys.exit(run(create_arg_parser().parse_args()))
+
+
+if __name__ == "__main__":
+    main()